@@ -1,5 +1,6 @@
 #include <rpb-1600-commands.h>
 #include <rpb-1600.h>
+#include <rpb-1600-stream.h>
 
 RPB_1600 charger;
 
@@ -17,6 +18,10 @@ void loop()
   Serial.printf("1) Read current curve configuration\n");
   Serial.printf("2) Set configuration\n");
   Serial.printf("3) Stream Voltage/Current readings (disable debug #define)\n");
+  Serial.printf("4) Stream binary telemetry frames (decode with tools/stream-to-csv, disable debug #define)\n");
+#ifdef RPB_1600_TRACE
+  Serial.printf("5) Dump the bus trace (decode with tools/trace-decode)\n");
+#endif
   Serial.printf("##################################################################################\n");
 
   char input = getInput();
@@ -35,10 +40,17 @@ void loop()
     {
       // Looks like we got the curve info successfully, print it out
       Serial.printf("------- BEGIN CURVE CONFIGURATION -------\n");
+#ifdef RPB_1600_FIXED_POINT
+      Serial.printf("Constant Current: %ldmA\n", (long)curveInfo.cc);
+      Serial.printf("Constant Voltage: %ldmV\n", (long)curveInfo.cv);
+      Serial.printf("Floating Voltage: %ldmV\n", (long)curveInfo.floating_voltage);
+      Serial.printf("Taper Current: %ldmA\n", (long)curveInfo.taper_current);
+#else
       Serial.printf("Constant Current: %dA\n", curveInfo.cc);
       Serial.printf("Constant Voltage: %4.2fV\n", curveInfo.cv);
       Serial.printf("Floating Voltage: %4.2fV\n", curveInfo.floating_voltage);
       Serial.printf("Taper Current: %dA\n", curveInfo.taper_current);
+#endif
       Serial.printf("Charge curve setting: ");
 
       if (curveInfo.config.charge_curve_type == 0)
@@ -105,7 +117,7 @@ void loop()
     Serial.printf("Curve configuration setting options:\n");
     Serial.printf("1) Write to arbitrary command/data (write two bytes)\n");
     Serial.printf("2) Write to command with linear data\n");
-    Serial.printf("3) Read data via specified command (must have debug #defined uncommented)\n");
+    Serial.printf("3) Read data via specified command\n");
 
     input = getInput();
 
@@ -186,7 +198,6 @@ void loop()
     else if (input == '3') // Read w/ command
     {
       Serial.printf("--- READ WITH COMMAND ---\n");
-      Serial.printf("Make sure you have #define RPB_1600_DEBUG uncommented\n");
       Serial.printf("Enter the command in HEX and press ENTER\n");
 
       uint8_t cmd = getHexByteInput();
@@ -197,20 +208,30 @@ void loop()
       {
       }; // Wait for input
 
-      int8_t expected_length = (int8_t)Serial.parseInt();
+      uint8_t expected_length = (uint8_t)Serial.parseInt();
       while (Serial.available())
       {
         Serial.read();
       } // Flush the serial RX buffer
 
       Serial.printf("Sending command 0x%x with length %d\n", cmd, expected_length);
-      if (charger.readWithCommand(cmd, expected_length))
+      uint8_t reply[RPB_1600_RAW_LENGTH(MAX_RECEIVE_BYTES)];
+      rpb_1600_read_result result = charger.readRaw(cmd, reply, expected_length);
+
+      if (result.status == RPB_1600_READ_OK)
       {
-        Serial.printf("Read succeeded!\n");
+        Serial.printf("Read succeeded! Reply (first byte received first):");
+
+        for (uint8_t i = 0; i < result.length; i++)
+        {
+          Serial.printf(" 0x%02x", reply[i]);
+        }
+
+        Serial.printf("\n");
       }
       else
       {
-        Serial.printf("Read failed :(\n");
+        Serial.printf("Read failed :( status %d, bus status %d\n", result.status, result.bus_status);
       }
     }
     else // Invalid entry within set curve config
@@ -227,9 +248,15 @@ void loop()
     {
       if (charger.getReadings(&chargerReadings))
       {
+#ifdef RPB_1600_FIXED_POINT
+        Serial.printf("VIN: %ldmV ", (long)chargerReadings.v_in);
+        Serial.printf("VOUT: %ldmV ", (long)chargerReadings.v_out);
+        Serial.printf("IOUT: %ldmA \n", (long)chargerReadings.i_out);
+#else
         Serial.printf("VIN: %d ", chargerReadings.v_in);
         Serial.printf("VOUT: %4.2f ", chargerReadings.v_out);
         Serial.printf("IOUT: %d \n", chargerReadings.i_out);
+#endif
         // Serial.printf("Fan speed 1: %d ",chargerReadings.fan_speed_1);
         // Serial.printf("Fan speed 2: %d\n",chargerReadings.fan_speed_2);
       }
@@ -246,6 +273,35 @@ void loop()
       Serial.read();
     } // Flush the serial RX buffer
   }
+  else if (input == '4') // Stream binary frames
+  {
+    Serial.printf("Enter the sample period in ms (0 = as fast as the bus allows) and press ENTER.\n");
+    Serial.printf("Binary frames start straight away, send any character to stop.\n");
+
+    while (Serial.available() == 0)
+    {
+    }; // Wait for input
+
+    uint32_t period_ms = (uint32_t)Serial.parseInt();
+    while (Serial.available())
+    {
+      Serial.read();
+    } // Flush the serial RX buffer
+
+    streamBinary(period_ms);
+  }
+#ifdef RPB_1600_TRACE
+  else if (input == '5') // Dump the trace
+  {
+    uint8_t dump[256];
+    size_t length;
+
+    while ((length = charger.getTrace().dump(charger.getAddress(), dump, sizeof(dump))) > 0)
+    {
+      Serial.write(dump, length);
+    }
+  }
+#endif
   else // Invalid input main menu
   {
     Serial.printf("Invalid option selected, restarting...\n");
@@ -257,6 +313,58 @@ void loop()
   } // Flush the serial RX buffer
 } // End loop()
 
+/**
+ * @brief Send framed raw readings (see rpb-1600-stream.h) until something arrives on the serial port
+ */
+void streamBinary(uint32_t period_ms)
+{
+  RPB_1600_StreamEncoder encoder;
+  uint8_t frame[RPB_1600_STREAM_MAX_FRAME_LENGTH];
+  uint8_t data[RPB_1600_STREAM_CHANNELS][2];
+  uint16_t words[RPB_1600_STREAM_CHANNELS];
+
+  rpb_1600_read items[RPB_1600_STREAM_CHANNELS] = {
+      {CMD_CODE_READ_VIN, CMD_LENGTH_READ_VIN, data[0], false, false},
+      {CMD_CODE_READ_VOUT, CMD_LENGTH_READ_VOUT, data[1], false, false},
+      {CMD_CODE_READ_IOUT, CMD_LENGTH_READ_IOUT, data[2], false, false},
+      {CMD_CODE_READ_FAN_SPEED_1, CMD_LENGTH_READ_FAN_SPEED_1, data[3], false, false},
+      {CMD_CODE_READ_FAN_SPEED_2, CMD_LENGTH_READ_FAN_SPEED_2, data[4], false, false},
+  };
+
+  uint32_t next_sample = millis();
+
+  while (Serial.available() == 0)
+  {
+    // Samples stay on a fixed grid, a slow read doesn't push every later one back
+    if ((int32_t)(millis() - next_sample) < 0)
+    {
+      continue;
+    }
+
+    next_sample += period_ms;
+
+    if (charger.readMany(items, RPB_1600_STREAM_CHANNELS) != RPB_1600_STREAM_CHANNELS)
+    {
+      // Skip this sample, the host sees the gap in the sequence numbers
+      encoder.skip();
+      continue;
+    }
+
+    for (int i = 0; i < RPB_1600_STREAM_CHANNELS; i++)
+    {
+      words[i] = data[i][0] | (data[i][1] << 8);
+    }
+
+    size_t length = encoder.encode(words, micros(), frame);
+    Serial.write(frame, length);
+  }
+
+  while (Serial.available())
+  {
+    Serial.read();
+  } // Flush the serial RX buffer
+}
+
 char getInput(void)
 {
   while (Serial.available() == 0)
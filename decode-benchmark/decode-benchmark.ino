@@ -0,0 +1,116 @@
+// Measures how many CPU cycles it takes to decode one snapshot (the raw bytes behind a readings or a
+// curve_parameters struct), with no charger attached. Build it once as is and once with
+// -DRPB_1600_FIXED_POINT in the build flags to compare the float and integer decoders on a board.
+// Teensy 3.x/4.x count cycles with the DWT cycle counter, other boards work them out from micros().
+
+#include <rpb-1600-commands.h>
+#include <rpb-1600-linear.h>
+#include <rpb-1600.h>
+
+#define ITERATIONS 10000
+// Different raw snapshots to cycle through, so nothing can be worked out ahead of time
+#define SNAPSHOTS 8
+
+uint8_t readingsRaw[SNAPSHOTS][5][2];
+uint8_t curveRaw[SNAPSHOTS][9][2];
+
+void putWord(uint16_t word, uint8_t *bytes)
+{
+  bytes[0] = word & 0xFF;
+  bytes[1] = word >> 8;
+}
+
+// Tells the compiler the decoded struct is read, so even an LTO build can't drop the work being
+// timed. It doesn't generate any instructions.
+void keep(const void *decoded)
+{
+  asm volatile("" : : "r"(decoded) : "memory");
+}
+
+uint32_t cycles(void)
+{
+#ifdef ARM_DWT_CYCCNT
+  return ARM_DWT_CYCCNT;
+#else
+  return micros() * (F_CPU / 1000000);
+#endif
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(500);
+
+#ifdef ARM_DWT_CYCCNT
+  // Turn the cycle counter on
+  ARM_DEMCR |= ARM_DEMCR_TRCENA;
+  ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+#endif
+
+  for (uint8_t i = 0; i < SNAPSHOTS; i++)
+  {
+    putWord(linear11_from_scaled(230 + i, 1, CMD_N_VALUE_READ_VIN), readingsRaw[i][0]);
+    putWord(linear16_from_scaled(27600 + 10 * i, 1000, CMD_N_VALUE_READ_VOUT), readingsRaw[i][1]);
+    putWord(linear11_from_scaled(20250 + 250 * i, 1000, CMD_N_VALUE_READ_IOUT), readingsRaw[i][2]);
+    putWord(linear11_from_scaled(3200 + 32 * i, 1, CMD_N_VALUE_READ_FAN_SPEED_1), readingsRaw[i][3]);
+    putWord(linear11_from_scaled(3300 + 32 * i, 1, CMD_N_VALUE_READ_FAN_SPEED_2), readingsRaw[i][4]);
+
+    putWord(linear11_from_scaled(40000 + 250 * i, 1000, CMD_N_VALUE_CURVE_CC), curveRaw[i][0]);
+    putWord(linear16_from_scaled(28800 + 10 * i, 1000, CMD_N_VALUE_CURVE_CV), curveRaw[i][1]);
+    putWord(linear16_from_scaled(27600 + 10 * i, 1000, CMD_N_VALUE_CURVE_FV), curveRaw[i][2]);
+    putWord(linear11_from_scaled(4000 + 250 * i, 1000, CMD_N_VALUE_CURVE_TC), curveRaw[i][3]);
+    putWord(0x0004 | i, curveRaw[i][4]);
+    putWord(linear11_from_scaled(600 + i, 1, CMD_N_VALUE_CURVE_CC_TIMEOUT), curveRaw[i][5]);
+    putWord(linear11_from_scaled(600 + i, 1, CMD_N_VALUE_CURVE_CV_TIMEOUT), curveRaw[i][6]);
+    putWord(linear11_from_scaled(60 + i, 1, CMD_N_VALUE_CURVE_FLOAT_TIMEOUT), curveRaw[i][7]);
+    putWord(i * 0x0101, curveRaw[i][8]);
+  }
+}
+
+void loop()
+{
+  readings data;
+  curve_parameters params;
+  const uint8_t *raw[9];
+
+  uint32_t start = cycles();
+
+  for (uint16_t n = 0; n < ITERATIONS; n++)
+  {
+    for (uint8_t r = 0; r < 5; r++)
+    {
+      raw[r] = readingsRaw[n % SNAPSHOTS][r];
+    }
+
+    RPB_1600::decodeReadings(raw, &data);
+    keep(&data);
+  }
+
+  uint32_t readingsCycles = cycles() - start;
+  start = cycles();
+
+  for (uint16_t n = 0; n < ITERATIONS; n++)
+  {
+    for (uint8_t r = 0; r < 9; r++)
+    {
+      raw[r] = curveRaw[n % SNAPSHOTS][r];
+    }
+
+    RPB_1600::decodeCurveParams(raw, &params);
+    keep(&params);
+  }
+
+  uint32_t curveCycles = cycles() - start;
+
+#ifdef RPB_1600_FIXED_POINT
+  Serial.print("Fixed point, ");
+#else
+  Serial.print("Float, ");
+#endif
+  Serial.print("cycles per readings snapshot: ");
+  Serial.print(readingsCycles / ITERATIONS);
+  Serial.print(", per curve_parameters snapshot: ");
+  Serial.println(curveCycles / ITERATIONS);
+
+  delay(1000);
+}
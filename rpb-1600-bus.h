@@ -0,0 +1,185 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef RPB_1600_BUS_H
+#define RPB_1600_BUS_H
+
+/**
+ * @brief Result of a single bus transaction
+ */
+enum rpb_1600_bus_status : uint8_t
+{
+    RPB_1600_BUS_OK = 0,
+    // The charger didn't acknowledge its address or one of the bytes we sent
+    RPB_1600_BUS_NACK,
+    // Any other bus failure (arbitration lost, timeout, bad arguments, etc.)
+    RPB_1600_BUS_ERROR,
+    // A transaction started with startWriteRead() hasn't finished yet, or the bus is already in use
+    RPB_1600_BUS_BUSY,
+};
+
+/**
+ * @brief One write-then-read in a burst passed to RPB_1600_Bus::writeReadMany()
+ */
+struct rpb_1600_bus_transfer
+{
+    const uint8_t *tx;
+    uint8_t tx_length;
+    uint8_t *rx;
+    uint8_t rx_length;
+    // Filled in by writeReadMany()
+    uint8_t received;
+    uint8_t status;
+};
+
+/**
+ * @brief The transport RPB_1600 uses to talk to the charger
+ * @details Implement this to run the library on something other than the Arduino Wire library.
+ * See rpb-1600-wire.h for the default backend, rpb-1600-linux.h for Linux i2c-dev and rpb-1600-sim.h
+ * for a simulated charger that runs on a plain host.
+ */
+class RPB_1600_Bus
+{
+public:
+    virtual ~RPB_1600_Bus() {}
+
+    /**
+     * @brief Bring up the bus hardware, called from the first RPB_1600::Init() on the bus
+     */
+    virtual void begin(void) {}
+
+    /**
+     * @brief Set the bus clock frequency in Hz
+     * @details RPB_1600 goes through changeClock(), which keeps track of the clock for every charger
+     * sharing the bus.
+     */
+    virtual void setClock(uint32_t frequency) = 0;
+
+    /**
+     * @brief setClock(), remembering the frequency for getClock()
+     */
+    void changeClock(uint32_t frequency)
+    {
+        my_clock = frequency;
+        setClock(frequency);
+    }
+
+    /**
+     * @brief The clock last set with changeClock(), 0 if the bus hasn't been set up yet
+     */
+    uint32_t getClock(void) const { return my_clock; }
+
+    /**
+     * @brief Microseconds since some arbitrary point, wrapping at 2^32 like the Arduino micros()
+     * @details The library uses this for anything time based, so simulated buses can run on virtual time
+     */
+    virtual uint32_t micros(void) = 0;
+
+    /**
+     * @brief Wait for at least the given number of microseconds
+     * @details The default implementation spins on micros(). Simulated buses advance virtual time instead.
+     */
+    virtual void delayMicroseconds(uint32_t microseconds)
+    {
+        uint32_t start = micros();
+
+        while (micros() - start < microseconds)
+        {
+        }
+    }
+
+    /**
+     * @brief Write length bytes to the device at address, ending with a stop condition
+     * @return One of rpb_1600_bus_status
+     */
+    virtual uint8_t write(uint8_t address, const uint8_t *data, uint8_t length) = 0;
+
+    /**
+     * @brief Write txLength bytes, then issue a repeated start and read up to rxLength bytes into rx[]
+     * @param received Set to the number of bytes the device sent. This may be larger than rxLength
+     * if the device sent more than we asked for, but no more than rxLength bytes are stored.
+     * @return One of rpb_1600_bus_status
+     */
+    virtual uint8_t writeRead(uint8_t address, const uint8_t *tx, uint8_t txLength,
+                              uint8_t *rx, uint8_t rxLength, uint8_t *received) = 0;
+
+    /**
+     * @brief Run a burst of write-then-read transactions to the same device
+     * @details Every transfer is attempted, a failure doesn't stop the ones after it. Each transfer's
+     * received and status fields are filled in as if it was done with writeRead(). The default
+     * implementation just calls writeRead() for each one, backends should override it if they can
+     * pack the burst tighter (e.g. by not releasing the bus in between transfers).
+     * @return The number of transfers that completed with RPB_1600_BUS_OK
+     */
+    virtual uint8_t writeReadMany(uint8_t address, rpb_1600_bus_transfer *transfers, uint8_t count)
+    {
+        uint8_t num_ok = 0;
+
+        for (uint8_t i = 0; i < count; i++)
+        {
+            rpb_1600_bus_transfer *t = &transfers[i];
+            t->status = writeRead(address, t->tx, t->tx_length, t->rx, t->rx_length, &t->received);
+
+            if (t->status == RPB_1600_BUS_OK)
+            {
+                num_ok++;
+            }
+        }
+
+        return num_ok;
+    }
+
+    /**
+     * @brief Start a write-then-read without waiting for it to finish
+     * @details tx[] and rx[] must stay valid until pollWriteRead() stops returning RPB_1600_BUS_BUSY.
+     * The default implementation runs the whole transaction with writeRead() before returning, so
+     * the transaction is already finished by the first poll. Backends with interrupt or DMA driven
+     * hardware can override this pair to overlap the transaction with other work, and
+     * RPB_1600_LinuxBus runs it on a worker thread.
+     * @return RPB_1600_BUS_OK if the transaction was started, RPB_1600_BUS_BUSY if another one is
+     * still in flight, or any other rpb_1600_bus_status on failure
+     */
+    virtual uint8_t startWriteRead(uint8_t address, const uint8_t *tx, uint8_t txLength,
+                                   uint8_t *rx, uint8_t rxLength)
+    {
+        if (my_async_in_flight)
+        {
+            return RPB_1600_BUS_BUSY;
+        }
+
+        my_async_status = writeRead(address, tx, txLength, rx, rxLength, &my_async_received);
+        my_async_in_flight = true;
+
+        return RPB_1600_BUS_OK;
+    }
+
+    /**
+     * @brief Check on the transaction started with startWriteRead()
+     * @param received Set to the number of bytes the device sent once the transaction is finished
+     * @return RPB_1600_BUS_BUSY while the transaction is in flight, otherwise its final rpb_1600_bus_status
+     */
+    virtual uint8_t pollWriteRead(uint8_t *received)
+    {
+        if (!my_async_in_flight)
+        {
+            return RPB_1600_BUS_ERROR;
+        }
+
+        my_async_in_flight = false;
+        *received = my_async_received;
+
+        return my_async_status;
+    }
+
+private:
+    uint32_t my_clock = 0;
+
+    /**
+     * @brief State for the default startWriteRead()/pollWriteRead() implementation
+     */
+    bool my_async_in_flight = false;
+    uint8_t my_async_status = RPB_1600_BUS_OK;
+    uint8_t my_async_received = 0;
+};
+
+#endif // RPB_1600_BUS_H
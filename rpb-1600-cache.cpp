@@ -0,0 +1,185 @@
+#include "rpb-1600-cache.h"
+#include "rpb-1600-commands.h"
+#include <string.h>
+
+struct cache_default_policy
+{
+    uint8_t command;
+    uint8_t policy;
+};
+
+// The starting policy of every cache entry
+static const cache_default_policy cache_defaults[RPB_1600_CACHE_ENTRIES] = {
+    // Identity, never changes
+    {CMD_CODE_CAPABILITY, RPB_1600_CACHE_STATIC},
+    {CMD_CODE_VOUT_MODE, RPB_1600_CACHE_STATIC},
+    {CMD_CODE_PMBUS_REVISION, RPB_1600_CACHE_STATIC},
+    {CMD_CODE_MFR_ID, RPB_1600_CACHE_STATIC},
+    {CMD_CODE_MFR_MODEL, RPB_1600_CACHE_STATIC},
+    {CMD_CODE_MFR_REVISION, RPB_1600_CACHE_STATIC},
+    {CMD_CODE_MFR_LOCATION, RPB_1600_CACHE_STATIC},
+    {CMD_CODE_MFR_DATE, RPB_1600_CACHE_STATIC},
+    {CMD_CODE_MFR_SERIAL, RPB_1600_CACHE_STATIC},
+    // Settings, only change when we write them
+    {CMD_CODE_OPERATION, RPB_1600_CACHE_WRITE_INVALIDATED},
+    {CMD_CODE_ON_OFF_CONFIG, RPB_1600_CACHE_WRITE_INVALIDATED},
+    {CMD_CODE_VOUT_COMMAND, RPB_1600_CACHE_WRITE_INVALIDATED},
+    {CMD_CODE_VOUT_TRIM, RPB_1600_CACHE_WRITE_INVALIDATED},
+    {CMD_CODE_IOUT_OC_FAULT_LIMIT, RPB_1600_CACHE_WRITE_INVALIDATED},
+    {CMD_CODE_IOUT_OC_FAULT_RESPONSE, RPB_1600_CACHE_WRITE_INVALIDATED},
+    {CMD_CODE_CURVE_CC, RPB_1600_CACHE_WRITE_INVALIDATED},
+    {CMD_CODE_CURVE_CV, RPB_1600_CACHE_WRITE_INVALIDATED},
+    {CMD_CODE_CURVE_FV, RPB_1600_CACHE_WRITE_INVALIDATED},
+    {CMD_CODE_CURVE_TC, RPB_1600_CACHE_WRITE_INVALIDATED},
+    {CMD_CODE_CURVE_CONFIG, RPB_1600_CACHE_WRITE_INVALIDATED},
+    {CMD_CODE_CURVE_CC_TIMEOUT, RPB_1600_CACHE_WRITE_INVALIDATED},
+    {CMD_CODE_CURVE_CV_TIMEOUT, RPB_1600_CACHE_WRITE_INVALIDATED},
+    {CMD_CODE_CURVE_FLOAT_TIMEOUT, RPB_1600_CACHE_WRITE_INVALIDATED},
+    // Telemetry and status, only cached once a TTL is set
+    {CMD_CODE_READ_VIN, RPB_1600_CACHE_TTL},
+    {CMD_CODE_READ_VOUT, RPB_1600_CACHE_TTL},
+    {CMD_CODE_READ_IOUT, RPB_1600_CACHE_TTL},
+    {CMD_CODE_READ_FAN_SPEED_1, RPB_1600_CACHE_TTL},
+    {CMD_CODE_READ_FAN_SPEED_2, RPB_1600_CACHE_TTL},
+    {CMD_CODE_CHG_STATUS, RPB_1600_CACHE_TTL},
+    {CMD_CODE_STATUS_WORD, RPB_1600_CACHE_TTL},
+    {CMD_CODE_STATUS_VOUT, RPB_1600_CACHE_TTL},
+    {CMD_CODE_STATUS_IOUT, RPB_1600_CACHE_TTL},
+    {CMD_CODE_STATUS_INPUT, RPB_1600_CACHE_TTL},
+    {CMD_CODE_STATUS_TEMPERATURE, RPB_1600_CACHE_TTL},
+    {CMD_CODE_STATUS_CML, RPB_1600_CACHE_TTL},
+    {CMD_CODE_STATUS_MFR_SPECIFIC, RPB_1600_CACHE_TTL},
+    {CMD_CODE_STATUS_FANS_1_2, RPB_1600_CACHE_TTL},
+};
+
+RPB_1600_Cache::RPB_1600_Cache()
+{
+    memset(my_entries, 0, sizeof(my_entries));
+
+    for (uint8_t i = 0; i < RPB_1600_CACHE_ENTRIES; i++)
+    {
+        my_entries[i].command = cache_defaults[i].command;
+        my_entries[i].policy = cache_defaults[i].policy;
+    }
+
+    resetStats();
+}
+
+bool RPB_1600_Cache::setPolicy(uint8_t commandID, uint8_t policy, uint32_t ttl_us)
+{
+    rpb_1600_cache_entry *entry = findEntry(commandID);
+
+    if (entry == nullptr)
+    {
+        return false;
+    }
+
+    entry->policy = policy;
+    entry->ttl_us = ttl_us;
+    entry->valid = false;
+
+    return true;
+}
+
+bool RPB_1600_Cache::lookup(uint8_t commandID, uint8_t length, uint32_t now, uint8_t *destination)
+{
+    rpb_1600_cache_entry *entry = findEntry(commandID);
+
+    if (entry == nullptr || !isCacheable(entry))
+    {
+        return false;
+    }
+
+    bool fresh = entry->valid && entry->length == length;
+
+    // Unsigned subtraction handles micros() wrapping around
+    if (fresh && entry->policy == RPB_1600_CACHE_TTL && (uint32_t)(now - entry->timestamp) >= entry->ttl_us)
+    {
+        fresh = false;
+    }
+
+    if (!fresh)
+    {
+        my_stats.misses++;
+        return false;
+    }
+
+    memcpy(destination, entry->data, length);
+    my_stats.hits++;
+
+    return true;
+}
+
+void RPB_1600_Cache::store(uint8_t commandID, const uint8_t *data, uint8_t length, uint32_t now)
+{
+    rpb_1600_cache_entry *entry = findEntry(commandID);
+
+    if (entry == nullptr || !isCacheable(entry) || length > MAX_RECEIVE_BYTES)
+    {
+        return;
+    }
+
+    memcpy(entry->data, data, length);
+    entry->length = length;
+    entry->timestamp = now;
+    entry->valid = true;
+}
+
+void RPB_1600_Cache::onWrite(uint8_t commandID)
+{
+    rpb_1600_cache_entry *entry = findEntry(commandID);
+
+    if (entry != nullptr && entry->valid && entry->policy == RPB_1600_CACHE_WRITE_INVALIDATED)
+    {
+        entry->valid = false;
+        my_stats.invalidations++;
+    }
+}
+
+void RPB_1600_Cache::invalidate(uint8_t commandID)
+{
+    rpb_1600_cache_entry *entry = findEntry(commandID);
+
+    if (entry != nullptr)
+    {
+        entry->valid = false;
+    }
+}
+
+void RPB_1600_Cache::invalidateAll(void)
+{
+    for (uint8_t i = 0; i < RPB_1600_CACHE_ENTRIES; i++)
+    {
+        my_entries[i].valid = false;
+    }
+}
+
+rpb_1600_cache_stats RPB_1600_Cache::getStats(void) const
+{
+    return my_stats;
+}
+
+void RPB_1600_Cache::resetStats(void)
+{
+    memset(&my_stats, 0, sizeof(my_stats));
+}
+
+rpb_1600_cache_entry *RPB_1600_Cache::findEntry(uint8_t commandID)
+{
+    for (uint8_t i = 0; i < RPB_1600_CACHE_ENTRIES; i++)
+    {
+        if (my_entries[i].command == commandID)
+        {
+            return &my_entries[i];
+        }
+    }
+
+    return nullptr;
+}
+
+bool RPB_1600_Cache::isCacheable(const rpb_1600_cache_entry *entry)
+{
+    return entry->policy == RPB_1600_CACHE_STATIC ||
+           entry->policy == RPB_1600_CACHE_WRITE_INVALIDATED ||
+           (entry->policy == RPB_1600_CACHE_TTL && entry->ttl_us > 0);
+}
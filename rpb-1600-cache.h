@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include "rpb-1600.h"
+
+#ifndef RPB_1600_CACHE_H
+#define RPB_1600_CACHE_H
+
+/**
+ * @brief How long a cached register stays valid
+ */
+enum rpb_1600_cache_policy : uint8_t
+{
+    // Never cached
+    RPB_1600_CACHE_NONE = 0,
+    // Read once and kept forever (identity data, MFR_* etc.)
+    RPB_1600_CACHE_STATIC,
+    // Kept until we write to the register (CURVE_*, VOUT_COMMAND etc.)
+    RPB_1600_CACHE_WRITE_INVALIDATED,
+    // Kept for a fixed time after it was read (telemetry). A TTL of 0 means never cached.
+    RPB_1600_CACHE_TTL,
+};
+
+/**
+ * @brief The number of registers the cache has an entry for
+ */
+#define RPB_1600_CACHE_ENTRIES 37
+
+struct rpb_1600_cache_entry
+{
+    uint8_t command;
+    uint8_t policy;
+    bool valid;
+    uint8_t length;
+    uint32_t ttl_us;
+    // micros() at the time the register was read
+    uint32_t timestamp;
+    uint8_t data[MAX_RECEIVE_BYTES];
+};
+
+struct rpb_1600_cache_stats
+{
+    // Reads answered from the cache
+    uint32_t hits;
+    // Reads of a cacheable register that had to go to the bus
+    uint32_t misses;
+    // Entries dropped because we wrote to the register
+    uint32_t invalidations;
+};
+
+/**
+ * @brief Per-register cache of charger responses, see RPB_1600::attachCache()
+ * @details Every register in rpb-1600-commands.h that's worth caching starts out with a sensible
+ * policy: MFR_* and the other identity registers are static, anything we can write is invalidated
+ * by writes, and telemetry uses a TTL that defaults to 0 (not cached) until you set one.
+ */
+class RPB_1600_Cache
+{
+public:
+    RPB_1600_Cache();
+
+    /**
+     * @brief Change how a register is cached. Changing the policy drops anything cached for it.
+     * @param ttl_us Only used with RPB_1600_CACHE_TTL
+     * @return false if the register doesn't have a cache entry
+     */
+    bool setPolicy(uint8_t commandID, uint8_t policy, uint32_t ttl_us = 0);
+
+    /**
+     * @brief Copy a cached response into destination[] if there is a valid one of the right length
+     * @param now The current time from RPB_1600_Bus::micros()
+     * @return true on a hit
+     */
+    bool lookup(uint8_t commandID, uint8_t length, uint32_t now, uint8_t *destination);
+
+    /**
+     * @brief Remember a response read from the bus, if the register is cacheable
+     */
+    void store(uint8_t commandID, const uint8_t *data, uint8_t length, uint32_t now);
+
+    /**
+     * @brief Called after a write to commandID, drops the cached value if the policy says to
+     */
+    void onWrite(uint8_t commandID);
+
+    /**
+     * @brief Drop the cached value of one register, whatever its policy
+     */
+    void invalidate(uint8_t commandID);
+
+    /**
+     * @brief Drop every cached value
+     */
+    void invalidateAll(void);
+
+    rpb_1600_cache_stats getStats(void) const;
+    void resetStats(void);
+
+private:
+    rpb_1600_cache_entry my_entries[RPB_1600_CACHE_ENTRIES];
+    rpb_1600_cache_stats my_stats;
+
+    rpb_1600_cache_entry *findEntry(uint8_t commandID);
+
+    /**
+     * @brief Whether an entry's policy means it should be cached at all
+     */
+    static bool isCacheable(const rpb_1600_cache_entry *entry);
+};
+
+#endif // RPB_1600_CACHE_H
@@ -17,7 +17,7 @@
 #define CMD_CODE_STATUS_VOUT 0x7A
 #define CMD_CODE_STATUS_IOUT 0x7B
 #define CMD_CODE_STATUS_INPUT 0x7C
-#define CMD_CODE_STATUS_TEMPERATURE 0x7E
+#define CMD_CODE_STATUS_TEMPERATURE 0x7D
 #define CMD_CODE_STATUS_CML 0x7E
 #define CMD_CODE_STATUS_MFR_SPECIFIC 0x80
 #define CMD_CODE_STATUS_FANS_1_2 0x81
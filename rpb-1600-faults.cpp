@@ -0,0 +1,302 @@
+#include "rpb-1600-faults.h"
+#include "rpb-1600-commands.h"
+#include "rpb-1600-time.h"
+#include <string.h>
+
+/**
+ * @brief A detail status register and the STATUS_WORD bits that summarize it
+ */
+struct status_detail_register
+{
+    uint8_t command;
+    uint16_t summary_mask;
+};
+
+// Indexed by rpb_1600_status_detail. VOUT, IOUT and INPUT also have a bit in the low byte for their
+// most serious fault, so a warning that turns into a fault changes the summary too.
+static const status_detail_register detail_registers[RPB_1600_FAULT_DETAIL_REGISTERS] = {
+    {CMD_CODE_STATUS_VOUT, 0x8020},
+    {CMD_CODE_STATUS_IOUT, 0x4010},
+    {CMD_CODE_STATUS_INPUT, 0x2008},
+    {CMD_CODE_STATUS_TEMPERATURE, 0x0004},
+    {CMD_CODE_STATUS_CML, 0x0002},
+    {CMD_CODE_STATUS_MFR_SPECIFIC, 0x1000},
+    {CMD_CODE_STATUS_FANS_1_2, 0x0400},
+};
+
+RPB_1600_FaultMonitor::RPB_1600_FaultMonitor(RPB_1600 &charger) : my_charger(charger)
+{
+    memset(&my_status, 0, sizeof(my_status));
+    my_next_poll = my_charger.getBus()->micros();
+}
+
+void RPB_1600_FaultMonitor::onEvent(rpb_1600_fault_callback callback, void *context)
+{
+    my_callback = callback;
+    my_context = context;
+}
+
+void RPB_1600_FaultMonitor::setPeriod(uint32_t period_us)
+{
+    my_period_us = period_us;
+}
+
+void RPB_1600_FaultMonitor::setDetailRefresh(uint32_t period_us)
+{
+    my_refresh_us = period_us;
+}
+
+bool RPB_1600_FaultMonitor::service(void)
+{
+    uint32_t now = my_charger.getBus()->micros();
+
+    if (!rpb_1600_is_due(now, &my_next_poll, my_period_us))
+    {
+        return false;
+    }
+
+    poll();
+
+    return true;
+}
+
+bool RPB_1600_FaultMonitor::poll(void)
+{
+    uint8_t raw[CMD_LENGTH_STATUS_WORD];
+    rpb_1600_read word_read = {CMD_CODE_STATUS_WORD, CMD_LENGTH_STATUS_WORD, raw, false, false};
+    my_word_reads++;
+
+    if (my_charger.readMany(&word_read, 1) != 1)
+    {
+        my_failures++;
+        return false;
+    }
+
+    uint32_t now = my_charger.getBus()->micros();
+    uint16_t word = raw[0] | (raw[1] << 8);
+    uint16_t changed = word ^ my_status.word;
+
+    // Work out which detail registers need reading
+    uint8_t detail[RPB_1600_FAULT_DETAIL_REGISTERS];
+    uint8_t fresh[RPB_1600_FAULT_DETAIL_REGISTERS];
+    rpb_1600_read items[RPB_1600_FAULT_DETAIL_REGISTERS];
+    uint8_t index[RPB_1600_FAULT_DETAIL_REGISTERS];
+    uint8_t num_items = 0;
+
+    memcpy(detail, my_status.detail, sizeof(detail));
+
+    for (uint8_t i = 0; i < RPB_1600_FAULT_DETAIL_REGISTERS; i++)
+    {
+        uint16_t mask = detail_registers[i].summary_mask;
+
+        // Nothing summarized, so nothing to read
+        if ((word & mask) == 0)
+        {
+            detail[i] = 0;
+            my_detail_stale[i] = false;
+            continue;
+        }
+
+        bool refresh = my_refresh_us > 0 && (now - my_detail_read_at[i]) >= my_refresh_us;
+
+        if ((changed & mask) || my_detail_stale[i] || refresh)
+        {
+            items[num_items] = {detail_registers[i].command, 1, &fresh[i], false, false};
+            index[num_items++] = i;
+        }
+    }
+
+    if (num_items > 0)
+    {
+        my_charger.readMany(items, num_items);
+        my_detail_reads += num_items;
+
+        for (uint8_t n = 0; n < num_items; n++)
+        {
+            uint8_t i = index[n];
+
+            if (items[n].success)
+            {
+                detail[i] = fresh[i];
+                my_detail_read_at[i] = now;
+                my_detail_stale[i] = false;
+            }
+            else
+            {
+                // Keep what we had and try again next poll
+                my_failures++;
+                my_detail_stale[i] = true;
+            }
+        }
+    }
+
+    // Update everything before the callbacks, so they can look at the whole picture with getStatus()
+    uint16_t previous_word = my_status.word;
+    uint8_t previous_detail[RPB_1600_FAULT_DETAIL_REGISTERS];
+    memcpy(previous_detail, my_status.detail, sizeof(previous_detail));
+
+    my_status.word = word;
+    memcpy(my_status.detail, detail, sizeof(detail));
+    my_status.timestamp = now;
+    my_status.valid = true;
+    decode();
+
+    reportChanges(CMD_CODE_STATUS_WORD, previous_word, word, 16);
+
+    for (uint8_t i = 0; i < RPB_1600_FAULT_DETAIL_REGISTERS; i++)
+    {
+        reportChanges(detail_registers[i].command, previous_detail[i], detail[i], 8);
+    }
+
+    return true;
+}
+
+const fault_status *RPB_1600_FaultMonitor::getStatus(void) const
+{
+    return &my_status;
+}
+
+uint32_t RPB_1600_FaultMonitor::getWordReads(void) const
+{
+    return my_word_reads;
+}
+
+uint32_t RPB_1600_FaultMonitor::getDetailReads(void) const
+{
+    return my_detail_reads;
+}
+
+uint32_t RPB_1600_FaultMonitor::getFailures(void) const
+{
+    return my_failures;
+}
+
+uint32_t RPB_1600_FaultMonitor::getEventCount(void) const
+{
+    return my_events;
+}
+
+void RPB_1600_FaultMonitor::decode(void)
+{
+    parseStatusWord(my_status.word, &my_status.summary);
+    parseStatusVout(my_status.detail[RPB_1600_STATUS_VOUT], &my_status.vout);
+    parseStatusIout(my_status.detail[RPB_1600_STATUS_IOUT], &my_status.iout);
+    parseStatusInput(my_status.detail[RPB_1600_STATUS_INPUT], &my_status.input);
+    parseStatusTemperature(my_status.detail[RPB_1600_STATUS_TEMPERATURE], &my_status.temperature);
+    parseStatusCml(my_status.detail[RPB_1600_STATUS_CML], &my_status.cml);
+    my_status.mfr_specific = my_status.detail[RPB_1600_STATUS_MFR_SPECIFIC];
+    parseStatusFans(my_status.detail[RPB_1600_STATUS_FANS_1_2], &my_status.fans);
+}
+
+void RPB_1600_FaultMonitor::reportChanges(uint8_t commandID, uint16_t before, uint16_t after, uint8_t numBits)
+{
+    uint16_t changed = before ^ after;
+
+    for (uint8_t bit = 0; bit < numBits && changed != 0; bit++)
+    {
+        if (!(changed & (1 << bit)))
+        {
+            continue;
+        }
+
+        changed &= ~(1 << bit);
+        my_events++;
+
+        if (my_callback != nullptr)
+        {
+            fault_event event = {my_status.timestamp, commandID, bit, (after & (1 << bit)) != 0};
+            my_callback(&event, my_context);
+        }
+    }
+}
+
+void RPB_1600_FaultMonitor::parseStatusWord(uint16_t word, status_summary *summary)
+{
+    // Low byte:
+    summary->none_of_the_above = (word & 0x0001); // Bit 0
+    summary->cml = (word & 0x0002);               // Bit 1
+    summary->temperature = (word & 0x0004);       // Bit 2
+    summary->vin_uv_fault = (word & 0x0008);      // Bit 3
+    summary->iout_oc_fault = (word & 0x0010);     // Bit 4
+    summary->vout_ov_fault = (word & 0x0020);     // Bit 5
+    summary->off = (word & 0x0040);               // Bit 6
+    summary->busy = (word & 0x0080);              // Bit 7
+    // High byte:
+    summary->unknown = (word & 0x0100);            // Bit 8
+    summary->other = (word & 0x0200);              // Bit 9
+    summary->fans = (word & 0x0400);               // Bit 10
+    summary->power_good_negated = (word & 0x0800); // Bit 11
+    summary->mfr_specific = (word & 0x1000);       // Bit 12
+    summary->input = (word & 0x2000);              // Bit 13
+    summary->iout_pout = (word & 0x4000);          // Bit 14
+    summary->vout = (word & 0x8000);               // Bit 15
+}
+
+void RPB_1600_FaultMonitor::parseStatusVout(uint8_t bits, status_vout *vout)
+{
+    vout->tracking_error = (bits & 0x01);   // Bit 0
+    vout->toff_max_warning = (bits & 0x02); // Bit 1
+    vout->ton_max_fault = (bits & 0x04);    // Bit 2
+    vout->max_warning = (bits & 0x08);      // Bit 3
+    vout->uv_fault = (bits & 0x10);         // Bit 4
+    vout->uv_warning = (bits & 0x20);       // Bit 5
+    vout->ov_warning = (bits & 0x40);       // Bit 6
+    vout->ov_fault = (bits & 0x80);         // Bit 7
+}
+
+void RPB_1600_FaultMonitor::parseStatusIout(uint8_t bits, status_iout *iout)
+{
+    iout->pout_op_warning = (bits & 0x01);     // Bit 0
+    iout->pout_op_fault = (bits & 0x02);       // Bit 1
+    iout->power_limiting = (bits & 0x04);      // Bit 2
+    iout->current_share_fault = (bits & 0x08); // Bit 3
+    iout->uc_fault = (bits & 0x10);            // Bit 4
+    iout->oc_warning = (bits & 0x20);          // Bit 5
+    iout->oc_lv_fault = (bits & 0x40);         // Bit 6
+    iout->oc_fault = (bits & 0x80);            // Bit 7
+}
+
+void RPB_1600_FaultMonitor::parseStatusInput(uint8_t bits, status_input *input)
+{
+    input->pin_op_warning = (bits & 0x01); // Bit 0
+    input->iin_oc_warning = (bits & 0x02); // Bit 1
+    input->iin_oc_fault = (bits & 0x04);   // Bit 2
+    input->off_low_vin = (bits & 0x08);    // Bit 3
+    input->vin_uv_fault = (bits & 0x10);   // Bit 4
+    input->vin_uv_warning = (bits & 0x20); // Bit 5
+    input->vin_ov_warning = (bits & 0x40); // Bit 6
+    input->vin_ov_fault = (bits & 0x80);   // Bit 7
+}
+
+void RPB_1600_FaultMonitor::parseStatusTemperature(uint8_t bits, status_temperature *temperature)
+{
+    // Bits 0 - 3 are reserved
+    temperature->ut_fault = (bits & 0x10);   // Bit 4
+    temperature->ut_warning = (bits & 0x20); // Bit 5
+    temperature->ot_warning = (bits & 0x40); // Bit 6
+    temperature->ot_fault = (bits & 0x80);   // Bit 7
+}
+
+void RPB_1600_FaultMonitor::parseStatusCml(uint8_t bits, status_cml *cml)
+{
+    cml->other_memory_fault = (bits & 0x01);        // Bit 0
+    cml->other_communication_fault = (bits & 0x02); // Bit 1
+    // Bit 2 is reserved
+    cml->processor_fault = (bits & 0x08); // Bit 3
+    cml->memory_fault = (bits & 0x10);    // Bit 4
+    cml->pec_failed = (bits & 0x20);      // Bit 5
+    cml->invalid_data = (bits & 0x40);    // Bit 6
+    cml->invalid_command = (bits & 0x80); // Bit 7
+}
+
+void RPB_1600_FaultMonitor::parseStatusFans(uint8_t bits, status_fans *fans)
+{
+    fans->airflow_warning = (bits & 0x01);  // Bit 0
+    fans->airflow_fault = (bits & 0x02);    // Bit 1
+    fans->fan_2_overridden = (bits & 0x04); // Bit 2
+    fans->fan_1_overridden = (bits & 0x08); // Bit 3
+    fans->fan_2_warning = (bits & 0x10);    // Bit 4
+    fans->fan_1_warning = (bits & 0x20);    // Bit 5
+    fans->fan_2_fault = (bits & 0x40);      // Bit 6
+    fans->fan_1_fault = (bits & 0x80);      // Bit 7
+}
@@ -0,0 +1,277 @@
+#include "rpb-1600.h"
+
+#ifndef RPB_1600_FAULTS_H
+#define RPB_1600_FAULTS_H
+
+/**
+ * @brief The number of STATUS_* registers behind STATUS_WORD, see rpb_1600_status_detail
+ */
+#define RPB_1600_FAULT_DETAIL_REGISTERS 7
+
+/**
+ * @brief How often the monitor reads STATUS_WORD by default, about 12% of a 100kHz bus
+ */
+#define RPB_1600_FAULT_DEFAULT_PERIOD_US 5000
+
+/**
+ * @brief How often a detail register is read again while its summary bits stay set, by default
+ */
+#define RPB_1600_FAULT_DEFAULT_REFRESH_US 1000000
+
+/**
+ * @brief The detail status registers, in the order fault_status keeps them
+ */
+enum rpb_1600_status_detail : uint8_t
+{
+    RPB_1600_STATUS_VOUT = 0,
+    RPB_1600_STATUS_IOUT,
+    RPB_1600_STATUS_INPUT,
+    RPB_1600_STATUS_TEMPERATURE,
+    RPB_1600_STATUS_CML,
+    RPB_1600_STATUS_MFR_SPECIFIC,
+    RPB_1600_STATUS_FANS_1_2,
+};
+
+/**
+ * @brief STATUS_WORD, the summary of every other status register (PMBus part II, 17.2)
+ */
+struct status_summary
+{
+    // Low byte (STATUS_BYTE):
+    bool busy;
+    bool off;
+    bool vout_ov_fault;
+    bool iout_oc_fault;
+    bool vin_uv_fault;
+    // Something in STATUS_TEMPERATURE
+    bool temperature;
+    // Something in STATUS_CML
+    bool cml;
+    bool none_of_the_above;
+    // High byte, each one means something is set in the matching detail register:
+    bool vout;
+    bool iout_pout;
+    bool input;
+    bool mfr_specific;
+    // Set when the output is NOT good
+    bool power_good_negated;
+    bool fans;
+    bool other;
+    bool unknown;
+};
+
+struct status_vout
+{
+    bool ov_fault;
+    bool ov_warning;
+    bool uv_warning;
+    bool uv_fault;
+    bool max_warning;
+    bool ton_max_fault;
+    bool toff_max_warning;
+    bool tracking_error;
+};
+
+struct status_iout
+{
+    bool oc_fault;
+    // Overcurrent with the output shut down to a low voltage
+    bool oc_lv_fault;
+    bool oc_warning;
+    bool uc_fault;
+    bool current_share_fault;
+    bool power_limiting;
+    bool pout_op_fault;
+    bool pout_op_warning;
+};
+
+struct status_input
+{
+    bool vin_ov_fault;
+    bool vin_ov_warning;
+    bool vin_uv_warning;
+    bool vin_uv_fault;
+    // The unit is off because the input voltage is too low
+    bool off_low_vin;
+    bool iin_oc_fault;
+    bool iin_oc_warning;
+    bool pin_op_warning;
+};
+
+struct status_temperature
+{
+    bool ot_fault;
+    bool ot_warning;
+    bool ut_warning;
+    bool ut_fault;
+};
+
+struct status_cml
+{
+    bool invalid_command;
+    bool invalid_data;
+    bool pec_failed;
+    bool memory_fault;
+    bool processor_fault;
+    bool other_communication_fault;
+    bool other_memory_fault;
+};
+
+struct status_fans
+{
+    bool fan_1_fault;
+    bool fan_2_fault;
+    bool fan_1_warning;
+    bool fan_2_warning;
+    bool fan_1_overridden;
+    bool fan_2_overridden;
+    bool airflow_fault;
+    bool airflow_warning;
+};
+
+/**
+ * @brief Everything the monitor knows about the charger's faults
+ */
+struct fault_status
+{
+    // Raw registers, detail[] is indexed by rpb_1600_status_detail
+    uint16_t word;
+    uint8_t detail[RPB_1600_FAULT_DETAIL_REGISTERS];
+
+    status_summary summary;
+    status_vout vout;
+    status_iout iout;
+    status_input input;
+    status_temperature temperature;
+    status_cml cml;
+    // Mean Well don't publish what these bits mean, so they're left raw
+    uint8_t mfr_specific;
+    status_fans fans;
+
+    // RPB_1600_Bus::micros() when STATUS_WORD was last read
+    uint32_t timestamp;
+    // false until STATUS_WORD has been read once
+    bool valid;
+};
+
+/**
+ * @brief One status bit being set or cleared
+ */
+struct fault_event
+{
+    // RPB_1600_Bus::micros() when the STATUS_WORD read that saw the change finished
+    uint32_t timestamp;
+    // CMD_CODE_STATUS_WORD or one of the detail registers, e.g. CMD_CODE_STATUS_VOUT
+    uint8_t command;
+    // 0 - 15 for STATUS_WORD, 0 - 7 for the detail registers
+    uint8_t bit;
+    // true when the bit was set, false when it cleared
+    bool asserted;
+};
+
+/**
+ * @brief Called from service() for every status bit that changes, summary bits first
+ */
+typedef void (*rpb_1600_fault_callback)(const fault_event *event, void *context);
+
+/**
+ * @brief Watches STATUS_WORD and reads the detail STATUS_* registers only when they can have changed
+ * @details Each poll reads just the two STATUS_WORD bytes. A detail register is read (all the ones
+ * that need it in one burst) when one of its summary bits changes, and again every refresh period
+ * while they stay set, in case a warning turns into a fault without the summary changing. When its
+ * summary bits clear it's known to be 0 without reading it. Every bit that changes, in STATUS_WORD or
+ * a detail register, is passed to the callback as a fault_event. Bits already set on the first poll
+ * count as changes.
+ */
+class RPB_1600_FaultMonitor
+{
+public:
+    /**
+     * @param charger Must already be Init()ed, and must outlive the monitor
+     */
+    RPB_1600_FaultMonitor(RPB_1600 &charger);
+
+    /**
+     * @brief Have every fault_event passed on to callback, nullptr to stop
+     */
+    void onEvent(rpb_1600_fault_callback callback, void *context = nullptr);
+
+    /**
+     * @brief How often service() reads STATUS_WORD (defaults to RPB_1600_FAULT_DEFAULT_PERIOD_US)
+     */
+    void setPeriod(uint32_t period_us);
+
+    /**
+     * @brief How often a detail register is read again while its summary bits stay set, 0 to only
+     * read it when they change (defaults to RPB_1600_FAULT_DEFAULT_REFRESH_US)
+     */
+    void setDetailRefresh(uint32_t period_us);
+
+    /**
+     * @brief Call this often from loop(). Polls when the period is up.
+     * @return true if it polled
+     */
+    bool service(void);
+
+    /**
+     * @brief Read STATUS_WORD (and whichever detail registers need it) right now
+     * @return false if STATUS_WORD couldn't be read, in which case nothing changes
+     */
+    bool poll(void);
+
+    const fault_status *getStatus(void) const;
+
+    /**
+     * @brief Reads of STATUS_WORD and of detail registers, and how many of them failed
+     */
+    uint32_t getWordReads(void) const;
+    uint32_t getDetailReads(void) const;
+    uint32_t getFailures(void) const;
+
+    /**
+     * @brief Events passed to the callback so far
+     */
+    uint32_t getEventCount(void) const;
+
+    static void parseStatusWord(uint16_t word, status_summary *summary);
+    static void parseStatusVout(uint8_t bits, status_vout *vout);
+    static void parseStatusIout(uint8_t bits, status_iout *iout);
+    static void parseStatusInput(uint8_t bits, status_input *input);
+    static void parseStatusTemperature(uint8_t bits, status_temperature *temperature);
+    static void parseStatusCml(uint8_t bits, status_cml *cml);
+    static void parseStatusFans(uint8_t bits, status_fans *fans);
+
+private:
+    RPB_1600 &my_charger;
+    fault_status my_status;
+
+    rpb_1600_fault_callback my_callback = nullptr;
+    void *my_context = nullptr;
+
+    uint32_t my_period_us = RPB_1600_FAULT_DEFAULT_PERIOD_US;
+    uint32_t my_refresh_us = RPB_1600_FAULT_DEFAULT_REFRESH_US;
+    uint32_t my_next_poll;
+
+    /**
+     * @brief When each detail register was last read, and the ones whose last read failed
+     */
+    uint32_t my_detail_read_at[RPB_1600_FAULT_DETAIL_REGISTERS] = {};
+    bool my_detail_stale[RPB_1600_FAULT_DETAIL_REGISTERS] = {};
+
+    uint32_t my_word_reads = 0;
+    uint32_t my_detail_reads = 0;
+    uint32_t my_failures = 0;
+    uint32_t my_events = 0;
+
+    /**
+     * @brief Fill in the typed structs from the raw registers
+     */
+    void decode(void);
+
+    /**
+     * @brief Pass an event to the callback for every bit that differs between before and after
+     */
+    void reportChanges(uint8_t commandID, uint16_t before, uint16_t after, uint8_t numBits);
+};
+
+#endif // RPB_1600_FAULTS_H
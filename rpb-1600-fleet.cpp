@@ -0,0 +1,265 @@
+#include "rpb-1600-fleet.h"
+#include "rpb-1600-commands.h"
+#include <string.h>
+
+RPB_1600_Fleet::RPB_1600_Fleet() : my_num_buses(0), my_num_units(0), my_poll_data(nullptr), my_poll_start(0)
+{
+    memset(my_snapshots, 0, sizeof(my_snapshots));
+}
+
+bool RPB_1600_Fleet::addBus(RPB_1600_Bus &bus)
+{
+    if (my_num_buses >= RPB_1600_FLEET_MAX_BUSES)
+    {
+        return false;
+    }
+
+    my_buses[my_num_buses++] = &bus;
+
+    return true;
+}
+
+uint8_t RPB_1600_Fleet::discover(void)
+{
+    my_num_units = 0;
+
+    for (uint8_t b = 0; b < my_num_buses; b++)
+    {
+        RPB_1600::beginBus(*my_buses[b]);
+
+        for (uint8_t a = 0; a < RPB_1600_UNITS_PER_BUS; a++)
+        {
+            uint8_t address = RPB_1600_FIRST_ADDRESS + a;
+            uint8_t command = CMD_CODE_PMBUS_REVISION;
+            uint8_t revision[CMD_LENGTH_PMBUS_REVISION];
+            uint8_t received = 0;
+
+            // Anything that answers a PMBUS_REVISION read is a charger. It's a bare read, so an empty
+            // address costs one NACKed transaction and no charger gets set up for it.
+            uint8_t status =
+                my_buses[b]->writeRead(address, &command, 1, revision, CMD_LENGTH_PMBUS_REVISION, &received);
+
+            if (status == RPB_1600_BUS_OK && received >= CMD_LENGTH_PMBUS_REVISION && addUnit(b, address))
+            {
+                readIdentity(my_num_units - 1);
+            }
+        }
+    }
+
+    return my_num_units;
+}
+
+bool RPB_1600_Fleet::addUnit(uint8_t busIndex, uint8_t address)
+{
+    if (my_num_units >= RPB_1600_FLEET_MAX_UNITS || busIndex >= my_num_buses)
+    {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < my_num_units; i++)
+    {
+        if (my_units[i].bus_index == busIndex && my_units[i].address == address)
+        {
+            return false;
+        }
+    }
+
+    fleet_unit *unit = &my_units[my_num_units++];
+    unit->charger = RPB_1600(*my_buses[busIndex]);
+    unit->charger.Init(address);
+    unit->bus_index = busIndex;
+    unit->address = address;
+    unit->identity_valid = false;
+
+    return true;
+}
+
+uint8_t RPB_1600_Fleet::getNumUnits(void) const
+{
+    return my_num_units;
+}
+
+RPB_1600 *RPB_1600_Fleet::getUnit(uint8_t index)
+{
+    return (index < my_num_units) ? &my_units[index].charger : nullptr;
+}
+
+uint8_t RPB_1600_Fleet::getUnitAddress(uint8_t index) const
+{
+    return (index < my_num_units) ? my_units[index].address : 0;
+}
+
+uint8_t RPB_1600_Fleet::getUnitBusIndex(uint8_t index) const
+{
+    return (index < my_num_units) ? my_units[index].bus_index : 0;
+}
+
+const mfr_data *RPB_1600_Fleet::getUnitIdentity(uint8_t index)
+{
+    return (index < my_num_units && readIdentity(index)) ? &my_units[index].identity : nullptr;
+}
+
+uint8_t RPB_1600_Fleet::getInventory(fleet_inventory_entry *table, uint8_t maxEntries)
+{
+    uint8_t num_entries = (my_num_units < maxEntries) ? my_num_units : maxEntries;
+
+    for (uint8_t i = 0; i < num_entries; i++)
+    {
+        table[i].bus_index = my_units[i].bus_index;
+        table[i].address = my_units[i].address;
+        table[i].identity_valid = readIdentity(i);
+
+        if (table[i].identity_valid)
+        {
+            table[i].identity = my_units[i].identity;
+        }
+        else
+        {
+            memset(&table[i].identity, 0, sizeof(table[i].identity));
+        }
+    }
+
+    return num_entries;
+}
+
+bool RPB_1600_Fleet::beginPoll(fleet_readings *data)
+{
+    if (my_poll_data != nullptr)
+    {
+        return false;
+    }
+
+    memset(data, 0, sizeof(*data));
+    data->num_units = my_num_units;
+
+    my_poll_data = data;
+    my_poll_start = (my_num_buses > 0) ? my_buses[0]->micros() : 0;
+
+    // Kick off the first charger on every bus
+    for (uint8_t b = 0; b < my_num_buses; b++)
+    {
+        startNextUnit(b, 0);
+    }
+
+    return true;
+}
+
+bool RPB_1600_Fleet::service(void)
+{
+    if (my_poll_data == nullptr)
+    {
+        return false;
+    }
+
+    bool busy = false;
+
+    for (uint8_t b = 0; b < my_num_buses; b++)
+    {
+        uint8_t u = my_active_unit[b];
+
+        if (u >= my_num_units)
+        {
+            continue;
+        }
+
+        my_units[u].charger.service();
+
+        uint8_t state = my_snapshots[u].state;
+
+        if (state == RPB_1600_REQUEST_DONE || state == RPB_1600_REQUEST_FAILED)
+        {
+            my_poll_data->valid[u] = (state == RPB_1600_REQUEST_DONE);
+            startNextUnit(b, u + 1);
+        }
+
+        busy |= my_active_unit[b] < my_num_units;
+    }
+
+    if (!busy)
+    {
+        finishPoll();
+    }
+
+    return busy;
+}
+
+bool RPB_1600_Fleet::poll(fleet_readings *data)
+{
+    if (!beginPoll(data))
+    {
+        return false;
+    }
+
+    while (service())
+    {
+    }
+
+    return data->num_valid == data->num_units;
+}
+
+void RPB_1600_Fleet::startNextUnit(uint8_t busIndex, uint8_t from)
+{
+    for (uint8_t u = from; u < my_num_units; u++)
+    {
+        if (my_units[u].bus_index == busIndex)
+        {
+            my_active_unit[busIndex] = u;
+            my_units[u].charger.beginReadings(&my_snapshots[u], &my_poll_data->unit[u]);
+            return;
+        }
+    }
+
+    // Nothing left on this bus
+    my_active_unit[busIndex] = my_num_units;
+}
+
+bool RPB_1600_Fleet::readIdentity(uint8_t index)
+{
+    fleet_unit *unit = &my_units[index];
+
+    // Blocking reads would trip over a poll that's still using the buses
+    if (!unit->identity_valid && my_poll_data == nullptr)
+    {
+        unit->identity_valid = unit->charger.getMfrData(&unit->identity);
+    }
+
+    return unit->identity_valid;
+}
+
+void RPB_1600_Fleet::finishPoll(void)
+{
+    fleet_readings *data = my_poll_data;
+    rpb_1600_voltage total_v_out = 0;
+
+    for (uint8_t u = 0; u < my_num_units; u++)
+    {
+        if (!data->valid[u])
+        {
+            continue;
+        }
+
+        rpb_1600_voltage v_out = data->unit[u].v_out;
+
+        if (data->num_valid == 0 || v_out < data->min_v_out)
+        {
+            data->min_v_out = v_out;
+        }
+
+        if (data->num_valid == 0 || v_out > data->max_v_out)
+        {
+            data->max_v_out = v_out;
+        }
+
+        total_v_out += v_out;
+        data->total_i_out += data->unit[u].i_out;
+        data->num_valid++;
+    }
+
+    if (data->num_valid > 0)
+    {
+        data->mean_v_out = total_v_out / data->num_valid;
+    }
+
+    data->duration_us = ((my_num_buses > 0) ? my_buses[0]->micros() : 0) - my_poll_start;
+    my_poll_data = nullptr;
+}
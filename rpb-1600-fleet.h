@@ -0,0 +1,171 @@
+#include "rpb-1600.h"
+
+#ifndef RPB_1600_FLEET_H
+#define RPB_1600_FLEET_H
+
+/**
+ * @brief The most I2C buses a fleet can span (a Teensy 4.0 has Wire, Wire1 and Wire2)
+ */
+#define RPB_1600_FLEET_MAX_BUSES 3
+
+/**
+ * @brief The RPB-1600 address range: A0-A2 set the bottom 3 bits, the top bit is always set
+ */
+#define RPB_1600_FIRST_ADDRESS 0x40
+#define RPB_1600_UNITS_PER_BUS 8
+
+#define RPB_1600_FLEET_MAX_UNITS (RPB_1600_FLEET_MAX_BUSES * RPB_1600_UNITS_PER_BUS)
+
+/**
+ * @brief Readings from every charger in a fleet, plus totals
+ */
+struct fleet_readings
+{
+    // Indexed the same as RPB_1600_Fleet::getUnit()
+    readings unit[RPB_1600_FLEET_MAX_UNITS];
+    bool valid[RPB_1600_FLEET_MAX_UNITS];
+    uint8_t num_units;
+    uint8_t num_valid;
+    // Totals over the units that were read successfully
+    // Whole amps, or milliamps with RPB_1600_FIXED_POINT (see rpb_1600_quantity)
+    uint32_t total_i_out;
+    rpb_1600_voltage min_v_out;
+    rpb_1600_voltage max_v_out;
+    rpb_1600_voltage mean_v_out;
+    // How long the whole scan took
+    uint32_t duration_us;
+};
+
+/**
+ * @brief One charger in RPB_1600_Fleet::getInventory()
+ */
+struct fleet_inventory_entry
+{
+    uint8_t bus_index;
+    uint8_t address;
+    // false if the charger's manufacturer strings couldn't be read
+    bool identity_valid;
+    mfr_data identity;
+};
+
+/**
+ * @brief Owns every charger on up to three buses and polls them all at once
+ * @details Each bus works through its own chargers one at a time, and service() starts the next
+ * transaction on every bus before finishing any of them. A scan only takes as long as the busiest
+ * bus with a backend whose startWriteRead() returns before the transaction is done, like
+ * RPB_1600_LinuxBus with one bus per /dev/i2c-N. The Arduino Wire API only has blocking calls, so
+ * with RPB_1600_WireBus the buses take turns transaction by transaction and a scan takes as long as
+ * all of the buses added together. Getting the overlap there needs a backend built on an interrupt
+ * or DMA driven I2C driver for the board.
+ */
+class RPB_1600_Fleet
+{
+public:
+    RPB_1600_Fleet();
+
+    /**
+     * @brief Add a bus for discover() to search. bus must outlive the fleet.
+     * @return false if the fleet already has RPB_1600_FLEET_MAX_BUSES buses
+     */
+    bool addBus(RPB_1600_Bus &bus);
+
+    /**
+     * @brief Probe addresses 0x40 - 0x47 on every bus and take ownership of each charger that answers
+     * @details Each address gets a single PMBUS_REVISION read straight on the bus, without retries
+     * or PEC. Brings up any bus no charger has yet (see RPB_1600::beginBus()). Reads each charger's
+     * manufacturer strings (one burst per charger, see RPB_1600::getMfrData()) and keeps them for
+     * getInventory(). Forgets any chargers found by a previous call.
+     * @return The number of chargers found
+     */
+    uint8_t discover(void);
+
+    /**
+     * @brief Add a charger by hand rather than with discover()
+     * @return false if the fleet is full, busIndex is out of range or the charger is already in the fleet
+     */
+    bool addUnit(uint8_t busIndex, uint8_t address);
+
+    uint8_t getNumUnits(void) const;
+    RPB_1600 *getUnit(uint8_t index);
+    uint8_t getUnitAddress(uint8_t index) const;
+    uint8_t getUnitBusIndex(uint8_t index) const;
+
+    /**
+     * @brief A charger's manufacturer strings, read once and kept
+     * @return nullptr if index is out of range or the strings can't be read
+     */
+    const mfr_data *getUnitIdentity(uint8_t index);
+
+    /**
+     * @brief Copy where every charger is and what it is into table, in getUnit() order
+     * @details Chargers whose strings haven't been read yet (added with addUnit(), or that failed
+     * during discover()) are read now, unless a poll is in progress, the rest come from what was kept.
+     * @return The number of entries filled in
+     */
+    uint8_t getInventory(fleet_inventory_entry *table, uint8_t maxEntries);
+
+    /**
+     * @brief Start reading every charger into data, and return immediately
+     * @details Call service() until it returns false, then data is complete
+     * @return false if a scan is already in progress
+     */
+    bool beginPoll(fleet_readings *data);
+
+    /**
+     * @brief Advance the scan by at most one transaction on each bus
+     * @return true if the scan is still in progress
+     */
+    bool service(void);
+
+    /**
+     * @brief Blocking version of beginPoll()
+     * @return true if every charger was read successfully
+     */
+    bool poll(fleet_readings *data);
+
+private:
+    struct fleet_unit
+    {
+        RPB_1600 charger;
+        uint8_t bus_index;
+        uint8_t address;
+        mfr_data identity;
+        bool identity_valid;
+    };
+
+    RPB_1600_Bus *my_buses[RPB_1600_FLEET_MAX_BUSES];
+    uint8_t my_num_buses;
+
+    fleet_unit my_units[RPB_1600_FLEET_MAX_UNITS];
+    uint8_t my_num_units;
+
+    /**
+     * @brief The asynchronous reads in progress, one per charger
+     */
+    rpb_1600_snapshot my_snapshots[RPB_1600_FLEET_MAX_UNITS];
+
+    /**
+     * @brief For each bus, the index of the charger it's currently reading (or my_num_units when done)
+     */
+    uint8_t my_active_unit[RPB_1600_FLEET_MAX_BUSES];
+
+    fleet_readings *my_poll_data;
+    uint32_t my_poll_start;
+
+    /**
+     * @brief Start reading the next charger on a bus, starting the search at unit index from
+     */
+    void startNextUnit(uint8_t busIndex, uint8_t from);
+
+    /**
+     * @brief Read a charger's manufacturer strings, unless we already have them
+     */
+    bool readIdentity(uint8_t index);
+
+    /**
+     * @brief Fill in the totals once every charger has been read
+     */
+    void finishPoll(void);
+};
+
+#endif // RPB_1600_FLEET_H
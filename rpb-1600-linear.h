@@ -0,0 +1,429 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef RPB_1600_LINEAR_H
+#define RPB_1600_LINEAR_H
+
+/**
+ * This file is a header only codec for the PMBus "Linear" data formats. It has no dependencies on
+ * the rest of the library, so it can be used on its own to post-process logged data on a host.
+ *
+ * Linear11 (PMBus 1.1 section 7.1): a 16 bit word with a 5 bit two's complement exponent N in the
+ * top bits and an 11 bit two's complement mantissa Y in the bottom bits. Value = Y * 2^N
+ *
+ * Linear16 (PMBus 1.1 section 8.3.1): used for output voltages. The word is an unsigned 16 bit
+ * mantissa, and the exponent N comes from the low 5 bits of VOUT_MODE. Value = word * 2^N
+ *
+ * Everything is constexpr (C++11 style, so it builds on AVR too) and free of data dependent
+ * branches (the ternaries compile down to conditional selects), so the batch decoders vectorize.
+ */
+
+#define LINEAR11_MANTISSA_MIN -1024
+#define LINEAR11_MANTISSA_MAX 1023
+#define LINEAR11_EXPONENT_MIN -16
+#define LINEAR11_EXPONENT_MAX 15
+
+/**
+ * @brief An exact Linear value: numerator / denominator, where denominator is a power of two
+ */
+struct linear_rational
+{
+    int32_t numerator;
+    uint32_t denominator;
+};
+
+/**
+ * @brief 2^N for N = -16 to 16, indexed by N + 16
+ * @details Covers every exponent Linear11 can encode, plus 2^16 so the encoders can use -N
+ */
+static constexpr float linear_pow2_table[33] = {
+    1.0f / 65536, 1.0f / 32768, 1.0f / 16384, 1.0f / 8192, 1.0f / 4096, 1.0f / 2048,
+    1.0f / 1024, 1.0f / 512, 1.0f / 256, 1.0f / 128, 1.0f / 64, 1.0f / 32, 1.0f / 16,
+    1.0f / 8, 1.0f / 4, 1.0f / 2, 1.0f, 2.0f, 4.0f, 8.0f, 16.0f, 32.0f, 64.0f, 128.0f,
+    256.0f, 512.0f, 1024.0f, 2048.0f, 4096.0f, 8192.0f, 16384.0f, 32768.0f, 65536.0f};
+
+//----------------------------------------------------------------------
+// Field access
+//----------------------------------------------------------------------
+
+/**
+ * @brief Sign extend the 5 bit exponent out of the top of a Linear11 word
+ */
+constexpr int8_t linear11_exponent(uint16_t word)
+{
+    return (int8_t)((int16_t)word >> 11);
+}
+
+/**
+ * @brief Sign extend the 11 bit mantissa out of the bottom of a Linear11 word
+ */
+constexpr int16_t linear11_mantissa(uint16_t word)
+{
+    return (int16_t)(uint16_t)(word << 5) >> 5;
+}
+
+/**
+ * @brief Sign extend the 5 bit exponent out of the bottom of a VOUT_MODE byte
+ */
+constexpr int8_t vout_mode_exponent(uint8_t mode)
+{
+    return (int8_t)(uint8_t)(mode << 3) >> 3;
+}
+
+/**
+ * @brief Pack an exponent and mantissa into a Linear11 word, both are truncated to fit
+ */
+constexpr uint16_t linear11_pack(int8_t N, int16_t Y)
+{
+    return (uint16_t)(((uint16_t)(N & 0x1F) << 11) | ((uint16_t)Y & 0x07FF));
+}
+
+/**
+ * @brief Assemble a word from the two bytes on the wire (low byte first)
+ */
+constexpr uint16_t linear_word(const uint8_t *bytes)
+{
+    return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+//----------------------------------------------------------------------
+// Helpers
+//----------------------------------------------------------------------
+
+/**
+ * @brief max(value, 0) without a branch
+ */
+constexpr int32_t linear_positive_part(int32_t value)
+{
+    return value & ~(value >> 31);
+}
+
+/**
+ * @brief Round to the nearest integer and clamp to [minimum, maximum]
+ */
+constexpr int32_t linear_round_clamp(float value, int32_t minimum, int32_t maximum)
+{
+    return value < (float)minimum   ? minimum
+           : value > (float)maximum ? maximum
+                                    : (int32_t)(value + (value < 0.0f ? -0.5f : 0.5f));
+}
+
+/**
+ * @brief mantissa * scale * 2^N, rounded to the nearest integer
+ * @details N must be in [-16, 15]. Exact as long as the result fits in 32 bits.
+ */
+constexpr int32_t linear_scale(int32_t mantissa, int8_t N, int32_t scale)
+{
+    return (int32_t)(((int64_t)mantissa * scale * ((int64_t)1 << (N + 16)) + 0x8000) >> 16);
+}
+
+/**
+ * @brief linear_scale() in 32 bit arithmetic, for 8 and 32 bit targets where 64 bit multiplies are
+ * library calls
+ * @details N must be in [-16, 15], and mantissa * scale and the result must both fit in 32 bits. That
+ * covers every Linear11 or Linear16 value scaled to thousandths.
+ */
+constexpr int32_t linear_scale_narrow(int32_t mantissa, int8_t N, int32_t scale)
+{
+    return N >= 0 ? mantissa * scale * ((int32_t)1 << linear_positive_part(N))
+                  : (mantissa * scale + (((int32_t)1 << linear_positive_part(-N)) >> 1)) >> linear_positive_part(-N);
+}
+
+/**
+ * @brief Clamp to [minimum, maximum]
+ */
+constexpr int32_t linear_clamp(int64_t value, int32_t minimum, int32_t maximum)
+{
+    return value < minimum ? minimum : value > maximum ? maximum : (int32_t)value;
+}
+
+constexpr int32_t linear_clamp(int32_t value, int32_t minimum, int32_t maximum)
+{
+    return value < minimum ? minimum : value > maximum ? maximum : value;
+}
+
+/**
+ * @brief round(value * 2^(-N) / scale), unclamped
+ * @details value * 2^(16 - N) / scale gives the mantissa with 16 extra fraction bits to round away
+ */
+constexpr int64_t linear_unscale(int32_t value, int32_t scale, int8_t N)
+{
+    return (((int64_t)value * ((int64_t)1 << (16 - N))) / scale + 0x8000) >> 16;
+}
+
+/**
+ * @brief value / divisor rounded down, divisor > 0
+ */
+constexpr int32_t linear_floor_div(int32_t value, int32_t divisor)
+{
+    return value >= 0 ? value / divisor : -(-(value + 1) / divisor) - 1;
+}
+
+/**
+ * @brief value - linear_floor_div(value, divisor) * divisor, in [0, divisor)
+ * @details divisor must be under 2^30
+ */
+constexpr int32_t linear_floor_mod(int32_t value, int32_t divisor)
+{
+    return (value % divisor + divisor) % divisor;
+}
+
+/**
+ * @brief (quotient + remainder / scale) * 2^shift, rounded to nearest with halves rounded up
+ * @details The whole part saturates at 2^29, far outside any mantissa, so the shift can't overflow
+ */
+constexpr int32_t linear_unscale_up(int32_t quotient, int32_t remainder, int32_t scale, int8_t shift)
+{
+    return linear_clamp(quotient, -((int32_t)1 << (29 - shift)), (int32_t)1 << (29 - shift)) *
+               ((int32_t)1 << shift) +
+           (remainder * ((int32_t)2 << shift) + scale) / (2 * scale);
+}
+
+/**
+ * @brief linear_unscale() in 32 bit arithmetic, for 8 and 32 bit targets where 64 bit divides are
+ * library calls
+ * @details Divides by scale first, so nothing overflows as long as scale is 1 to 16383 (thousandths
+ * are fine). Results past +-2^29 saturate there, which still reads as out of range to the fits checks.
+ * Halves round up, which can differ from linear_unscale() by one when value * 2^(-N) / scale is
+ * negative and within 2^-16 below a half.
+ */
+constexpr int32_t linear_unscale_narrow(int32_t value, int32_t scale, int8_t N)
+{
+    return N > 0 ? linear_floor_div(value, scale << N) +
+                       (linear_floor_mod(value, scale << N) >= (scale << (N - 1)) ? 1 : 0)
+                 : linear_unscale_up(linear_floor_div(value, scale), linear_floor_mod(value, scale), scale, -N);
+}
+
+//----------------------------------------------------------------------
+// Linear11 decode
+//----------------------------------------------------------------------
+
+constexpr float linear11_to_float(uint16_t word)
+{
+    return (float)linear11_mantissa(word) * linear_pow2_table[linear11_exponent(word) + 16];
+}
+
+/**
+ * @brief Decode to a fixed point value with fracBits fraction bits (e.g. 8 for Q.8), rounded to nearest
+ * @param fracBits 0 to 16
+ */
+constexpr int32_t linear11_to_fixed(uint16_t word, uint8_t fracBits)
+{
+    return linear_scale(linear11_mantissa(word), linear11_exponent(word), (int32_t)1 << fracBits);
+}
+
+/**
+ * @brief Decode to an integer in units of 1/scale (e.g. scale = 1000 for milliamps), rounded to nearest
+ */
+constexpr int32_t linear11_to_scaled(uint16_t word, int32_t scale)
+{
+    return linear_scale(linear11_mantissa(word), linear11_exponent(word), scale);
+}
+
+/**
+ * @brief Decode to an exact rational, no rounding at all
+ */
+constexpr linear_rational linear11_to_rational(uint16_t word)
+{
+    return linear_rational{
+        (int32_t)linear11_mantissa(word) * ((int32_t)1 << linear_positive_part(linear11_exponent(word))),
+        (uint32_t)1 << linear_positive_part(-linear11_exponent(word))};
+}
+
+//----------------------------------------------------------------------
+// Linear11 encode
+//----------------------------------------------------------------------
+
+/**
+ * @brief Encode value with exponent N, rounding to the nearest mantissa and saturating if it doesn't fit
+ */
+constexpr uint16_t linear11_from_float(float value, int8_t N)
+{
+    return linear11_pack(N, (int16_t)linear_round_clamp(value * linear_pow2_table[16 - N],
+                                                        LINEAR11_MANTISSA_MIN, LINEAR11_MANTISSA_MAX));
+}
+
+/**
+ * @brief Encode value (in units of 1/scale) with exponent N, rounding to the nearest mantissa and
+ * saturating if it doesn't fit
+ */
+constexpr uint16_t linear11_from_scaled(int32_t value, int32_t scale, int8_t N)
+{
+    return linear11_pack(N, (int16_t)linear_clamp(linear_unscale(value, scale, N),
+                                                  LINEAR11_MANTISSA_MIN, LINEAR11_MANTISSA_MAX));
+}
+
+/**
+ * @brief Whether value (in units of 1/scale) can be encoded with exponent N without saturating
+ */
+constexpr bool linear11_fits(int32_t value, int32_t scale, int8_t N)
+{
+    return linear_unscale(value, scale, N) >= LINEAR11_MANTISSA_MIN &&
+           linear_unscale(value, scale, N) <= LINEAR11_MANTISSA_MAX;
+}
+
+/**
+ * @brief linear11_from_scaled() without 64 bit arithmetic, scale must be 1 to 16383
+ */
+constexpr uint16_t linear11_from_scaled_narrow(int32_t value, int32_t scale, int8_t N)
+{
+    return linear11_pack(N, (int16_t)linear_clamp(linear_unscale_narrow(value, scale, N),
+                                                  LINEAR11_MANTISSA_MIN, LINEAR11_MANTISSA_MAX));
+}
+
+/**
+ * @brief linear11_fits() without 64 bit arithmetic, scale must be 1 to 16383
+ */
+constexpr bool linear11_fits_narrow(int32_t value, int32_t scale, int8_t N)
+{
+    return linear_unscale_narrow(value, scale, N) >= LINEAR11_MANTISSA_MIN &&
+           linear_unscale_narrow(value, scale, N) <= LINEAR11_MANTISSA_MAX;
+}
+
+/**
+ * @brief Whether value can be encoded with exponent N without saturating
+ */
+constexpr bool linear11_fits_float(float value, int8_t N)
+{
+    return value * linear_pow2_table[16 - N] >= LINEAR11_MANTISSA_MIN - 0.5f &&
+           value * linear_pow2_table[16 - N] < LINEAR11_MANTISSA_MAX + 0.5f;
+}
+
+//----------------------------------------------------------------------
+// Linear16
+//----------------------------------------------------------------------
+
+constexpr float linear16_to_float(uint16_t word, int8_t N)
+{
+    return (float)word * linear_pow2_table[N + 16];
+}
+
+/**
+ * @brief Decode to a fixed point value with fracBits fraction bits, rounded to nearest
+ * @param fracBits 0 to 15
+ */
+constexpr int32_t linear16_to_fixed(uint16_t word, int8_t N, uint8_t fracBits)
+{
+    return linear_scale(word, N, (int32_t)1 << fracBits);
+}
+
+/**
+ * @brief Decode to an integer in units of 1/scale (e.g. scale = 1000 for millivolts), rounded to nearest
+ */
+constexpr int32_t linear16_to_scaled(uint16_t word, int8_t N, int32_t scale)
+{
+    return linear_scale(word, N, scale);
+}
+
+constexpr linear_rational linear16_to_rational(uint16_t word, int8_t N)
+{
+    return linear_rational{
+        (int32_t)word * ((int32_t)1 << linear_positive_part(N)),
+        (uint32_t)1 << linear_positive_part(-N)};
+}
+
+constexpr uint16_t linear16_from_float(float value, int8_t N)
+{
+    return (uint16_t)linear_round_clamp(value * linear_pow2_table[16 - N], 0, UINT16_MAX);
+}
+
+/**
+ * @brief Whether value can be encoded with exponent N without saturating
+ */
+constexpr bool linear16_fits_float(float value, int8_t N)
+{
+    return value * linear_pow2_table[16 - N] >= -0.5f && value * linear_pow2_table[16 - N] < UINT16_MAX + 0.5f;
+}
+
+constexpr uint16_t linear16_from_scaled(int32_t value, int32_t scale, int8_t N)
+{
+    return (uint16_t)linear_clamp(linear_unscale(value, scale, N), 0, UINT16_MAX);
+}
+
+/**
+ * @brief Whether value (in units of 1/scale) can be encoded with exponent N without saturating
+ */
+constexpr bool linear16_fits(int32_t value, int32_t scale, int8_t N)
+{
+    return linear_unscale(value, scale, N) >= 0 && linear_unscale(value, scale, N) <= UINT16_MAX;
+}
+
+/**
+ * @brief linear16_from_scaled() without 64 bit arithmetic, scale must be 1 to 16383
+ */
+constexpr uint16_t linear16_from_scaled_narrow(int32_t value, int32_t scale, int8_t N)
+{
+    return (uint16_t)linear_clamp(linear_unscale_narrow(value, scale, N), 0, UINT16_MAX);
+}
+
+/**
+ * @brief linear16_fits() without 64 bit arithmetic, scale must be 1 to 16383
+ */
+constexpr bool linear16_fits_narrow(int32_t value, int32_t scale, int8_t N)
+{
+    return linear_unscale_narrow(value, scale, N) >= 0 && linear_unscale_narrow(value, scale, N) <= UINT16_MAX;
+}
+
+//----------------------------------------------------------------------
+// Batch decode
+//----------------------------------------------------------------------
+
+/**
+ * @brief 2^N as a float, built straight from the exponent bits so it vectorizes without a table gather
+ */
+static inline float linear_pow2_bits(int32_t N)
+{
+    uint32_t bits = (uint32_t)(N + 127) << 23;
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+/**
+ * @brief Decode count Linear11 words to floats
+ */
+static inline void linear11_decode(const uint16_t *words, size_t count, float *out)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = (float)linear11_mantissa(words[i]) * linear_pow2_bits(linear11_exponent(words[i]));
+    }
+}
+
+/**
+ * @brief Decode count Linear11 words to integers in units of 1/scale, rounded to nearest
+ */
+static inline void linear11_decode(const uint16_t *words, size_t count, int32_t scale, int32_t *out)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = linear11_to_scaled(words[i], scale);
+    }
+}
+
+/**
+ * @brief Decode count Linear16 words that share exponent N to floats
+ */
+static inline void linear16_decode(const uint16_t *words, size_t count, int8_t N, float *out)
+{
+    float multiplier = linear_pow2_table[N + 16];
+
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = (float)words[i] * multiplier;
+    }
+}
+
+/**
+ * @brief Decode count Linear16 words that share exponent N to integers in units of 1/scale, rounded to nearest
+ */
+static inline void linear16_decode(const uint16_t *words, size_t count, int8_t N, int32_t scale, int32_t *out)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = linear16_to_scaled(words[i], N, scale);
+    }
+}
+
+#endif // RPB_1600_LINEAR_H
@@ -0,0 +1,365 @@
+#include "rpb-1600-linux.h"
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+RPB_1600_LinuxSystemIo RPB_1600_DefaultLinuxIo;
+
+//----------------------------------------------------------------------
+// RPB_1600_LinuxSystemIo
+//----------------------------------------------------------------------
+
+int RPB_1600_LinuxSystemIo::open(const char *path, int flags)
+{
+    return ::open(path, flags);
+}
+
+int RPB_1600_LinuxSystemIo::close(int fd)
+{
+    return ::close(fd);
+}
+
+int RPB_1600_LinuxSystemIo::ioctl(int fd, unsigned long request, void *argument)
+{
+    return ::ioctl(fd, request, argument);
+}
+
+uint32_t RPB_1600_LinuxSystemIo::micros(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    // Truncating to 32 bits wraps the same way the Arduino micros() does
+    return (uint32_t)((uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000);
+}
+
+void RPB_1600_LinuxSystemIo::delayMicroseconds(uint32_t microseconds)
+{
+    struct timespec remaining = {(time_t)(microseconds / 1000000), (long)(microseconds % 1000000) * 1000};
+
+    // Keep sleeping through signals
+    while (nanosleep(&remaining, &remaining) != 0 && errno == EINTR)
+    {
+    }
+}
+
+//----------------------------------------------------------------------
+// RPB_1600_LinuxBus
+//----------------------------------------------------------------------
+
+RPB_1600_LinuxBus::RPB_1600_LinuxBus(const char *device, RPB_1600_LinuxIo &io) : my_io(io)
+{
+    strncpy(my_device, device, sizeof(my_device) - 1);
+    my_device[sizeof(my_device) - 1] = '\0';
+}
+
+RPB_1600_LinuxBus::~RPB_1600_LinuxBus()
+{
+    end();
+}
+
+void RPB_1600_LinuxBus::begin(void)
+{
+    // Every charger on the bus calls this from Init()
+    if (my_fd >= 0)
+    {
+        return;
+    }
+
+    my_fd = my_io.open(my_device, O_RDWR);
+
+    if (my_fd < 0)
+    {
+        my_error = errno;
+        return;
+    }
+
+    unsigned long functions = 0;
+
+    if (my_io.ioctl(my_fd, I2C_FUNCS, &functions) < 0)
+    {
+        my_error = errno;
+        end();
+        return;
+    }
+
+    if (!(functions & I2C_FUNC_I2C))
+    {
+        my_error = EOPNOTSUPP;
+        end();
+    }
+}
+
+void RPB_1600_LinuxBus::end(void)
+{
+    // The worker mustn't be part way through an ioctl when the device closes
+    stopWorker();
+
+    if (my_fd >= 0)
+    {
+        my_io.close(my_fd);
+        my_fd = -1;
+    }
+}
+
+bool RPB_1600_LinuxBus::isOpen(void) const
+{
+    return my_fd >= 0;
+}
+
+int RPB_1600_LinuxBus::getError(void) const
+{
+    std::lock_guard<std::mutex> lock(my_transfer_mutex);
+    return my_error;
+}
+
+void RPB_1600_LinuxBus::setClock(uint32_t frequency)
+{
+    (void)frequency;
+}
+
+uint32_t RPB_1600_LinuxBus::micros(void)
+{
+    return my_io.micros();
+}
+
+void RPB_1600_LinuxBus::delayMicroseconds(uint32_t microseconds)
+{
+    my_io.delayMicroseconds(microseconds);
+}
+
+uint8_t RPB_1600_LinuxBus::write(uint8_t address, const uint8_t *data, uint8_t length)
+{
+    i2c_msg message = {address, 0, length, const_cast<uint8_t *>(data)};
+
+    return transfer(&message, 1);
+}
+
+uint8_t RPB_1600_LinuxBus::writeRead(uint8_t address, const uint8_t *tx, uint8_t txLength,
+                                     uint8_t *rx, uint8_t rxLength, uint8_t *received)
+{
+    i2c_msg messages[2];
+    uint8_t num_messages = addTransfer(messages, 0, address, tx, txLength, rx, rxLength);
+    uint8_t status = transfer(messages, num_messages);
+
+    // I2C_RDWR either reads every byte asked for or fails
+    *received = (status == RPB_1600_BUS_OK) ? rxLength : 0;
+
+    return status;
+}
+
+uint8_t RPB_1600_LinuxBus::writeReadMany(uint8_t address, rpb_1600_bus_transfer *transfers, uint8_t count)
+{
+    i2c_msg messages[RPB_1600_LINUX_MAX_MESSAGES];
+    uint8_t num_ok = 0;
+    uint8_t first = 0;
+
+    while (first < count)
+    {
+        // Pack as many transfers into this ioctl as will fit
+        uint8_t num_messages = 0;
+        uint8_t last = first;
+
+        while (last < count && num_messages + 2 <= RPB_1600_LINUX_MAX_MESSAGES)
+        {
+            rpb_1600_bus_transfer *t = &transfers[last++];
+            num_messages += addTransfer(messages, num_messages, address, t->tx, t->tx_length, t->rx, t->rx_length);
+        }
+
+        if (transfer(messages, num_messages) == RPB_1600_BUS_OK)
+        {
+            for (uint8_t i = first; i < last; i++)
+            {
+                transfers[i].status = RPB_1600_BUS_OK;
+                transfers[i].received = transfers[i].rx_length;
+                num_ok++;
+            }
+        }
+        else
+        {
+            // No way to tell which message failed, so go through them one at a time
+            for (uint8_t i = first; i < last; i++)
+            {
+                rpb_1600_bus_transfer *t = &transfers[i];
+                t->status = writeRead(address, t->tx, t->tx_length, t->rx, t->rx_length, &t->received);
+
+                if (t->status == RPB_1600_BUS_OK)
+                {
+                    num_ok++;
+                }
+            }
+        }
+
+        first = last;
+    }
+
+    return num_ok;
+}
+
+uint8_t RPB_1600_LinuxBus::startWriteRead(uint8_t address, const uint8_t *tx, uint8_t txLength,
+                                          uint8_t *rx, uint8_t rxLength)
+{
+    // The worker only runs while the device is open, so it never sees my_fd change
+    if (my_fd < 0)
+    {
+        return RPB_1600_BUS_ERROR;
+    }
+
+    std::lock_guard<std::mutex> lock(my_job_mutex);
+
+    if (my_job_state != JOB_IDLE)
+    {
+        return RPB_1600_BUS_BUSY;
+    }
+
+    if (!my_worker.joinable())
+    {
+        my_worker = std::thread(&RPB_1600_LinuxBus::runWorker, this);
+    }
+
+    my_job = {address, tx, txLength, rx, rxLength, RPB_1600_BUS_OK, 0};
+    my_job_state = JOB_QUEUED;
+    my_job_wake.notify_one();
+
+    return RPB_1600_BUS_OK;
+}
+
+uint8_t RPB_1600_LinuxBus::pollWriteRead(uint8_t *received)
+{
+    std::lock_guard<std::mutex> lock(my_job_mutex);
+
+    if (my_job_state == JOB_IDLE)
+    {
+        return RPB_1600_BUS_ERROR;
+    }
+
+    if (my_job_state == JOB_QUEUED)
+    {
+        return RPB_1600_BUS_BUSY;
+    }
+
+    my_job_state = JOB_IDLE;
+    *received = my_job.received;
+
+    return my_job.status;
+}
+
+uint32_t RPB_1600_LinuxBus::getIoctlCount(void) const
+{
+    std::lock_guard<std::mutex> lock(my_transfer_mutex);
+    return my_ioctl_count;
+}
+
+void RPB_1600_LinuxBus::resetCounters(void)
+{
+    std::lock_guard<std::mutex> lock(my_transfer_mutex);
+    my_ioctl_count = 0;
+}
+
+void RPB_1600_LinuxBus::runWorker(void)
+{
+    std::unique_lock<std::mutex> lock(my_job_mutex);
+
+    while (true)
+    {
+        my_job_wake.wait(lock, [this] { return my_job_state == JOB_QUEUED || my_worker_stop; });
+
+        // Finish a queued transaction even when asked to stop, so its caller gets a result
+        if (my_job_state != JOB_QUEUED)
+        {
+            return;
+        }
+
+        async_job job = my_job;
+        lock.unlock();
+
+        i2c_msg messages[2];
+        uint8_t num_messages = addTransfer(messages, 0, job.address, job.tx, job.tx_length, job.rx, job.rx_length);
+        uint8_t status = transfer(messages, num_messages);
+
+        lock.lock();
+        my_job.status = status;
+        my_job.received = (status == RPB_1600_BUS_OK) ? job.rx_length : 0;
+        my_job_state = JOB_DONE;
+    }
+}
+
+void RPB_1600_LinuxBus::stopWorker(void)
+{
+    if (!my_worker.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(my_job_mutex);
+        my_worker_stop = true;
+        my_job_wake.notify_one();
+    }
+
+    my_worker.join();
+    my_worker_stop = false;
+}
+
+uint8_t RPB_1600_LinuxBus::addTransfer(i2c_msg *messages, uint8_t count, uint8_t address, const uint8_t *tx,
+                                       uint8_t txLength, uint8_t *rx, uint8_t rxLength)
+{
+    uint8_t added = 0;
+
+    // The kernel only reads from write buffers
+    if (txLength > 0 || rxLength == 0)
+    {
+        messages[count + added++] = {address, 0, txLength, const_cast<uint8_t *>(tx)};
+    }
+
+    if (rxLength > 0)
+    {
+        messages[count + added++] = {address, I2C_M_RD, rxLength, rx};
+    }
+
+    return added;
+}
+
+uint8_t RPB_1600_LinuxBus::transfer(i2c_msg *messages, uint8_t count)
+{
+    if (my_fd < 0)
+    {
+        return RPB_1600_BUS_ERROR;
+    }
+
+    i2c_rdwr_ioctl_data request = {messages, count};
+    std::lock_guard<std::mutex> lock(my_transfer_mutex);
+    my_ioctl_count++;
+
+    if (my_io.ioctl(my_fd, I2C_RDWR, &request) < 0)
+    {
+        my_error = errno;
+        return toBusStatus(my_error);
+    }
+
+    return RPB_1600_BUS_OK;
+}
+
+uint8_t RPB_1600_LinuxBus::toBusStatus(int error)
+{
+    // Adapter drivers mostly report a missing ACK as ENXIO (on the address) or EREMOTEIO (on data).
+    // EBUSY (bus stuck) isn't RPB_1600_BUS_BUSY, which means an asynchronous transaction in flight.
+    switch (error)
+    {
+    case ENXIO:
+    case EREMOTEIO:
+        return RPB_1600_BUS_NACK;
+    default:
+        return RPB_1600_BUS_ERROR;
+    }
+}
+
+#endif // __linux__ && !ARDUINO
@@ -0,0 +1,224 @@
+#include "rpb-1600-bus.h"
+
+#if defined(__linux__) && !defined(ARDUINO)
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+#ifndef RPB_1600_LINUX_H
+#define RPB_1600_LINUX_H
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+/**
+ * @brief The most messages the kernel accepts in one I2C_RDWR ioctl (I2C_RDWR_IOCTL_MAX_MSGS)
+ * @details Each write-then-read takes two, so a burst of up to 21 transfers costs one system call
+ */
+#define RPB_1600_LINUX_MAX_MESSAGES 42
+
+/**
+ * @brief The longest device path RPB_1600_LinuxBus keeps, including the terminating null
+ */
+#define RPB_1600_LINUX_MAX_PATH 64
+
+struct i2c_msg;
+
+/**
+ * @brief The system calls RPB_1600_LinuxBus makes, so they can be swapped for an in-process fake
+ * @details Every method behaves like the call it's named after: open() and ioctl() return -1 and set
+ * errno on failure. See RPB_1600_SimulatedI2cDev in rpb-1600-sim.h for a fake that answers I2C_RDWR
+ * from simulated chargers.
+ */
+class RPB_1600_LinuxIo
+{
+public:
+    virtual ~RPB_1600_LinuxIo() {}
+
+    virtual int open(const char *path, int flags) = 0;
+    virtual int close(int fd) = 0;
+    virtual int ioctl(int fd, unsigned long request, void *argument) = 0;
+
+    /**
+     * @brief Microseconds on a monotonic clock, wrapping at 2^32
+     */
+    virtual uint32_t micros(void) = 0;
+    virtual void delayMicroseconds(uint32_t microseconds) = 0;
+};
+
+/**
+ * @brief RPB_1600_LinuxIo that makes the real system calls
+ */
+class RPB_1600_LinuxSystemIo : public RPB_1600_LinuxIo
+{
+public:
+    int open(const char *path, int flags) override;
+    int close(int fd) override;
+    int ioctl(int fd, unsigned long request, void *argument) override;
+    uint32_t micros(void) override;
+    void delayMicroseconds(uint32_t microseconds) override;
+};
+
+/**
+ * @brief The system calls used by RPB_1600_LinuxBus objects that aren't given any explicitly
+ */
+extern RPB_1600_LinuxSystemIo RPB_1600_DefaultLinuxIo;
+
+/**
+ * @brief RPB_1600_Bus backend for Linux userspace, built on the i2c-dev interface (/dev/i2c-N)
+ * @details Every write-then-read is one I2C_RDWR ioctl carrying a write message and a read message,
+ * which the adapter joins with a repeated start. writeReadMany() packs the whole burst into one
+ * ioctl, so a getReadings() snapshot is a single system call and a single bus transaction with one
+ * stop at the end. Needs an adapter with plain I2C support (I2C_FUNC_I2C), SMBus-only adapters can't
+ * do I2C_RDWR.
+ *
+ * startWriteRead() hands the transaction to a worker thread and returns straight away, and
+ * pollWriteRead() collects the result. The thread is started the first time it's needed and stopped
+ * by end(). Each /dev/i2c-N is its own file descriptor and the kernel drives each adapter separately,
+ * so an RPB_1600_Fleet with one RPB_1600_LinuxBus per adapter reads all of them at the same time.
+ * Blocking calls made while a transaction is in flight wait for it to finish first.
+ *
+ * The kernel owns the bus clock (set it in the device tree or with the adapter's module parameters),
+ * so setClock() does nothing and clock calibration can't speed the bus up.
+ *
+ *   RPB_1600_LinuxBus bus("/dev/i2c-1");
+ *   RPB_1600 charger(bus);
+ *   charger.Init(0x47);
+ */
+class RPB_1600_LinuxBus : public RPB_1600_Bus
+{
+public:
+    /**
+     * @param device The i2c-dev node, e.g. "/dev/i2c-1". It's opened by begin().
+     * @param io Swap the system calls for a fake to run without hardware
+     */
+    RPB_1600_LinuxBus(const char *device, RPB_1600_LinuxIo &io = RPB_1600_DefaultLinuxIo);
+    ~RPB_1600_LinuxBus();
+
+    /**
+     * @brief Open the device, if it isn't open already
+     * @details Check isOpen() afterwards, and getError() for why it failed
+     */
+    void begin(void) override;
+
+    /**
+     * @brief Close the device, begin() opens it again
+     * @details Waits for a transaction started with startWriteRead() to finish, and stops the worker
+     * thread. The result can still be collected with pollWriteRead().
+     */
+    void end(void);
+
+    bool isOpen(void) const;
+
+    /**
+     * @brief The errno of the last failed system call, 0 if none has failed
+     */
+    int getError(void) const;
+
+    /**
+     * @brief Does nothing, the clock is set by the kernel
+     */
+    void setClock(uint32_t frequency) override;
+
+    uint32_t micros(void) override;
+    void delayMicroseconds(uint32_t microseconds) override;
+    uint8_t write(uint8_t address, const uint8_t *data, uint8_t length) override;
+    uint8_t writeRead(uint8_t address, const uint8_t *tx, uint8_t txLength,
+                      uint8_t *rx, uint8_t rxLength, uint8_t *received) override;
+
+    /**
+     * @brief Send the burst as one I2C_RDWR ioctl (more if it needs over RPB_1600_LINUX_MAX_MESSAGES)
+     * @details The kernel fails a whole ioctl if any message in it fails, so a failed ioctl is run
+     * again one transfer at a time to find out which transfers failed.
+     */
+    uint8_t writeReadMany(uint8_t address, rpb_1600_bus_transfer *transfers, uint8_t count) override;
+
+    /**
+     * @brief Queue a write-then-read for the worker thread, starting the thread if it isn't running
+     * @return RPB_1600_BUS_OK if it was queued, RPB_1600_BUS_BUSY if the last one hasn't been
+     * collected with pollWriteRead() yet, or RPB_1600_BUS_ERROR if the device isn't open
+     */
+    uint8_t startWriteRead(uint8_t address, const uint8_t *tx, uint8_t txLength,
+                           uint8_t *rx, uint8_t rxLength) override;
+    uint8_t pollWriteRead(uint8_t *received) override;
+
+    /**
+     * @brief The number of I2C_RDWR ioctls issued so far
+     */
+    uint32_t getIoctlCount(void) const;
+
+    void resetCounters(void);
+
+private:
+    char my_device[RPB_1600_LINUX_MAX_PATH];
+    RPB_1600_LinuxIo &my_io;
+    int my_fd = -1;
+    int my_error = 0;
+    uint32_t my_ioctl_count = 0;
+
+    /**
+     * @brief Held for every ioctl, so the worker thread and blocking calls take turns on the device
+     * @details Also guards my_error and my_ioctl_count
+     */
+    mutable std::mutex my_transfer_mutex;
+
+    /**
+     * @brief The transaction handed to the worker thread, guarded by my_job_mutex
+     */
+    enum job_state : uint8_t
+    {
+        JOB_IDLE,
+        JOB_QUEUED,
+        JOB_DONE,
+    };
+
+    struct async_job
+    {
+        uint8_t address;
+        const uint8_t *tx;
+        uint8_t tx_length;
+        uint8_t *rx;
+        uint8_t rx_length;
+        uint8_t status;
+        uint8_t received;
+    };
+
+    std::thread my_worker;
+    std::mutex my_job_mutex;
+    std::condition_variable my_job_wake;
+    async_job my_job = {};
+    uint8_t my_job_state = JOB_IDLE;
+    bool my_worker_stop = false;
+
+    /**
+     * @brief The worker thread: runs each queued transaction until told to stop
+     */
+    void runWorker(void);
+
+    /**
+     * @brief Let the worker thread finish what it's doing, then join it
+     */
+    void stopWorker(void);
+
+    /**
+     * @brief Add a write-then-read to messages[] starting at index count
+     * @return The number of messages added, 1 or 2
+     */
+    static uint8_t addTransfer(i2c_msg *messages, uint8_t count, uint8_t address, const uint8_t *tx,
+                               uint8_t txLength, uint8_t *rx, uint8_t rxLength);
+
+    /**
+     * @brief Issue count messages as one I2C_RDWR ioctl
+     * @return One of rpb_1600_bus_status
+     */
+    uint8_t transfer(i2c_msg *messages, uint8_t count);
+
+    /**
+     * @brief Convert an errno from a failed I2C_RDWR into an rpb_1600_bus_status
+     */
+    static uint8_t toBusStatus(int error);
+};
+
+#endif // __linux__ && !ARDUINO
+
+#endif // RPB_1600_LINUX_H
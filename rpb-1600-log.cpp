@@ -0,0 +1,535 @@
+#include "rpb-1600-log.h"
+#include <math.h>
+#include <string.h>
+
+#define LOG_FLAG_STATUS 0x01
+#define LOG_FLAG_CHANNEL_SHIFT 1
+
+//----------------------------------------------------------------------
+// Encoding helpers
+//----------------------------------------------------------------------
+
+static uint64_t zigzagEncode(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t zigzagDecode(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static uint8_t putVarint(uint64_t value, uint8_t *out)
+{
+    uint8_t length = 0;
+
+    while (value >= 0x80)
+    {
+        out[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+
+    out[length++] = (uint8_t)value;
+
+    return length;
+}
+
+/**
+ * @brief Read a varint from buffer[*position] without going past end
+ * @return false if it runs off the end or is too long
+ */
+static bool getVarint(const uint8_t *buffer, uint16_t *position, uint16_t end, uint64_t *value)
+{
+    *value = 0;
+
+    for (uint8_t shift = 0; shift < 64; shift += 7)
+    {
+        if (*position >= end)
+        {
+            return false;
+        }
+
+        uint8_t byte = buffer[(*position)++];
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void putLittleEndian(uint64_t value, uint8_t length, uint8_t *out)
+{
+    for (uint8_t i = 0; i < length; i++)
+    {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint64_t getLittleEndian(const uint8_t *in, uint8_t length)
+{
+    uint64_t value = 0;
+
+    for (uint8_t i = 0; i < length; i++)
+    {
+        value |= (uint64_t)in[i] << (8 * i);
+    }
+
+    return value;
+}
+
+/**
+ * @brief value * multiplier / divisor, rounded to nearest, in integers
+ */
+static int32_t rescale(int32_t value, int32_t multiplier, int32_t divisor)
+{
+    int32_t product = value * multiplier;
+    return (product + (product < 0 ? -divisor / 2 : divisor / 2)) / divisor;
+}
+
+/**
+ * @brief charge_status flags as bits, in the order they're declared
+ */
+static uint16_t packStatus(const charge_status &status)
+{
+    return (status.fully_charged << 0) |
+           (status.in_cc_mode << 1) |
+           (status.in_cv_mode << 2) |
+           (status.in_float_mode << 3) |
+           (status.EEPROM_error << 4) |
+           (status.temp_compensation_short_circuit << 5) |
+           (status.battery_detected << 6) |
+           (status.timeout_flag_cc_mode << 7) |
+           (status.timeout_flag_cv_mode << 8) |
+           (status.timeout_flag_float_mode << 9);
+}
+
+static void unpackStatus(uint16_t bits, charge_status *status)
+{
+    status->fully_charged = bits & (1 << 0);
+    status->in_cc_mode = bits & (1 << 1);
+    status->in_cv_mode = bits & (1 << 2);
+    status->in_float_mode = bits & (1 << 3);
+    status->EEPROM_error = bits & (1 << 4);
+    status->temp_compensation_short_circuit = bits & (1 << 5);
+    status->battery_detected = bits & (1 << 6);
+    status->timeout_flag_cc_mode = bits & (1 << 7);
+    status->timeout_flag_cv_mode = bits & (1 << 8);
+    status->timeout_flag_float_mode = bits & (1 << 9);
+}
+
+//----------------------------------------------------------------------
+// RPB_1600_LogWriter
+//----------------------------------------------------------------------
+
+RPB_1600_LogWriter::RPB_1600_LogWriter(rpb_1600_log_sink sink, void *context)
+    : my_sink(sink), my_sink_context(context)
+{
+    resetBlock();
+}
+
+bool RPB_1600_LogWriter::append(uint32_t timestamp, const readings &data, const charge_status &status)
+{
+    // Extend the wrapping timestamp to 64 bits of session time
+    if (my_started)
+    {
+        my_session_time += (uint32_t)(timestamp - my_last_timestamp);
+    }
+
+    my_started = true;
+    my_last_timestamp = timestamp;
+
+    // The log keeps each channel at its register's resolution whatever the build's readings hold
+#ifdef RPB_1600_FIXED_POINT
+    int32_t channels[RPB_1600_LOG_CHANNELS] = {
+        rescale(data.v_in, RPB_1600_LOG_VIN_SCALE, RPB_1600_QUANTITY_SCALE),
+        rescale(data.v_out, RPB_1600_LOG_VOUT_SCALE, RPB_1600_QUANTITY_SCALE),
+        rescale(data.i_out, RPB_1600_LOG_IOUT_SCALE, RPB_1600_QUANTITY_SCALE),
+        data.fan_speed_1,
+        data.fan_speed_2,
+    };
+#else
+    int32_t channels[RPB_1600_LOG_CHANNELS] = {
+        (int32_t)data.v_in * RPB_1600_LOG_VIN_SCALE,
+        (int32_t)lroundf(data.v_out * RPB_1600_LOG_VOUT_SCALE),
+        (int32_t)data.i_out * RPB_1600_LOG_IOUT_SCALE,
+        data.fan_speed_1,
+        data.fan_speed_2,
+    };
+#endif
+
+    uint16_t packed = packStatus(status);
+    uint8_t record[RPB_1600_LOG_MAX_RECORD_LENGTH];
+    uint8_t length = encodeRecord(my_session_time, channels, packed, record);
+    bool ok = true;
+
+    if (my_length + length > RPB_1600_LOG_BLOCK_SIZE)
+    {
+        ok = flush();
+
+        // The record has to be encoded again against the fresh block
+        length = encodeRecord(my_session_time, channels, packed, record);
+    }
+
+    if (my_block_records == 0)
+    {
+        putLittleEndian(my_session_time, 8, &my_block[8]);
+        my_previous_time = my_session_time;
+    }
+
+    memcpy(&my_block[my_length], record, length);
+    my_length += length;
+    my_block_records++;
+    my_record_count++;
+
+    my_previous_interval = (int64_t)(my_session_time - my_previous_time);
+    my_previous_time = my_session_time;
+    memcpy(my_previous, channels, sizeof(my_previous));
+    my_previous_status = packed;
+    my_status_known = true;
+
+    return ok;
+}
+
+bool RPB_1600_LogWriter::flush(void)
+{
+    if (my_block_records == 0)
+    {
+        return true;
+    }
+
+    my_block[0] = RPB_1600_LOG_MAGIC_0;
+    my_block[1] = RPB_1600_LOG_MAGIC_1;
+    my_block[2] = RPB_1600_LOG_VERSION;
+    my_block[3] = 0;
+    putLittleEndian(my_block_count, 4, &my_block[4]);
+    putLittleEndian(my_block_records, 2, &my_block[16]);
+    putLittleEndian(my_length - RPB_1600_LOG_HEADER_LENGTH, 2, &my_block[18]);
+    memset(&my_block[my_length], 0, RPB_1600_LOG_BLOCK_SIZE - my_length);
+
+    // Only count blocks that were stored, so block n stays at offset n * RPB_1600_LOG_BLOCK_SIZE
+    bool ok = my_sink(my_block, my_sink_context);
+
+    if (ok)
+    {
+        my_block_count++;
+    }
+    else
+    {
+        my_failed_blocks++;
+    }
+
+    resetBlock();
+
+    return ok;
+}
+
+uint32_t RPB_1600_LogWriter::getBlockCount(void) const
+{
+    return my_block_count;
+}
+
+uint32_t RPB_1600_LogWriter::getRecordCount(void) const
+{
+    return my_record_count;
+}
+
+uint32_t RPB_1600_LogWriter::getFailedBlocks(void) const
+{
+    return my_failed_blocks;
+}
+
+void RPB_1600_LogWriter::resetBlock(void)
+{
+    my_length = RPB_1600_LOG_HEADER_LENGTH;
+    my_block_records = 0;
+    memset(my_previous, 0, sizeof(my_previous));
+    my_previous_interval = 0;
+    my_status_known = false;
+}
+
+uint8_t RPB_1600_LogWriter::encodeRecord(uint64_t time, const int32_t *channels, uint16_t status, uint8_t *out) const
+{
+    uint8_t flags = 0;
+    uint8_t length = 1;
+
+    // The first record in a block has no interval, so it stores 0
+    int64_t interval = (my_block_records == 0) ? 0 : (int64_t)(time - my_previous_time);
+    length += putVarint(zigzagEncode(interval - my_previous_interval), &out[length]);
+
+    for (uint8_t i = 0; i < RPB_1600_LOG_CHANNELS; i++)
+    {
+        int64_t change = (int64_t)channels[i] - my_previous[i];
+
+        if (change != 0)
+        {
+            flags |= 1 << (LOG_FLAG_CHANNEL_SHIFT + i);
+            length += putVarint(zigzagEncode(change), &out[length]);
+        }
+    }
+
+    if (!my_status_known || status != my_previous_status)
+    {
+        flags |= LOG_FLAG_STATUS;
+        length += putVarint(status, &out[length]);
+    }
+
+    out[0] = flags;
+
+    return length;
+}
+
+//----------------------------------------------------------------------
+// RPB_1600_LogReader
+//----------------------------------------------------------------------
+
+RPB_1600_LogReader::RPB_1600_LogReader(rpb_1600_log_source source, void *context, uint32_t numBlocks)
+    : my_source(source), my_source_context(context), my_num_blocks(numBlocks)
+{
+    memset(my_previous, 0, sizeof(my_previous));
+}
+
+bool RPB_1600_LogReader::seekBlock(uint32_t index)
+{
+    return loadBlock(index);
+}
+
+bool RPB_1600_LogReader::seekTime(uint64_t timestamp_us)
+{
+    // Find the last block that starts at or before timestamp_us
+    uint32_t low = 0;
+    uint32_t high = my_num_blocks;
+    uint64_t start;
+
+    while (high - low > 1)
+    {
+        uint32_t middle = low + (high - low) / 2;
+
+        if (!blockStartTime(middle, &start))
+        {
+            return false;
+        }
+
+        if (start <= timestamp_us)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    if (!loadBlock(low))
+    {
+        return false;
+    }
+
+    // Then skip forward to the record, without handing out the ones before it
+    while (true)
+    {
+        uint32_t block_index = my_block_index;
+        uint16_t position = my_position;
+        uint16_t records_left = my_records_left;
+        int32_t previous[RPB_1600_LOG_CHANNELS];
+        memcpy(previous, my_previous, sizeof(previous));
+        int64_t previous_interval = my_previous_interval;
+        uint64_t time = my_time;
+        uint16_t status = my_status;
+        uint32_t bad_blocks = my_bad_blocks;
+
+        log_record record;
+
+        if (!next(&record))
+        {
+            return false;
+        }
+
+        if (record.timestamp_us >= timestamp_us)
+        {
+            // Step back so next() hands out this record
+            if (block_index != my_block_index && !loadBlock(block_index))
+            {
+                return false;
+            }
+
+            my_position = position;
+            my_records_left = records_left;
+            memcpy(my_previous, previous, sizeof(my_previous));
+            my_previous_interval = previous_interval;
+            my_time = time;
+            my_status = status;
+            // next() will skip any bad blocks in between again
+            my_bad_blocks = bad_blocks;
+
+            return true;
+        }
+    }
+}
+
+bool RPB_1600_LogReader::next(log_record *record)
+{
+    if (!my_block_valid)
+    {
+        return false;
+    }
+
+    while (true)
+    {
+        if (my_records_left > 0)
+        {
+            if (decodeRecord(record))
+            {
+                return true;
+            }
+
+            // Nothing after a bad record can be trusted, the next block starts from scratch
+            my_bad_blocks++;
+            my_records_left = 0;
+        }
+
+        // Move on to the next block, skipping any empty ones
+        if (!loadNextGoodBlock())
+        {
+            return false;
+        }
+    }
+}
+
+uint32_t RPB_1600_LogReader::getNumBlocks(void) const
+{
+    return my_num_blocks;
+}
+
+uint32_t RPB_1600_LogReader::getBadBlocks(void) const
+{
+    return my_bad_blocks;
+}
+
+bool RPB_1600_LogReader::loadNextGoodBlock(void)
+{
+    for (uint32_t index = my_block_index + 1; index < my_num_blocks; index++)
+    {
+        if (loadBlock(index))
+        {
+            return true;
+        }
+
+        my_bad_blocks++;
+    }
+
+    my_block_valid = false;
+
+    return false;
+}
+
+bool RPB_1600_LogReader::decodeRecord(log_record *record)
+{
+    uint16_t position = my_position;
+    uint64_t value;
+
+    if (position >= my_payload_end)
+    {
+        return false;
+    }
+
+    uint8_t flags = my_block[position++];
+
+    if (!getVarint(my_block, &position, my_payload_end, &value))
+    {
+        return false;
+    }
+
+    my_previous_interval += zigzagDecode(value);
+    my_time += my_previous_interval;
+
+    for (uint8_t i = 0; i < RPB_1600_LOG_CHANNELS; i++)
+    {
+        if (flags & (1 << (LOG_FLAG_CHANNEL_SHIFT + i)))
+        {
+            if (!getVarint(my_block, &position, my_payload_end, &value))
+            {
+                return false;
+            }
+
+            my_previous[i] += (int32_t)zigzagDecode(value);
+        }
+    }
+
+    if (flags & LOG_FLAG_STATUS)
+    {
+        if (!getVarint(my_block, &position, my_payload_end, &value))
+        {
+            return false;
+        }
+
+        my_status = (uint16_t)value;
+    }
+
+    my_position = position;
+    my_records_left--;
+
+    record->timestamp_us = my_time;
+#ifdef RPB_1600_FIXED_POINT
+    record->data.v_in = rescale((int32_t)my_previous[0], RPB_1600_QUANTITY_SCALE, RPB_1600_LOG_VIN_SCALE);
+    record->data.v_out = rescale((int32_t)my_previous[1], RPB_1600_QUANTITY_SCALE, RPB_1600_LOG_VOUT_SCALE);
+    record->data.i_out = rescale((int32_t)my_previous[2], RPB_1600_QUANTITY_SCALE, RPB_1600_LOG_IOUT_SCALE);
+#else
+    // Whole volts and amps, rounded the way parseLinearData() rounds them
+    record->data.v_in = (uint16_t)rescale((int32_t)my_previous[0], 1, RPB_1600_LOG_VIN_SCALE);
+    record->data.v_out = (float)my_previous[1] / RPB_1600_LOG_VOUT_SCALE;
+    record->data.i_out = (uint16_t)rescale((int32_t)my_previous[2], 1, RPB_1600_LOG_IOUT_SCALE);
+#endif
+    record->data.fan_speed_1 = (uint16_t)my_previous[3];
+    record->data.fan_speed_2 = (uint16_t)my_previous[4];
+    unpackStatus(my_status, &record->status);
+
+    return true;
+}
+
+bool RPB_1600_LogReader::loadBlock(uint32_t index)
+{
+    my_block_valid = false;
+
+    if (index >= my_num_blocks || !my_source(index, my_block, my_source_context))
+    {
+        return false;
+    }
+
+    uint16_t payload_length = (uint16_t)getLittleEndian(&my_block[18], 2);
+
+    if (my_block[0] != RPB_1600_LOG_MAGIC_0 || my_block[1] != RPB_1600_LOG_MAGIC_1 ||
+        my_block[2] != RPB_1600_LOG_VERSION || getLittleEndian(&my_block[4], 4) != index ||
+        payload_length > RPB_1600_LOG_BLOCK_SIZE - RPB_1600_LOG_HEADER_LENGTH)
+    {
+        return false;
+    }
+
+    my_block_index = index;
+    my_position = RPB_1600_LOG_HEADER_LENGTH;
+    my_payload_end = RPB_1600_LOG_HEADER_LENGTH + payload_length;
+    my_records_left = (uint16_t)getLittleEndian(&my_block[16], 2);
+    my_block_valid = true;
+
+    memset(my_previous, 0, sizeof(my_previous));
+    my_previous_interval = 0;
+    my_time = getLittleEndian(&my_block[8], 8);
+    my_status = 0;
+
+    return true;
+}
+
+bool RPB_1600_LogReader::blockStartTime(uint32_t index, uint64_t *timestamp)
+{
+    if (!loadBlock(index))
+    {
+        return false;
+    }
+
+    *timestamp = my_time;
+
+    return true;
+}
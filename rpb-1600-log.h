@@ -0,0 +1,243 @@
+#include <stdint.h>
+#include "rpb-1600.h"
+
+#ifndef RPB_1600_LOG_H
+#define RPB_1600_LOG_H
+
+/**
+ * This file defines a compressed log format for whole charge sessions, a writer for the MCU side
+ * and a reader for replaying logs on a host.
+ *
+ * A log is a sequence of fixed size blocks, so block n always starts at byte n * RPB_1600_LOG_BLOCK_SIZE.
+ * Every block decodes on its own (the first record in a block is stored against zero, and always
+ * carries the status), which makes seeking to a block O(1) and limits the damage a bad block can do:
+ * the reader drops the rest of a corrupt block and picks up again at the next block that checks out.
+ *
+ * Block header (multi-byte fields little endian):
+ *   0-1    magic 'R' 'L'
+ *   2      format version
+ *   3      reserved, 0
+ *   4-7    block index
+ *   8-15   timestamp of the first record, microseconds since the first record in the log
+ *   16-17  number of records
+ *   18-19  number of payload bytes after the header, the rest of the block is padding
+ *
+ * Record:
+ *   flags  bit 0: status follows, bits 1-5: channel 0-4 changed
+ *   varint zig-zag change in the time between records (microseconds)
+ *   varint zig-zag change of each channel that changed: VIN * 2, VOUT * 512, IOUT * 4, FAN_SPEED_1,
+ *          FAN_SPEED_2
+ *   varint packed charge_status, only when it changed
+ */
+
+/**
+ * @brief Block size, a multiple of the SD card sector size works best. Override it before including.
+ */
+#ifndef RPB_1600_LOG_BLOCK_SIZE
+#define RPB_1600_LOG_BLOCK_SIZE 512
+#endif
+
+#define RPB_1600_LOG_HEADER_LENGTH 20
+#define RPB_1600_LOG_MAGIC_0 'R'
+#define RPB_1600_LOG_MAGIC_1 'L'
+#define RPB_1600_LOG_VERSION 2
+
+#define RPB_1600_LOG_CHANNELS 5
+
+/**
+ * @brief VIN is stored in 1/2 V steps, the resolution of READ_VIN (Linear11, N = -1)
+ */
+#define RPB_1600_LOG_VIN_SCALE 2
+
+/**
+ * @brief VOUT is stored in 1/512 V steps, the resolution of READ_VOUT (Linear16, N = -9)
+ */
+#define RPB_1600_LOG_VOUT_SCALE 512
+
+/**
+ * @brief IOUT is stored in 1/4 A steps, the resolution of READ_IOUT (Linear11, N = -2)
+ */
+#define RPB_1600_LOG_IOUT_SCALE 4
+
+/**
+ * @brief Flags byte, 5 byte time varint, 5 channel varints of up to 5 bytes, 2 byte status varint
+ */
+#define RPB_1600_LOG_MAX_RECORD_LENGTH (1 + 5 + RPB_1600_LOG_CHANNELS * 5 + 2)
+
+/**
+ * @brief Called with each finished block, e.g. to append it to a file on an SD card
+ * @details block is always RPB_1600_LOG_BLOCK_SIZE bytes
+ * @return false if the block couldn't be stored
+ */
+typedef bool (*rpb_1600_log_sink)(const uint8_t *block, void *context);
+
+/**
+ * @brief Called by the reader to fetch block index of the log into block
+ * @return false if there's no such block
+ */
+typedef bool (*rpb_1600_log_source)(uint32_t index, uint8_t *block, void *context);
+
+/**
+ * @brief One decoded record
+ */
+struct log_record
+{
+    // Microseconds since the first record in the log
+    uint64_t timestamp_us;
+    readings data;
+    charge_status status;
+};
+
+/**
+ * @brief Compresses readings and charge status into blocks and hands them to a sink
+ * @details Holds one block in RAM. Call flush() at the end of a session, or the last partial block is lost.
+ */
+class RPB_1600_LogWriter
+{
+public:
+    RPB_1600_LogWriter(rpb_1600_log_sink sink, void *context);
+
+    /**
+     * @brief Add a record
+     * @param timestamp RPB_1600_Bus::micros() (or ::micros()) when the readings were taken, wrapping is fine
+     * as long as records are less than 71 minutes apart
+     * @return false if a block filled up and the sink failed to store it (the block is dropped)
+     */
+    bool append(uint32_t timestamp, const readings &data, const charge_status &status);
+
+    /**
+     * @brief Pad the current block and hand it to the sink, even if it isn't full
+     * @return false if the sink failed to store it. true if the block was stored or was empty.
+     */
+    bool flush(void);
+
+    /**
+     * @brief Blocks stored by the sink
+     */
+    uint32_t getBlockCount(void) const;
+    uint32_t getRecordCount(void) const;
+
+    /**
+     * @brief Blocks the sink failed to store
+     */
+    uint32_t getFailedBlocks(void) const;
+
+private:
+    rpb_1600_log_sink my_sink;
+    void *my_sink_context;
+
+    uint8_t my_block[RPB_1600_LOG_BLOCK_SIZE];
+    uint16_t my_length = RPB_1600_LOG_HEADER_LENGTH;
+    uint16_t my_block_records = 0;
+
+    // Encoder state, reset at the start of every block
+    int32_t my_previous[RPB_1600_LOG_CHANNELS];
+    int64_t my_previous_interval = 0;
+    uint16_t my_previous_status = 0;
+    bool my_status_known = false;
+
+    // Session time
+    bool my_started = false;
+    uint32_t my_last_timestamp = 0;
+    uint64_t my_session_time = 0;
+    uint64_t my_previous_time = 0;
+
+    uint32_t my_block_count = 0;
+    uint32_t my_record_count = 0;
+    uint32_t my_failed_blocks = 0;
+
+    /**
+     * @brief Start a new, empty block
+     */
+    void resetBlock(void);
+
+    /**
+     * @brief Encode a record into out against the current block state, without changing it
+     * @return The length of the record
+     */
+    uint8_t encodeRecord(uint64_t time, const int32_t *channels, uint16_t status, uint8_t *out) const;
+};
+
+/**
+ * @brief Decodes a log block by block, from any point in it
+ */
+class RPB_1600_LogReader
+{
+public:
+    /**
+     * @param numBlocks The length of the log in blocks (e.g. the file size / RPB_1600_LOG_BLOCK_SIZE)
+     */
+    RPB_1600_LogReader(rpb_1600_log_source source, void *context, uint32_t numBlocks);
+
+    /**
+     * @brief Continue reading from the start of block index. seekBlock(0) to read the whole log.
+     * @return false if the block is missing or isn't a valid block
+     */
+    bool seekBlock(uint32_t index);
+
+    /**
+     * @brief Continue reading from the first record at or after timestamp_us
+     * @details Binary searches the block headers, so it fetches O(log n) blocks
+     * @return false if there's no such record
+     */
+    bool seekTime(uint64_t timestamp_us);
+
+    /**
+     * @brief Decode the next record, moving on to the next block as needed
+     * @details A block that can't be fetched, has a bad header or runs out of payload part way
+     * through a record is skipped (from that record on), and reading carries on at the start of the
+     * next good block. See getBadBlocks().
+     * @return false at the end of the log
+     */
+    bool next(log_record *record);
+
+    uint32_t getNumBlocks(void) const;
+
+    /**
+     * @brief Blocks next() skipped or cut short because they were missing or corrupt
+     */
+    uint32_t getBadBlocks(void) const;
+
+private:
+    rpb_1600_log_source my_source;
+    void *my_source_context;
+    uint32_t my_num_blocks;
+
+    uint8_t my_block[RPB_1600_LOG_BLOCK_SIZE];
+    bool my_block_valid = false;
+    uint32_t my_block_index = 0;
+    uint16_t my_position = 0;
+    uint16_t my_payload_end = 0;
+    uint16_t my_records_left = 0;
+    uint32_t my_bad_blocks = 0;
+
+    // Decoder state, reset at the start of every block
+    int32_t my_previous[RPB_1600_LOG_CHANNELS];
+    int64_t my_previous_interval = 0;
+    uint64_t my_time = 0;
+    uint16_t my_status = 0;
+
+    /**
+     * @brief Fetch and check a block's header
+     */
+    bool loadBlock(uint32_t index);
+
+    /**
+     * @brief Load the first good block after the current one, counting the bad ones on the way
+     * @return false if there isn't one
+     */
+    bool loadNextGoodBlock(void);
+
+    /**
+     * @brief Decode the record at my_position into record
+     * @return false if the payload runs out before the record does
+     */
+    bool decodeRecord(log_record *record);
+
+    /**
+     * @brief The timestamp of the first record in a block, from its header
+     */
+    bool blockStartTime(uint32_t index, uint64_t *timestamp);
+};
+
+#endif // RPB_1600_LOG_H
@@ -0,0 +1,153 @@
+#include <stdint.h>
+#include <atomic>
+#include "rpb-1600.h"
+
+#ifndef RPB_1600_RING_H
+#define RPB_1600_RING_H
+
+/**
+ * @brief One set of readings and when they were taken
+ */
+struct telemetry_sample
+{
+    // RPB_1600_Bus::micros() when the readings finished
+    uint32_t timestamp_us;
+    readings data;
+};
+
+/**
+ * @brief Fixed capacity, heap free, lock free single producer/single consumer queue of samples
+ * @details The producer (usually the polling code, via RPB_1600::onReadings()) and the consumer
+ * can run in different contexts: an ISR and loop(), or two threads on a host. Only one of each!
+ * When the ring is full new samples are dropped and counted, samples already queued are never
+ * overwritten. Needs std::atomic, so it isn't available on AVR.
+ */
+class RPB_1600_SampleRing
+{
+public:
+    /**
+     * @param storage Caller owned array of capacity samples, must outlive the ring
+     * @param capacity Should be a power of two. Anything else is rounded down to one, so only part of
+     * storage gets used, and a capacity of 0 gives a ring that drops everything. Check capacity().
+     */
+    RPB_1600_SampleRing(telemetry_sample *storage, uint32_t capacity)
+        : my_storage(storage), my_capacity(floorPowerOfTwo(capacity)), my_mask(my_capacity - 1),
+          my_head(0), my_tail(0), my_overflows(0)
+    {
+    }
+
+    /**
+     * @brief Producer side: queue a sample
+     * @return false if the ring was full and the sample was dropped
+     */
+    bool push(const telemetry_sample &sample)
+    {
+        uint32_t head = my_head.load(std::memory_order_relaxed);
+        uint32_t tail = my_tail.load(std::memory_order_acquire);
+
+        if (head - tail >= my_capacity)
+        {
+            my_overflows.store(my_overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        my_storage[head & my_mask] = sample;
+        my_head.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * @brief Consumer side: take the oldest sample
+     * @return false if the ring was empty
+     */
+    bool pop(telemetry_sample *sample)
+    {
+        return drain(sample, 1) == 1;
+    }
+
+    /**
+     * @brief Consumer side: take up to maxSamples of the oldest samples in one go
+     * @return The number of samples copied into samples[]
+     */
+    uint32_t drain(telemetry_sample *samples, uint32_t maxSamples)
+    {
+        uint32_t tail = my_tail.load(std::memory_order_relaxed);
+        uint32_t head = my_head.load(std::memory_order_acquire);
+        uint32_t count = head - tail;
+
+        if (count > maxSamples)
+        {
+            count = maxSamples;
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            samples[i] = my_storage[(tail + i) & my_mask];
+        }
+
+        my_tail.store(tail + count, std::memory_order_release);
+
+        return count;
+    }
+
+    /**
+     * @brief The number of queued samples. Only exact when called from the producer or consumer.
+     */
+    uint32_t size(void) const
+    {
+        return my_head.load(std::memory_order_acquire) - my_tail.load(std::memory_order_acquire);
+    }
+
+    uint32_t capacity(void) const
+    {
+        return my_capacity;
+    }
+
+    /**
+     * @brief The number of samples dropped because the ring was full
+     */
+    uint32_t getOverflows(void) const
+    {
+        return my_overflows.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Pass to RPB_1600::onReadings() with the ring as the context to feed it from the polling path
+     */
+    static void onReadings(const readings *data, uint32_t timestamp, void *ring)
+    {
+        telemetry_sample sample;
+        sample.timestamp_us = timestamp;
+        sample.data = *data;
+        static_cast<RPB_1600_SampleRing *>(ring)->push(sample);
+    }
+
+private:
+    telemetry_sample *my_storage;
+    uint32_t my_capacity;
+    uint32_t my_mask;
+
+    // Free running counters, the slot index is the counter masked by capacity - 1.
+    // Only the producer writes my_head and my_overflows, only the consumer writes my_tail.
+    std::atomic<uint32_t> my_head;
+    std::atomic<uint32_t> my_tail;
+    std::atomic<uint32_t> my_overflows;
+
+    /**
+     * @brief The largest power of two no bigger than value, 0 for 0
+     */
+    static uint32_t floorPowerOfTwo(uint32_t value)
+    {
+        uint32_t power = 1;
+
+        while (power <= value / 2)
+        {
+            power *= 2;
+        }
+
+        return (value > 0) ? power : 0;
+    }
+};
+
+#endif // RPB_1600_RING_H
@@ -0,0 +1,256 @@
+#include "rpb-1600-scheduler.h"
+#include "rpb-1600-commands.h"
+#include "rpb-1600-time.h"
+#include <string.h>
+
+// How much unused bus time the token bucket can save up, before the budget is applied
+#define SCHEDULER_BURST_WINDOW_US 10000
+// The clock RPB_1600::Init() starts a bus at, assumed until the bus is set up
+#define SCHEDULER_DEFAULT_CLOCK 100000
+
+RPB_1600_Scheduler::RPB_1600_Scheduler(RPB_1600 &charger)
+    : my_charger(charger), my_num_entries(0), my_budget_percent(50)
+{
+    my_last_refill = my_charger.getBus()->micros();
+    my_credit_us = maxCredit();
+}
+
+int8_t RPB_1600_Scheduler::add(uint8_t commandID, uint8_t length, uint32_t period_us, uint8_t priority, bool block)
+{
+    if (my_num_entries >= RPB_1600_SCHEDULER_MAX_ENTRIES || length > MAX_RECEIVE_BYTES)
+    {
+        return -1;
+    }
+
+    scheduled_register *entry = &my_entries[my_num_entries];
+    memset(entry, 0, sizeof(*entry));
+    entry->command = commandID;
+    entry->length = length;
+    entry->period_us = period_us;
+    entry->priority = priority;
+    entry->block = block;
+    // Everything is due straight away
+    entry->due = my_charger.getBus()->micros();
+
+    return my_num_entries++;
+}
+
+void RPB_1600_Scheduler::addDefaultSchedule(void)
+{
+    add(CMD_CODE_READ_VOUT, CMD_LENGTH_READ_VOUT, 20000, 3);
+    add(CMD_CODE_READ_IOUT, CMD_LENGTH_READ_IOUT, 20000, 3);
+    add(CMD_CODE_CHG_STATUS, CMD_LENGTH_CHG_STATUS, 200000, 2);
+    add(CMD_CODE_READ_VIN, CMD_LENGTH_READ_VIN, 1000000, 1);
+    add(CMD_CODE_READ_FAN_SPEED_1, CMD_LENGTH_READ_FAN_SPEED_1, 1000000, 1);
+    add(CMD_CODE_READ_FAN_SPEED_2, CMD_LENGTH_READ_FAN_SPEED_2, 1000000, 1);
+    add(CMD_CODE_MFR_ID, RPB_1600_BLOCK_LENGTH(CMD_LENGTH_MFR_ID), 0, 0, true);
+    add(CMD_CODE_MFR_MODEL, RPB_1600_BLOCK_LENGTH(CMD_LENGTH_MFR_MODEL), 0, 0, true);
+    add(CMD_CODE_MFR_REVISION, RPB_1600_BLOCK_LENGTH(CMD_LENGTH_MFR_REVISION), 0, 0, true);
+    add(CMD_CODE_MFR_LOCATION, RPB_1600_BLOCK_LENGTH(CMD_LENGTH_MFR_LOCATION), 0, 0, true);
+    add(CMD_CODE_MFR_DATE, RPB_1600_BLOCK_LENGTH(CMD_LENGTH_MFR_DATE), 0, 0, true);
+    add(CMD_CODE_MFR_SERIAL, RPB_1600_BLOCK_LENGTH(CMD_LENGTH_MFR_SERIAL), 0, 0, true);
+}
+
+void RPB_1600_Scheduler::setUtilizationBudget(uint8_t percent)
+{
+    if (percent < 1)
+    {
+        percent = 1;
+    }
+    else if (percent > 100)
+    {
+        percent = 100;
+    }
+
+    my_budget_percent = percent;
+}
+
+bool RPB_1600_Scheduler::service(void)
+{
+    uint32_t now = my_charger.getBus()->micros();
+    refill(now);
+
+    // Find the due register with the earliest deadline
+    scheduled_register *next = nullptr;
+
+    for (uint8_t i = 0; i < my_num_entries; i++)
+    {
+        scheduled_register *entry = &my_entries[i];
+
+        // Read once registers are finished after their first good read
+        if (entry->period_us == 0 && entry->valid)
+        {
+            continue;
+        }
+
+        if (!rpb_1600_reached(now, entry->due))
+        {
+            continue;
+        }
+
+        countMissedDeadlines(entry, now);
+
+        if (next == nullptr)
+        {
+            next = entry;
+            continue;
+        }
+
+        int32_t difference = (int32_t)(deadline(entry) - deadline(next));
+
+        if (difference < 0 || (difference == 0 && entry->priority > next->priority))
+        {
+            next = entry;
+        }
+    }
+
+    if (next == nullptr)
+    {
+        return false;
+    }
+
+    // Stay inside the bus utilization budget
+    int32_t cost = estimateReadTime(next->length);
+
+    if (my_credit_us < cost)
+    {
+        return false;
+    }
+
+    my_credit_us -= cost;
+
+    uint8_t data[MAX_RECEIVE_BYTES];
+    rpb_1600_read item = {next->command, next->length, data, false, next->block};
+    my_charger.readMany(&item, 1);
+
+    uint32_t finished = my_charger.getBus()->micros();
+    next->reads++;
+
+    if (item.success)
+    {
+        memcpy(next->data, data, next->length);
+        next->valid = true;
+        next->timestamp = finished;
+    }
+    else
+    {
+        next->failures++;
+    }
+
+    if (next->period_us == 0)
+    {
+        // Back off before trying a failed read again. Its deadline moves with it, so it can't end up
+        // with the earliest deadline and starve the periodic registers.
+        if (!item.success)
+        {
+            uint32_t wait = RPB_1600_SCHEDULER_ONCE_RETRY_US;
+
+            for (uint32_t n = 1; n < next->failures && wait < RPB_1600_SCHEDULER_ONCE_DEADLINE_US; n++)
+            {
+                wait *= 2;
+            }
+
+            next->due = finished + ((wait < RPB_1600_SCHEDULER_ONCE_DEADLINE_US) ? wait : RPB_1600_SCHEDULER_ONCE_DEADLINE_US);
+        }
+
+        return true;
+    }
+
+    if ((int32_t)(finished - deadline(next)) > 0)
+    {
+        next->missed_deadlines++;
+    }
+
+    // Schedule the next read a period after this one was due, unless we've fallen so far behind
+    // that it's already due, in which case start the schedule again from now
+    rpb_1600_advance(&next->due, finished, next->period_us, finished);
+
+    return true;
+}
+
+const scheduled_register *RPB_1600_Scheduler::get(int8_t handle) const
+{
+    if (handle < 0 || handle >= my_num_entries)
+    {
+        return nullptr;
+    }
+
+    return &my_entries[handle];
+}
+
+uint8_t RPB_1600_Scheduler::getNumEntries(void) const
+{
+    return my_num_entries;
+}
+
+uint32_t RPB_1600_Scheduler::getMissedDeadlines(void) const
+{
+    uint32_t total = 0;
+
+    for (uint8_t i = 0; i < my_num_entries; i++)
+    {
+        total += my_entries[i].missed_deadlines;
+    }
+
+    return total;
+}
+
+uint32_t RPB_1600_Scheduler::estimateReadTime(uint8_t length) const
+{
+    // Start, address + command, repeated start, address + response, stop + bus free time.
+    // 9 bit times per byte (8 data bits plus ACK)
+    uint32_t bits = 1 + 9 * 2 + 1 + 9 * (1 + length) + 6;
+    uint32_t clock = my_charger.getBus()->getClock();
+    clock = (clock > 0) ? clock : SCHEDULER_DEFAULT_CLOCK;
+
+    return (bits * 1000000UL + clock - 1) / clock;
+}
+
+void RPB_1600_Scheduler::refill(uint32_t now)
+{
+    uint32_t elapsed = now - my_last_refill;
+    my_last_refill = now;
+
+    // Cap elapsed so the multiplication can't overflow after a long gap
+    if (elapsed > SCHEDULER_BURST_WINDOW_US * 100UL)
+    {
+        elapsed = SCHEDULER_BURST_WINDOW_US * 100UL;
+    }
+
+    my_credit_us += (int32_t)(elapsed * my_budget_percent / 100);
+
+    if (my_credit_us > maxCredit())
+    {
+        my_credit_us = maxCredit();
+    }
+}
+
+int32_t RPB_1600_Scheduler::maxCredit(void) const
+{
+    return (int32_t)(SCHEDULER_BURST_WINDOW_US * my_budget_percent / 100 + estimateReadTime(MAX_RECEIVE_BYTES));
+}
+
+uint32_t RPB_1600_Scheduler::deadline(const scheduled_register *entry)
+{
+    return entry->due + ((entry->period_us > 0) ? entry->period_us : RPB_1600_SCHEDULER_ONCE_DEADLINE_US);
+}
+
+void RPB_1600_Scheduler::countMissedDeadlines(scheduled_register *entry, uint32_t now)
+{
+    if (entry->period_us == 0)
+    {
+        return;
+    }
+
+    int32_t overdue = (int32_t)(now - deadline(entry));
+
+    if (overdue <= 0)
+    {
+        return;
+    }
+
+    // Every period whose deadline has gone by
+    uint32_t missed = (uint32_t)overdue / entry->period_us + 1;
+    entry->missed_deadlines += missed;
+    entry->due += missed * entry->period_us;
+}
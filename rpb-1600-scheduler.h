@@ -0,0 +1,139 @@
+#include "rpb-1600.h"
+
+#ifndef RPB_1600_SCHEDULER_H
+#define RPB_1600_SCHEDULER_H
+
+/**
+ * @brief The most registers one scheduler can poll
+ */
+#define RPB_1600_SCHEDULER_MAX_ENTRIES 16
+
+/**
+ * @brief Deadline given to read-once registers (period 0), so periodic reads win while they're due
+ */
+#define RPB_1600_SCHEDULER_ONCE_DEADLINE_US 1000000
+
+/**
+ * @brief How long a read-once register waits after its first failed read
+ * @details The wait doubles with every failure after that, up to RPB_1600_SCHEDULER_ONCE_DEADLINE_US,
+ * so a register that never answers doesn't crowd out the periodic ones
+ */
+#define RPB_1600_SCHEDULER_ONCE_RETRY_US 10000
+
+/**
+ * @brief A register the scheduler polls, and the latest value it read
+ */
+struct scheduled_register
+{
+    uint8_t command;
+    uint8_t length;
+    // How often to read it, 0 to read it once
+    uint32_t period_us;
+    // Breaks ties between registers with the same deadline, higher goes first
+    uint8_t priority;
+    // An SMBus block read, see rpb_1600_read
+    bool block;
+
+    // Latest response (byte count first for a block read), see rpb-1600-linear.h to decode it
+    uint8_t data[MAX_RECEIVE_BYTES];
+    bool valid;
+    // micros() when data was read
+    uint32_t timestamp;
+
+    uint32_t reads;
+    uint32_t failures;
+    // Deadlines that passed before a read finished, whether the read was late or never happened
+    uint32_t missed_deadlines;
+
+    // When the next read is due
+    uint32_t due;
+};
+
+/**
+ * @brief Earliest-deadline-first polling of individual registers at their own rates
+ * @details Every register has a period, and each read has to happen before the next one is due.
+ * service() reads the due register with the earliest deadline, as long as doing so keeps the bus
+ * under the configured utilization budget (a token bucket of bus time).
+ */
+class RPB_1600_Scheduler
+{
+public:
+    /**
+     * @param charger Must already be Init()ed, and must outlive the scheduler
+     */
+    RPB_1600_Scheduler(RPB_1600 &charger);
+
+    /**
+     * @brief Start polling a register
+     * @param block Read it with an SMBus block read, length includes the byte count (see RPB_1600_BLOCK_LENGTH())
+     * @return A handle for get(), or -1 if the scheduler is full or length is too long
+     */
+    int8_t add(uint8_t commandID, uint8_t length, uint32_t period_us, uint8_t priority = 0, bool block = false);
+
+    /**
+     * @brief VOUT/IOUT at 50Hz, CHG_STATUS at 5Hz, VIN and fan speeds at 1Hz, MFR_* once
+     */
+    void addDefaultSchedule(void);
+
+    /**
+     * @brief Cap the fraction of bus time the scheduler may use, 1 to 100 (defaults to 50)
+     */
+    void setUtilizationBudget(uint8_t percent);
+
+    /**
+     * @brief Call this often from loop(). Reads at most one register.
+     * @return true if a register was read
+     */
+    bool service(void);
+
+    const scheduled_register *get(int8_t handle) const;
+    uint8_t getNumEntries(void) const;
+
+    /**
+     * @brief Missed deadlines summed over every register
+     */
+    uint32_t getMissedDeadlines(void) const;
+
+    /**
+     * @brief The estimated bus time of a read of length bytes at the current clock
+     * @details The clock is read from the charger's bus, so it follows calibrateClock() and automatic
+     * clock changes
+     */
+    uint32_t estimateReadTime(uint8_t length) const;
+
+private:
+    RPB_1600 &my_charger;
+    scheduled_register my_entries[RPB_1600_SCHEDULER_MAX_ENTRIES];
+    uint8_t my_num_entries;
+
+    uint8_t my_budget_percent;
+
+    /**
+     * @brief Token bucket of bus time we're allowed to use, in microseconds
+     */
+    int32_t my_credit_us;
+    uint32_t my_last_refill;
+
+    /**
+     * @brief Add the bus time earned since the last call to the token bucket
+     */
+    void refill(uint32_t now);
+
+    /**
+     * @brief The most bus time the token bucket can hold
+     */
+    int32_t maxCredit(void) const;
+
+    /**
+     * @brief When a register's current read has to be done by
+     */
+    static uint32_t deadline(const scheduled_register *entry);
+
+    /**
+     * @brief Count the deadlines of a periodic register that have gone by without a read
+     * @details Moves the register on to its current period, it stays due
+     */
+    static void countMissedDeadlines(scheduled_register *entry, uint32_t now);
+};
+
+#endif // RPB_1600_SCHEDULER_H
@@ -0,0 +1,151 @@
+#include "rpb-1600-settle.h"
+#include <string.h>
+
+RPB_1600_SettleTracker::RPB_1600_SettleTracker()
+{
+    reset();
+}
+
+void RPB_1600_SettleTracker::record(uint8_t commandID, uint32_t settle_us)
+{
+    settle_entry *entry = findOrAddEntry(commandID);
+
+    if (entry == nullptr)
+    {
+        return;
+    }
+
+    entry->confirmed++;
+    addSample(entry, settle_us);
+}
+
+void RPB_1600_SettleTracker::recordUpperBound(uint8_t commandID, uint32_t settle_us)
+{
+    settle_entry *entry = findOrAddEntry(commandID);
+
+    if (entry == nullptr)
+    {
+        return;
+    }
+
+    entry->confirmed++;
+
+    if (entry->num_samples == 0 || settle_us < percentile(entry, 50))
+    {
+        addSample(entry, settle_us);
+    }
+}
+
+void RPB_1600_SettleTracker::recordTimeout(uint8_t commandID)
+{
+    settle_entry *entry = findOrAddEntry(commandID);
+
+    if (entry != nullptr)
+    {
+        entry->timeouts++;
+    }
+}
+
+uint32_t RPB_1600_SettleTracker::getExpectedSettle(uint8_t commandID) const
+{
+    const settle_entry *entry = findEntry(commandID);
+
+    if (entry == nullptr || entry->num_samples == 0)
+    {
+        return 0;
+    }
+
+    return percentile(entry, 50);
+}
+
+bool RPB_1600_SettleTracker::getStats(uint8_t commandID, rpb_1600_settle_stats *stats) const
+{
+    const settle_entry *entry = findEntry(commandID);
+
+    if (entry == nullptr)
+    {
+        return false;
+    }
+
+    stats->command = commandID;
+    stats->confirmed = entry->confirmed;
+    stats->timeouts = entry->timeouts;
+    stats->p50_us = percentile(entry, 50);
+    stats->p99_us = percentile(entry, 99);
+    stats->max_us = percentile(entry, 100);
+
+    return true;
+}
+
+void RPB_1600_SettleTracker::reset(void)
+{
+    memset(my_entries, 0, sizeof(my_entries));
+    my_num_entries = 0;
+}
+
+const RPB_1600_SettleTracker::settle_entry *RPB_1600_SettleTracker::findEntry(uint8_t commandID) const
+{
+    for (uint8_t i = 0; i < my_num_entries; i++)
+    {
+        if (my_entries[i].command == commandID)
+        {
+            return &my_entries[i];
+        }
+    }
+
+    return nullptr;
+}
+
+RPB_1600_SettleTracker::settle_entry *RPB_1600_SettleTracker::findOrAddEntry(uint8_t commandID)
+{
+    settle_entry *entry = const_cast<settle_entry *>(findEntry(commandID));
+
+    if (entry == nullptr && my_num_entries < RPB_1600_SETTLE_COMMANDS)
+    {
+        entry = &my_entries[my_num_entries++];
+        entry->command = commandID;
+    }
+
+    return entry;
+}
+
+void RPB_1600_SettleTracker::addSample(settle_entry *entry, uint32_t settle_us)
+{
+    entry->samples[entry->next_sample] = settle_us;
+    entry->next_sample = (entry->next_sample + 1) % RPB_1600_SETTLE_SAMPLES;
+
+    if (entry->num_samples < RPB_1600_SETTLE_SAMPLES)
+    {
+        entry->num_samples++;
+    }
+}
+
+uint32_t RPB_1600_SettleTracker::percentile(const settle_entry *entry, uint8_t percent)
+{
+    if (entry->num_samples == 0)
+    {
+        return 0;
+    }
+
+    // Insertion sort a copy, there are only a handful of samples
+    uint32_t sorted[RPB_1600_SETTLE_SAMPLES];
+    uint8_t count = entry->num_samples;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint32_t value = entry->samples[i];
+        uint8_t j = i;
+
+        while (j > 0 && sorted[j - 1] > value)
+        {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+
+        sorted[j] = value;
+    }
+
+    uint16_t rank = (percent * count + 99) / 100;
+
+    return sorted[(rank > 0) ? rank - 1 : 0];
+}
@@ -0,0 +1,105 @@
+#include <stdint.h>
+
+#ifndef RPB_1600_SETTLE_H
+#define RPB_1600_SETTLE_H
+
+/**
+ * @brief The number of registers the tracker keeps settle times for
+ */
+#define RPB_1600_SETTLE_COMMANDS 8
+
+/**
+ * @brief How many of the most recent settle times are kept per register, percentiles are over these
+ */
+#define RPB_1600_SETTLE_SAMPLES 32
+
+struct rpb_1600_settle_stats
+{
+    uint8_t command;
+    // Confirmed writes, and writes that never read back within their timeout
+    uint32_t confirmed;
+    uint32_t timeouts;
+    // Over the last RPB_1600_SETTLE_SAMPLES measured settle times, from the end of the write to halfway
+    // between the last readback of the old value and the first one of the new value. Writes whose
+    // first readback already matched only count if they show the median is too high, see recordUpperBound().
+    uint32_t p50_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+};
+
+/**
+ * @brief Learns how long each register takes to settle after a write, see RPB_1600::attachSettleTracker()
+ * @details Confirmed writes to a register with a history first look for the new value just before its
+ * median settle time, rather than starting from the shortest backoff.
+ */
+class RPB_1600_SettleTracker
+{
+public:
+    RPB_1600_SettleTracker();
+
+    /**
+     * @brief Add a settle time for commandID. Registers past the first RPB_1600_SETTLE_COMMANDS aren't tracked.
+     */
+    void record(uint8_t commandID, uint32_t settle_us);
+
+    /**
+     * @brief Count a write to commandID that matched on its first readback, settle_us after the write
+     * @details It settled no later than that, but could have been any time before. That's only kept
+     * as a sample if there's no history yet or it's under the median, so it can pull an estimate
+     * that's too high back down, but never push one up.
+     */
+    void recordUpperBound(uint8_t commandID, uint32_t settle_us);
+
+    /**
+     * @brief Count a write to commandID that never read back
+     */
+    void recordTimeout(uint8_t commandID);
+
+    /**
+     * @brief The median settle time of commandID, or 0 if there's no history for it
+     */
+    uint32_t getExpectedSettle(uint8_t commandID) const;
+
+    /**
+     * @return false if there's no history for commandID
+     */
+    bool getStats(uint8_t commandID, rpb_1600_settle_stats *stats) const;
+
+    /**
+     * @brief Forget everything
+     */
+    void reset(void);
+
+private:
+    struct settle_entry
+    {
+        uint8_t command;
+        uint8_t num_samples;
+        uint8_t next_sample;
+        uint32_t confirmed;
+        uint32_t timeouts;
+        uint32_t samples[RPB_1600_SETTLE_SAMPLES];
+    };
+
+    settle_entry my_entries[RPB_1600_SETTLE_COMMANDS];
+    uint8_t my_num_entries;
+
+    const settle_entry *findEntry(uint8_t commandID) const;
+
+    /**
+     * @brief Find commandID's entry, or start one if there's room
+     */
+    settle_entry *findOrAddEntry(uint8_t commandID);
+
+    /**
+     * @brief Add a settle time to an entry's samples
+     */
+    static void addSample(settle_entry *entry, uint32_t settle_us);
+
+    /**
+     * @brief Nearest-rank percentile of an entry's samples
+     */
+    static uint32_t percentile(const settle_entry *entry, uint8_t percent);
+};
+
+#endif // RPB_1600_SETTLE_H
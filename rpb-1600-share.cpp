@@ -0,0 +1,275 @@
+#include "rpb-1600-share.h"
+#include "rpb-1600-commands.h"
+#include "rpb-1600-linear.h"
+#include "rpb-1600-time.h"
+#include <string.h>
+
+RPB_1600_CurrentShare::RPB_1600_CurrentShare(RPB_1600_Fleet &fleet) : my_fleet(fleet)
+{
+    memset(my_units, 0, sizeof(my_units));
+    memset(&my_stats, 0, sizeof(my_stats));
+}
+
+bool RPB_1600_CurrentShare::begin(void)
+{
+    bool success = true;
+
+    memset(my_units, 0, sizeof(my_units));
+
+    for (uint8_t i = 0; i < my_fleet.getNumUnits(); i++)
+    {
+        uint8_t data[2] = {0, 0};
+
+        if (!my_fleet.getUnit(i)->writeTwoBytes(CMD_CODE_VOUT_TRIM, data))
+        {
+            my_units[i].write_failures++;
+            success = false;
+        }
+    }
+
+    my_next_write = 0;
+    my_next_step = now();
+
+    return success;
+}
+
+void RPB_1600_CurrentShare::setGains(float kp, float ki)
+{
+    my_kp = kp;
+    my_ki = ki;
+}
+
+void RPB_1600_CurrentShare::setSlewLimit(float voltsPerSecond)
+{
+    my_slew = voltsPerSecond;
+}
+
+void RPB_1600_CurrentShare::setTrimLimit(float volts)
+{
+    my_trim_limit = volts;
+}
+
+void RPB_1600_CurrentShare::setDeadband(float amps)
+{
+    my_deadband = amps;
+}
+
+void RPB_1600_CurrentShare::setPeriod(uint32_t period_us)
+{
+    my_period_us = period_us;
+}
+
+void RPB_1600_CurrentShare::setBudget(uint32_t budget_us)
+{
+    my_budget_us = budget_us;
+}
+
+bool RPB_1600_CurrentShare::service(void)
+{
+    uint32_t start = now();
+    uint32_t jitter;
+
+    if (!rpb_1600_is_due(start, &my_next_step, my_period_us, &jitter))
+    {
+        return false;
+    }
+
+    my_stats.last_jitter_us = jitter;
+    my_stats.total_jitter_us += jitter;
+
+    if (jitter > my_stats.max_jitter_us)
+    {
+        my_stats.max_jitter_us = jitter;
+    }
+
+    step();
+
+    return true;
+}
+
+void RPB_1600_CurrentShare::step(void)
+{
+    uint8_t num_units = my_fleet.getNumUnits();
+
+    if (num_units == 0)
+    {
+        return;
+    }
+
+    uint32_t start = now();
+    float dt = my_period_us / 1000000.0f;
+
+    // Read every unit's current, nothing else
+    float total = 0;
+    float minimum = 0;
+    float maximum = 0;
+    uint8_t num_valid = 0;
+    // The mean only counts units the loop can still move
+    float sharing_total = 0;
+    uint8_t num_sharing = 0;
+
+    for (uint8_t i = 0; i < num_units; i++)
+    {
+        share_unit *unit = &my_units[i];
+        uint8_t raw[CMD_LENGTH_READ_IOUT];
+        rpb_1600_read item = {CMD_CODE_READ_IOUT, CMD_LENGTH_READ_IOUT, raw, false, false};
+
+        unit->valid = my_fleet.getUnit(i)->readMany(&item, 1) == 1;
+
+        if (!unit->valid)
+        {
+            unit->read_failures++;
+            continue;
+        }
+
+        unit->i_out = linear11_to_float(linear_word(raw));
+        total += unit->i_out;
+        minimum = (num_valid == 0 || unit->i_out < minimum) ? unit->i_out : minimum;
+        maximum = (num_valid == 0 || unit->i_out > maximum) ? unit->i_out : maximum;
+        num_valid++;
+
+        if (!unit->saturated)
+        {
+            sharing_total += unit->i_out;
+            num_sharing++;
+        }
+    }
+
+    my_stats.spread = maximum - minimum;
+
+    // Work out the new trims. There's nothing to balance against with fewer than two units.
+    if (num_valid >= 2)
+    {
+        float mean = (num_sharing >= 2) ? sharing_total / num_sharing : total / num_valid;
+        float max_step = my_slew * dt;
+
+        for (uint8_t i = 0; i < num_units; i++)
+        {
+            share_unit *unit = &my_units[i];
+
+            if (!unit->valid)
+            {
+                continue;
+            }
+
+            float error = mean - unit->i_out;
+
+            if (error < my_deadband && error > -my_deadband)
+            {
+                error = 0;
+            }
+
+            // Hold a saturated unit until its error turns around
+            bool pushing_up = error > 0;
+
+            if (unit->saturated && (unit->trim > 0) == pushing_up)
+            {
+                unit->error = error;
+                continue;
+            }
+
+            float change = my_kp * (error - unit->error) + my_ki * error * dt;
+            unit->error = error;
+
+            change = (change > max_step) ? max_step : (change < -max_step) ? -max_step : change;
+            float trim = unit->trim + change;
+            unit->saturated = error != 0 && (trim >= my_trim_limit || trim <= -my_trim_limit);
+            unit->trim = (trim > my_trim_limit) ? my_trim_limit : (trim < -my_trim_limit) ? -my_trim_limit : trim;
+
+            unit->write_pending |= encodeTrim(unit->trim) != unit->trim_written;
+        }
+    }
+
+    // Send the writes that are needed, starting with any the last iteration didn't get to
+    uint8_t first = (my_next_write < num_units) ? my_next_write : 0;
+    uint8_t num_written = 0;
+
+    for (uint8_t n = 0; n < num_units; n++)
+    {
+        uint8_t i = (first + n) % num_units;
+
+        if (!my_units[i].write_pending)
+        {
+            continue;
+        }
+
+        // At least one write goes out, so a budget the reads alone use up can't stall the loop
+        if (my_budget_us > 0 && num_written > 0 && now() - start >= my_budget_us)
+        {
+            // Out of time, these go first next iteration
+            my_next_write = i;
+
+            for (uint8_t m = n; m < num_units; m++)
+            {
+                my_stats.deferred_writes += my_units[(first + m) % num_units].write_pending ? 1 : 0;
+            }
+
+            break;
+        }
+
+        writeTrim(i);
+        num_written++;
+    }
+
+    uint32_t duration = now() - start;
+    my_stats.iterations++;
+    my_stats.last_duration_us = duration;
+    my_stats.total_duration_us += duration;
+
+    if (duration > my_stats.max_duration_us)
+    {
+        my_stats.max_duration_us = duration;
+    }
+
+    if (my_budget_us > 0 && duration > my_budget_us)
+    {
+        my_stats.overruns++;
+    }
+}
+
+const share_unit *RPB_1600_CurrentShare::getUnit(uint8_t index) const
+{
+    return (index < my_fleet.getNumUnits()) ? &my_units[index] : nullptr;
+}
+
+const share_stats *RPB_1600_CurrentShare::getStats(void) const
+{
+    return &my_stats;
+}
+
+void RPB_1600_CurrentShare::resetStats(void)
+{
+    memset(&my_stats, 0, sizeof(my_stats));
+}
+
+uint32_t RPB_1600_CurrentShare::now(void)
+{
+    RPB_1600 *first = my_fleet.getUnit(0);
+
+    return (first != nullptr) ? first->getBus()->micros() : 0;
+}
+
+void RPB_1600_CurrentShare::writeTrim(uint8_t index)
+{
+    share_unit *unit = &my_units[index];
+    int16_t value = encodeTrim(unit->trim);
+    uint8_t data[2] = {(uint8_t)(value & 0x00FF), (uint8_t)((uint16_t)value >> 8)};
+
+    unit->write_pending = false;
+    my_stats.writes++;
+
+    if (!my_fleet.getUnit(index)->writeTwoBytes(CMD_CODE_VOUT_TRIM, data))
+    {
+        unit->write_failures++;
+        unit->write_pending = true;
+        return;
+    }
+
+    unit->trim_written = value;
+}
+
+int16_t RPB_1600_CurrentShare::encodeTrim(float volts)
+{
+    // VOUT_TRIM is a signed Linear16 value
+    return (int16_t)linear_round_clamp(volts / linear16_to_float(1, CMD_N_VALUE_VOUT_TRIM), INT16_MIN, INT16_MAX);
+}
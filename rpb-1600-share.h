@@ -0,0 +1,176 @@
+#include "rpb-1600-fleet.h"
+
+#ifndef RPB_1600_SHARE_H
+#define RPB_1600_SHARE_H
+
+/**
+ * @brief Default loop settings, see the setters in RPB_1600_CurrentShare
+ */
+#define RPB_1600_SHARE_DEFAULT_PERIOD_US 100000
+#define RPB_1600_SHARE_DEFAULT_KP 0.0f
+#define RPB_1600_SHARE_DEFAULT_KI 0.02f
+#define RPB_1600_SHARE_DEFAULT_SLEW 0.5f
+#define RPB_1600_SHARE_DEFAULT_TRIM_LIMIT 0.5f
+
+/**
+ * @brief What the loop knows about one charger
+ */
+struct share_unit
+{
+    // Latest READ_IOUT, amps
+    float i_out;
+    // The trim the loop wants, volts. What's on the charger is this rounded to the VOUT_TRIM resolution.
+    float trim;
+    // The VOUT_TRIM value last written, in units of 2^CMD_N_VALUE_VOUT_TRIM volts
+    int16_t trim_written;
+    // The mean current minus this unit's current, last iteration
+    float error;
+    // false if READ_IOUT failed last iteration, the unit is left out until it reads again
+    bool valid;
+    // Held at the trim limit and left out of the mean, e.g. a unit that's turned off. It rejoins
+    // once its current comes back past the mean.
+    bool saturated;
+    // A trim change waiting to be written, because an iteration ran out of time (see setBudget())
+    // or the write failed
+    bool write_pending;
+    uint32_t read_failures;
+    uint32_t write_failures;
+};
+
+/**
+ * @brief How well the loop is keeping time
+ */
+struct share_stats
+{
+    uint32_t iterations;
+    // Iterations that took longer than the budget
+    uint32_t overruns;
+    // VOUT_TRIM writes sent, and ones put off to the next iteration by the budget
+    uint32_t writes;
+    uint32_t deferred_writes;
+
+    // How late each iteration started compared to its schedule
+    uint32_t last_jitter_us;
+    uint32_t max_jitter_us;
+    uint64_t total_jitter_us;
+
+    // How long each iteration kept the bus busy, reads and writes
+    uint32_t last_duration_us;
+    uint32_t max_duration_us;
+    uint64_t total_duration_us;
+
+    // Largest minus smallest current of the units read last iteration
+    float spread;
+};
+
+/**
+ * @brief Balances the output current of paralleled chargers by trimming their output voltage
+ * @details Each iteration reads READ_IOUT from every charger in the fleet, works out how far each one
+ * is from the mean, and nudges its VOUT_TRIM with a PI controller (velocity form, so the slew limit
+ * and trim limit apply directly to the change). A unit carrying less than its share has its voltage
+ * raised. VOUT_TRIM is only written when the new trim rounds to a different register value, so a
+ * balanced fleet costs one two byte read per charger per iteration.
+ *
+ * Trimming only moves the current while the chargers are regulating voltage (CV and float, or plain
+ * power supply use). In CC each unit is already held to CURVE_CC, so the errors stay small there.
+ * Don't poll the fleet with beginPoll() while the loop runs, both use the buses.
+ */
+class RPB_1600_CurrentShare
+{
+public:
+    /**
+     * @param fleet discover() (or addUnit()) first, and don't change the units while the loop runs
+     */
+    RPB_1600_CurrentShare(RPB_1600_Fleet &fleet);
+
+    /**
+     * @brief Zero every charger's VOUT_TRIM and start the schedule from now
+     * @return false if any of the writes failed
+     */
+    bool begin(void);
+
+    /**
+     * @brief The PI gains
+     * @param kp Volts of trim per amp change in a unit's error
+     * @param ki Volts of trim per amp of error per second
+     */
+    void setGains(float kp, float ki);
+
+    /**
+     * @brief The fastest a unit's trim may move, volts per second
+     */
+    void setSlewLimit(float voltsPerSecond);
+
+    /**
+     * @brief The most trim the loop may apply in either direction, volts
+     */
+    void setTrimLimit(float volts);
+
+    /**
+     * @brief Errors smaller than this are treated as 0, amps (0 by default)
+     * @details READ_IOUT is coarse, a deadband of about one step stops the loop hunting between two values
+     */
+    void setDeadband(float amps);
+
+    /**
+     * @brief Time between iterations (defaults to RPB_1600_SHARE_DEFAULT_PERIOD_US)
+     */
+    void setPeriod(uint32_t period_us);
+
+    /**
+     * @brief The most bus time one iteration may take, 0 for no limit (the default)
+     * @details The reads always happen. Once the budget is used up the remaining trim writes wait
+     * for the next iteration, which starts with them. At least one write goes out every iteration.
+     */
+    void setBudget(uint32_t budget_us);
+
+    /**
+     * @brief Call this often from loop(). Runs an iteration when one is due.
+     * @return true if it ran one
+     */
+    bool service(void);
+
+    /**
+     * @brief Run one iteration right now, off schedule
+     */
+    void step(void);
+
+    const share_unit *getUnit(uint8_t index) const;
+    const share_stats *getStats(void) const;
+    void resetStats(void);
+
+private:
+    RPB_1600_Fleet &my_fleet;
+    share_unit my_units[RPB_1600_FLEET_MAX_UNITS];
+    share_stats my_stats;
+
+    float my_kp = RPB_1600_SHARE_DEFAULT_KP;
+    float my_ki = RPB_1600_SHARE_DEFAULT_KI;
+    float my_slew = RPB_1600_SHARE_DEFAULT_SLEW;
+    float my_trim_limit = RPB_1600_SHARE_DEFAULT_TRIM_LIMIT;
+    float my_deadband = 0;
+    uint32_t my_period_us = RPB_1600_SHARE_DEFAULT_PERIOD_US;
+    uint32_t my_budget_us = 0;
+
+    // When the next iteration is due
+    uint32_t my_next_step = 0;
+    // Where the next iteration starts writing, so deferred writes go first
+    uint8_t my_next_write = 0;
+
+    /**
+     * @brief The clock the loop runs on, the first charger's bus
+     */
+    uint32_t now(void);
+
+    /**
+     * @brief Send a unit's trim to VOUT_TRIM, it stays pending for the next iteration if the write fails
+     */
+    void writeTrim(uint8_t index);
+
+    /**
+     * @brief A trim in volts as a VOUT_TRIM value
+     */
+    static int16_t encodeTrim(float volts);
+};
+
+#endif // RPB_1600_SHARE_H
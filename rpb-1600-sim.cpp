@@ -0,0 +1,1277 @@
+#include "rpb-1600-sim.h"
+#include "rpb-1600-commands.h"
+#include "rpb-1600-linear.h"
+#include "rpb-1600-crc.h"
+#include <string.h>
+
+#if defined(__linux__) && !defined(ARDUINO)
+#include <errno.h>
+#include <chrono>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#endif
+
+// Bit times for the parts of a transaction that aren't data bytes
+#define SIM_BITS_PER_BYTE 9
+#define SIM_BITS_START 1
+#define SIM_BITS_STOP 6
+
+// CHG_STATUS bits, the ones RPB_1600::parseChargeStatus() reads
+#define SIM_CHG_FULLY_CHARGED 0x0001
+#define SIM_CHG_CC_MODE 0x0002
+#define SIM_CHG_CV_MODE 0x0004
+#define SIM_CHG_FLOAT_MODE 0x0008
+#define SIM_CHG_EEPROM_ERROR 0x0100
+#define SIM_CHG_SENSOR_SHORT 0x0400
+#define SIM_CHG_BATTERY_DETECTED 0x0800
+#define SIM_CHG_CC_TIMEOUT 0x2000
+#define SIM_CHG_CV_TIMEOUT 0x4000
+#define SIM_CHG_FLOAT_TIMEOUT 0x8000
+
+// CURVE_CONFIG bits, the ones RPB_1600::parseCurveConfig() reads
+#define SIM_CONFIG_TEMP_COMP_MASK 0x000C
+#define SIM_CONFIG_TEMP_COMP_SHIFT 2
+#define SIM_CONFIG_TWO_STAGE 0x0040
+#define SIM_CONFIG_CC_TIMEOUT 0x0100
+#define SIM_CONFIG_CV_TIMEOUT 0x0200
+#define SIM_CONFIG_FLOAT_TIMEOUT 0x0400
+
+// STATUS_WORD bits the simulator sets
+#define SIM_STATUS_OFF 0x0040
+#define SIM_STATUS_POWER_GOOD_NEGATED 0x0800
+
+/**
+ * @brief A detail status register and the STATUS_WORD bits it sets
+ */
+struct sim_status_summary
+{
+    uint8_t command;
+    // Set whenever the detail register isn't 0
+    uint16_t summary;
+    // Set as well when any of fault_bits are
+    uint8_t fault_bits;
+    uint16_t fault_summary;
+};
+
+static const sim_status_summary sim_status_summaries[] = {
+    // VOUT_OV_FAULT
+    {CMD_CODE_STATUS_VOUT, 0x8000, 0x80, 0x0020},
+    // IOUT_OC_FAULT
+    {CMD_CODE_STATUS_IOUT, 0x4000, 0x80, 0x0010},
+    // VIN_UV_FAULT
+    {CMD_CODE_STATUS_INPUT, 0x2000, 0x10, 0x0008},
+    {CMD_CODE_STATUS_TEMPERATURE, 0x0004, 0, 0},
+    {CMD_CODE_STATUS_CML, 0x0002, 0, 0},
+    {CMD_CODE_STATUS_MFR_SPECIFIC, 0x1000, 0, 0},
+    {CMD_CODE_STATUS_FANS_1_2, 0x0400, 0, 0},
+};
+
+#define SIM_NUM_STATUS_SUMMARIES (sizeof(sim_status_summaries) / sizeof(sim_status_summaries[0]))
+
+// Temperature compensation for each CURVE_CONFIG setting, in mV per degree C per cell away from 25C
+static const float sim_temp_compensation[4] = {0.0f, -3.0f, -4.0f, -5.0f};
+
+//----------------------------------------------------------------------
+// Command table
+//----------------------------------------------------------------------
+
+struct sim_register_info
+{
+    uint8_t code;
+    uint8_t length;
+    bool writable;
+    // Read with an SMBus block read, the byte count goes out before the length bytes
+    bool block;
+};
+
+// Every command in rpb-1600-commands.h, in the same order
+static const sim_register_info sim_registers[RPB_1600_SIM_NUM_REGISTERS] = {
+    {CMD_CODE_OPERATION, CMD_LENGTH_OPERATION, true, false},
+    {CMD_CODE_ON_OFF_CONFIG, CMD_LENGTH_ON_OFF_CONFIG, true, false},
+    {CMD_CODE_CAPABILITY, CMD_LENGTH_CAPABILITY, false, false},
+    {CMD_CODE_VOUT_MODE, CMD_LENGTH_VOUT_MODE, false, false},
+    {CMD_CODE_VOUT_COMMAND, CMD_LENGTH_VOUT_COMMAND, true, false},
+    {CMD_CODE_VOUT_TRIM, CMD_LENGTH_VOUT_TRIM, true, false},
+    {CMD_CODE_IOUT_OC_FAULT_LIMIT, CMD_LENGTH_IOUT_OC_FAULT_LIMIT, true, false},
+    {CMD_CODE_IOUT_OC_FAULT_RESPONSE, CMD_LENGTH_IOUT_OC_FAULT_RESPONSE, false, false},
+    {CMD_CODE_STATUS_WORD, CMD_LENGTH_STATUS_WORD, false, false},
+    {CMD_CODE_STATUS_VOUT, CMD_LENGTH_STATUS_VOUT, false, false},
+    {CMD_CODE_STATUS_IOUT, CMD_LENGTH_STATUS_IOUT, false, false},
+    {CMD_CODE_STATUS_INPUT, CMD_LENGTH_STATUS_INPUT, false, false},
+    {CMD_CODE_STATUS_TEMPERATURE, CMD_LENGTH_STATUS_TEMPERATURE, false, false},
+    {CMD_CODE_STATUS_CML, CMD_LENGTH_STATUS_CML, false, false},
+    {CMD_CODE_STATUS_MFR_SPECIFIC, CMD_LENGTH_STATUS_MFR_SPECIFIC, false, false},
+    {CMD_CODE_STATUS_FANS_1_2, CMD_LENGTH_STATUS_FANS_1_2, false, false},
+    {CMD_CODE_READ_VIN, CMD_LENGTH_READ_VIN, false, false},
+    {CMD_CODE_READ_VOUT, CMD_LENGTH_READ_VOUT, false, false},
+    {CMD_CODE_READ_IOUT, CMD_LENGTH_READ_IOUT, false, false},
+    {CMD_CODE_READ_FAN_SPEED_1, CMD_LENGTH_READ_FAN_SPEED_1, false, false},
+    {CMD_CODE_READ_FAN_SPEED_2, CMD_LENGTH_READ_FAN_SPEED_2, false, false},
+    {CMD_CODE_PMBUS_REVISION, CMD_LENGTH_PMBUS_REVISION, false, false},
+    {CMD_CODE_MFR_ID, CMD_LENGTH_MFR_ID, false, true},
+    {CMD_CODE_MFR_MODEL, CMD_LENGTH_MFR_MODEL, false, true},
+    {CMD_CODE_MFR_REVISION, CMD_LENGTH_MFR_REVISION, false, true},
+    {CMD_CODE_MFR_LOCATION, CMD_LENGTH_MFR_LOCATION, false, true},
+    {CMD_CODE_MFR_DATE, CMD_LENGTH_MFR_DATE, false, true},
+    {CMD_CODE_MFR_SERIAL, CMD_LENGTH_MFR_SERIAL, false, true},
+    {CMD_CODE_CURVE_CC, CMD_LENGTH_CURVE_CC, true, false},
+    {CMD_CODE_CURVE_CV, CMD_LENGTH_CURVE_CV, true, false},
+    {CMD_CODE_CURVE_FV, CMD_LENGTH_CURVE_FV, true, false},
+    {CMD_CODE_CURVE_TC, CMD_LENGTH_CURVE_TC, true, false},
+    {CMD_CODE_CURVE_CONFIG, CMD_LENGTH_CURVE_CONFIG, true, false},
+    {CMD_CODE_CURVE_CC_TIMEOUT, CMD_LENGTH_CURVE_CC_TIMEOUT, true, false},
+    {CMD_CODE_CURVE_CV_TIMEOUT, CMD_LENGTH_CURVE_CV_TIMEOUT, true, false},
+    {CMD_CODE_CURVE_FLOAT_TIMEOUT, CMD_LENGTH_CURVE_FLOAT_TIMEOUT, true, false},
+    {CMD_CODE_CHG_STATUS, CMD_LENGTH_CHG_STATUS, false, false},
+};
+
+//----------------------------------------------------------------------
+// RPB_1600_SimulatedCharger
+//----------------------------------------------------------------------
+
+RPB_1600_SimulatedCharger::RPB_1600_SimulatedCharger(uint8_t address) : my_address(address)
+{
+    reset();
+}
+
+uint8_t RPB_1600_SimulatedCharger::getAddress(void) const
+{
+    return my_address;
+}
+
+void RPB_1600_SimulatedCharger::reset(void)
+{
+    memset(my_registers, 0, sizeof(my_registers));
+    memset(my_pending, 0, sizeof(my_pending));
+
+    uint8_t on = 0x80;
+    setRegister(CMD_CODE_OPERATION, &on, CMD_LENGTH_OPERATION);
+    uint8_t capability = 0x20;
+    setRegister(CMD_CODE_CAPABILITY, &capability, CMD_LENGTH_CAPABILITY);
+    // Linear mode with N = -9 in the low 5 bits
+    uint8_t vout_mode = CMD_N_VALUE_VOUT_MODE & 0x1F;
+    setRegister(CMD_CODE_VOUT_MODE, &vout_mode, CMD_LENGTH_VOUT_MODE);
+    uint8_t pmbus_revision = 0x11;
+    setRegister(CMD_CODE_PMBUS_REVISION, &pmbus_revision, CMD_LENGTH_PMBUS_REVISION);
+
+    // Voltages are plain 16 bit mantissas scaled by 2^-9 (see VOUT_MODE)
+    setWord(CMD_CODE_VOUT_COMMAND, 24 * 512);
+    setWord(CMD_CODE_READ_VOUT, 14131); // 27.6V
+    setWord(CMD_CODE_CURVE_CV, 14746);  // 28.8V
+    setWord(CMD_CODE_CURVE_FV, 14131);  // 27.6V
+
+    setWord(CMD_CODE_IOUT_OC_FAULT_LIMIT, linear11_pack(CMD_N_VALUE_IOUT_OC_FAULT_LIMIT, 55 * 4));
+    setWord(CMD_CODE_READ_VIN, linear11_pack(CMD_N_VALUE_READ_VIN, 230 * 2));
+    setWord(CMD_CODE_READ_IOUT, linear11_pack(CMD_N_VALUE_READ_IOUT, 10 * 4));
+    setWord(CMD_CODE_READ_FAN_SPEED_1, linear11_pack(CMD_N_VALUE_READ_FAN_SPEED_1, 5000 / 32));
+    setWord(CMD_CODE_READ_FAN_SPEED_2, linear11_pack(CMD_N_VALUE_READ_FAN_SPEED_2, 5000 / 32));
+    setWord(CMD_CODE_CURVE_CC, linear11_pack(CMD_N_VALUE_CURVE_CC, 50 * 4));
+    setWord(CMD_CODE_CURVE_TC, linear11_pack(CMD_N_VALUE_CURVE_TC, 5 * 4));
+    setWord(CMD_CODE_CURVE_CC_TIMEOUT, linear11_pack(CMD_N_VALUE_CURVE_CC_TIMEOUT, 600));
+    setWord(CMD_CODE_CURVE_CV_TIMEOUT, linear11_pack(CMD_N_VALUE_CURVE_CV_TIMEOUT, 480));
+    setWord(CMD_CODE_CURVE_FLOAT_TIMEOUT, linear11_pack(CMD_N_VALUE_CURVE_FLOAT_TIMEOUT, 600));
+
+    // Custom curve, -3mV/C/cell temperature compensation, 3 stage
+    setWord(CMD_CODE_CURVE_CONFIG, 0x0004);
+    // In CC mode, battery detected
+    setWord(CMD_CODE_CHG_STATUS, 0x0802);
+
+    setRegister(CMD_CODE_MFR_ID, (const uint8_t *)"MEAN WELL   ", CMD_LENGTH_MFR_ID);
+    setRegister(CMD_CODE_MFR_MODEL, (const uint8_t *)"RPB-1600-24 ", CMD_LENGTH_MFR_MODEL);
+    setRegister(CMD_CODE_MFR_REVISION, (const uint8_t *)"A01   ", CMD_LENGTH_MFR_REVISION);
+    setRegister(CMD_CODE_MFR_LOCATION, (const uint8_t *)"SIM", CMD_LENGTH_MFR_LOCATION);
+    setRegister(CMD_CODE_MFR_DATE, (const uint8_t *)"230101", CMD_LENGTH_MFR_DATE);
+    setRegister(CMD_CODE_MFR_SERIAL, (const uint8_t *)"SIM00000000", CMD_LENGTH_MFR_SERIAL);
+    my_registers[findRegister(CMD_CODE_MFR_SERIAL)][CMD_LENGTH_MFR_SERIAL - 1] = '0' + (my_address & 0x07);
+
+    updateStatusWord();
+}
+
+bool RPB_1600_SimulatedCharger::setRegister(uint8_t commandID, const uint8_t *data, uint8_t length)
+{
+    int8_t index = findRegister(commandID);
+
+    if (index < 0 || sim_registers[index].length != length)
+    {
+        return false;
+    }
+
+    memcpy(my_registers[index], data, length);
+
+    return true;
+}
+
+bool RPB_1600_SimulatedCharger::setWord(uint8_t commandID, uint16_t value)
+{
+    uint8_t data[2] = {(uint8_t)(value & 0x00FF), (uint8_t)(value >> 8)};
+
+    return setRegister(commandID, data, 2);
+}
+
+uint8_t RPB_1600_SimulatedCharger::getRegister(uint8_t commandID, uint8_t *data) const
+{
+    int8_t index = findRegister(commandID);
+
+    if (index < 0)
+    {
+        return 0;
+    }
+
+    memcpy(data, my_registers[index], sim_registers[index].length);
+
+    return sim_registers[index].length;
+}
+
+uint8_t RPB_1600_SimulatedCharger::handleWrite(const uint8_t *data, uint8_t length)
+{
+    if (length < 1)
+    {
+        return RPB_1600_BUS_ERROR;
+    }
+
+    int8_t index = findRegister(data[0]);
+
+    // The charger NACKs unsupported commands and read only commands
+    if (index < 0 || !sim_registers[index].writable)
+    {
+        return RPB_1600_BUS_NACK;
+    }
+
+    // One extra byte is a PEC, which has to match
+    if (length == sim_registers[index].length + 2)
+    {
+        if (pmbus_write_pec(my_address, data, length - 1) != data[length - 1])
+        {
+            return RPB_1600_BUS_NACK;
+        }
+    }
+    else if (length != sim_registers[index].length + 1)
+    {
+        return RPB_1600_BUS_NACK;
+    }
+
+    if (my_settle_max_us == 0)
+    {
+        memcpy(my_registers[index], &data[1], sim_registers[index].length);
+        return RPB_1600_BUS_OK;
+    }
+
+    // xorshift32 for a settle time somewhere in the range
+    my_random ^= my_random << 13;
+    my_random ^= my_random >> 17;
+    my_random ^= my_random << 5;
+    uint32_t settle = my_settle_min_us + my_random % (my_settle_max_us - my_settle_min_us + 1);
+
+    memcpy(my_pending_data[index], &data[1], sim_registers[index].length);
+    my_pending_until[index] = my_now_us + settle;
+    my_pending[index] = true;
+
+    return RPB_1600_BUS_OK;
+}
+
+void RPB_1600_SimulatedCharger::setSettleTime(uint32_t minimum_us, uint32_t maximum_us)
+{
+    my_settle_min_us = minimum_us;
+    my_settle_max_us = (maximum_us < minimum_us) ? minimum_us : maximum_us;
+}
+
+void RPB_1600_SimulatedCharger::setTime(uint32_t now_us)
+{
+    my_now_us = now_us;
+
+    for (uint8_t i = 0; i < RPB_1600_SIM_NUM_REGISTERS; i++)
+    {
+        if (my_pending[i] && (int32_t)(now_us - my_pending_until[i]) >= 0)
+        {
+            memcpy(my_registers[i], my_pending_data[i], sim_registers[i].length);
+            my_pending[i] = false;
+        }
+    }
+
+    if (my_has_battery)
+    {
+        if (my_model_time_valid)
+        {
+            advance(now_us - my_model_time_us);
+        }
+
+        my_model_time_us = now_us;
+        my_model_time_valid = true;
+    }
+}
+
+void RPB_1600_SimulatedCharger::setBattery(const rpb_1600_sim_battery &battery)
+{
+    my_battery = battery;
+    my_has_battery = true;
+    my_model_time_valid = false;
+    powerCycle();
+}
+
+rpb_1600_sim_battery *RPB_1600_SimulatedCharger::getBattery(void)
+{
+    return my_has_battery ? &my_battery : nullptr;
+}
+
+void RPB_1600_SimulatedCharger::advance(uint32_t microseconds)
+{
+    if (!my_has_battery)
+    {
+        return;
+    }
+
+    while (microseconds > 0)
+    {
+        uint32_t step = (microseconds < RPB_1600_SIM_CHARGE_STEP_US) ? microseconds : RPB_1600_SIM_CHARGE_STEP_US;
+        stepCharge(step);
+        microseconds -= step;
+    }
+}
+
+void RPB_1600_SimulatedCharger::powerCycle(void)
+{
+    my_fully_charged = false;
+    my_battery_lost = false;
+    my_timeout_flags = 0;
+    restartCharge();
+    stepCharge(0);
+}
+
+void RPB_1600_SimulatedCharger::setEepromError(bool error)
+{
+    my_eeprom_error = error;
+    stepCharge(0);
+}
+
+void RPB_1600_SimulatedCharger::setTemperatureSensorShort(bool shorted)
+{
+    my_sensor_short = shorted;
+    stepCharge(0);
+}
+
+uint8_t RPB_1600_SimulatedCharger::getChargeStage(void) const
+{
+    return (my_has_battery && isOutputOn()) ? my_stage : (uint8_t)RPB_1600_SIM_STAGE_OFF;
+}
+
+bool RPB_1600_SimulatedCharger::raiseFault(uint8_t statusCommand, uint8_t bits)
+{
+    for (uint8_t i = 0; i < SIM_NUM_STATUS_SUMMARIES; i++)
+    {
+        if (sim_status_summaries[i].command == statusCommand)
+        {
+            my_registers[findRegister(statusCommand)][0] |= bits;
+            updateStatusWord();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool RPB_1600_SimulatedCharger::clearFault(uint8_t statusCommand, uint8_t bits)
+{
+    for (uint8_t i = 0; i < SIM_NUM_STATUS_SUMMARIES; i++)
+    {
+        if (sim_status_summaries[i].command == statusCommand)
+        {
+            my_registers[findRegister(statusCommand)][0] &= ~bits;
+            updateStatusWord();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void RPB_1600_SimulatedCharger::restartCharge(void)
+{
+    my_stage_time_us = 0;
+
+    if (!my_has_battery)
+    {
+        my_stage = RPB_1600_SIM_STAGE_OFF;
+    }
+    else if (!my_battery.connected)
+    {
+        my_battery_lost = true;
+        my_stage = RPB_1600_SIM_STAGE_FAULT;
+    }
+    else if (my_eeprom_error)
+    {
+        my_stage = RPB_1600_SIM_STAGE_FAULT;
+    }
+    else
+    {
+        my_stage = RPB_1600_SIM_STAGE_CC;
+    }
+}
+
+void RPB_1600_SimulatedCharger::stepCharge(uint32_t microseconds)
+{
+    if (!my_has_battery)
+    {
+        return;
+    }
+
+    bool charging = my_stage == RPB_1600_SIM_STAGE_CC || my_stage == RPB_1600_SIM_STAGE_CV ||
+                    my_stage == RPB_1600_SIM_STAGE_FLOAT;
+
+    // These stop the charger until it's power cycled
+    if (charging && !my_battery.connected)
+    {
+        my_battery_lost = true;
+        my_stage = RPB_1600_SIM_STAGE_FAULT;
+        charging = false;
+    }
+    else if (charging && my_eeprom_error)
+    {
+        my_stage = RPB_1600_SIM_STAGE_FAULT;
+        charging = false;
+    }
+
+    // The curve, from whatever has been written to the registers
+    uint16_t config = getWord(CMD_CODE_CURVE_CONFIG);
+    float cc = linear11_to_float(getWord(CMD_CODE_CURVE_CC));
+    float taper = linear11_to_float(getWord(CMD_CODE_CURVE_TC));
+    float compensation = sim_temp_compensation[(config & SIM_CONFIG_TEMP_COMP_MASK) >> SIM_CONFIG_TEMP_COMP_SHIFT] *
+                         (my_battery.temperature - 25.0f) * my_battery.cells / 1000.0f;
+    float cv = linear16_to_float(getWord(CMD_CODE_CURVE_CV), CMD_N_VALUE_CURVE_CV) + compensation;
+    float fv = linear16_to_float(getWord(CMD_CODE_CURVE_FV), CMD_N_VALUE_CURVE_FV) + compensation;
+
+    float resistance = (my_battery.internal_resistance > 0) ? my_battery.internal_resistance : 0.001f;
+    float open_circuit = my_battery.empty_voltage +
+                         (my_battery.full_voltage - my_battery.empty_voltage) * my_battery.state_of_charge +
+                         my_battery.temperature_coefficient * (my_battery.temperature - 25.0f) * my_battery.cells;
+    float current = 0;
+
+    if (charging && isOutputOn() && !my_sensor_short)
+    {
+        // CC until the battery's terminal voltage gets up to CV
+        if (my_stage == RPB_1600_SIM_STAGE_CC && open_circuit + cc * resistance >= cv)
+        {
+            my_stage = RPB_1600_SIM_STAGE_CV;
+            my_stage_time_us = 0;
+        }
+
+        // Then CV until the current tails off to the taper current
+        if (my_stage == RPB_1600_SIM_STAGE_CV && !my_fully_charged && (cv - open_circuit) / resistance <= taper)
+        {
+            my_fully_charged = true;
+
+            // A two stage curve holds CV from then on
+            if (!(config & SIM_CONFIG_TWO_STAGE))
+            {
+                my_stage = RPB_1600_SIM_STAGE_FLOAT;
+                my_stage_time_us = 0;
+            }
+        }
+
+        float target = (my_stage == RPB_1600_SIM_STAGE_CV) ? cv : fv;
+        current = (my_stage == RPB_1600_SIM_STAGE_CC) ? cc : (target - open_circuit) / resistance;
+        current = (current < 0) ? 0 : (current > cc) ? cc : current;
+
+        // Stage timeouts, when they're enabled. A two stage curve stops timing CV once it's fully charged.
+        uint8_t timeout_command = CMD_CODE_CURVE_CC_TIMEOUT;
+        uint16_t timeout_enable = SIM_CONFIG_CC_TIMEOUT;
+        uint16_t timeout_flag = SIM_CHG_CC_TIMEOUT;
+
+        if (my_stage == RPB_1600_SIM_STAGE_CV)
+        {
+            timeout_command = CMD_CODE_CURVE_CV_TIMEOUT;
+            timeout_enable = my_fully_charged ? 0 : SIM_CONFIG_CV_TIMEOUT;
+            timeout_flag = SIM_CHG_CV_TIMEOUT;
+        }
+        else if (my_stage == RPB_1600_SIM_STAGE_FLOAT)
+        {
+            timeout_command = CMD_CODE_CURVE_FLOAT_TIMEOUT;
+            timeout_enable = SIM_CONFIG_FLOAT_TIMEOUT;
+            timeout_flag = SIM_CHG_FLOAT_TIMEOUT;
+        }
+
+        my_stage_time_us += microseconds;
+        // Minutes
+        uint64_t timeout_us = (uint64_t)linear11_to_float(getWord(timeout_command)) * 60000000ULL;
+
+        if ((config & timeout_enable) && my_stage_time_us >= timeout_us)
+        {
+            my_timeout_flags |= timeout_flag;
+            my_stage = (my_stage == RPB_1600_SIM_STAGE_FLOAT) ? RPB_1600_SIM_STAGE_DONE : RPB_1600_SIM_STAGE_FAULT;
+        }
+    }
+
+    if (my_battery.capacity_ah > 0)
+    {
+        my_battery.state_of_charge += current * (microseconds / 1e6f) / 3600.0f / my_battery.capacity_ah;
+        my_battery.state_of_charge = (my_battery.state_of_charge > 1.0f) ? 1.0f : my_battery.state_of_charge;
+    }
+
+    float voltage = my_battery.connected ? open_circuit + current * resistance : 0;
+    setWord(CMD_CODE_READ_VOUT, linear16_from_float(voltage, CMD_N_VALUE_READ_VOUT));
+    setWord(CMD_CODE_READ_IOUT, linear11_from_float(current, CMD_N_VALUE_READ_IOUT));
+    updateChargeStatus();
+}
+
+void RPB_1600_SimulatedCharger::updateChargeStatus(void)
+{
+    uint16_t status = my_timeout_flags;
+
+    if (my_fully_charged)
+    {
+        status |= SIM_CHG_FULLY_CHARGED;
+    }
+
+    if (isOutputOn() && !my_sensor_short)
+    {
+        status |= (my_stage == RPB_1600_SIM_STAGE_CC) ? SIM_CHG_CC_MODE : 0;
+        status |= (my_stage == RPB_1600_SIM_STAGE_CV) ? SIM_CHG_CV_MODE : 0;
+        status |= (my_stage == RPB_1600_SIM_STAGE_FLOAT) ? SIM_CHG_FLOAT_MODE : 0;
+    }
+
+    if (my_eeprom_error)
+    {
+        status |= SIM_CHG_EEPROM_ERROR;
+    }
+
+    if (my_sensor_short)
+    {
+        status |= SIM_CHG_SENSOR_SHORT;
+    }
+
+    // Once lost, the battery isn't seen again until a power cycle
+    if (my_battery.connected && !my_battery_lost)
+    {
+        status |= SIM_CHG_BATTERY_DETECTED;
+    }
+
+    setWord(CMD_CODE_CHG_STATUS, status);
+}
+
+void RPB_1600_SimulatedCharger::updateStatusWord(void)
+{
+    uint16_t word = isOutputOn() ? 0 : (SIM_STATUS_OFF | SIM_STATUS_POWER_GOOD_NEGATED);
+
+    for (uint8_t i = 0; i < SIM_NUM_STATUS_SUMMARIES; i++)
+    {
+        const sim_status_summary *entry = &sim_status_summaries[i];
+        uint8_t bits = my_registers[findRegister(entry->command)][0];
+
+        if (bits != 0)
+        {
+            word |= entry->summary;
+        }
+
+        if (bits & entry->fault_bits)
+        {
+            word |= entry->fault_summary;
+        }
+    }
+
+    setWord(CMD_CODE_STATUS_WORD, word);
+}
+
+bool RPB_1600_SimulatedCharger::isOutputOn(void) const
+{
+    return (my_registers[findRegister(CMD_CODE_OPERATION)][0] & 0x80) != 0;
+}
+
+uint16_t RPB_1600_SimulatedCharger::getWord(uint8_t commandID) const
+{
+    uint8_t data[MAX_RECEIVE_BYTES];
+    getRegister(commandID, data);
+    return linear_word(data);
+}
+
+uint8_t RPB_1600_SimulatedCharger::handleRead(uint8_t commandID, uint8_t *rx, uint8_t rxLength)
+{
+    int8_t index = findRegister(commandID);
+
+    if (index < 0)
+    {
+        return RPB_1600_BUS_NACK;
+    }
+
+    // Catch up with OPERATION writes and detail registers set with setRegister()
+    if (commandID == CMD_CODE_STATUS_WORD)
+    {
+        updateStatusWord();
+    }
+
+    // Paralleled chargers' outputs depend on each other
+    if (my_bank != nullptr && (commandID == CMD_CODE_READ_VOUT || commandID == CMD_CODE_READ_IOUT))
+    {
+        my_bank->solve();
+    }
+
+    // What goes out on the bus, with the byte count in front for a block read
+    uint8_t response[MAX_RECEIVE_BYTES];
+    uint8_t length = sim_registers[index].length;
+
+    if (sim_registers[index].block)
+    {
+        response[0] = length;
+        memcpy(&response[1], my_registers[index], length);
+        length++;
+    }
+    else
+    {
+        memcpy(response, my_registers[index], length);
+    }
+
+    for (uint8_t i = 0; i < rxLength; i++)
+    {
+        rx[i] = (i < length) ? response[i] : 0xFF;
+    }
+
+    // Reading one byte past the end clocks out the PEC
+    if (rxLength > length)
+    {
+        rx[length] = pmbus_read_pec(my_address, commandID, response, length);
+    }
+
+    return RPB_1600_BUS_OK;
+}
+
+int8_t RPB_1600_SimulatedCharger::findRegister(uint8_t commandID)
+{
+    for (int8_t i = 0; i < RPB_1600_SIM_NUM_REGISTERS; i++)
+    {
+        if (sim_registers[i].code == commandID)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// RPB_1600_SimulatedBank
+//----------------------------------------------------------------------
+
+bool RPB_1600_SimulatedBank::attach(RPB_1600_SimulatedCharger *unit, float setpointError, float outputResistance)
+{
+    if (my_num_units >= RPB_1600_SIM_BANK_MAX_UNITS || unit->my_bank != nullptr)
+    {
+        return false;
+    }
+
+    unit->my_bank = this;
+    my_units[my_num_units] = unit;
+    my_setpoint_errors[my_num_units] = setpointError;
+    my_resistances[my_num_units] = outputResistance;
+    my_currents[my_num_units] = 0.0f;
+    my_num_units++;
+
+    return true;
+}
+
+void RPB_1600_SimulatedBank::setLoad(float emf, float resistance)
+{
+    my_emf = emf;
+    my_resistance = resistance;
+}
+
+void RPB_1600_SimulatedBank::solve(void)
+{
+    float setpoints[RPB_1600_SIM_BANK_MAX_UNITS];
+    float limits[RPB_1600_SIM_BANK_MAX_UNITS];
+    bool pinned[RPB_1600_SIM_BANK_MAX_UNITS];
+
+    for (uint8_t i = 0; i < my_num_units; i++)
+    {
+        RPB_1600_SimulatedCharger *unit = my_units[i];
+        // VOUT_TRIM is signed
+        float trim = (int16_t)unit->getWord(CMD_CODE_VOUT_TRIM) * linear16_to_float(1, CMD_N_VALUE_VOUT_TRIM);
+
+        setpoints[i] = linear16_to_float(unit->getWord(CMD_CODE_VOUT_COMMAND), CMD_N_VALUE_VOUT_COMMAND) + trim +
+                       my_setpoint_errors[i];
+        limits[i] = linear11_to_float(unit->getWord(CMD_CODE_CURVE_CC));
+        pinned[i] = !unit->isOutputOn();
+        my_currents[i] = 0.0f;
+    }
+
+    // Solve the bank node with every charger that isn't pinned as a source behind its resistance.
+    // Then pin the one furthest outside 0 - CURVE_CC to that limit and solve again, until none are.
+    for (uint8_t pass = 0; pass <= my_num_units; pass++)
+    {
+        float conductance = 1.0f / my_resistance;
+        float injected = my_emf / my_resistance;
+
+        for (uint8_t i = 0; i < my_num_units; i++)
+        {
+            if (pinned[i])
+            {
+                injected += my_currents[i];
+            }
+            else
+            {
+                conductance += 1.0f / my_resistances[i];
+                injected += setpoints[i] / my_resistances[i];
+            }
+        }
+
+        my_voltage = injected / conductance;
+
+        float worst = 0.0f;
+        int8_t worst_index = -1;
+
+        for (uint8_t i = 0; i < my_num_units; i++)
+        {
+            if (pinned[i])
+            {
+                continue;
+            }
+
+            my_currents[i] = (setpoints[i] - my_voltage) / my_resistances[i];
+
+            float outside = (my_currents[i] < 0.0f)        ? -my_currents[i]
+                            : (my_currents[i] > limits[i]) ? my_currents[i] - limits[i]
+                                                           : 0.0f;
+
+            if (outside > worst)
+            {
+                worst = outside;
+                worst_index = i;
+            }
+        }
+
+        if (worst_index < 0)
+        {
+            break;
+        }
+
+        pinned[worst_index] = true;
+        my_currents[worst_index] = (my_currents[worst_index] < 0.0f) ? 0.0f : limits[worst_index];
+    }
+
+    for (uint8_t i = 0; i < my_num_units; i++)
+    {
+        my_units[i]->setWord(CMD_CODE_READ_VOUT, linear16_from_float(my_voltage, CMD_N_VALUE_READ_VOUT));
+        my_units[i]->setWord(CMD_CODE_READ_IOUT, linear11_from_float(my_currents[i], CMD_N_VALUE_READ_IOUT));
+    }
+}
+
+float RPB_1600_SimulatedBank::getVoltage(void) const
+{
+    return my_voltage;
+}
+
+float RPB_1600_SimulatedBank::getCurrent(uint8_t index) const
+{
+    return (index < my_num_units) ? my_currents[index] : 0.0f;
+}
+
+//----------------------------------------------------------------------
+// RPB_1600_SimulatedBus
+//----------------------------------------------------------------------
+
+RPB_1600_SimulatedBus::RPB_1600_SimulatedBus()
+    : my_num_units(0), my_clock(100000), my_now_ns(0), my_async_in_flight(false), my_async_latency(0)
+{
+    resetCounters();
+}
+
+bool RPB_1600_SimulatedBus::attach(RPB_1600_SimulatedCharger *unit)
+{
+    if (my_num_units >= RPB_1600_SIM_MAX_UNITS || findUnit(unit->getAddress()) != nullptr)
+    {
+        return false;
+    }
+
+    my_units[my_num_units++] = unit;
+
+    return true;
+}
+
+void RPB_1600_SimulatedBus::setClock(uint32_t frequency)
+{
+    my_clock = frequency;
+}
+
+uint32_t RPB_1600_SimulatedBus::micros(void)
+{
+    return (uint32_t)(my_now_ns / 1000);
+}
+
+void RPB_1600_SimulatedBus::advanceTime(uint32_t microseconds)
+{
+    my_now_ns += (uint64_t)microseconds * 1000;
+
+    for (uint8_t i = 0; i < my_num_units; i++)
+    {
+        my_units[i]->setTime(micros());
+    }
+}
+
+void RPB_1600_SimulatedBus::delayMicroseconds(uint32_t microseconds)
+{
+    advanceTime(microseconds);
+}
+
+uint8_t RPB_1600_SimulatedBus::write(uint8_t address, const uint8_t *data, uint8_t length)
+{
+    my_transaction_count++;
+
+    RPB_1600_SimulatedCharger *unit = findUnit(address);
+
+    if (unit == nullptr)
+    {
+        // Start, address byte (NACKed), stop
+        addBitTime(SIM_BITS_START + SIM_BITS_PER_BYTE + SIM_BITS_STOP);
+        return RPB_1600_BUS_NACK;
+    }
+
+    my_byte_count += length;
+    addBitTime(SIM_BITS_START + SIM_BITS_PER_BYTE * (1 + length) + SIM_BITS_STOP);
+    addByteLatency(1 + length);
+    unit->setTime(micros());
+
+    if (length < 2 || length > MAX_RECEIVE_BYTES + 2)
+    {
+        return unit->handleWrite(data, length);
+    }
+
+    // Leave the command code alone, corrupt what follows it
+    uint8_t corrupted[MAX_RECEIVE_BYTES + 2];
+    memcpy(corrupted, data, length);
+    corrupt(&corrupted[1], length - 1);
+
+    return unit->handleWrite(corrupted, length);
+}
+
+uint8_t RPB_1600_SimulatedBus::writeRead(uint8_t address, const uint8_t *tx, uint8_t txLength,
+                                         uint8_t *rx, uint8_t rxLength, uint8_t *received)
+{
+    return transfer(address, tx, txLength, rx, rxLength, received, true);
+}
+
+uint8_t RPB_1600_SimulatedBus::writeReadMany(uint8_t address, rpb_1600_bus_transfer *transfers, uint8_t count)
+{
+    uint8_t num_ok = 0;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        rpb_1600_bus_transfer *t = &transfers[i];
+        t->status = transfer(address, t->tx, t->tx_length, t->rx, t->rx_length, &t->received, i == count - 1);
+
+        if (t->status == RPB_1600_BUS_OK)
+        {
+            num_ok++;
+        }
+    }
+
+    return num_ok;
+}
+
+uint8_t RPB_1600_SimulatedBus::startWriteRead(uint8_t address, const uint8_t *tx, uint8_t txLength,
+                                              uint8_t *rx, uint8_t rxLength)
+{
+    if (my_async_in_flight)
+    {
+        return RPB_1600_BUS_BUSY;
+    }
+
+    my_async_in_flight = true;
+    my_async_polls_left = my_async_latency;
+    my_async_address = address;
+    my_async_command = (txLength > 0) ? tx[0] : 0;
+    my_async_tx_length = txLength;
+    my_async_rx = rx;
+    my_async_rx_length = rxLength;
+
+    return RPB_1600_BUS_OK;
+}
+
+uint8_t RPB_1600_SimulatedBus::pollWriteRead(uint8_t *received)
+{
+    if (!my_async_in_flight)
+    {
+        return RPB_1600_BUS_ERROR;
+    }
+
+    if (my_async_polls_left > 0)
+    {
+        my_async_polls_left--;
+        return RPB_1600_BUS_BUSY;
+    }
+
+    my_async_in_flight = false;
+
+    return writeRead(my_async_address, &my_async_command, my_async_tx_length,
+                     my_async_rx, my_async_rx_length, received);
+}
+
+void RPB_1600_SimulatedBus::setAsyncLatency(uint8_t polls)
+{
+    my_async_latency = polls;
+}
+
+void RPB_1600_SimulatedBus::setByteErrorRate(uint32_t oneIn, uint32_t seed)
+{
+    my_error_rate = oneIn;
+    my_random = (seed != 0) ? seed : 1;
+}
+
+void RPB_1600_SimulatedBus::setMaxReliableClock(uint32_t frequency)
+{
+    my_max_reliable_clock = frequency;
+}
+
+void RPB_1600_SimulatedBus::setByteLatency(uint32_t nanoseconds)
+{
+    my_byte_latency_ns = nanoseconds;
+}
+
+uint32_t RPB_1600_SimulatedBus::getCorruptedBytes(void) const
+{
+    return my_corrupted_bytes;
+}
+
+uint32_t RPB_1600_SimulatedBus::getClock(void) const
+{
+    return my_clock;
+}
+
+uint32_t RPB_1600_SimulatedBus::getTransactionCount(void) const
+{
+    return my_transaction_count;
+}
+
+uint32_t RPB_1600_SimulatedBus::getByteCount(void) const
+{
+    return my_byte_count;
+}
+
+void RPB_1600_SimulatedBus::resetCounters(void)
+{
+    my_transaction_count = 0;
+    my_byte_count = 0;
+    my_bus_time_ns = 0;
+}
+
+uint32_t RPB_1600_SimulatedBus::getBusTimeMicros(void) const
+{
+    return (uint32_t)(my_bus_time_ns / 1000);
+}
+
+uint8_t RPB_1600_SimulatedBus::transfer(uint8_t address, const uint8_t *tx, uint8_t txLength,
+                                        uint8_t *rx, uint8_t rxLength, uint8_t *received, bool sendStop)
+{
+    my_transaction_count++;
+    *received = 0;
+
+    RPB_1600_SimulatedCharger *unit = findUnit(address);
+
+    // PMBus reads are always a single command byte followed by a repeated start
+    if (unit == nullptr || txLength != 1)
+    {
+        // Start, address byte (NACKed), stop
+        addBitTime(SIM_BITS_START + SIM_BITS_PER_BYTE + SIM_BITS_STOP);
+        return RPB_1600_BUS_NACK;
+    }
+
+    unit->setTime(micros());
+    uint8_t status = unit->handleRead(tx[0], rx, rxLength);
+
+    if (status != RPB_1600_BUS_OK)
+    {
+        // Start, address, command byte (NACKed), stop
+        addBitTime(SIM_BITS_START + SIM_BITS_PER_BYTE * 2 + SIM_BITS_STOP);
+        return status;
+    }
+
+    corrupt(rx, rxLength);
+
+    *received = rxLength;
+    my_byte_count += txLength + rxLength;
+    addReadTime(txLength, rxLength, sendStop);
+
+    return RPB_1600_BUS_OK;
+}
+
+void RPB_1600_SimulatedBus::addReadTime(uint8_t txLength, uint8_t rxLength, bool sendStop)
+{
+    // Start, address + command, repeated start, address + response, then maybe a stop
+    uint32_t bits = SIM_BITS_START + SIM_BITS_PER_BYTE * (1 + txLength) +
+                    SIM_BITS_START + SIM_BITS_PER_BYTE * (1 + rxLength);
+
+    if (sendStop)
+    {
+        bits += SIM_BITS_STOP;
+    }
+
+    addBitTime(bits);
+    addByteLatency(2 + txLength + rxLength);
+}
+
+void RPB_1600_SimulatedBus::addBitTime(uint32_t bitCount)
+{
+    uint64_t elapsed = (uint64_t)bitCount * 1000000000ULL / my_clock;
+    my_bus_time_ns += elapsed;
+    my_now_ns += elapsed;
+}
+
+void RPB_1600_SimulatedBus::addByteLatency(uint32_t byteCount)
+{
+    uint64_t elapsed = (uint64_t)byteCount * my_byte_latency_ns;
+    my_bus_time_ns += elapsed;
+    my_now_ns += elapsed;
+}
+
+RPB_1600_SimulatedCharger *RPB_1600_SimulatedBus::findUnit(uint8_t address)
+{
+    for (uint8_t i = 0; i < my_num_units; i++)
+    {
+        if (my_units[i]->getAddress() == address)
+        {
+            return my_units[i];
+        }
+    }
+
+    return nullptr;
+}
+
+void RPB_1600_SimulatedBus::corrupt(uint8_t *data, uint8_t length)
+{
+    uint32_t rate = my_error_rate;
+
+    if (my_max_reliable_clock != 0 && my_clock > my_max_reliable_clock &&
+        (rate == 0 || rate > RPB_1600_SIM_OVERCLOCK_ERROR_RATE))
+    {
+        rate = RPB_1600_SIM_OVERCLOCK_ERROR_RATE;
+    }
+
+    if (rate == 0)
+    {
+        return;
+    }
+
+    for (uint8_t i = 0; i < length; i++)
+    {
+        // xorshift32
+        my_random ^= my_random << 13;
+        my_random ^= my_random >> 17;
+        my_random ^= my_random << 5;
+
+        if (my_random % rate == 0)
+        {
+            data[i] ^= 1 << ((my_random >> 8) & 0x07);
+            my_corrupted_bytes++;
+        }
+    }
+}
+
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+//----------------------------------------------------------------------
+// RPB_1600_SimulatedI2cDev
+//----------------------------------------------------------------------
+
+// The fd open() hands out, any non-negative number would do
+#define SIM_I2C_DEV_FD 3
+
+RPB_1600_SimulatedI2cDev::RPB_1600_SimulatedI2cDev(RPB_1600_SimulatedBus &bus) : my_bus(bus)
+{
+}
+
+int RPB_1600_SimulatedI2cDev::open(const char *path, int flags)
+{
+    (void)path;
+    (void)flags;
+    std::lock_guard<std::mutex> lock(my_mutex);
+
+    if (my_open)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    my_open = true;
+
+    return SIM_I2C_DEV_FD;
+}
+
+int RPB_1600_SimulatedI2cDev::close(int fd)
+{
+    std::lock_guard<std::mutex> lock(my_mutex);
+
+    if (!my_open || fd != SIM_I2C_DEV_FD)
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    my_open = false;
+
+    return 0;
+}
+
+int RPB_1600_SimulatedI2cDev::ioctl(int fd, unsigned long request, void *argument)
+{
+    std::unique_lock<std::mutex> lock(my_mutex);
+    my_ioctl_count++;
+
+    if (!my_open || fd != SIM_I2C_DEV_FD)
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (request == I2C_FUNCS)
+    {
+        *(unsigned long *)argument = my_smbus_only ? I2C_FUNC_SMBUS_EMUL : (I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL);
+        return 0;
+    }
+
+    if (request != I2C_RDWR)
+    {
+        errno = ENOTTY;
+        return -1;
+    }
+
+    i2c_rdwr_ioctl_data *data = (i2c_rdwr_ioctl_data *)argument;
+
+    if (my_smbus_only || data->nmsgs > RPB_1600_LINUX_MAX_MESSAGES)
+    {
+        errno = my_smbus_only ? EOPNOTSUPP : EINVAL;
+        return -1;
+    }
+
+    if (my_ioctl_delay_us > 0)
+    {
+        uint32_t delay_us = my_ioctl_delay_us;
+        lock.unlock();
+        std::this_thread::sleep_for(std::chrono::microseconds(delay_us));
+        lock.lock();
+    }
+
+    int error = transfer(data->msgs, data->nmsgs);
+
+    if (error != 0)
+    {
+        errno = error;
+        return -1;
+    }
+
+    // Like the kernel, the number of messages transferred
+    return data->nmsgs;
+}
+
+uint32_t RPB_1600_SimulatedI2cDev::micros(void)
+{
+    std::lock_guard<std::mutex> lock(my_mutex);
+    return my_bus.micros();
+}
+
+void RPB_1600_SimulatedI2cDev::delayMicroseconds(uint32_t microseconds)
+{
+    std::lock_guard<std::mutex> lock(my_mutex);
+    my_bus.delayMicroseconds(microseconds);
+}
+
+void RPB_1600_SimulatedI2cDev::setSmbusOnly(bool smbusOnly)
+{
+    std::lock_guard<std::mutex> lock(my_mutex);
+    my_smbus_only = smbusOnly;
+}
+
+void RPB_1600_SimulatedI2cDev::setIoctlDelay(uint32_t microseconds)
+{
+    std::lock_guard<std::mutex> lock(my_mutex);
+    my_ioctl_delay_us = microseconds;
+}
+
+uint32_t RPB_1600_SimulatedI2cDev::getIoctlCount(void) const
+{
+    std::lock_guard<std::mutex> lock(my_mutex);
+    return my_ioctl_count;
+}
+
+uint32_t RPB_1600_SimulatedI2cDev::getMessageCount(void) const
+{
+    std::lock_guard<std::mutex> lock(my_mutex);
+    return my_message_count;
+}
+
+void RPB_1600_SimulatedI2cDev::resetCounters(void)
+{
+    std::lock_guard<std::mutex> lock(my_mutex);
+    my_ioctl_count = 0;
+    my_message_count = 0;
+}
+
+int RPB_1600_SimulatedI2cDev::transfer(i2c_msg *messages, uint32_t count)
+{
+    rpb_1600_bus_transfer transfers[RPB_1600_LINUX_MAX_MESSAGES / 2];
+    uint8_t num_transfers = 0;
+    uint16_t address = 0;
+
+    my_message_count += count;
+
+    for (uint32_t i = 0; i <= count; i++)
+    {
+        i2c_msg *message = (i < count) ? &messages[i] : nullptr;
+        bool is_pair = message != nullptr && i + 1 < count && !(message->flags & I2C_M_RD) &&
+                       (messages[i + 1].flags & I2C_M_RD) && messages[i + 1].addr == message->addr;
+
+        // A run of write-then-reads to one charger ends here, send it as one burst
+        if (num_transfers > 0 && (!is_pair || message->addr != address))
+        {
+            my_bus.writeReadMany(address, transfers, num_transfers);
+
+            for (uint8_t n = 0; n < num_transfers; n++)
+            {
+                if (transfers[n].status != RPB_1600_BUS_OK)
+                {
+                    return (transfers[n].status == RPB_1600_BUS_NACK) ? ENXIO : EIO;
+                }
+
+                if (transfers[n].received < transfers[n].rx_length)
+                {
+                    return EIO;
+                }
+            }
+
+            num_transfers = 0;
+        }
+
+        if (message == nullptr)
+        {
+            break;
+        }
+
+        // The library never moves more than 255 bytes in one message
+        if (message->len > 0xFF || (is_pair && messages[i + 1].len > 0xFF))
+        {
+            return EINVAL;
+        }
+
+        if (is_pair)
+        {
+            address = message->addr;
+            transfers[num_transfers++] = {message->buf, (uint8_t)message->len, messages[i + 1].buf,
+                                          (uint8_t)messages[i + 1].len, 0, RPB_1600_BUS_OK};
+            i++;
+        }
+        else if (!(message->flags & I2C_M_RD))
+        {
+            uint8_t status = my_bus.write(message->addr, message->buf, message->len);
+
+            if (status != RPB_1600_BUS_OK)
+            {
+                return (status == RPB_1600_BUS_NACK) ? ENXIO : EIO;
+            }
+        }
+        else
+        {
+            // A read with no command in front of it, nothing on an RPB-1600 answers that
+            return ENXIO;
+        }
+    }
+
+    return 0;
+}
+
+#endif // __linux__ && !ARDUINO
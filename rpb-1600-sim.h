@@ -0,0 +1,550 @@
+#include "rpb-1600-bus.h"
+#include "rpb-1600-linux.h"
+#include "rpb-1600.h"
+
+#ifndef RPB_1600_SIM_H
+#define RPB_1600_SIM_H
+
+/**
+ * @brief The number of chargers that can share one bus (addresses 0x40 - 0x47)
+ */
+#define RPB_1600_SIM_MAX_UNITS 8
+
+/**
+ * @brief The number of command codes a simulated charger answers
+ */
+#define RPB_1600_SIM_NUM_REGISTERS 37
+
+/**
+ * @brief The most chargers one RPB_1600_SimulatedBank can parallel (a whole fleet)
+ */
+#define RPB_1600_SIM_BANK_MAX_UNITS 24
+
+/**
+ * @brief One in how many bytes get corrupted above the maximum reliable clock, see setMaxReliableClock()
+ */
+#define RPB_1600_SIM_OVERCLOCK_ERROR_RATE 16
+
+/**
+ * @brief The longest step the charge model takes, longer advances are split into steps this long
+ */
+#ifndef RPB_1600_SIM_CHARGE_STEP_US
+#define RPB_1600_SIM_CHARGE_STEP_US 1000000
+#endif
+
+/**
+ * @brief Where a simulated charger is in its charge curve, see RPB_1600_SimulatedCharger::getChargeStage()
+ */
+enum rpb_1600_sim_stage : uint8_t
+{
+    // No battery model attached, or the output is turned off with OPERATION
+    RPB_1600_SIM_STAGE_OFF = 0,
+    RPB_1600_SIM_STAGE_CC,
+    RPB_1600_SIM_STAGE_CV,
+    RPB_1600_SIM_STAGE_FLOAT,
+    // The float stage timed out, charging is finished until the charger is power cycled
+    RPB_1600_SIM_STAGE_DONE,
+    // Stopped by a CC/CV timeout, a missing battery or an EEPROM error until the charger is power cycled
+    RPB_1600_SIM_STAGE_FAULT,
+};
+
+/**
+ * @brief A battery for a simulated charger to charge, see RPB_1600_SimulatedCharger::setBattery()
+ * @details The open circuit voltage rises in a straight line from empty_voltage to full_voltage with
+ * the state of charge (shifted by temperature_coefficient), and the terminal voltage is that plus the
+ * charge current times internal_resistance. So in CV the current tails off as the battery fills, and a
+ * cold battery without temperature compensation tapers off early and ends up undercharged.
+ */
+struct rpb_1600_sim_battery
+{
+    float capacity_ah;
+    // Ohms
+    float internal_resistance;
+    float empty_voltage;
+    float full_voltage;
+    // 0 - 1
+    float state_of_charge;
+    // Celsius, what the charger's temperature compensation sensor reads
+    float temperature;
+    // How the open circuit voltage moves with temperature away from 25C, in volts per degree C per cell
+    float temperature_coefficient;
+    // Temperature compensation is per cell (12 for a 24V lead acid battery)
+    uint8_t cells;
+    // A charger that loses its battery stops with the battery flag cleared until it's power cycled
+    bool connected;
+};
+
+class RPB_1600_SimulatedBank;
+
+/**
+ * @brief A simulated RPB-1600 register file
+ * @details Answers every command in rpb-1600-commands.h with plausible default values, and stores
+ * whatever is written to the writable ones. Attach one or more of these to an RPB_1600_SimulatedBus
+ * to run the library without hardware.
+ */
+class RPB_1600_SimulatedCharger
+{
+public:
+    RPB_1600_SimulatedCharger(uint8_t address);
+
+    uint8_t getAddress(void) const;
+
+    /**
+     * @brief Restore every register to its power-on default
+     */
+    void reset(void);
+
+    /**
+     * @brief Overwrite the raw contents of a register, regardless of whether the charger lets the bus write it
+     * @return true on success, false if the command is unknown or length doesn't match
+     */
+    bool setRegister(uint8_t commandID, const uint8_t *data, uint8_t length);
+
+    /**
+     * @brief Convenience wrapper around setRegister() for two byte registers (low byte first on the wire)
+     */
+    bool setWord(uint8_t commandID, uint16_t value);
+
+    /**
+     * @brief Copy the raw contents of a register into data[]
+     * @return The length of the register, or 0 if the command is unknown
+     */
+    uint8_t getRegister(uint8_t commandID, uint8_t *data) const;
+
+    /**
+     * @brief Handle a write transaction addressed to this charger (data[0] is the command code)
+     * @details A write with one extra byte carries a PEC, which is NACKed if it doesn't match
+     * @return One of rpb_1600_bus_status
+     */
+    uint8_t handleWrite(const uint8_t *data, uint8_t length);
+
+    /**
+     * @brief Handle a write-then-read transaction addressed to this charger
+     * @details Like the real charger, the first byte clocked out past the end of the register is the
+     * PEC, and any after that read as 0xFF
+     * @return One of rpb_1600_bus_status
+     */
+    uint8_t handleRead(uint8_t commandID, uint8_t *rx, uint8_t rxLength);
+
+    /**
+     * @brief Make writes take a while to land, like the real charger
+     * @details Each write takes effect after a random time between minimum_us and maximum_us, until
+     * then reads of the register return the old value. Both 0 (the default) means writes land straight away.
+     */
+    void setSettleTime(uint32_t minimum_us, uint32_t maximum_us);
+
+    /**
+     * @brief Tell the charger what time it is, the bus does this before every transaction
+     */
+    void setTime(uint32_t now_us);
+
+    //----------------------------------------------------------------------
+    // Charge model
+    //----------------------------------------------------------------------
+
+    /**
+     * @brief Connect a battery and start charging it, as if the charger had just been powered on
+     * @details From then on the charger works through CC, CV and float using whatever is in the
+     * CURVE_* registers, and READ_VOUT, READ_IOUT and CHG_STATUS follow what it's doing. Time moves
+     * with the bus (every transaction and RPB_1600_SimulatedBus::advanceTime()), or with advance()
+     * for a charger that isn't on a bus. Don't use both on the same charger.
+     */
+    void setBattery(const rpb_1600_sim_battery &battery);
+
+    /**
+     * @brief The attached battery, to change it part way through a charge (nullptr if there isn't one)
+     */
+    rpb_1600_sim_battery *getBattery(void);
+
+    /**
+     * @brief Run the charge model forward by microseconds of virtual time
+     */
+    void advance(uint32_t microseconds);
+
+    /**
+     * @brief Turn the charger off and on again
+     * @details Clears the latched flags and starts charging again from CC. The registers keep their
+     * values, the curve lives in EEPROM on the real charger.
+     */
+    void powerCycle(void);
+
+    /**
+     * @brief Make the charger report an EEPROM charge parameter error, which stops charging until a power cycle
+     */
+    void setEepromError(bool error);
+
+    /**
+     * @brief Short the temperature compensation sensor, which stops charging until it's removed
+     */
+    void setTemperatureSensorShort(bool shorted);
+
+    /**
+     * @brief One of rpb_1600_sim_stage
+     */
+    uint8_t getChargeStage(void) const;
+
+    //----------------------------------------------------------------------
+    // Fault injection
+    //----------------------------------------------------------------------
+
+    /**
+     * @brief Set bits in one of the detail status registers (STATUS_VOUT, _IOUT, _INPUT, _TEMPERATURE,
+     * _CML, _MFR_SPECIFIC or _FANS_1_2), as if the charger had seen a fault or warning
+     * @details STATUS_WORD's summary bits follow the detail registers. The bits stay set until
+     * clearFault() or reset().
+     * @return false if statusCommand isn't a detail status register
+     */
+    bool raiseFault(uint8_t statusCommand, uint8_t bits);
+
+    /**
+     * @brief Clear bits set with raiseFault()
+     */
+    bool clearFault(uint8_t statusCommand, uint8_t bits = 0xFF);
+
+private:
+    friend class RPB_1600_SimulatedBank;
+
+    uint8_t my_address;
+
+    /**
+     * @brief The bank this charger is paralleled onto, if any
+     */
+    RPB_1600_SimulatedBank *my_bank = nullptr;
+
+    /**
+     * @brief Writes that haven't landed yet, see setSettleTime()
+     */
+    uint32_t my_now_us = 0;
+    uint32_t my_settle_min_us = 0;
+    uint32_t my_settle_max_us = 0;
+    uint32_t my_random = 1;
+    bool my_pending[RPB_1600_SIM_NUM_REGISTERS] = {};
+    uint32_t my_pending_until[RPB_1600_SIM_NUM_REGISTERS] = {};
+    uint8_t my_pending_data[RPB_1600_SIM_NUM_REGISTERS][MAX_RECEIVE_BYTES];
+
+    /**
+     * @brief The charge model, see setBattery()
+     */
+    rpb_1600_sim_battery my_battery;
+    bool my_has_battery = false;
+    uint8_t my_stage = RPB_1600_SIM_STAGE_OFF;
+    // How long the charger has been in the current stage, for the timeouts
+    uint64_t my_stage_time_us = 0;
+    // Time of the last setTime() the model caught up to
+    uint32_t my_model_time_us = 0;
+    bool my_model_time_valid = false;
+    bool my_fully_charged = false;
+    bool my_eeprom_error = false;
+    bool my_sensor_short = false;
+    bool my_battery_lost = false;
+    // CHG_STATUS timeout bits that have been raised
+    uint16_t my_timeout_flags = 0;
+
+    /**
+     * @brief Register contents, indexed the same as the command table in rpb-1600-sim.cpp
+     */
+    uint8_t my_registers[RPB_1600_SIM_NUM_REGISTERS][MAX_RECEIVE_BYTES];
+
+    /**
+     * @brief Find a command in the command table
+     * @return The index of the command, or -1 if the charger doesn't support it
+     */
+    static int8_t findRegister(uint8_t commandID);
+
+    /**
+     * @brief Two byte register contents as a word
+     */
+    uint16_t getWord(uint8_t commandID) const;
+
+    /**
+     * @brief Move the charge model forward by one step of at most RPB_1600_SIM_CHARGE_STEP_US
+     */
+    void stepCharge(uint32_t microseconds);
+
+    /**
+     * @brief Start charging again from CC, or stop with a fault if we can't
+     */
+    void restartCharge(void);
+
+    /**
+     * @brief Update CHG_STATUS from the model
+     */
+    void updateChargeStatus(void);
+
+    /**
+     * @brief Work out STATUS_WORD from the detail status registers and OPERATION
+     */
+    void updateStatusWord(void);
+
+    /**
+     * @brief Whether OPERATION has the output turned on
+     */
+    bool isOutputOn(void) const;
+};
+
+/**
+ * @brief Simulated chargers wired in parallel onto one battery bank
+ * @details Each charger is a voltage source at VOUT_COMMAND + VOUT_TRIM plus its own setpoint error,
+ * behind its own output resistance. It can't sink current, its current is capped at CURVE_CC, and
+ * OPERATION turns it off. The bank is an EMF behind a resistance. Whenever any of the chargers has
+ * READ_VOUT or READ_IOUT read, the bank is solved again and every charger's READ_VOUT and READ_IOUT
+ * are updated, so the chargers can be on different buses. Don't use setBattery() on these chargers.
+ */
+class RPB_1600_SimulatedBank
+{
+public:
+    /**
+     * @brief Wire a charger into the bank
+     * @param setpointError How far off the charger's output voltage is from what it's told, volts
+     * @param outputResistance Ohms, how much its voltage droops under load
+     * @return false if the bank is full or the charger is already in a bank
+     */
+    bool attach(RPB_1600_SimulatedCharger *unit, float setpointError = 0.0f, float outputResistance = 0.01f);
+
+    /**
+     * @brief The battery bank the chargers feed (defaults to 26V behind 10 milliohms)
+     */
+    void setLoad(float emf, float resistance);
+
+    /**
+     * @brief Work out the bank voltage and each charger's current from their registers
+     */
+    void solve(void);
+
+    /**
+     * @brief The bank voltage, and one charger's current, from the last solve()
+     */
+    float getVoltage(void) const;
+    float getCurrent(uint8_t index) const;
+
+private:
+    RPB_1600_SimulatedCharger *my_units[RPB_1600_SIM_BANK_MAX_UNITS];
+    float my_setpoint_errors[RPB_1600_SIM_BANK_MAX_UNITS];
+    float my_resistances[RPB_1600_SIM_BANK_MAX_UNITS];
+    float my_currents[RPB_1600_SIM_BANK_MAX_UNITS];
+    uint8_t my_num_units = 0;
+
+    float my_emf = 26.0f;
+    float my_resistance = 0.01f;
+    float my_voltage = 0.0f;
+};
+
+/**
+ * @brief An RPB_1600_Bus that routes transactions to attached simulated chargers
+ * @details Transactions to an address with no charger attached are NACKed, just like a real bus.
+ */
+class RPB_1600_SimulatedBus : public RPB_1600_Bus
+{
+public:
+    RPB_1600_SimulatedBus();
+
+    /**
+     * @brief Put a simulated charger on the bus
+     * @return false if the bus is full or the address is already taken
+     */
+    bool attach(RPB_1600_SimulatedCharger *unit);
+
+    void setClock(uint32_t frequency) override;
+
+    /**
+     * @brief Virtual time: advances by the wire time of every transaction, plus any advanceTime() calls
+     */
+    uint32_t micros(void) override;
+
+    /**
+     * @brief Let virtual time pass without any bus traffic
+     * @details Attached chargers are told the new time, so their charge models keep up. Advance in
+     * steps shorter than the 71 minutes micros() takes to wrap.
+     */
+    void advanceTime(uint32_t microseconds);
+
+    /**
+     * @brief Same as advanceTime()
+     */
+    void delayMicroseconds(uint32_t microseconds) override;
+
+    uint8_t write(uint8_t address, const uint8_t *data, uint8_t length) override;
+    uint8_t writeRead(uint8_t address, const uint8_t *tx, uint8_t txLength,
+                      uint8_t *rx, uint8_t rxLength, uint8_t *received) override;
+    uint8_t startWriteRead(uint8_t address, const uint8_t *tx, uint8_t txLength,
+                           uint8_t *rx, uint8_t rxLength) override;
+    uint8_t pollWriteRead(uint8_t *received) override;
+
+    /**
+     * @brief Like the Wire backend, holds the bus for the whole burst and only sends one stop at the end
+     */
+    uint8_t writeReadMany(uint8_t address, rpb_1600_bus_transfer *transfers, uint8_t count) override;
+
+    /**
+     * @brief Make asynchronous transactions stay in flight for this many calls to pollWriteRead()
+     * @details Defaults to 0, so transactions finish on the first poll like the default backend
+     */
+    void setAsyncLatency(uint8_t polls);
+
+    /**
+     * @brief Flip a random bit in roughly one in every oneIn bytes that cross the bus, 0 to turn it off
+     * @details Corrupts bytes in both directions (the address and command bytes aren't touched), to
+     * exercise PEC checking and retries. Deterministic for a given seed.
+     */
+    void setByteErrorRate(uint32_t oneIn, uint32_t seed = 1);
+
+    /**
+     * @brief Model a harness that can't keep up with fast clocks
+     * @details Above this clock, roughly one in every RPB_1600_SIM_OVERCLOCK_ERROR_RATE bytes is
+     * corrupted (as well as any setByteErrorRate() errors). 0, the default, means any clock is fine.
+     */
+    void setMaxReliableClock(uint32_t frequency);
+
+    /**
+     * @brief Add a fixed delay to every byte on the bus, like a slave that stretches the clock
+     * @details Counts towards virtual time and getBusTimeMicros() on top of the bit times. 0, the
+     * default, adds nothing.
+     */
+    void setByteLatency(uint32_t nanoseconds);
+
+    /**
+     * @brief The number of bytes corrupted so far
+     */
+    uint32_t getCorruptedBytes(void) const;
+
+    uint32_t getClock(void) const;
+
+    /**
+     * @brief The number of transactions (writes and write-then-reads) the bus has carried
+     */
+    uint32_t getTransactionCount(void) const;
+
+    /**
+     * @brief The number of bytes moved in either direction, not counting address bytes
+     */
+    uint32_t getByteCount(void) const;
+
+    /**
+     * @brief How long the transactions so far would have kept a real bus busy at the current clock
+     * @details Counts 9 bit times per byte (8 data bits plus ACK), 1 for each start or repeated start,
+     * and 1 for each stop plus 5 for the bus free time that has to follow it.
+     */
+    uint32_t getBusTimeMicros(void) const;
+
+    void resetCounters(void);
+
+private:
+    RPB_1600_SimulatedCharger *my_units[RPB_1600_SIM_MAX_UNITS];
+    uint8_t my_num_units;
+    uint32_t my_clock;
+    uint32_t my_transaction_count;
+    uint32_t my_byte_count;
+    uint64_t my_bus_time_ns;
+    uint64_t my_now_ns;
+
+    /**
+     * @brief The transaction started by startWriteRead(), run once its latency has elapsed
+     */
+    bool my_async_in_flight;
+    uint8_t my_async_latency;
+    uint8_t my_async_polls_left;
+    uint8_t my_async_address;
+    uint8_t my_async_command;
+    uint8_t my_async_tx_length;
+    uint8_t *my_async_rx;
+    uint8_t my_async_rx_length;
+
+    uint32_t my_error_rate = 0;
+    uint32_t my_max_reliable_clock = 0;
+    uint32_t my_byte_latency_ns = 0;
+    uint32_t my_random = 1;
+    uint32_t my_corrupted_bytes = 0;
+
+    RPB_1600_SimulatedCharger *findUnit(uint8_t address);
+
+    /**
+     * @brief Apply the byte error rate to length bytes of data
+     */
+    void corrupt(uint8_t *data, uint8_t length);
+
+    /**
+     * @brief Add a write-then-read to the bus time, with or without the trailing stop
+     */
+    void addReadTime(uint8_t txLength, uint8_t rxLength, bool sendStop);
+
+    /**
+     * @brief Add bitCount bit times at the current clock to the bus time and virtual time
+     */
+    void addBitTime(uint32_t bitCount);
+
+    /**
+     * @brief Add the setByteLatency() delay for byteCount bytes (address bytes included)
+     */
+    void addByteLatency(uint32_t byteCount);
+
+    /**
+     * @brief A write-then-read, optionally leaving the bus held afterwards
+     */
+    uint8_t transfer(uint8_t address, const uint8_t *tx, uint8_t txLength,
+                     uint8_t *rx, uint8_t rxLength, uint8_t *received, bool sendStop);
+};
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+/**
+ * @brief An in-process stand-in for /dev/i2c-N that answers I2C_RDWR from an RPB_1600_SimulatedBus
+ * @details Hand it to RPB_1600_LinuxBus to run the Linux backend without hardware. Any path opens.
+ * Each run of write-then-read pairs in an ioctl goes to the simulated bus as one writeReadMany(), so
+ * bus time is counted the way a real adapter would spend it, and like a real adapter the ioctl fails
+ * as a whole (ENXIO for a NACK, EIO for anything else) if any transfer in it fails. Time is the
+ * simulated bus's virtual time. Every call takes a lock, so RPB_1600_LinuxBus's worker thread can use
+ * it alongside the thread that owns the bus.
+ */
+class RPB_1600_SimulatedI2cDev : public RPB_1600_LinuxIo
+{
+public:
+    RPB_1600_SimulatedI2cDev(RPB_1600_SimulatedBus &bus);
+
+    int open(const char *path, int flags) override;
+    int close(int fd) override;
+
+    /**
+     * @brief Answers I2C_FUNCS and I2C_RDWR, anything else fails with ENOTTY
+     */
+    int ioctl(int fd, unsigned long request, void *argument) override;
+
+    uint32_t micros(void) override;
+    void delayMicroseconds(uint32_t microseconds) override;
+
+    /**
+     * @brief Make the adapter SMBus-only, so I2C_FUNCS leaves out I2C_FUNC_I2C
+     */
+    void setSmbusOnly(bool smbusOnly);
+
+    /**
+     * @brief Make every I2C_RDWR take this long in real time, like an adapter waiting on a real bus
+     * @details The wait happens outside the lock. Virtual time isn't affected.
+     */
+    void setIoctlDelay(uint32_t microseconds);
+
+    /**
+     * @brief The number of ioctls made, of any kind, and the number of I2C messages they carried
+     */
+    uint32_t getIoctlCount(void) const;
+    uint32_t getMessageCount(void) const;
+
+    void resetCounters(void);
+
+private:
+    RPB_1600_SimulatedBus &my_bus;
+    mutable std::mutex my_mutex;
+    bool my_open = false;
+    bool my_smbus_only = false;
+    uint32_t my_ioctl_delay_us = 0;
+    uint32_t my_ioctl_count = 0;
+    uint32_t my_message_count = 0;
+
+    /**
+     * @brief Run the messages of one I2C_RDWR, returns 0 or an errno
+     */
+    int transfer(i2c_msg *messages, uint32_t count);
+};
+
+#endif // __linux__ && !ARDUINO
+
+#endif // RPB_1600_SIM_H
@@ -0,0 +1,177 @@
+#include "rpb-1600-stats.h"
+#include "rpb-1600-bus.h"
+#include <string.h>
+
+RPB_1600_Stats::RPB_1600_Stats()
+{
+    reset();
+}
+
+rpb_1600_transfer_result RPB_1600_Stats::classify(uint8_t busStatus, uint8_t received, uint8_t expected, bool pecOk)
+{
+    if (busStatus == RPB_1600_BUS_NACK)
+    {
+        return RPB_1600_TRANSFER_NACK;
+    }
+
+    if (busStatus != RPB_1600_BUS_OK)
+    {
+        return RPB_1600_TRANSFER_BUS_ERROR;
+    }
+
+    if (received < expected)
+    {
+        return RPB_1600_TRANSFER_SHORT_READ;
+    }
+
+    if (received > expected)
+    {
+        return RPB_1600_TRANSFER_OVER_LENGTH;
+    }
+
+    return pecOk ? RPB_1600_TRANSFER_OK : RPB_1600_TRANSFER_PEC_ERROR;
+}
+
+void RPB_1600_Stats::record(uint8_t commandID, rpb_1600_transfer_result result, uint8_t bytesWritten,
+                            uint8_t bytesRead, uint32_t latency_us)
+{
+    rpb_1600_command_stats *entry = findOrAddCommand(commandID);
+    rpb_1600_command_stats *targets[2] = {&my_totals, entry};
+    uint8_t num_targets = (entry != nullptr) ? 2 : 1;
+    uint8_t latency_bucket = bucket(latency_us);
+
+    if (entry == nullptr)
+    {
+        my_untracked++;
+    }
+
+    for (uint8_t i = 0; i < num_targets; i++)
+    {
+        rpb_1600_command_stats *stats = targets[i];
+
+        stats->transactions++;
+        stats->bytes_written += bytesWritten;
+        stats->bytes_read += bytesRead;
+        stats->latency_total_us += latency_us;
+        stats->histogram[latency_bucket]++;
+
+        if (latency_us > stats->latency_max_us)
+        {
+            stats->latency_max_us = latency_us;
+        }
+
+        switch (result)
+        {
+        case RPB_1600_TRANSFER_NACK:
+            stats->nacks++;
+            break;
+        case RPB_1600_TRANSFER_BUS_ERROR:
+            stats->bus_errors++;
+            break;
+        case RPB_1600_TRANSFER_SHORT_READ:
+            stats->short_reads++;
+            break;
+        case RPB_1600_TRANSFER_OVER_LENGTH:
+            stats->over_length++;
+            break;
+        case RPB_1600_TRANSFER_PEC_ERROR:
+            stats->pec_errors++;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+bool RPB_1600_Stats::getCommandStats(uint8_t commandID, rpb_1600_command_stats *stats) const
+{
+    for (uint8_t i = 0; i < my_num_commands; i++)
+    {
+        if (my_commands[i].command == commandID)
+        {
+            memcpy(stats, &my_commands[i], sizeof(*stats));
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint8_t RPB_1600_Stats::snapshot(rpb_1600_command_stats *stats, uint8_t maxCommands) const
+{
+    uint8_t count = (my_num_commands < maxCommands) ? my_num_commands : maxCommands;
+    memcpy(stats, my_commands, count * sizeof(*stats));
+    return count;
+}
+
+void RPB_1600_Stats::getTotals(rpb_1600_command_stats *stats) const
+{
+    memcpy(stats, &my_totals, sizeof(*stats));
+}
+
+uint32_t RPB_1600_Stats::getUntrackedTransactions(void) const
+{
+    return my_untracked;
+}
+
+void RPB_1600_Stats::reset(void)
+{
+    memset(my_commands, 0, sizeof(my_commands));
+    memset(&my_totals, 0, sizeof(my_totals));
+    my_num_commands = 0;
+    my_untracked = 0;
+}
+
+uint8_t RPB_1600_Stats::bucket(uint32_t latency_us)
+{
+    // floor(log2(latency_us)), with 0 and 1 both in bucket 0. CLZ is a single instruction on ARM.
+    // unsigned int is only 16 bits on AVR, unsigned long is at least 32 everywhere (64 on Linux).
+    uint8_t log2 = (latency_us > 1) ? 8 * sizeof(unsigned long) - 1 - __builtin_clzl(latency_us) : 0;
+    return (log2 < RPB_1600_STATS_BUCKETS) ? log2 : RPB_1600_STATS_BUCKETS - 1;
+}
+
+uint32_t RPB_1600_Stats::latencyPercentile(const rpb_1600_command_stats *stats, uint8_t percent)
+{
+    if (stats->transactions == 0)
+    {
+        return 0;
+    }
+
+    // Nearest rank, rounded up
+    uint64_t rank = ((uint64_t)stats->transactions * percent + 99) / 100;
+    uint64_t seen = 0;
+
+    for (uint8_t i = 0; i < RPB_1600_STATS_BUCKETS - 1; i++)
+    {
+        seen += stats->histogram[i];
+
+        if (seen >= rank)
+        {
+            // Everything in bucket i is under 2^(i+1), and nothing is over the max
+            uint32_t bound = (uint32_t)1 << (i + 1);
+            return (bound < stats->latency_max_us) ? bound : stats->latency_max_us;
+        }
+    }
+
+    return stats->latency_max_us;
+}
+
+rpb_1600_command_stats *RPB_1600_Stats::findOrAddCommand(uint8_t commandID)
+{
+    for (uint8_t i = 0; i < my_num_commands; i++)
+    {
+        if (my_commands[i].command == commandID)
+        {
+            return &my_commands[i];
+        }
+    }
+
+    if (my_num_commands == RPB_1600_STATS_COMMANDS)
+    {
+        return nullptr;
+    }
+
+    rpb_1600_command_stats *entry = &my_commands[my_num_commands++];
+    entry->command = commandID;
+    return entry;
+}
@@ -0,0 +1,124 @@
+#include <stdint.h>
+
+#ifndef RPB_1600_STATS_H
+#define RPB_1600_STATS_H
+
+/**
+ * @brief The number of command codes with their own counters. Transactions with commands past the
+ * first RPB_1600_STATS_COMMANDS still count towards the totals.
+ */
+#ifndef RPB_1600_STATS_COMMANDS
+#define RPB_1600_STATS_COMMANDS 24
+#endif
+
+/**
+ * @brief Latency histogram buckets. Bucket 0 counts transactions under 2us, bucket i (i > 0) counts
+ * [2^i, 2^(i+1)) us, and the last bucket counts everything from 2^(RPB_1600_STATS_BUCKETS - 1) us up.
+ */
+#define RPB_1600_STATS_BUCKETS 20
+
+/**
+ * @brief How a transaction ended, worst first when more than one applies
+ */
+enum rpb_1600_transfer_result : uint8_t
+{
+    RPB_1600_TRANSFER_OK = 0,
+    // The charger didn't acknowledge its address or a byte
+    RPB_1600_TRANSFER_NACK,
+    // Any other bus failure (arbitration lost, timeout, ...)
+    RPB_1600_TRANSFER_BUS_ERROR,
+    // Fewer bytes came back than we asked for
+    RPB_1600_TRANSFER_SHORT_READ,
+    // The charger had more bytes to send than we asked for
+    RPB_1600_TRANSFER_OVER_LENGTH,
+    // Right length, but the PEC didn't match
+    RPB_1600_TRANSFER_PEC_ERROR,
+};
+
+struct rpb_1600_command_stats
+{
+    // 0 for the totals
+    uint8_t command;
+    uint32_t transactions;
+    uint32_t nacks;
+    uint32_t bus_errors;
+    uint32_t short_reads;
+    uint32_t over_length;
+    uint32_t pec_errors;
+    // On the wire, not counting the address byte(s). Includes command codes and PEC bytes.
+    uint32_t bytes_written;
+    uint32_t bytes_read;
+    uint32_t latency_max_us;
+    uint64_t latency_total_us;
+    uint32_t histogram[RPB_1600_STATS_BUCKETS];
+};
+
+/**
+ * @brief Per command transaction counters and latency histograms, see RPB_1600::getStats()
+ * @details Compile with RPB_1600_STATS defined to have every RPB_1600 keep one.
+ */
+class RPB_1600_Stats
+{
+public:
+    RPB_1600_Stats();
+
+    /**
+     * @brief Work out how a transaction ended from what the bus reported
+     * @param expected The number of bytes asked for, including a PEC. 0 for writes.
+     * @param pecOk false if the response had the right length but failed its PEC check
+     */
+    static rpb_1600_transfer_result classify(uint8_t busStatus, uint8_t received, uint8_t expected, bool pecOk);
+
+    /**
+     * @brief Count one transaction
+     */
+    void record(uint8_t commandID, rpb_1600_transfer_result result, uint8_t bytesWritten, uint8_t bytesRead,
+                uint32_t latency_us);
+
+    /**
+     * @return false if there's nothing recorded for commandID
+     */
+    bool getCommandStats(uint8_t commandID, rpb_1600_command_stats *stats) const;
+
+    /**
+     * @brief Copy out the counters of up to maxCommands commands, in the order they were first seen
+     * @return The number copied
+     */
+    uint8_t snapshot(rpb_1600_command_stats *stats, uint8_t maxCommands) const;
+
+    /**
+     * @brief Every transaction, whether or not its command has its own counters
+     */
+    void getTotals(rpb_1600_command_stats *stats) const;
+
+    /**
+     * @brief Transactions whose command didn't get its own counters because the table was full
+     */
+    uint32_t getUntrackedTransactions(void) const;
+
+    /**
+     * @brief Zero everything
+     */
+    void reset(void);
+
+    /**
+     * @brief The histogram bucket latency_us falls in
+     */
+    static uint8_t bucket(uint32_t latency_us);
+
+    /**
+     * @brief An upper bound on the given percentile of latency, from the histogram
+     * @details Bucket resolution, so it's at most twice the real value. 0 if nothing's been recorded.
+     */
+    static uint32_t latencyPercentile(const rpb_1600_command_stats *stats, uint8_t percent);
+
+private:
+    rpb_1600_command_stats my_commands[RPB_1600_STATS_COMMANDS];
+    uint8_t my_num_commands;
+    rpb_1600_command_stats my_totals;
+    uint32_t my_untracked;
+
+    rpb_1600_command_stats *findOrAddCommand(uint8_t commandID);
+};
+
+#endif // RPB_1600_STATS_H
@@ -0,0 +1,203 @@
+#include "rpb-1600-stream.h"
+#include <string.h>
+
+uint16_t rpb1600StreamChecksum(const uint8_t *data, size_t length)
+{
+    uint16_t sum1 = 0;
+    uint16_t sum2 = 0;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        sum1 = (sum1 + data[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+
+    return (sum2 << 8) | sum1;
+}
+
+//----------------------------------------------------------------------
+// RPB_1600_StreamEncoder
+//----------------------------------------------------------------------
+
+RPB_1600_StreamEncoder::RPB_1600_StreamEncoder() : my_sequence(0)
+{
+    memset(my_previous, 0, sizeof(my_previous));
+    forceKeyframe();
+}
+
+size_t RPB_1600_StreamEncoder::encode(const uint16_t *words, uint32_t timestamp, uint8_t *out)
+{
+    // Send a delta frame if every channel moved by a signed byte's worth or less
+    bool delta = my_frames_since_keyframe < RPB_1600_STREAM_KEYFRAME_INTERVAL;
+
+    for (uint8_t i = 0; delta && i < RPB_1600_STREAM_CHANNELS; i++)
+    {
+        int32_t difference = (int32_t)words[i] - (int32_t)my_previous[i];
+        delta = difference >= -127 && difference <= 127;
+    }
+
+    out[0] = RPB_1600_STREAM_SYNC_0;
+    out[1] = RPB_1600_STREAM_SYNC_1;
+    out[2] = delta ? RPB_1600_STREAM_DELTA : RPB_1600_STREAM_KEYFRAME;
+    out[3] = delta ? RPB_1600_STREAM_CHANNELS : RPB_1600_STREAM_CHANNELS * 2;
+    out[4] = my_sequence & 0xFF;
+    out[5] = my_sequence >> 8;
+    out[6] = timestamp & 0xFF;
+    out[7] = (timestamp >> 8) & 0xFF;
+    out[8] = (timestamp >> 16) & 0xFF;
+    out[9] = (timestamp >> 24) & 0xFF;
+
+    uint8_t *payload = &out[RPB_1600_STREAM_HEADER_LENGTH];
+
+    for (uint8_t i = 0; i < RPB_1600_STREAM_CHANNELS; i++)
+    {
+        if (delta)
+        {
+            payload[i] = (uint8_t)(int8_t)((int32_t)words[i] - (int32_t)my_previous[i]);
+        }
+        else
+        {
+            payload[2 * i] = words[i] & 0xFF;
+            payload[2 * i + 1] = words[i] >> 8;
+        }
+
+        my_previous[i] = words[i];
+    }
+
+    size_t length = RPB_1600_STREAM_HEADER_LENGTH + out[3];
+    uint16_t checksum = rpb1600StreamChecksum(&out[2], length - 2);
+    out[length] = checksum & 0xFF;
+    out[length + 1] = checksum >> 8;
+
+    my_sequence++;
+    my_frames_since_keyframe = delta ? my_frames_since_keyframe + 1 : 0;
+
+    return length + RPB_1600_STREAM_CHECKSUM_LENGTH;
+}
+
+void RPB_1600_StreamEncoder::forceKeyframe(void)
+{
+    my_frames_since_keyframe = RPB_1600_STREAM_KEYFRAME_INTERVAL;
+}
+
+void RPB_1600_StreamEncoder::skip(void)
+{
+    my_sequence++;
+    forceKeyframe();
+}
+
+//----------------------------------------------------------------------
+// RPB_1600_StreamDecoder
+//----------------------------------------------------------------------
+
+RPB_1600_StreamDecoder::RPB_1600_StreamDecoder()
+    : my_length(0), my_have_previous(false), my_previous_sequence(0), my_checksum_errors(0), my_dropped_frames(0)
+{
+    memset(my_previous, 0, sizeof(my_previous));
+}
+
+bool RPB_1600_StreamDecoder::feed(uint8_t byte, stream_frame *frame)
+{
+    // Hunt for the two sync bytes
+    if (my_length == 0 && byte != RPB_1600_STREAM_SYNC_0)
+    {
+        return false;
+    }
+
+    if (my_length == 1 && byte != RPB_1600_STREAM_SYNC_1)
+    {
+        my_length = (byte == RPB_1600_STREAM_SYNC_0) ? 1 : 0;
+        return false;
+    }
+
+    my_buffer[my_length++] = byte;
+
+    // Sanity check the payload length as soon as we have it
+    if (my_length == 4 && my_buffer[3] > RPB_1600_STREAM_MAX_PAYLOAD_LENGTH)
+    {
+        // Probably a truncated frame followed by the start of the next one
+        my_length = (byte == RPB_1600_STREAM_SYNC_0) ? 1 : 0;
+        return false;
+    }
+
+    if (my_length < 4 || my_length < RPB_1600_STREAM_HEADER_LENGTH + my_buffer[3] + RPB_1600_STREAM_CHECKSUM_LENGTH)
+    {
+        return false;
+    }
+
+    my_length = 0;
+
+    return decodeFrame(frame);
+}
+
+uint32_t RPB_1600_StreamDecoder::getChecksumErrors(void) const
+{
+    return my_checksum_errors;
+}
+
+uint32_t RPB_1600_StreamDecoder::getDroppedFrames(void) const
+{
+    return my_dropped_frames;
+}
+
+bool RPB_1600_StreamDecoder::decodeFrame(stream_frame *frame)
+{
+    uint8_t payload_length = my_buffer[3];
+    size_t checked_length = RPB_1600_STREAM_HEADER_LENGTH + payload_length - 2;
+    uint16_t checksum = my_buffer[checked_length + 2] | (my_buffer[checked_length + 3] << 8);
+
+    if (checksum != rpb1600StreamChecksum(&my_buffer[2], checked_length))
+    {
+        my_checksum_errors++;
+        return false;
+    }
+
+    uint8_t type = my_buffer[2];
+    uint16_t sequence = my_buffer[4] | (my_buffer[5] << 8);
+    const uint8_t *payload = &my_buffer[RPB_1600_STREAM_HEADER_LENGTH];
+
+    bool in_order = my_have_previous && sequence == (uint16_t)(my_previous_sequence + 1);
+
+    if (my_have_previous && !in_order)
+    {
+        my_dropped_frames += (uint16_t)(sequence - my_previous_sequence - 1);
+    }
+
+    if (type == RPB_1600_STREAM_KEYFRAME && payload_length == RPB_1600_STREAM_CHANNELS * 2)
+    {
+        for (uint8_t i = 0; i < RPB_1600_STREAM_CHANNELS; i++)
+        {
+            my_previous[i] = payload[2 * i] | (payload[2 * i + 1] << 8);
+        }
+    }
+    else if (type == RPB_1600_STREAM_DELTA && payload_length == RPB_1600_STREAM_CHANNELS)
+    {
+        // Can't apply a delta to a frame we never saw, wait for the next keyframe
+        if (!in_order)
+        {
+            my_have_previous = false;
+            my_dropped_frames++;
+            return false;
+        }
+
+        for (uint8_t i = 0; i < RPB_1600_STREAM_CHANNELS; i++)
+        {
+            my_previous[i] += (int8_t)payload[i];
+        }
+    }
+    else
+    {
+        // Unknown frame type, skip it
+        return false;
+    }
+
+    my_have_previous = true;
+    my_previous_sequence = sequence;
+
+    frame->sequence = sequence;
+    frame->timestamp_us = (uint32_t)my_buffer[6] | ((uint32_t)my_buffer[7] << 8) |
+                          ((uint32_t)my_buffer[8] << 16) | ((uint32_t)my_buffer[9] << 24);
+    memcpy(frame->words, my_previous, sizeof(my_previous));
+
+    return true;
+}
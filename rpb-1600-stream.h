@@ -0,0 +1,142 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef RPB_1600_STREAM_H
+#define RPB_1600_STREAM_H
+
+/**
+ * This file defines a compact, framed binary format for streaming raw telemetry over a serial link,
+ * along with an encoder for the MCU side and a decoder for the host side.
+ *
+ * Frame layout (multi-byte fields little endian):
+ *   0     sync 0xA5
+ *   1     sync 0x5A
+ *   2     frame type (rpb_1600_stream_frame_type)
+ *   3     payload length
+ *   4-5   sequence number, increments by one every frame
+ *   6-9   timestamp in microseconds
+ *   10-   payload
+ *   last  Fletcher-16 checksum of everything from the frame type to the end of the payload
+ *
+ * Keyframe payloads are the raw words of every channel. Delta payloads are one signed byte per
+ * channel, the difference from the previous frame. The encoder sends a delta frame when every
+ * channel changed by less than +/-127 and sends a keyframe at least every RPB_1600_STREAM_KEYFRAME_INTERVAL
+ * frames, so a decoder that loses bytes catches up again quickly.
+ */
+
+#define RPB_1600_STREAM_SYNC_0 0xA5
+#define RPB_1600_STREAM_SYNC_1 0x5A
+
+/**
+ * @brief Channels in every frame: VIN, VOUT, IOUT, FAN_SPEED_1, FAN_SPEED_2 (same order as getReadings())
+ */
+#define RPB_1600_STREAM_CHANNELS 5
+
+#define RPB_1600_STREAM_HEADER_LENGTH 10
+#define RPB_1600_STREAM_CHECKSUM_LENGTH 2
+#define RPB_1600_STREAM_MAX_PAYLOAD_LENGTH (RPB_1600_STREAM_CHANNELS * 2)
+#define RPB_1600_STREAM_MAX_FRAME_LENGTH \
+    (RPB_1600_STREAM_HEADER_LENGTH + RPB_1600_STREAM_MAX_PAYLOAD_LENGTH + RPB_1600_STREAM_CHECKSUM_LENGTH)
+
+#define RPB_1600_STREAM_KEYFRAME_INTERVAL 32
+
+enum rpb_1600_stream_frame_type : uint8_t
+{
+    RPB_1600_STREAM_KEYFRAME = 1,
+    RPB_1600_STREAM_DELTA = 2,
+};
+
+/**
+ * @brief A decoded frame
+ */
+struct stream_frame
+{
+    uint16_t sequence;
+    uint32_t timestamp_us;
+    // Raw Linear11/Linear16 words as read from the charger, see rpb-1600-linear.h to decode them
+    uint16_t words[RPB_1600_STREAM_CHANNELS];
+};
+
+/**
+ * @brief Fletcher-16 checksum of length bytes
+ */
+uint16_t rpb1600StreamChecksum(const uint8_t *data, size_t length);
+
+/**
+ * @brief Builds frames on the MCU side
+ */
+class RPB_1600_StreamEncoder
+{
+public:
+    RPB_1600_StreamEncoder();
+
+    /**
+     * @brief Build the next frame
+     * @param words RPB_1600_STREAM_CHANNELS raw words in channel order
+     * @param out Must have room for RPB_1600_STREAM_MAX_FRAME_LENGTH bytes
+     * @return The length of the frame written to out[]
+     */
+    size_t encode(const uint16_t *words, uint32_t timestamp, uint8_t *out);
+
+    /**
+     * @brief Make the next frame a keyframe, e.g. when a host connects
+     */
+    void forceKeyframe(void);
+
+    /**
+     * @brief Use up a sequence number without building a frame, e.g. for a sample that couldn't be read
+     * @details The host sees the gap and counts the frame as dropped. The next frame is a keyframe,
+     * since the decoder can't apply a delta across a gap.
+     */
+    void skip(void);
+
+private:
+    uint16_t my_sequence;
+    uint16_t my_previous[RPB_1600_STREAM_CHANNELS];
+    uint8_t my_frames_since_keyframe;
+};
+
+/**
+ * @brief Reassembles frames from a byte stream on the host side
+ */
+class RPB_1600_StreamDecoder
+{
+public:
+    RPB_1600_StreamDecoder();
+
+    /**
+     * @brief Feed one byte from the stream
+     * @return true if that byte completed a valid frame, which is copied into frame
+     */
+    bool feed(uint8_t byte, stream_frame *frame);
+
+    /**
+     * @brief Frames thrown away because their checksum didn't match
+     */
+    uint32_t getChecksumErrors(void) const;
+
+    /**
+     * @brief Frames missing according to the sequence numbers, plus delta frames that had to be
+     * thrown away because the frame before them was missing
+     */
+    uint32_t getDroppedFrames(void) const;
+
+private:
+    uint8_t my_buffer[RPB_1600_STREAM_MAX_FRAME_LENGTH];
+    uint8_t my_length;
+
+    // State for reconstructing delta frames
+    bool my_have_previous;
+    uint16_t my_previous_sequence;
+    uint16_t my_previous[RPB_1600_STREAM_CHANNELS];
+
+    uint32_t my_checksum_errors;
+    uint32_t my_dropped_frames;
+
+    /**
+     * @brief Check and decode the complete frame in my_buffer
+     */
+    bool decodeFrame(stream_frame *frame);
+};
+
+#endif // RPB_1600_STREAM_H
@@ -0,0 +1,58 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef RPB_1600_TIME_H
+#define RPB_1600_TIME_H
+
+/**
+ * Helpers for periodic work timed against a wrapping micros() clock, shared by the scheduler,
+ * the fault monitor and the current share loop.
+ */
+
+/**
+ * @brief Whether a micros() timestamp has been reached
+ * @details The signed difference handles micros() wrapping, as long as the two are less than
+ * 2^31 us (about 35 minutes) apart
+ */
+inline bool rpb_1600_reached(uint32_t now, uint32_t time)
+{
+    return (int32_t)(now - time) >= 0;
+}
+
+/**
+ * @brief Moves a periodic deadline on by one period
+ * @details Keeps to the period, unless we've fallen a whole period behind, in which case the
+ * schedule starts again from restart
+ */
+inline void rpb_1600_advance(uint32_t *next, uint32_t now, uint32_t period, uint32_t restart)
+{
+    *next += period;
+
+    if (rpb_1600_reached(now, *next))
+    {
+        *next = restart;
+    }
+}
+
+/**
+ * @brief Whether periodic work is due, moving its deadline on to the next period if it is
+ * @param late If not null, set to how far past its deadline the work is when it's due
+ */
+inline bool rpb_1600_is_due(uint32_t now, uint32_t *next, uint32_t period, uint32_t *late = nullptr)
+{
+    if (!rpb_1600_reached(now, *next))
+    {
+        return false;
+    }
+
+    if (late != nullptr)
+    {
+        *late = now - *next;
+    }
+
+    rpb_1600_advance(next, now, period, now + period);
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,208 @@
+#include "rpb-1600-trace.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// Indexed by rpb_1600_trace_event
+static const char *const event_names[] = {
+    "?",
+    "READ",
+    "BURST_READ",
+    "ASYNC_READ",
+    "WRITE",
+    "CACHE_HIT",
+    "PEC_ERROR",
+    "CLOCK",
+    "SETTLED",
+    "SETTLE_TIMEOUT",
+};
+
+#define NUM_EVENT_NAMES (sizeof(event_names) / sizeof(event_names[0]))
+
+/**
+ * @brief snprintf() onto the end of what's already in out, even once out has filled up
+ */
+static int appendf(char *out, size_t length, int written, const char *format, ...)
+{
+    size_t used = ((size_t)written < length) ? (size_t)written : length;
+    va_list args;
+    va_start(args, format);
+    int result = vsnprintf(out + used, length - used, format, args);
+    va_end(args);
+    return result;
+}
+
+RPB_1600_Trace::RPB_1600_Trace()
+{
+    clear();
+}
+
+void RPB_1600_Trace::record(uint32_t timestamp, uint8_t event, uint8_t commandID, uint8_t status,
+                            const uint8_t *data, uint8_t length)
+{
+    uint16_t head = (my_tail + my_count) % RPB_1600_TRACE_RECORDS;
+
+    if (my_count == RPB_1600_TRACE_RECORDS)
+    {
+        // Full, the oldest record makes room
+        my_tail = (my_tail + 1) % RPB_1600_TRACE_RECORDS;
+        my_overwritten++;
+    }
+    else
+    {
+        my_count++;
+    }
+
+    fill(&my_records[head], timestamp, event, commandID, status, data, length);
+}
+
+void RPB_1600_Trace::recordValue(uint32_t timestamp, uint8_t event, uint8_t commandID, uint32_t value)
+{
+    uint8_t data[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+    record(timestamp, event, commandID, 0, data, sizeof(data));
+}
+
+uint16_t RPB_1600_Trace::read(rpb_1600_trace_record *records, uint16_t maxRecords)
+{
+    uint16_t num_read = 0;
+
+    while (num_read < maxRecords && my_count > 0)
+    {
+        records[num_read++] = my_records[my_tail];
+        my_tail = (my_tail + 1) % RPB_1600_TRACE_RECORDS;
+        my_count--;
+    }
+
+    return num_read;
+}
+
+size_t RPB_1600_Trace::dump(uint8_t address, uint8_t *out, size_t maxLength)
+{
+    if (maxLength < RPB_1600_TRACE_DUMP_HEADER_LENGTH)
+    {
+        return 0;
+    }
+
+    size_t room = (maxLength - RPB_1600_TRACE_DUMP_HEADER_LENGTH) / RPB_1600_TRACE_PACKED_LENGTH;
+    uint16_t num_records = (my_count < room) ? my_count : (uint16_t)room;
+
+    if (num_records == 0)
+    {
+        return 0;
+    }
+
+    packDumpHeader(address, num_records, out);
+
+    for (uint16_t i = 0; i < num_records; i++)
+    {
+        pack(&my_records[my_tail], &out[RPB_1600_TRACE_DUMP_HEADER_LENGTH + i * RPB_1600_TRACE_PACKED_LENGTH]);
+        my_tail = (my_tail + 1) % RPB_1600_TRACE_RECORDS;
+        my_count--;
+    }
+
+    return RPB_1600_TRACE_DUMP_HEADER_LENGTH + num_records * RPB_1600_TRACE_PACKED_LENGTH;
+}
+
+uint16_t RPB_1600_Trace::available(void) const
+{
+    return my_count;
+}
+
+uint32_t RPB_1600_Trace::getOverwritten(void) const
+{
+    return my_overwritten;
+}
+
+void RPB_1600_Trace::clear(void)
+{
+    my_tail = 0;
+    my_count = 0;
+    my_overwritten = 0;
+}
+
+void RPB_1600_Trace::fill(rpb_1600_trace_record *record, uint32_t timestamp, uint8_t event, uint8_t commandID,
+                          uint8_t status, const uint8_t *data, uint8_t length)
+{
+    record->timestamp_us = timestamp;
+    record->event = event;
+    record->command = commandID;
+    record->status = status;
+    record->length = length;
+    memcpy(record->data, data, (length < RPB_1600_TRACE_DATA_BYTES) ? length : RPB_1600_TRACE_DATA_BYTES);
+}
+
+void RPB_1600_Trace::pack(const rpb_1600_trace_record *record, uint8_t *out)
+{
+    out[0] = record->timestamp_us & 0xFF;
+    out[1] = (record->timestamp_us >> 8) & 0xFF;
+    out[2] = (record->timestamp_us >> 16) & 0xFF;
+    out[3] = (record->timestamp_us >> 24) & 0xFF;
+    out[4] = record->event;
+    out[5] = record->command;
+    out[6] = record->status;
+    out[7] = record->length;
+
+    // Don't leak whatever was in the unused part of data[]
+    uint8_t kept = (record->length < RPB_1600_TRACE_DATA_BYTES) ? record->length : RPB_1600_TRACE_DATA_BYTES;
+    memcpy(&out[8], record->data, kept);
+    memset(&out[8 + kept], 0, RPB_1600_TRACE_DATA_BYTES - kept);
+}
+
+void RPB_1600_Trace::unpack(const uint8_t *in, rpb_1600_trace_record *record)
+{
+    record->timestamp_us = (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+    record->event = in[4];
+    record->command = in[5];
+    record->status = in[6];
+    record->length = in[7];
+    memcpy(record->data, &in[8], RPB_1600_TRACE_DATA_BYTES);
+}
+
+void RPB_1600_Trace::packDumpHeader(uint8_t address, uint16_t numRecords, uint8_t *out)
+{
+    memcpy(out, RPB_1600_TRACE_MAGIC, 4);
+    out[4] = address;
+    out[5] = RPB_1600_TRACE_VERSION;
+    out[6] = numRecords & 0xFF;
+    out[7] = numRecords >> 8;
+}
+
+uint32_t RPB_1600_Trace::value(const rpb_1600_trace_record *record)
+{
+    return (uint32_t)record->data[0] | ((uint32_t)record->data[1] << 8) |
+           ((uint32_t)record->data[2] << 16) | ((uint32_t)record->data[3] << 24);
+}
+
+int RPB_1600_Trace::format(const rpb_1600_trace_record *record, char *out, size_t length)
+{
+    const char *name = (record->event < NUM_EVENT_NAMES) ? event_names[record->event] : event_names[0];
+
+    int written = snprintf(out, length, "%10lu %-14s cmd 0x%02x", (unsigned long)record->timestamp_us, name,
+                           record->command);
+
+    if (record->event == RPB_1600_TRACE_CLOCK)
+    {
+        return written + appendf(out, length, written, " %luHz", (unsigned long)value(record));
+    }
+
+    if (record->event == RPB_1600_TRACE_SETTLED || record->event == RPB_1600_TRACE_SETTLE_TIMEOUT)
+    {
+        return written + appendf(out, length, written, " %luus", (unsigned long)value(record));
+    }
+
+    written += appendf(out, length, written, " status %d, %d bytes:", record->status, record->length);
+
+    uint8_t kept = (record->length < RPB_1600_TRACE_DATA_BYTES) ? record->length : RPB_1600_TRACE_DATA_BYTES;
+
+    for (uint8_t i = 0; i < kept; i++)
+    {
+        written += appendf(out, length, written, " %02x", record->data[i]);
+    }
+
+    if (kept < record->length)
+    {
+        written += appendf(out, length, written, " ...");
+    }
+
+    return written;
+}
@@ -0,0 +1,158 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef RPB_1600_TRACE_H
+#define RPB_1600_TRACE_H
+
+/**
+ * This file defines a fixed size RAM ring of compact binary trace events, so the library can record
+ * what it puts on the bus without printing while it's doing it. Formatting happens later, either on
+ * the MCU with RPB_1600_Trace::format() or on a host with tools/trace-decode.
+ *
+ * Dump format (what tools/trace-decode reads), multi-byte fields little endian:
+ *   0-3    magic 'R' 'P' 'B' 'T'
+ *   4      charger address
+ *   5      format version
+ *   6-7    number of records that follow
+ *   8-     records, RPB_1600_TRACE_PACKED_LENGTH bytes each, oldest first (see pack())
+ */
+
+/**
+ * @brief Records the ring holds. When it's full, new records overwrite the oldest.
+ */
+#ifndef RPB_1600_TRACE_RECORDS
+#define RPB_1600_TRACE_RECORDS 128
+#endif
+
+/**
+ * @brief Raw bytes kept per record, the rest of a longer transfer is dropped (length still says how long it was)
+ */
+#define RPB_1600_TRACE_DATA_BYTES 8
+
+#define RPB_1600_TRACE_PACKED_LENGTH (8 + RPB_1600_TRACE_DATA_BYTES)
+#define RPB_1600_TRACE_DUMP_HEADER_LENGTH 8
+#define RPB_1600_TRACE_MAGIC "RPBT"
+#define RPB_1600_TRACE_VERSION 1
+
+/**
+ * @brief Long enough for any line format() writes
+ */
+#define RPB_1600_TRACE_LINE_LENGTH 96
+
+enum rpb_1600_trace_event : uint8_t
+{
+    // A register read with readWithCommand() and friends. status is the bus status, data is what came back.
+    RPB_1600_TRACE_READ = 1,
+    // One read of a readMany() burst
+    RPB_1600_TRACE_BURST_READ,
+    // A queued read (submitRead(), snapshots) that finished
+    RPB_1600_TRACE_ASYNC_READ,
+    // A write. data is what followed the command code, including any PEC.
+    RPB_1600_TRACE_WRITE,
+    // A read answered from the cache
+    RPB_1600_TRACE_CACHE_HIT,
+    // A response that failed its PEC check, data is the response and its PEC
+    RPB_1600_TRACE_PEC_ERROR,
+    // The bus clock changed, data is the new frequency
+    RPB_1600_TRACE_CLOCK,
+    // A confirmed write read back, data is the settle time in microseconds
+    RPB_1600_TRACE_SETTLED,
+    // A confirmed write didn't read back in time, data is the timeout in microseconds
+    RPB_1600_TRACE_SETTLE_TIMEOUT,
+};
+
+struct rpb_1600_trace_record
+{
+    // RPB_1600_Bus::micros() when the event was recorded
+    uint32_t timestamp_us;
+    uint8_t event;
+    uint8_t command;
+    uint8_t status;
+    // Bytes the event carried, which may be more than the RPB_1600_TRACE_DATA_BYTES kept
+    uint8_t length;
+    uint8_t data[RPB_1600_TRACE_DATA_BYTES];
+};
+
+/**
+ * @brief A ring of trace records, see RPB_1600::getTrace()
+ * @details Compile with RPB_1600_TRACE defined to have every RPB_1600 keep one.
+ */
+class RPB_1600_Trace
+{
+public:
+    RPB_1600_Trace();
+
+    /**
+     * @brief Add a record, overwriting the oldest one if the ring is full
+     */
+    void record(uint32_t timestamp, uint8_t event, uint8_t commandID, uint8_t status, const uint8_t *data,
+                uint8_t length);
+
+    /**
+     * @brief Add a record that carries a single number, like a frequency or a time
+     */
+    void recordValue(uint32_t timestamp, uint8_t event, uint8_t commandID, uint32_t value);
+
+    /**
+     * @brief Take up to maxRecords records out of the ring, oldest first
+     * @return The number taken
+     */
+    uint16_t read(rpb_1600_trace_record *records, uint16_t maxRecords);
+
+    /**
+     * @brief Take as many records as fit in out and write them there in the dump format, header first
+     * @details Call it until it returns 0 to empty the ring. address goes in the header, so dumps
+     * from more than one charger can go down the same serial port.
+     * @return The number of bytes written to out, 0 if the ring is empty or out can't hold one record
+     */
+    size_t dump(uint8_t address, uint8_t *out, size_t maxLength);
+
+    /**
+     * @brief Records waiting to be read
+     */
+    uint16_t available(void) const;
+
+    /**
+     * @brief Records overwritten before anyone read them
+     */
+    uint32_t getOverwritten(void) const;
+
+    void clear(void);
+
+    /**
+     * @brief Fill in a record, what record() does without the ring
+     */
+    static void fill(rpb_1600_trace_record *record, uint32_t timestamp, uint8_t event, uint8_t commandID,
+                     uint8_t status, const uint8_t *data, uint8_t length);
+
+    /**
+     * @brief Serialize a record into RPB_1600_TRACE_PACKED_LENGTH bytes, and back
+     */
+    static void pack(const rpb_1600_trace_record *record, uint8_t *out);
+    static void unpack(const uint8_t *in, rpb_1600_trace_record *record);
+
+    /**
+     * @brief Write the dump header for numRecords records into out (RPB_1600_TRACE_DUMP_HEADER_LENGTH bytes)
+     */
+    static void packDumpHeader(uint8_t address, uint16_t numRecords, uint8_t *out);
+
+    /**
+     * @brief The value a recordValue() record carries
+     */
+    static uint32_t value(const rpb_1600_trace_record *record);
+
+    /**
+     * @brief Print a record as one line of text, without a newline
+     * @return The length of the line, as snprintf() would
+     */
+    static int format(const rpb_1600_trace_record *record, char *out, size_t length);
+
+private:
+    rpb_1600_trace_record my_records[RPB_1600_TRACE_RECORDS];
+    // Index of the oldest record
+    uint16_t my_tail;
+    uint16_t my_count;
+    uint32_t my_overwritten;
+};
+
+#endif // RPB_1600_TRACE_H
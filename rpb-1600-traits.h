@@ -0,0 +1,369 @@
+#include <stdint.h>
+#include <string.h>
+#include "rpb-1600-commands.h"
+#include "rpb-1600-linear.h"
+
+#ifndef RPB_1600_TRAITS_H
+#define RPB_1600_TRAITS_H
+
+/**
+ * This file describes every command in rpb-1600-commands.h as a type, so the code, length, data
+ * format and access of a command travel together and are checked by the compiler. Use them with
+ * RPB_1600::read<>(), RPB_1600::write<>() and RPB_1600::readAll<>(), e.g.
+ *
+ *   float vout;
+ *   charger.read<rpb_1600_cmd::read_vout>(&vout);
+ *   charger.write<rpb_1600_cmd::curve_cv>(28.8f);
+ *
+ * Everything is resolved at compile time: each call is the one bus transaction plus the decode (or
+ * encode) for that command's format.
+ *
+ * With RPB_1600_FIXED_POINT the Linear11 and Linear16 commands take int32_t thousandths instead of
+ * floats, e.g. charger.write<rpb_1600_cmd::curve_cv>(28800).
+ */
+
+#ifdef RPB_1600_FIXED_POINT
+/**
+ * @brief Linear values are integers in 1/RPB_1600_FIXED_SCALE of their unit with RPB_1600_FIXED_POINT
+ */
+#define RPB_1600_FIXED_SCALE 1000
+#endif
+
+/**
+ * @brief How a command's bytes map to a value
+ */
+enum rpb_1600_encoding : uint8_t
+{
+    // 1 byte, uint8_t
+    RPB_1600_ENCODING_BYTE,
+    // 2 bytes, low byte first, uint16_t (status and config bitfields)
+    RPB_1600_ENCODING_WORD,
+    // 2 bytes of Linear11, float (int32_t thousandths with RPB_1600_FIXED_POINT). N is the exponent
+    // used when writing.
+    RPB_1600_ENCODING_LINEAR11,
+    // 2 bytes of Linear16 with a fixed exponent N, float (int32_t thousandths with RPB_1600_FIXED_POINT)
+    RPB_1600_ENCODING_LINEAR16,
+    // An SMBus block read: a byte count, then up to Length bytes, rpb_1600_block<Length> (manufacturer strings)
+    RPB_1600_ENCODING_BLOCK,
+};
+
+enum rpb_1600_access : uint8_t
+{
+    RPB_1600_ACCESS_READ = 1,
+    RPB_1600_ACCESS_WRITE = 2,
+    RPB_1600_ACCESS_READ_WRITE = 3,
+};
+
+/**
+ * @brief The value of a RPB_1600_ENCODING_BLOCK command
+ */
+template <uint8_t Length>
+struct rpb_1600_block
+{
+    // How many of bytes the charger sent, the rest are 0
+    uint8_t length;
+    uint8_t bytes[Length];
+};
+
+//----------------------------------------------------------------------
+// Codecs, one per encoding
+//----------------------------------------------------------------------
+
+template <rpb_1600_encoding Encoding, uint8_t Length>
+struct rpb_1600_codec;
+
+template <uint8_t Length>
+struct rpb_1600_codec<RPB_1600_ENCODING_BYTE, Length>
+{
+    static_assert(Length == 1, "Byte commands are 1 byte long");
+    typedef uint8_t value_type;
+
+    static value_type decode(const uint8_t *data, int8_t) { return data[0]; }
+
+    static bool encode(value_type value, int8_t, uint8_t *data)
+    {
+        data[0] = value;
+        return true;
+    }
+};
+
+template <uint8_t Length>
+struct rpb_1600_codec<RPB_1600_ENCODING_WORD, Length>
+{
+    static_assert(Length == 2, "Word commands are 2 bytes long");
+    typedef uint16_t value_type;
+
+    static value_type decode(const uint8_t *data, int8_t) { return linear_word(data); }
+
+    static bool encode(value_type value, int8_t, uint8_t *data)
+    {
+        data[0] = value & 0xFF;
+        data[1] = value >> 8;
+        return true;
+    }
+};
+
+template <uint8_t Length>
+struct rpb_1600_codec<RPB_1600_ENCODING_LINEAR11, Length>
+{
+    static_assert(Length == 2, "Linear11 commands are 2 bytes long");
+#ifdef RPB_1600_FIXED_POINT
+    typedef int32_t value_type;
+
+    static value_type decode(const uint8_t *data, int8_t)
+    {
+        uint16_t word = linear_word(data);
+        return linear_scale_narrow(linear11_mantissa(word), linear11_exponent(word), RPB_1600_FIXED_SCALE);
+    }
+
+    static bool encode(value_type value, int8_t N, uint8_t *data)
+    {
+        if (!linear11_fits_narrow(value, RPB_1600_FIXED_SCALE, N))
+        {
+            return false;
+        }
+
+        uint16_t word = linear11_from_scaled_narrow(value, RPB_1600_FIXED_SCALE, N);
+#else
+    typedef float value_type;
+
+    static value_type decode(const uint8_t *data, int8_t) { return linear11_to_float(linear_word(data)); }
+
+    static bool encode(value_type value, int8_t N, uint8_t *data)
+    {
+        if (!linear11_fits_float(value, N))
+        {
+            return false;
+        }
+
+        uint16_t word = linear11_from_float(value, N);
+#endif
+        data[0] = word & 0xFF;
+        data[1] = word >> 8;
+        return true;
+    }
+};
+
+template <uint8_t Length>
+struct rpb_1600_codec<RPB_1600_ENCODING_LINEAR16, Length>
+{
+    static_assert(Length == 2, "Linear16 commands are 2 bytes long");
+#ifdef RPB_1600_FIXED_POINT
+    typedef int32_t value_type;
+
+    static value_type decode(const uint8_t *data, int8_t N)
+    {
+        return linear_scale_narrow(linear_word(data), N, RPB_1600_FIXED_SCALE);
+    }
+
+    static bool encode(value_type value, int8_t N, uint8_t *data)
+    {
+        if (!linear16_fits_narrow(value, RPB_1600_FIXED_SCALE, N))
+        {
+            return false;
+        }
+
+        uint16_t word = linear16_from_scaled_narrow(value, RPB_1600_FIXED_SCALE, N);
+#else
+    typedef float value_type;
+
+    static value_type decode(const uint8_t *data, int8_t N) { return linear16_to_float(linear_word(data), N); }
+
+    static bool encode(value_type value, int8_t N, uint8_t *data)
+    {
+        if (!linear16_fits_float(value, N))
+        {
+            return false;
+        }
+
+        uint16_t word = linear16_from_float(value, N);
+#endif
+        data[0] = word & 0xFF;
+        data[1] = word >> 8;
+        return true;
+    }
+};
+
+template <uint8_t Length>
+struct rpb_1600_codec<RPB_1600_ENCODING_BLOCK, Length>
+{
+    typedef rpb_1600_block<Length> value_type;
+
+    // data is the block as it came off the bus, byte count first
+    static value_type decode(const uint8_t *data, int8_t)
+    {
+        value_type value;
+        value.length = (data[0] < Length) ? data[0] : Length;
+        memset(value.bytes, 0, Length);
+        memcpy(value.bytes, &data[1], value.length);
+        return value;
+    }
+
+    static bool encode(const value_type &value, int8_t, uint8_t *data)
+    {
+        if (value.length > Length)
+        {
+            return false;
+        }
+
+        data[0] = value.length;
+        memcpy(&data[1], value.bytes, value.length);
+        return true;
+    }
+};
+
+//----------------------------------------------------------------------
+// Commands
+//----------------------------------------------------------------------
+
+/**
+ * @brief Everything about one command
+ */
+template <uint8_t Code, uint8_t Length, rpb_1600_encoding Encoding, int8_t N, rpb_1600_access Access>
+struct rpb_1600_command
+{
+    typedef rpb_1600_codec<Encoding, Length> codec;
+    typedef typename codec::value_type value_type;
+
+    static constexpr uint8_t code = Code;
+    static constexpr uint8_t length = Length;
+    static constexpr rpb_1600_encoding encoding = Encoding;
+    static constexpr bool block = Encoding == RPB_1600_ENCODING_BLOCK;
+    // What goes over the bus, which for a block read includes the byte count
+    static constexpr uint8_t wire_length = block ? Length + 1 : Length;
+    static constexpr int8_t exponent = N;
+    static constexpr bool readable = (Access & RPB_1600_ACCESS_READ) != 0;
+    static constexpr bool writable = (Access & RPB_1600_ACCESS_WRITE) != 0;
+
+    static value_type decode(const uint8_t *data) { return codec::decode(data, N); }
+
+    /**
+     * @return false if value doesn't fit the command's format
+     */
+    static bool encode(const value_type &value, uint8_t *data) { return codec::encode(value, N, data); }
+};
+
+namespace rpb_1600_cmd
+{
+typedef rpb_1600_command<CMD_CODE_OPERATION, CMD_LENGTH_OPERATION, RPB_1600_ENCODING_BYTE, 0, RPB_1600_ACCESS_READ_WRITE> operation;
+typedef rpb_1600_command<CMD_CODE_ON_OFF_CONFIG, CMD_LENGTH_ON_OFF_CONFIG, RPB_1600_ENCODING_BYTE, 0, RPB_1600_ACCESS_READ_WRITE> on_off_config;
+typedef rpb_1600_command<CMD_CODE_CAPABILITY, CMD_LENGTH_CAPABILITY, RPB_1600_ENCODING_BYTE, 0, RPB_1600_ACCESS_READ> capability;
+typedef rpb_1600_command<CMD_CODE_VOUT_MODE, CMD_LENGTH_VOUT_MODE, RPB_1600_ENCODING_BYTE, 0, RPB_1600_ACCESS_READ> vout_mode;
+typedef rpb_1600_command<CMD_CODE_VOUT_COMMAND, CMD_LENGTH_VOUT_COMMAND, RPB_1600_ENCODING_LINEAR16, CMD_N_VALUE_VOUT_COMMAND, RPB_1600_ACCESS_READ_WRITE> vout_command;
+typedef rpb_1600_command<CMD_CODE_VOUT_TRIM, CMD_LENGTH_VOUT_TRIM, RPB_1600_ENCODING_LINEAR16, CMD_N_VALUE_VOUT_TRIM, RPB_1600_ACCESS_READ_WRITE> vout_trim;
+typedef rpb_1600_command<CMD_CODE_IOUT_OC_FAULT_LIMIT, CMD_LENGTH_IOUT_OC_FAULT_LIMIT, RPB_1600_ENCODING_LINEAR11, CMD_N_VALUE_IOUT_OC_FAULT_LIMIT, RPB_1600_ACCESS_READ_WRITE> iout_oc_fault_limit;
+typedef rpb_1600_command<CMD_CODE_IOUT_OC_FAULT_RESPONSE, CMD_LENGTH_IOUT_OC_FAULT_RESPONSE, RPB_1600_ENCODING_BYTE, 0, RPB_1600_ACCESS_READ> iout_oc_fault_response;
+typedef rpb_1600_command<CMD_CODE_STATUS_WORD, CMD_LENGTH_STATUS_WORD, RPB_1600_ENCODING_WORD, 0, RPB_1600_ACCESS_READ> status_word;
+typedef rpb_1600_command<CMD_CODE_STATUS_VOUT, CMD_LENGTH_STATUS_VOUT, RPB_1600_ENCODING_BYTE, 0, RPB_1600_ACCESS_READ> status_vout;
+typedef rpb_1600_command<CMD_CODE_STATUS_IOUT, CMD_LENGTH_STATUS_IOUT, RPB_1600_ENCODING_BYTE, 0, RPB_1600_ACCESS_READ> status_iout;
+typedef rpb_1600_command<CMD_CODE_STATUS_INPUT, CMD_LENGTH_STATUS_INPUT, RPB_1600_ENCODING_BYTE, 0, RPB_1600_ACCESS_READ> status_input;
+typedef rpb_1600_command<CMD_CODE_STATUS_TEMPERATURE, CMD_LENGTH_STATUS_TEMPERATURE, RPB_1600_ENCODING_BYTE, 0, RPB_1600_ACCESS_READ> status_temperature;
+typedef rpb_1600_command<CMD_CODE_STATUS_CML, CMD_LENGTH_STATUS_CML, RPB_1600_ENCODING_BYTE, 0, RPB_1600_ACCESS_READ> status_cml;
+typedef rpb_1600_command<CMD_CODE_STATUS_MFR_SPECIFIC, CMD_LENGTH_STATUS_MFR_SPECIFIC, RPB_1600_ENCODING_BYTE, 0, RPB_1600_ACCESS_READ> status_mfr_specific;
+typedef rpb_1600_command<CMD_CODE_STATUS_FANS_1_2, CMD_LENGTH_STATUS_FANS_1_2, RPB_1600_ENCODING_BYTE, 0, RPB_1600_ACCESS_READ> status_fans_1_2;
+typedef rpb_1600_command<CMD_CODE_READ_VIN, CMD_LENGTH_READ_VIN, RPB_1600_ENCODING_LINEAR11, CMD_N_VALUE_READ_VIN, RPB_1600_ACCESS_READ> read_vin;
+typedef rpb_1600_command<CMD_CODE_READ_VOUT, CMD_LENGTH_READ_VOUT, RPB_1600_ENCODING_LINEAR16, CMD_N_VALUE_READ_VOUT, RPB_1600_ACCESS_READ> read_vout;
+typedef rpb_1600_command<CMD_CODE_READ_IOUT, CMD_LENGTH_READ_IOUT, RPB_1600_ENCODING_LINEAR11, CMD_N_VALUE_READ_IOUT, RPB_1600_ACCESS_READ> read_iout;
+typedef rpb_1600_command<CMD_CODE_READ_FAN_SPEED_1, CMD_LENGTH_READ_FAN_SPEED_1, RPB_1600_ENCODING_LINEAR11, CMD_N_VALUE_READ_FAN_SPEED_1, RPB_1600_ACCESS_READ> read_fan_speed_1;
+typedef rpb_1600_command<CMD_CODE_READ_FAN_SPEED_2, CMD_LENGTH_READ_FAN_SPEED_2, RPB_1600_ENCODING_LINEAR11, CMD_N_VALUE_READ_FAN_SPEED_2, RPB_1600_ACCESS_READ> read_fan_speed_2;
+typedef rpb_1600_command<CMD_CODE_PMBUS_REVISION, CMD_LENGTH_PMBUS_REVISION, RPB_1600_ENCODING_BYTE, 0, RPB_1600_ACCESS_READ> pmbus_revision;
+typedef rpb_1600_command<CMD_CODE_MFR_ID, CMD_LENGTH_MFR_ID, RPB_1600_ENCODING_BLOCK, 0, RPB_1600_ACCESS_READ> mfr_id;
+typedef rpb_1600_command<CMD_CODE_MFR_MODEL, CMD_LENGTH_MFR_MODEL, RPB_1600_ENCODING_BLOCK, 0, RPB_1600_ACCESS_READ> mfr_model;
+typedef rpb_1600_command<CMD_CODE_MFR_REVISION, CMD_LENGTH_MFR_REVISION, RPB_1600_ENCODING_BLOCK, 0, RPB_1600_ACCESS_READ> mfr_revision;
+typedef rpb_1600_command<CMD_CODE_MFR_LOCATION, CMD_LENGTH_MFR_LOCATION, RPB_1600_ENCODING_BLOCK, 0, RPB_1600_ACCESS_READ> mfr_location;
+typedef rpb_1600_command<CMD_CODE_MFR_DATE, CMD_LENGTH_MFR_DATE, RPB_1600_ENCODING_BLOCK, 0, RPB_1600_ACCESS_READ> mfr_date;
+typedef rpb_1600_command<CMD_CODE_MFR_SERIAL, CMD_LENGTH_MFR_SERIAL, RPB_1600_ENCODING_BLOCK, 0, RPB_1600_ACCESS_READ> mfr_serial;
+typedef rpb_1600_command<CMD_CODE_CURVE_CC, CMD_LENGTH_CURVE_CC, RPB_1600_ENCODING_LINEAR11, CMD_N_VALUE_CURVE_CC, RPB_1600_ACCESS_READ_WRITE> curve_cc;
+typedef rpb_1600_command<CMD_CODE_CURVE_CV, CMD_LENGTH_CURVE_CV, RPB_1600_ENCODING_LINEAR16, CMD_N_VALUE_CURVE_CV, RPB_1600_ACCESS_READ_WRITE> curve_cv;
+typedef rpb_1600_command<CMD_CODE_CURVE_FV, CMD_LENGTH_CURVE_FV, RPB_1600_ENCODING_LINEAR16, CMD_N_VALUE_CURVE_FV, RPB_1600_ACCESS_READ_WRITE> curve_fv;
+typedef rpb_1600_command<CMD_CODE_CURVE_TC, CMD_LENGTH_CURVE_TC, RPB_1600_ENCODING_LINEAR11, CMD_N_VALUE_CURVE_TC, RPB_1600_ACCESS_READ_WRITE> curve_tc;
+typedef rpb_1600_command<CMD_CODE_CURVE_CONFIG, CMD_LENGTH_CURVE_CONFIG, RPB_1600_ENCODING_WORD, 0, RPB_1600_ACCESS_READ_WRITE> curve_config;
+typedef rpb_1600_command<CMD_CODE_CURVE_CC_TIMEOUT, CMD_LENGTH_CURVE_CC_TIMEOUT, RPB_1600_ENCODING_LINEAR11, CMD_N_VALUE_CURVE_CC_TIMEOUT, RPB_1600_ACCESS_READ_WRITE> curve_cc_timeout;
+typedef rpb_1600_command<CMD_CODE_CURVE_CV_TIMEOUT, CMD_LENGTH_CURVE_CV_TIMEOUT, RPB_1600_ENCODING_LINEAR11, CMD_N_VALUE_CURVE_CV_TIMEOUT, RPB_1600_ACCESS_READ_WRITE> curve_cv_timeout;
+typedef rpb_1600_command<CMD_CODE_CURVE_FLOAT_TIMEOUT, CMD_LENGTH_CURVE_FLOAT_TIMEOUT, RPB_1600_ENCODING_LINEAR11, CMD_N_VALUE_CURVE_FLOAT_TIMEOUT, RPB_1600_ACCESS_READ_WRITE> curve_float_timeout;
+typedef rpb_1600_command<CMD_CODE_CHG_STATUS, CMD_LENGTH_CHG_STATUS, RPB_1600_ENCODING_WORD, 0, RPB_1600_ACCESS_READ> chg_status;
+} // namespace rpb_1600_cmd
+
+//----------------------------------------------------------------------
+// Lists of commands
+//----------------------------------------------------------------------
+
+/**
+ * @brief Compile time facts about a list of commands, and the pieces of RPB_1600::readAll<>()
+ */
+template <typename... Cmds>
+struct rpb_1600_command_list;
+
+template <>
+struct rpb_1600_command_list<>
+{
+    static constexpr bool contains(uint8_t) { return false; }
+    static constexpr bool unique(void) { return true; }
+    static constexpr bool readable(void) { return true; }
+    static constexpr uint8_t max_length(void) { return 0; }
+
+    template <typename Item>
+    static void prepare(Item *, uint8_t *, uint8_t) {}
+
+    template <typename Item>
+    static void decode(const Item *) {}
+};
+
+template <typename Cmd, typename... Rest>
+struct rpb_1600_command_list<Cmd, Rest...>
+{
+    typedef rpb_1600_command_list<Rest...> rest;
+
+    static constexpr bool contains(uint8_t code) { return Cmd::code == code || rest::contains(code); }
+    static constexpr bool unique(void) { return !rest::contains(Cmd::code) && rest::unique(); }
+    static constexpr bool readable(void) { return Cmd::readable && rest::readable(); }
+    static constexpr uint8_t max_length(void)
+    {
+        return Cmd::wire_length > rest::max_length() ? Cmd::wire_length : rest::max_length();
+    }
+
+    /**
+     * @brief Fill in one readMany() item per command, reading into raw[stride * i]
+     */
+    template <typename Item>
+    static void prepare(Item *items, uint8_t *raw, uint8_t stride)
+    {
+        items[0] = Item{Cmd::code, Cmd::wire_length, raw, false, Cmd::block};
+        rest::prepare(&items[1], raw + stride, stride);
+    }
+
+    /**
+     * @brief Decode the items that were read successfully into their values, leave the rest alone
+     */
+    template <typename Item>
+    static void decode(const Item *items, typename Cmd::value_type *value, typename Rest::value_type *...values)
+    {
+        if (items[0].success)
+        {
+            *value = Cmd::decode(items[0].destination);
+        }
+
+        rest::decode(&items[1], values...);
+    }
+};
+
+/**
+ * @brief Every command in rpb-1600-commands.h
+ */
+typedef rpb_1600_command_list<
+    rpb_1600_cmd::operation, rpb_1600_cmd::on_off_config, rpb_1600_cmd::capability, rpb_1600_cmd::vout_mode,
+    rpb_1600_cmd::vout_command, rpb_1600_cmd::vout_trim, rpb_1600_cmd::iout_oc_fault_limit,
+    rpb_1600_cmd::iout_oc_fault_response, rpb_1600_cmd::status_word, rpb_1600_cmd::status_vout,
+    rpb_1600_cmd::status_iout, rpb_1600_cmd::status_input, rpb_1600_cmd::status_temperature,
+    rpb_1600_cmd::status_cml, rpb_1600_cmd::status_mfr_specific, rpb_1600_cmd::status_fans_1_2,
+    rpb_1600_cmd::read_vin, rpb_1600_cmd::read_vout, rpb_1600_cmd::read_iout, rpb_1600_cmd::read_fan_speed_1,
+    rpb_1600_cmd::read_fan_speed_2, rpb_1600_cmd::pmbus_revision, rpb_1600_cmd::mfr_id, rpb_1600_cmd::mfr_model,
+    rpb_1600_cmd::mfr_revision, rpb_1600_cmd::mfr_location, rpb_1600_cmd::mfr_date, rpb_1600_cmd::mfr_serial,
+    rpb_1600_cmd::curve_cc, rpb_1600_cmd::curve_cv, rpb_1600_cmd::curve_fv, rpb_1600_cmd::curve_tc,
+    rpb_1600_cmd::curve_config, rpb_1600_cmd::curve_cc_timeout, rpb_1600_cmd::curve_cv_timeout,
+    rpb_1600_cmd::curve_float_timeout, rpb_1600_cmd::chg_status>
+    rpb_1600_all_commands;
+
+static_assert(rpb_1600_all_commands::unique(), "Two commands in rpb-1600-commands.h have the same code");
+
+#endif // RPB_1600_TRAITS_H
@@ -0,0 +1,130 @@
+#include "rpb-1600-wire.h"
+
+#ifdef ARDUINO
+
+RPB_1600_WireBus RPB_1600_DefaultWireBus(Wire);
+
+RPB_1600_WireBus::RPB_1600_WireBus(TwoWire &wire) : my_wire(wire)
+{
+}
+
+void RPB_1600_WireBus::begin(void)
+{
+    my_wire.begin();
+}
+
+void RPB_1600_WireBus::setClock(uint32_t frequency)
+{
+    my_wire.setClock(frequency);
+}
+
+uint32_t RPB_1600_WireBus::micros(void)
+{
+    return ::micros();
+}
+
+void RPB_1600_WireBus::delayMicroseconds(uint32_t microseconds)
+{
+    // delayMicroseconds() is only accurate up to a few milliseconds on some boards
+    if (microseconds >= 1000)
+    {
+        ::delay(microseconds / 1000);
+        microseconds %= 1000;
+    }
+
+    ::delayMicroseconds(microseconds);
+}
+
+uint8_t RPB_1600_WireBus::write(uint8_t address, const uint8_t *data, uint8_t length)
+{
+    my_wire.beginTransmission(address);
+    uint8_t bytes_written = my_wire.write(data, length);
+    uint8_t error = my_wire.endTransmission();
+
+    if (bytes_written != length)
+    {
+        return RPB_1600_BUS_ERROR;
+    }
+
+    return toBusStatus(error);
+}
+
+uint8_t RPB_1600_WireBus::writeRead(uint8_t address, const uint8_t *tx, uint8_t txLength,
+                                    uint8_t *rx, uint8_t rxLength, uint8_t *received)
+{
+    return transfer(address, tx, txLength, rx, rxLength, received, true);
+}
+
+uint8_t RPB_1600_WireBus::writeReadMany(uint8_t address, rpb_1600_bus_transfer *transfers, uint8_t count)
+{
+    uint8_t num_ok = 0;
+
+    // Hold the bus for the whole burst: every transfer after the first starts with a repeated start,
+    // and only the last one ends with a stop
+    for (uint8_t i = 0; i < count; i++)
+    {
+        rpb_1600_bus_transfer *t = &transfers[i];
+        t->status = transfer(address, t->tx, t->tx_length, t->rx, t->rx_length, &t->received, i == count - 1);
+
+        if (t->status == RPB_1600_BUS_OK)
+        {
+            num_ok++;
+        }
+    }
+
+    return num_ok;
+}
+
+uint8_t RPB_1600_WireBus::transfer(uint8_t address, const uint8_t *tx, uint8_t txLength,
+                                   uint8_t *rx, uint8_t rxLength, uint8_t *received, bool sendStop)
+{
+    *received = 0;
+
+    // Send the command ID to the charger, and don't terminate the transmission
+    my_wire.beginTransmission(address);
+    my_wire.write(tx, txLength);
+    uint8_t error = my_wire.endTransmission(false);
+
+    if (error != 0)
+    {
+        return toBusStatus(error);
+    }
+
+    // Repeated start straight into the read
+    my_wire.requestFrom(address, rxLength, (uint8_t)sendStop);
+
+    // Pull bytes from the internal i2c RX buffer, counting (but not storing) any extras
+    while (my_wire.available())
+    {
+        uint8_t value = my_wire.read();
+
+        if (*received < rxLength)
+        {
+            rx[*received] = value;
+        }
+
+        if (*received < 0xFF)
+        {
+            (*received)++;
+        }
+    }
+
+    return RPB_1600_BUS_OK;
+}
+
+uint8_t RPB_1600_WireBus::toBusStatus(uint8_t wireError)
+{
+    // Wire error codes: 0 = success, 2 = NACK on address, 3 = NACK on data, anything else is a bus error
+    switch (wireError)
+    {
+    case 0:
+        return RPB_1600_BUS_OK;
+    case 2:
+    case 3:
+        return RPB_1600_BUS_NACK;
+    default:
+        return RPB_1600_BUS_ERROR;
+    }
+}
+
+#endif // ARDUINO
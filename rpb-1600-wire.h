@@ -0,0 +1,59 @@
+#include "rpb-1600-bus.h"
+
+#ifndef RPB_1600_WIRE_H
+#define RPB_1600_WIRE_H
+
+#ifdef ARDUINO
+
+#include "Wire.h"
+
+/**
+ * @brief RPB_1600_Bus backend built on the Arduino Wire library
+ * @details RPB_1600 uses the instance wrapping Wire by default. Construct your own to talk to
+ * chargers on another port, e.g. RPB_1600_WireBus bus1(Wire1);
+ *
+ * Wire only has blocking calls, so this backend keeps the default startWriteRead(), which runs the
+ * whole transaction before it returns. Nothing overlaps with a transaction on a Wire bus, including
+ * transactions on the other buses of an RPB_1600_Fleet.
+ */
+class RPB_1600_WireBus : public RPB_1600_Bus
+{
+public:
+    RPB_1600_WireBus(TwoWire &wire);
+
+    void begin(void) override;
+    void setClock(uint32_t frequency) override;
+    uint32_t micros(void) override;
+    void delayMicroseconds(uint32_t microseconds) override;
+    uint8_t write(uint8_t address, const uint8_t *data, uint8_t length) override;
+    uint8_t writeRead(uint8_t address, const uint8_t *tx, uint8_t txLength,
+                      uint8_t *rx, uint8_t rxLength, uint8_t *received) override;
+    uint8_t writeReadMany(uint8_t address, rpb_1600_bus_transfer *transfers, uint8_t count) override;
+
+private:
+    /**
+     * @brief The Wire port this backend drives
+     */
+    TwoWire &my_wire;
+
+    /**
+     * @brief Convert a Wire endTransmission() error code into an rpb_1600_bus_status
+     */
+    static uint8_t toBusStatus(uint8_t wireError);
+
+    /**
+     * @brief A single write-then-read, optionally leaving the bus held afterwards
+     * @param sendStop Whether to release the bus with a stop condition once the read is done
+     */
+    uint8_t transfer(uint8_t address, const uint8_t *tx, uint8_t txLength,
+                     uint8_t *rx, uint8_t rxLength, uint8_t *received, bool sendStop);
+};
+
+/**
+ * @brief The backend used by RPB_1600 objects that aren't given a bus explicitly
+ */
+extern RPB_1600_WireBus RPB_1600_DefaultWireBus;
+
+#endif // ARDUINO
+
+#endif // RPB_1600_WIRE_H
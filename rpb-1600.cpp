@@ -1,75 +1,226 @@
 #include "rpb-1600.h"
 #include "rpb-1600-commands.h"
-#include "Wire.h"
+#include "rpb-1600-linear.h"
+#include "rpb-1600-cache.h"
+#include "rpb-1600-crc.h"
+#include "rpb-1600-settle.h"
+#include "rpb-1600-wire.h"
+#include <string.h>
+
+static const uint32_t clock_levels[RPB_1600_CLOCK_LEVELS] = RPB_1600_CLOCK_LEVEL_FREQUENCIES;
+
+struct calibration_register
+{
+    uint8_t command;
+    uint8_t length;
+    bool block;
+};
+
+// Registers that don't change while we're calibrating, so any difference means a corrupted read
+static const calibration_register calibration_registers[] = {
+    {CMD_CODE_MFR_ID, RPB_1600_BLOCK_LENGTH(CMD_LENGTH_MFR_ID), true},
+    {CMD_CODE_CURVE_CC, CMD_LENGTH_CURVE_CC, false},
+    {CMD_CODE_CURVE_CV, CMD_LENGTH_CURVE_CV, false},
+    {CMD_CODE_CURVE_FV, CMD_LENGTH_CURVE_FV, false},
+    {CMD_CODE_CURVE_TC, CMD_LENGTH_CURVE_TC, false},
+    {CMD_CODE_CURVE_CONFIG, CMD_LENGTH_CURVE_CONFIG, false},
+};
+
+#define NUM_CALIBRATION_REGISTERS (sizeof(calibration_registers) / sizeof(calibration_registers[0]))
+
+// What setCurveParams() programs, in the order it writes them. All of them are 2 bytes long.
+static const uint8_t curve_registers[RPB_1600_CURVE_REGISTERS] = {
+    CMD_CODE_CURVE_CC,
+    CMD_CODE_CURVE_CV,
+    CMD_CODE_CURVE_FV,
+    CMD_CODE_CURVE_TC,
+    CMD_CODE_CURVE_CONFIG,
+    CMD_CODE_CURVE_CC_TIMEOUT,
+    CMD_CODE_CURVE_CV_TIMEOUT,
+    CMD_CODE_CURVE_FLOAT_TIMEOUT,
+};
 
 //----------------------------------------------------------------------
 // Public Functions
 //----------------------------------------------------------------------
 
-RPB_1600::RPB_1600()
+#ifdef ARDUINO
+RPB_1600::RPB_1600() : my_bus(&RPB_1600_DefaultWireBus)
+{
+}
+#else
+RPB_1600::RPB_1600() : my_bus(nullptr)
+{
+}
+#endif
+
+RPB_1600::RPB_1600(RPB_1600_Bus &bus) : my_bus(&bus)
 {
 }
 
-bool RPB_1600::Init(uint8_t chargerAddress)
+bool RPB_1600::Init(uint8_t chargerAddress, bool calibrate)
 {
     my_charger_address = chargerAddress;
 
-    Wire.setClock(100000);
-    Wire.begin();
+    if (my_bus == nullptr)
+    {
+        return false;
+    }
+
+    // The clock lives with the bus, another charger on it may already have calibrated it
+    if (my_bus->getClock() == 0)
+    {
+        my_bus->begin();
+        setClockLevel(0);
+    }
+
+    if (calibrate)
+    {
+        calibrateClock();
+    }
+
 #ifdef RPB_1600_DEBUG
     Serial.printf("<RPB-1600 DEBUG> Init complete!\n");
 #endif
     return true;
 }
 
-bool RPB_1600::getReadings(readings *data)
+void RPB_1600::beginBus(RPB_1600_Bus &bus)
 {
-    if (!readWithCommand(CMD_CODE_READ_VIN, CMD_LENGTH_READ_VIN))
+    if (bus.getClock() == 0)
     {
-        return false;
+        bus.begin();
+        bus.changeClock(clock_levels[0]);
     }
+}
+
+uint32_t RPB_1600::calibrateClock(void)
+{
+    uint8_t reference[NUM_CALIBRATION_REGISTERS][MAX_RECEIVE_BYTES];
 
-    data->v_in = parseLinearData();
+    my_auto_clock = false;
+    my_max_clock_level = 0;
+    setClockLevel(0);
 
-    if (!readWithCommand(CMD_CODE_READ_VOUT, CMD_LENGTH_READ_VOUT))
+    if (!calibrationRound(reference, true))
     {
-        return false;
+#ifdef RPB_1600_DEBUG
+        Serial.printf("<RPB-1600 DEBUG> Clock calibration failed, couldn't read the reference registers\n");
+#endif
+        my_clock_stats.max_clock = clock_levels[0];
+        return 0;
+    }
+
+    for (uint8_t level = 1; level < RPB_1600_CLOCK_LEVELS; level++)
+    {
+        setClockLevel(level);
+        bool reliable = true;
+
+        for (uint8_t round = 0; round < RPB_1600_CALIBRATION_ROUNDS && reliable; round++)
+        {
+            reliable = calibrationRound(reference, false);
+        }
+
+#ifdef RPB_1600_DEBUG
+        Serial.printf("<RPB-1600 DEBUG> Clock calibration at %luHz: %s\n", (unsigned long)clock_levels[level],
+                      reliable ? "reliable" : "unreliable");
+#endif
+
+        if (!reliable)
+        {
+            break;
+        }
+
+        my_max_clock_level = level;
     }
 
-    data->v_out = parseLinearVoltage(CMD_N_VALUE_READ_VOUT);
+    setClockLevel(my_max_clock_level);
+    my_clock_stats.max_clock = clock_levels[my_max_clock_level];
+    my_auto_clock = true;
+    my_window_transactions = 0;
+    my_window_errors = 0;
+    my_clean_windows = 0;
+
+    return my_bus->getClock();
+}
+
+void RPB_1600::setAutoClock(bool enabled)
+{
+    my_auto_clock = enabled;
+}
+
+rpb_1600_clock_stats RPB_1600::getClockStats(void) const
+{
+    rpb_1600_clock_stats stats = my_clock_stats;
+    // Another charger on the bus may have changed the clock since this one last did
+    stats.clock = (my_bus != nullptr) ? my_bus->getClock() : 0;
+
+    return stats;
+}
 
-    if (!readWithCommand(CMD_CODE_READ_IOUT, CMD_LENGTH_READ_IOUT))
+bool RPB_1600::getReadings(readings *data)
+{
+    uint8_t vin[CMD_LENGTH_READ_VIN];
+    uint8_t vout[CMD_LENGTH_READ_VOUT];
+    uint8_t iout[CMD_LENGTH_READ_IOUT];
+    uint8_t fan1[CMD_LENGTH_READ_FAN_SPEED_1];
+    uint8_t fan2[CMD_LENGTH_READ_FAN_SPEED_2];
+
+    rpb_1600_read items[] = {
+        {CMD_CODE_READ_VIN, CMD_LENGTH_READ_VIN, vin, false, false},
+        {CMD_CODE_READ_VOUT, CMD_LENGTH_READ_VOUT, vout, false, false},
+        {CMD_CODE_READ_IOUT, CMD_LENGTH_READ_IOUT, iout, false, false},
+        {CMD_CODE_READ_FAN_SPEED_1, CMD_LENGTH_READ_FAN_SPEED_1, fan1, false, false},
+        {CMD_CODE_READ_FAN_SPEED_2, CMD_LENGTH_READ_FAN_SPEED_2, fan2, false, false},
+    };
+
+    uint8_t num_items = sizeof(items) / sizeof(items[0]);
+    bool all_ok = readMany(items, num_items) == num_items;
+
+    // Fill in whatever we did get
+    if (items[0].success)
     {
-        return false;
+        data->v_in = parseLinearQuantity(vin);
     }
 
-    data->i_out = parseLinearData();
+    if (items[1].success)
+    {
+        data->v_out = parseLinearVoltage(vout, CMD_N_VALUE_READ_VOUT);
+    }
 
-    if (!readWithCommand(CMD_CODE_READ_FAN_SPEED_1, CMD_LENGTH_READ_FAN_SPEED_1))
+    if (items[2].success)
     {
-        return false;
+        data->i_out = parseLinearQuantity(iout);
     }
 
-    data->fan_speed_1 = parseLinearData();
+    if (items[3].success)
+    {
+        data->fan_speed_1 = parseLinearData(fan1);
+    }
 
-    if (!readWithCommand(CMD_CODE_READ_FAN_SPEED_2, CMD_LENGTH_READ_FAN_SPEED_2))
+    if (items[4].success)
     {
-        return false;
+        data->fan_speed_2 = parseLinearData(fan2);
     }
 
-    data->fan_speed_2 = parseLinearData();
+    if (all_ok && my_readings_callback != nullptr)
+    {
+        my_readings_callback(data, my_bus->micros(), my_readings_context);
+    }
 
-    return true;
+    return all_ok;
 }
 
 bool RPB_1600::getChargeStatus(charge_status *status)
 {
-    if (!readWithCommand(CMD_CODE_CHG_STATUS, CMD_LENGTH_CHG_STATUS))
+    uint8_t raw[CMD_LENGTH_CHG_STATUS];
+
+    if (!readInto(CMD_CODE_CHG_STATUS, raw, CMD_LENGTH_CHG_STATUS))
     {
         return false;
     }
 
-    parseChargeStatus(status);
+    parseChargeStatus(raw, status);
 
     return true;
 }
@@ -84,324 +235,1397 @@ bool RPB_1600::getCurveParams(curve_parameters *params)
     params->config;
     params->cc_timeout;
     params->cv_timeout;
+    params->float_timeout;
     params->status; */
 
-    if (!readWithCommand(CMD_CODE_CURVE_CC, CMD_LENGTH_CURVE_CC))
+    uint8_t raw[9][2];
+
+    rpb_1600_read items[] = {
+        {CMD_CODE_CURVE_CC, CMD_LENGTH_CURVE_CC, raw[0], false, false},
+        {CMD_CODE_CURVE_CV, CMD_LENGTH_CURVE_CV, raw[1], false, false},
+        {CMD_CODE_CURVE_FV, CMD_LENGTH_CURVE_FV, raw[2], false, false},
+        {CMD_CODE_CURVE_TC, CMD_LENGTH_CURVE_TC, raw[3], false, false},
+        {CMD_CODE_CURVE_CONFIG, CMD_LENGTH_CURVE_CONFIG, raw[4], false, false},
+        {CMD_CODE_CURVE_CC_TIMEOUT, CMD_LENGTH_CURVE_CC_TIMEOUT, raw[5], false, false},
+        {CMD_CODE_CURVE_CV_TIMEOUT, CMD_LENGTH_CURVE_CV_TIMEOUT, raw[6], false, false},
+        {CMD_CODE_CURVE_FLOAT_TIMEOUT, CMD_LENGTH_CURVE_FLOAT_TIMEOUT, raw[7], false, false},
+        {CMD_CODE_CHG_STATUS, CMD_LENGTH_CHG_STATUS, raw[8], false, false},
+    };
+
+    uint8_t num_items = sizeof(items) / sizeof(items[0]);
+    bool all_ok = readMany(items, num_items) == num_items;
+
+    // Fill in whatever we did get
+    if (items[0].success)
     {
-        return false;
+        params->cc = parseLinearQuantity(raw[0]);
     }
 
-    params->cc = parseLinearData();
+    if (items[1].success)
+    {
+        params->cv = parseLinearVoltage(raw[1], CMD_N_VALUE_CURVE_CV);
+    }
 
-    if (!readWithCommand(CMD_CODE_CURVE_CV, CMD_LENGTH_CURVE_CV))
+    if (items[2].success)
     {
-        return false;
+        params->floating_voltage = parseLinearVoltage(raw[2], CMD_N_VALUE_CURVE_FV);
     }
 
-    params->cv = parseLinearVoltage(CMD_N_VALUE_CURVE_CV);
+    if (items[3].success)
+    {
+        params->taper_current = parseLinearQuantity(raw[3]);
+    }
 
-    if (!readWithCommand(CMD_CODE_CURVE_FV, CMD_LENGTH_CURVE_FV))
+    if (items[4].success)
     {
-        return false;
+        parseCurveConfig(raw[4], &params->config);
     }
 
-    params->floating_voltage = parseLinearVoltage(CMD_N_VALUE_CURVE_FV);
+    if (items[5].success)
+    {
+        params->cc_timeout = parseLinearData(raw[5]);
+    }
 
-    if (!readWithCommand(CMD_CODE_CURVE_TC, CMD_LENGTH_CURVE_TC))
+    if (items[6].success)
     {
-        return false;
+        params->cv_timeout = parseLinearData(raw[6]);
     }
 
-    params->taper_current = parseLinearData();
+    if (items[7].success)
+    {
+        params->float_timeout = parseLinearData(raw[7]);
+    }
 
-    if (!readWithCommand(CMD_CODE_CURVE_CONFIG, CMD_LENGTH_CURVE_CONFIG))
+    if (items[8].success)
     {
-        return false;
+        parseChargeStatus(raw[8], &params->status);
     }
 
-    parseCurveConfig(&params->config);
+    return all_ok;
+}
+
+bool RPB_1600::getMfrData(mfr_data *data)
+{
+    // Room for the longest string and its byte count
+    uint8_t raw[6][RPB_1600_BLOCK_LENGTH(CMD_LENGTH_MFR_ID)];
+
+    rpb_1600_read items[] = {
+        {CMD_CODE_MFR_ID, RPB_1600_BLOCK_LENGTH(CMD_LENGTH_MFR_ID), raw[0], false, true},
+        {CMD_CODE_MFR_MODEL, RPB_1600_BLOCK_LENGTH(CMD_LENGTH_MFR_MODEL), raw[1], false, true},
+        {CMD_CODE_MFR_REVISION, RPB_1600_BLOCK_LENGTH(CMD_LENGTH_MFR_REVISION), raw[2], false, true},
+        {CMD_CODE_MFR_LOCATION, RPB_1600_BLOCK_LENGTH(CMD_LENGTH_MFR_LOCATION), raw[3], false, true},
+        {CMD_CODE_MFR_DATE, RPB_1600_BLOCK_LENGTH(CMD_LENGTH_MFR_DATE), raw[4], false, true},
+        {CMD_CODE_MFR_SERIAL, RPB_1600_BLOCK_LENGTH(CMD_LENGTH_MFR_SERIAL), raw[5], false, true},
+    };
+
+    char *strings[] = {data->id, data->model, data->revision, data->location, data->date, data->serial};
 
-    if (!readWithCommand(CMD_CODE_CURVE_CC_TIMEOUT, CMD_LENGTH_CURVE_CC_TIMEOUT))
+    uint8_t num_items = sizeof(items) / sizeof(items[0]);
+    bool all_ok = readMany(items, num_items) == num_items;
+
+    // Fill in whatever we did get
+    for (uint8_t i = 0; i < num_items; i++)
     {
-        return false;
+        if (items[i].success)
+        {
+            parseBlockString(raw[i], strings[i]);
+        }
     }
 
-    params->cc_timeout = parseLinearData();
+    return all_ok;
+}
+
+bool RPB_1600::readWithCommand(uint8_t commandID, uint8_t receiveLength)
+{
+    uint8_t rx[RPB_1600_RAW_LENGTH(MAX_RECEIVE_BYTES)];
+
+    return readRaw(commandID, rx, receiveLength).status == RPB_1600_READ_OK;
+}
+
+rpb_1600_read_result RPB_1600::readRaw(uint8_t commandID, uint8_t *buffer, uint8_t length, bool block)
+{
+    rpb_1600_read_result result = {RPB_1600_READ_OK, RPB_1600_BUS_OK, 0};
 
-    if (!readWithCommand(CMD_CODE_CURVE_CV_TIMEOUT, CMD_LENGTH_CURVE_CV_TIMEOUT))
+    // Make sure the response fits the buffers along the way (the cache's, the bus backend's)
+    if (length > MAX_RECEIVE_BYTES)
     {
-        return false;
+        result.status = RPB_1600_READ_TOO_LONG;
+        return result;
     }
 
-    params->cv_timeout = parseLinearData();
-
-    if (!readWithCommand(CMD_CODE_CURVE_FLOAT_TIMEOUT, CMD_LENGTH_CURVE_FLOAT_TIMEOUT))
+    if (my_cache != nullptr && my_cache->lookup(commandID, length, my_bus->micros(), buffer))
     {
-        return false;
+        RPB_1600_TRACE_EVENT(RPB_1600_TRACE_CACHE_HIT, commandID, RPB_1600_BUS_OK, buffer, length);
     }
+    else
+    {
+        result.status = readResponse(commandID, buffer, length, my_retries + 1, block, &result.bus_status);
+
+        if (result.status != RPB_1600_READ_OK)
+        {
+            return result;
+        }
 
-    params->float_timeout = parseLinearData();
+        if (my_cache != nullptr)
+        {
+            my_cache->store(commandID, buffer, length, my_bus->micros());
+        }
+    }
 
-    getChargeStatus(&params->status);
+    // checkResponse() made sure a block read's count fits
+    result.length = block ? 1 + buffer[0] : length;
 
-    return true;
+    return result;
 }
 
-bool RPB_1600::readWithCommand(uint8_t commandID, uint8_t receiveLength)
+uint8_t RPB_1600::readMany(rpb_1600_read *items, uint8_t count)
 {
-#ifdef RPB_1600_DEBUG
-    Serial.printf("<RPB-1600 DEBUG> Attempting to read command 0x%x with length %d\n", commandID, receiveLength);
-#endif
-    // Send the command ID to the charger, and don't terminate the transmission
-    Wire.beginTransmission(my_charger_address);
-    Wire.write(commandID); // Write to I2C Tx buffer
-    Wire.endTransmission(false);
+    // Indices of the items that actually need to go to the bus
+    uint8_t indices[RPB_1600_MAX_BURST_READS];
+    uint8_t burst_length = 0;
+    uint8_t num_ok = 0;
+    uint32_t now = my_bus->micros();
 
-    // Request bytes from the device
-    Wire.beginTransmission(my_charger_address);
-    Wire.requestFrom(my_charger_address, receiveLength);
-
-    clearRXBuffer();
+    for (uint8_t i = 0; i < count; i++)
+    {
+        rpb_1600_read *item = &items[i];
 
-    // Count the number of bytes we receive
-    uint8_t num_bytes = 0;
+        // Longer than any register, and than the buffers a response lands in with PEC on
+        if (item->length > MAX_RECEIVE_BYTES)
+        {
+            item->success = false;
+            continue;
+        }
 
-    // Pull bytes from the internal i2c RX buffer
-    while (Wire.available())
-    {
-        // Write the received byte to the buffer
-        my_rx_buffer[num_bytes] = Wire.read();
+        if (my_cache != nullptr && my_cache->lookup(item->command, item->length, now, item->destination))
+        {
+            RPB_1600_TRACE_EVENT(RPB_1600_TRACE_CACHE_HIT, item->command, RPB_1600_BUS_OK, item->destination, item->length);
+            item->success = true;
+            num_ok++;
+            continue;
+        }
 
-#ifdef RPB_1600_DEBUG
-        Serial.printf("<RPB-1600 DEBUG> Received byte %d with value 0x%x\n", num_bytes, my_rx_buffer[num_bytes]);
-#endif
+        indices[burst_length++] = i;
 
-        // Make sure we aren't getting more bytes then we expect
-        if (++num_bytes > MAX_RECEIVE_BYTES)
+        if (burst_length == RPB_1600_MAX_BURST_READS)
         {
-            return false;
+            num_ok += readBurst(items, indices, burst_length);
+            burst_length = 0;
         }
     }
 
-#ifdef RPB_1600_DEBUG
-    Serial.printf("<RPB-1600 DEBUG> Total bytes received: %d\n", num_bytes);
-    Serial.printf("<RPB-1600 DEBUG> RX Buffer: [");
-    for (int i = 0; i < num_bytes; i++)
+    if (burst_length > 0)
     {
-        Serial.printf("0x%x,", my_rx_buffer[i]);
+        num_ok += readBurst(items, indices, burst_length);
     }
-    Serial.printf("]\n");
-#endif
 
-    return num_bytes == receiveLength;
+    return num_ok;
 }
 
 bool RPB_1600::writeTwoBytes(uint8_t commandID, uint8_t *data)
 {
-#ifdef RPB_1600_DEBUG
-    Serial.printf("<RPB-1600 DEBUG> Attempting to write 0x%x (low) and 0x%x (high) with command 0x%x\n", data[0], data[1], commandID);
-#endif
-
-    Wire.beginTransmission(my_charger_address);
-    Wire.write(commandID);
-    uint8_t bytes_written = Wire.write(data, 2);
-    Wire.endTransmission();
-
-    return bytes_written == 2;
+    return writeBytes(commandID, data, 2);
 }
 
 bool RPB_1600::writeLinearDataCommand(uint8_t commandID, int8_t N, int16_t value)
 {
-    uint16_t Y = 0;
-    uint16_t denominator = 0x0001;
-    // The Y value is calculated using the following equation
-    // (reference PMBUS spec rev 1.1 section 7.1): Value = Y * 2 ^ N
-    // Y = Value / (2 ^ N)
-    // We'll calculate denominator and do the math based on the polarity of N
+    return writeLinearValue(commandID, N, value, 1, 0);
+}
+
+bool RPB_1600::writeTwoBytesConfirmed(uint8_t commandID, uint8_t *data, uint32_t timeout_us)
+{
+    if (!writeTwoBytes(commandID, data))
+    {
+        return false;
+    }
 
-    if (N > 0)
+    uint32_t start = my_bus->micros();
+    uint32_t expected = (my_settle_tracker != nullptr) ? my_settle_tracker->getExpectedSettle(commandID) : 0;
+
+    // Back off exponentially from a fraction of the usual settle time
+    uint32_t backoff = (expected / 8 > RPB_1600_CONFIRM_MIN_BACKOFF_US) ? expected / 8 : RPB_1600_CONFIRM_MIN_BACKOFF_US;
+    // Look first a backoff step before the register usually settles, so one that's on time gives a
+    // real miss before the hit and the settle time can be measured between them
+    uint32_t wait = (expected > backoff + RPB_1600_CONFIRM_MIN_BACKOFF_US) ? expected - backoff : RPB_1600_CONFIRM_MIN_BACKOFF_US;
+    // When the last poll that still read the old value started. Polls are timed from when they
+    // start, that's when the charger picks what to answer with.
+    bool missed = false;
+    uint32_t last_miss = 0;
+
+    while (true)
     {
-        denominator <<= N;
-        Y = value / denominator;
+        uint32_t elapsed = my_bus->micros() - start;
+
+        if (elapsed >= timeout_us)
+        {
+            break;
+        }
+
+        // Make sure the last poll lands on the timeout rather than past it
+        if (wait > timeout_us - elapsed)
+        {
+            wait = timeout_us - elapsed;
+        }
+
+        my_bus->delayMicroseconds(wait);
+
+        // Straight from the bus, one attempt. A stale or corrupted read is just another poll.
+        uint8_t readback[2];
+        uint32_t poll = my_bus->micros() - start;
+
+        if (readRegister(commandID, readback, 2, 1) && readback[0] == data[0] && readback[1] == data[1])
+        {
+            if (missed)
+            {
+                // It settled somewhere between the last miss and this poll, call it halfway
+                uint32_t settle = (last_miss + poll) / 2;
+                RPB_1600_TRACE_VALUE(RPB_1600_TRACE_SETTLED, commandID, settle);
+
+                if (my_settle_tracker != nullptr)
+                {
+                    my_settle_tracker->record(commandID, settle);
+                }
+            }
+            else
+            {
+                // Already there on the first look, so all we know is it took no longer than this
+                RPB_1600_TRACE_VALUE(RPB_1600_TRACE_SETTLED, commandID, poll);
+
+                if (my_settle_tracker != nullptr)
+                {
+                    my_settle_tracker->recordUpperBound(commandID, poll);
+                }
+            }
+
+            // The write emptied the cache entry, and we know exactly what's in the register now
+            if (my_cache != nullptr)
+            {
+                my_cache->store(commandID, readback, 2, my_bus->micros());
+            }
+
+            return true;
+        }
+
+        missed = true;
+        last_miss = poll;
+        wait = backoff;
+        backoff = (backoff < RPB_1600_CONFIRM_MAX_BACKOFF_US / 2) ? backoff * 2 : RPB_1600_CONFIRM_MAX_BACKOFF_US;
     }
-    else if (N < 0)
+
+    RPB_1600_TRACE_VALUE(RPB_1600_TRACE_SETTLE_TIMEOUT, commandID, timeout_us);
+
+    if (my_settle_tracker != nullptr)
     {
-        denominator <<= (-N);
-        Y = value * denominator;
+        my_settle_tracker->recordTimeout(commandID);
     }
 
-#ifdef RPB_1600_DEBUG
-    Serial.printf("<RPB-1600 DEBUG> Y calculation: Value = %d Denom = %d Y = %d\n", value, denominator, Y);
-#endif
+    return false;
+}
+
+bool RPB_1600::writeLinearDataCommandConfirmed(uint8_t commandID, int8_t N, int16_t value, uint32_t timeout_us)
+{
+    // 0 would mean a plain write to writeLinearValue()
+    return writeLinearValue(commandID, N, value, 1, (timeout_us > 0) ? timeout_us : 1);
+}
 
-    return writeLinearDataHelper(commandID, N, Y);
+bool RPB_1600::writeLinearQuantity(uint8_t commandID, int8_t N, rpb_1600_quantity value)
+{
+    return writeLinearValue(commandID, N, value, RPB_1600_QUANTITY_SCALE, 0);
 }
 
-//----------------------------------------------------------------------
-// Private Functions
-//----------------------------------------------------------------------
+bool RPB_1600::writeLinearQuantityConfirmed(uint8_t commandID, int8_t N, rpb_1600_quantity value, uint32_t timeout_us)
+{
+    return writeLinearValue(commandID, N, value, RPB_1600_QUANTITY_SCALE, (timeout_us > 0) ? timeout_us : 1);
+}
 
-bool RPB_1600::writeLinearDataHelper(uint8_t commandID, int8_t N, int16_t Y)
+bool RPB_1600::setCurveParams(const curve_parameters &params, uint32_t timeout_us)
 {
-    // Make sure the N value isn't bigger then 5 bits
-    if (abs(N) > 15)
+    uint8_t current[RPB_1600_CURVE_REGISTERS][2];
+    uint8_t target[RPB_1600_CURVE_REGISTERS][2];
+    rpb_1600_read items[RPB_1600_CURVE_REGISTERS];
+
+    for (uint8_t i = 0; i < RPB_1600_CURVE_REGISTERS; i++)
+    {
+        items[i] = {curve_registers[i], 2, current[i], false, false};
+    }
+
+    // Without the current state there's nothing to diff against, or to roll back to
+    if (readMany(items, RPB_1600_CURVE_REGISTERS) != RPB_1600_CURVE_REGISTERS)
     {
-#ifdef RPB_1600_DEBUG
-        Serial.printf("<RPB-1600 DEBUG> N value too large! Can't convert to linear format. N = %d\n", N);
-#endif
         return false;
     }
 
-    // Make sure the Y (Mantissa) can fit in 11 bits
-    if (abs(Y) > 2047)
+    if (!encodeCurveParams(params, current, target))
     {
-#ifdef RPB_1600_DEBUG
-        Serial.printf("<RPB-1600 DEBUG> Mantissa (Y) value too large! Can't convert to linear format. Y = %d\n", Y);
-#endif
         return false;
     }
 
-    // The goal here is to truncate Y to 11 bits, and put those in the lowest 11 bits of the outgoing data
-    // Then we need to truncate N to 5 bits, and put those bits in the highest 5 bits of the outgoing data
-    // See Section 7.1 of the PMBus 1.1 specification for more info on the "Linear Data Format"
-    // Note that data[0] is the low byte (sent first) and data[1] is the high byte (sent second)
-    uint8_t data[2] = {0x00, 0x00};
-
-    // Mask the lowest 8 bits of the mantissa, and put those bits in the low byte of the outgoing data
-    data[0] = Y & 0x00FF;
-    // Mask the lowest 3 bits of the high byte of the mantissa, and put those bits in the high byte of the outgoing data
-    data[1] = (Y & 0x0700) >> 8;
-    // Mask the lowest 5 bits of N, and shift them to be the highest 5 bytes of the high byte
-    data[1] = (N & 0x1F) << 3;
-#ifdef RPB_1600_DEBUG
-    Serial.printf("<RPB-1600 DEBUG> Attempting to write linear data with N = %d and Mantissa (Y) = %d\n", N, Y);
-#endif
-    writeTwoBytes(commandID, data);
+    uint8_t num_written = 0;
+    uint8_t written[RPB_1600_CURVE_REGISTERS];
+    bool success = true;
 
-    return true;
-}
+    for (uint8_t i = 0; i < RPB_1600_CURVE_REGISTERS && success; i++)
+    {
+        if (target[i][0] == current[i][0] && target[i][1] == current[i][1])
+        {
+            continue;
+        }
 
-uint16_t RPB_1600::parseLinearData(void)
-{
-    uint16_t rawData = my_rx_buffer[0] | (my_rx_buffer[1] << 8);
+        // Roll this one back too if it fails, it might have reached the charger anyway
+        written[num_written++] = i;
+        success = writeTwoBytesConfirmed(curve_registers[i], target[i], timeout_us);
+    }
 
-    // Mask & shift out the "N" and "mantissa" values and convert them from 2s complement
-    int16_t rawN = (rawData & N_EXPONENT_MASK) >> N_EXPONENT_SHIFT;
-    int16_t N = UpscaleTwosComplement(rawN, N_EXPONENT_LENGTH);
-    int16_t rawMantissa = (rawData & MANTISSA_MASK);
-    int16_t mantissa = UpscaleTwosComplement(rawMantissa, MANTISSA_LENGTH);
+#ifdef RPB_1600_DEBUG
+    Serial.printf("<RPB-1600 DEBUG> Curve programming wrote %d of %d registers\n", num_written, RPB_1600_CURVE_REGISTERS);
+#endif
 
-    uint16_t result = static_cast<uint16_t>(mantissa);
-    // The result is calculated by doing the following: result = mantissa * 2 ^ N
-    // however, N can be positive or negative, so we shift the mantissa accordingly
-    // to perform the multiplication by a power of 2.
-    if (N > 0)
+    if (success)
     {
-        result <<= N;
+        return true;
     }
-    else if (N < 0)
+
+    // Undo in reverse order, so the charger passes back through the states it just came from
+    while (num_written > 0)
     {
-        result >>= (-N);
-    }
+        uint8_t i = written[--num_written];
+
+        if (!writeTwoBytesConfirmed(curve_registers[i], current[i], timeout_us))
+        {
 #ifdef RPB_1600_DEBUG
-    Serial.printf("<RPB-1600 DEBUG> Raw Data: 0x%x\n", rawData);
-    Serial.printf("<RPB-1600 DEBUG> Raw N: 0x%x\n", rawN);
-    Serial.printf("<RPB-1600 DEBUG> N: %d\n", N);
-    Serial.printf("<RPB-1600 DEBUG> Raw Mantissa : 0x%x\n", rawMantissa);
-    Serial.printf("<RPB-1600 DEBUG> Mantissa: %d\n", mantissa);
-    Serial.printf("<RPB-1600 DEBUG> Result: %d\n", result);
+            Serial.printf("<RPB-1600 DEBUG> Couldn't roll back command 0x%x!\n", curve_registers[i]);
 #endif
+        }
+    }
 
-    return result;
+    return false;
 }
 
-float RPB_1600::parseLinearVoltage(int8_t N)
+bool RPB_1600::submitRead(rpb_1600_request *request, uint8_t commandID, uint8_t receiveLength,
+                          rpb_1600_request_callback callback, void *context)
 {
-    uint16_t rawData = my_rx_buffer[0] | (my_rx_buffer[1] << 8);
-
-    // Calculate divisor using N
-    uint16_t divisor = 0x01 << abs(N);
-
-#ifdef RPB_1600_DEBUG
-    Serial.printf("<RPB-1600 DEBUG> Parsing linear voltage w/N: %d\n", N);
-#endif
-
-    float result = (float)rawData;
+    if (receiveLength > MAX_RECEIVE_BYTES ||
+        request->state == RPB_1600_REQUEST_QUEUED ||
+        request->state == RPB_1600_REQUEST_IN_FLIGHT)
+    {
+        return false;
+    }
 
-    // Divide based on the polarity of N
-    if (N > 0)
+    request->command = commandID;
+    request->length = receiveLength;
+    request->received = 0;
+    request->attempts = 0;
+    request->callback = callback;
+    request->context = context;
+    request->next = nullptr;
+    request->state = RPB_1600_REQUEST_QUEUED;
+
+    // Append to the end of the queue so requests go out in the order they were submitted
+    if (my_queue_tail == nullptr)
     {
-        result /= -divisor;
+        my_queue_head = request;
     }
-    else if (N < 0)
+    else
     {
-        result /= divisor;
+        my_queue_tail->next = request;
     }
 
-#ifdef RPB_1600_DEBUG
-    Serial.printf("<RPB-1600 DEBUG> Linear voltage result: %4.2fV\n", result);
-#endif
+    my_queue_tail = request;
 
-    return result;
+    return true;
 }
 
-void RPB_1600::parseCurveConfig(curve_config *config)
+bool RPB_1600::beginReadings(rpb_1600_snapshot *snapshot, readings *data,
+                             rpb_1600_snapshot_callback callback, void *context)
 {
-    // Bits 0 & 1 of low byte
-    config->charge_curve_type = (my_rx_buffer[0] & 0x02);
-    // Bits 2 & 3 of low byte
-    config->temp_compensation = (my_rx_buffer[0] & 0x0C) >> 2;
-    // Bit 7 of low byte (0 = 3 stage, 1 = 2 stage)
-    config->num_charge_stages = (my_rx_buffer[0] && 0x40) ? 2 : 3;
-    // Bit 0 of high byte
-    config->cc_timeout_indication_enabled = (my_rx_buffer[1] && 0x01);
-    // Bit 1 of high byte
-    config->cv_timeout_indication_enabled = (my_rx_buffer[1] && 0x02);
-    // Bit 2 of high byte
-    config->float_stage_timeout_indication_enabled = (my_rx_buffer[1] && 0x04);
-}
+    if (snapshot->state == RPB_1600_REQUEST_QUEUED)
+    {
+        return false;
+    }
 
-void RPB_1600::parseChargeStatus(charge_status *status)
-{
-    // Low byte:
-    status->fully_charged = (my_rx_buffer[0] && 0x01); // Bit 0
-    status->in_cc_mode = (my_rx_buffer[0] && 0x02);    // Bit 1
-    status->in_cv_mode = (my_rx_buffer[0] && 0x04);    // Bit 2
-    status->in_float_mode = (my_rx_buffer[0] && 0x08); // Bit 3
-    // High byte:
-    status->EEPROM_error = (my_rx_buffer[1] && 0x01);                    // Bit 0
-    status->temp_compensation_short_circuit = (my_rx_buffer[1] && 0x04); // Bit 1
-    status->battery_detected = (my_rx_buffer[1] && 0x08);                // Bit 3
-    status->timeout_flag_cc_mode = (my_rx_buffer[1] && 0x20);            // Bit 5
-    status->timeout_flag_cv_mode = (my_rx_buffer[1] && 0x40);            // Bit 6
-    status->timeout_flag_float_mode = (my_rx_buffer[1] && 0x80);         // Bit 7
+    // Same order as getReadings()
+    snapshot->requests[0].command = CMD_CODE_READ_VIN;
+    snapshot->requests[0].length = CMD_LENGTH_READ_VIN;
+    snapshot->requests[1].command = CMD_CODE_READ_VOUT;
+    snapshot->requests[1].length = CMD_LENGTH_READ_VOUT;
+    snapshot->requests[2].command = CMD_CODE_READ_IOUT;
+    snapshot->requests[2].length = CMD_LENGTH_READ_IOUT;
+    snapshot->requests[3].command = CMD_CODE_READ_FAN_SPEED_1;
+    snapshot->requests[3].length = CMD_LENGTH_READ_FAN_SPEED_1;
+    snapshot->requests[4].command = CMD_CODE_READ_FAN_SPEED_2;
+    snapshot->requests[4].length = CMD_LENGTH_READ_FAN_SPEED_2;
+    snapshot->num_requests = 5;
+    snapshot->is_curve_params = false;
+    snapshot->destination = data;
+
+    return beginSnapshot(snapshot, callback, context);
 }
 
-// Slightly modified version of this https://www.codeproject.com/Tips/1079637/Twos-Complement-for-Unusual-Integer-Sizes
-int16_t RPB_1600::UpscaleTwosComplement(int16_t value, size_t length)
+bool RPB_1600::beginCurveParams(rpb_1600_snapshot *snapshot, curve_parameters *params,
+                                rpb_1600_snapshot_callback callback, void *context)
 {
-    uint16_t mask = (~0) << length;
-    // Too small for complement?
-    if (length < 2)
+    if (snapshot->state == RPB_1600_REQUEST_QUEUED)
     {
-        return (~mask & value);
+        return false;
     }
-    // Two's complement?
-    uint16_t msb = 1 << (length - 1);
-    if (value & msb)
+
+    // Same order as getCurveParams()
+    snapshot->requests[0].command = CMD_CODE_CURVE_CC;
+    snapshot->requests[0].length = CMD_LENGTH_CURVE_CC;
+    snapshot->requests[1].command = CMD_CODE_CURVE_CV;
+    snapshot->requests[1].length = CMD_LENGTH_CURVE_CV;
+    snapshot->requests[2].command = CMD_CODE_CURVE_FV;
+    snapshot->requests[2].length = CMD_LENGTH_CURVE_FV;
+    snapshot->requests[3].command = CMD_CODE_CURVE_TC;
+    snapshot->requests[3].length = CMD_LENGTH_CURVE_TC;
+    snapshot->requests[4].command = CMD_CODE_CURVE_CONFIG;
+    snapshot->requests[4].length = CMD_LENGTH_CURVE_CONFIG;
+    snapshot->requests[5].command = CMD_CODE_CURVE_CC_TIMEOUT;
+    snapshot->requests[5].length = CMD_LENGTH_CURVE_CC_TIMEOUT;
+    snapshot->requests[6].command = CMD_CODE_CURVE_CV_TIMEOUT;
+    snapshot->requests[6].length = CMD_LENGTH_CURVE_CV_TIMEOUT;
+    snapshot->requests[7].command = CMD_CODE_CURVE_FLOAT_TIMEOUT;
+    snapshot->requests[7].length = CMD_LENGTH_CURVE_FLOAT_TIMEOUT;
+    snapshot->requests[8].command = CMD_CODE_CHG_STATUS;
+    snapshot->requests[8].length = CMD_LENGTH_CHG_STATUS;
+    snapshot->num_requests = 9;
+    snapshot->is_curve_params = true;
+    snapshot->destination = params;
+
+    return beginSnapshot(snapshot, callback, context);
+}
+
+bool RPB_1600::service(void)
+{
+    if (my_current_request == nullptr && my_queue_head != nullptr)
     {
-        return (mask | value);
+        rpb_1600_request *request = my_queue_head;
+
+        // Answer straight from the cache if we can
+        if (my_cache != nullptr && my_cache->lookup(request->command, request->length, my_bus->micros(), request->data))
+        {
+            RPB_1600_TRACE_EVENT(RPB_1600_TRACE_CACHE_HIT, request->command, RPB_1600_BUS_OK, request->data, request->length);
+            my_queue_head = request->next;
+
+            if (my_queue_head == nullptr)
+            {
+                my_queue_tail = nullptr;
+            }
+
+            my_current_request = request;
+            request->received = request->length;
+            completeCurrentRequest(RPB_1600_REQUEST_DONE);
+
+            return isBusy();
+        }
+
+#ifdef RPB_1600_STATS
+        my_request_start = my_bus->micros();
+#endif
+        uint8_t status = my_bus->startWriteRead(my_charger_address, &request->command, 1,
+                                                request->data, request->length + (my_pec ? 1 : 0));
+
+        // Someone else is using the bus, try again next time around
+        if (status == RPB_1600_BUS_BUSY)
+        {
+            return true;
+        }
+
+        // Pop the request off the queue, it's ours now
+        my_queue_head = request->next;
+
+        if (my_queue_head == nullptr)
+        {
+            my_queue_tail = nullptr;
+        }
+
+        my_current_request = request;
+        request->state = RPB_1600_REQUEST_IN_FLIGHT;
+
+        if (status != RPB_1600_BUS_OK)
+        {
+#ifdef RPB_1600_STATS
+            recordStats(request->command, status, 0, request->length + (my_pec ? 1 : 0), true, 1,
+                        my_bus->micros() - my_request_start);
+#endif
+            completeCurrentRequest(RPB_1600_REQUEST_FAILED);
+            return isBusy();
+        }
     }
-    else
+
+    if (my_current_request != nullptr)
     {
-        return (~mask & value);
-    }
-}
+        uint8_t received = 0;
+        uint8_t status = my_bus->pollWriteRead(&received);
 
-void RPB_1600::clearRXBuffer(void)
-{
-    memset(my_rx_buffer, 0, MAX_RECEIVE_BYTES);
-#ifdef RPB_1600_DEBUG
-    Serial.printf("<RPB-1600 DEBUG> RX Buffer Cleared!\n");
+        if (status == RPB_1600_BUS_BUSY)
+        {
+            return true;
+        }
+
+        rpb_1600_request *request = my_current_request;
+        request->received = received;
+
+        uint8_t expected = request->length + (my_pec ? 1 : 0);
+        RPB_1600_TRACE_EVENT(RPB_1600_TRACE_ASYNC_READ, request->command, status, request->data,
+                             (received < expected) ? received : expected);
+        bool complete = status == RPB_1600_BUS_OK && received == expected;
+        bool pec_ok = !complete || !my_pec || checkPEC(request->command, request->data, request->length);
+
+#ifdef RPB_1600_STATS
+        recordStats(request->command, status, received, expected, pec_ok, 1, my_bus->micros() - my_request_start);
 #endif
+
+        if (!complete)
+        {
+            recordTransaction(false);
+            completeCurrentRequest(RPB_1600_REQUEST_FAILED);
+        }
+        else if (!pec_ok)
+        {
+            recordTransaction(false);
+
+            if (request->attempts < my_retries)
+            {
+                // Put it back at the front of the queue to try again
+                request->attempts++;
+                request->state = RPB_1600_REQUEST_QUEUED;
+                request->next = my_queue_head;
+                my_queue_head = request;
+
+                if (my_queue_tail == nullptr)
+                {
+                    my_queue_tail = request;
+                }
+
+                my_current_request = nullptr;
+            }
+            else
+            {
+                completeCurrentRequest(RPB_1600_REQUEST_FAILED);
+            }
+        }
+        else
+        {
+            recordTransaction(true);
+
+            // Report the length of the response, not counting the PEC
+            request->received = request->length;
+
+            if (my_cache != nullptr)
+            {
+                my_cache->store(request->command, request->data, request->length, my_bus->micros());
+            }
+
+            completeCurrentRequest(RPB_1600_REQUEST_DONE);
+        }
+    }
+
+    return isBusy();
+}
+
+bool RPB_1600::isBusy(void) const
+{
+    return my_current_request != nullptr || my_queue_head != nullptr;
+}
+
+void RPB_1600::attachCache(RPB_1600_Cache *cache)
+{
+    my_cache = cache;
+}
+
+RPB_1600_Cache *RPB_1600::getCache(void) const
+{
+    return my_cache;
+}
+
+void RPB_1600::attachSettleTracker(RPB_1600_SettleTracker *tracker)
+{
+    my_settle_tracker = tracker;
+}
+
+RPB_1600_SettleTracker *RPB_1600::getSettleTracker(void) const
+{
+    return my_settle_tracker;
+}
+
+void RPB_1600::onReadings(rpb_1600_readings_callback callback, void *context)
+{
+    my_readings_callback = callback;
+    my_readings_context = context;
+}
+
+void RPB_1600::setPEC(bool enabled)
+{
+    my_pec = enabled;
+}
+
+bool RPB_1600::getPEC(void) const
+{
+    return my_pec;
+}
+
+void RPB_1600::setRetries(uint8_t retries)
+{
+    my_retries = retries;
+}
+
+uint32_t RPB_1600::getPECFailures(void) const
+{
+    return my_pec_failures;
+}
+
+uint16_t RPB_1600::getPECFailures(uint8_t commandID) const
+{
+    for (uint8_t i = 0; i < my_num_pec_counters; i++)
+    {
+        if (my_pec_counters[i].command == commandID)
+        {
+            return my_pec_counters[i].failures;
+        }
+    }
+
+    return 0;
+}
+
+#ifdef RPB_1600_STATS
+const RPB_1600_Stats &RPB_1600::getStats(void) const
+{
+    return my_stats;
+}
+
+void RPB_1600::resetStats(void)
+{
+    my_stats.reset();
+}
+#endif
+
+#ifdef RPB_1600_TRACE
+RPB_1600_Trace &RPB_1600::getTrace(void)
+{
+    return my_trace;
+}
+#endif
+
+RPB_1600_Bus *RPB_1600::getBus(void) const
+{
+    return my_bus;
+}
+
+uint8_t RPB_1600::getAddress(void) const
+{
+    return my_charger_address;
+}
+
+//----------------------------------------------------------------------
+// Private Functions
+//----------------------------------------------------------------------
+
+bool RPB_1600::readInto(uint8_t commandID, uint8_t *destination, uint8_t length, bool block)
+{
+    if (my_cache != nullptr && my_cache->lookup(commandID, length, my_bus->micros(), destination))
+    {
+        RPB_1600_TRACE_EVENT(RPB_1600_TRACE_CACHE_HIT, commandID, RPB_1600_BUS_OK, destination, length);
+        return true;
+    }
+
+    if (!readRegister(commandID, destination, length, my_retries + 1, block))
+    {
+        return false;
+    }
+
+    if (my_cache != nullptr)
+    {
+        my_cache->store(commandID, destination, length, my_bus->micros());
+    }
+
+    return true;
+}
+
+bool RPB_1600::writeBytes(uint8_t commandID, const uint8_t *data, uint8_t length)
+{
+    // Command code, data and PEC
+    uint8_t tx[MAX_RECEIVE_BYTES + 2];
+
+    if (length > MAX_RECEIVE_BYTES)
+    {
+        return false;
+    }
+
+    uint8_t tx_length = length + 1;
+    tx[0] = commandID;
+    memcpy(&tx[1], data, length);
+
+    if (my_pec)
+    {
+        tx[tx_length] = pmbus_write_pec(my_charger_address, tx, tx_length);
+        tx_length++;
+    }
+
+    // With PEC on, the charger NACKs a write that arrived corrupted, so try it again
+    uint8_t attempts = my_pec ? my_retries + 1 : 1;
+    bool success = false;
+
+    for (uint8_t i = 0; i < attempts && !success; i++)
+    {
+#ifdef RPB_1600_STATS
+        uint32_t start = my_bus->micros();
+#endif
+        uint8_t status = my_bus->write(my_charger_address, tx, tx_length);
+        success = status == RPB_1600_BUS_OK;
+        recordTransaction(success);
+        RPB_1600_TRACE_EVENT(RPB_1600_TRACE_WRITE, commandID, status, &tx[1], tx_length - 1);
+#ifdef RPB_1600_STATS
+        recordStats(commandID, status, 0, 0, true, tx_length, my_bus->micros() - start);
+#endif
+    }
+
+    // Even a failed write might have reached the charger, so drop what we had cached either way
+    if (my_cache != nullptr)
+    {
+        my_cache->onWrite(commandID);
+    }
+
+    return success;
+}
+
+bool RPB_1600::readRegister(uint8_t commandID, uint8_t *destination, uint8_t length, uint8_t attempts, bool block)
+{
+    // Room for the PEC, so it doesn't overrun the destination
+    uint8_t rx[RPB_1600_RAW_LENGTH(MAX_RECEIVE_BYTES)];
+    uint8_t bus_status;
+
+    if (readResponse(commandID, rx, length, attempts, block, &bus_status) != RPB_1600_READ_OK)
+    {
+        return false;
+    }
+
+    memcpy(destination, rx, length);
+
+    return true;
+}
+
+uint8_t RPB_1600::readResponse(uint8_t commandID, uint8_t *rx, uint8_t length, uint8_t attempts, bool block,
+                               uint8_t *busStatus)
+{
+    uint8_t rx_length = length + (my_pec ? 1 : 0);
+    *busStatus = RPB_1600_BUS_OK;
+
+    for (uint8_t attempt = 0; attempt < attempts; attempt++)
+    {
+        // Send the command ID to the charger, then read the response after a repeated start
+        uint8_t num_bytes = 0;
+#ifdef RPB_1600_STATS
+        uint32_t start = my_bus->micros();
+#endif
+        uint8_t status = my_bus->writeRead(my_charger_address, &commandID, 1, rx, rx_length, &num_bytes);
+        RPB_1600_TRACE_EVENT(RPB_1600_TRACE_READ, commandID, status, rx, (num_bytes < rx_length) ? num_bytes : rx_length);
+        bool complete = status == RPB_1600_BUS_OK && num_bytes == rx_length;
+        bool pec_ok = !complete || checkResponse(commandID, rx, length, block);
+        *busStatus = status;
+
+#ifdef RPB_1600_STATS
+        recordStats(commandID, status, num_bytes, rx_length, pec_ok, 1, my_bus->micros() - start);
+#endif
+
+        if (status != RPB_1600_BUS_OK)
+        {
+            recordTransaction(false);
+            return RPB_1600_READ_BUS_FAILED;
+        }
+
+        // Make sure we got exactly the number of bytes we expect
+        if (num_bytes != rx_length)
+        {
+            recordTransaction(false);
+            return RPB_1600_READ_SHORT;
+        }
+
+        if (pec_ok)
+        {
+            recordTransaction(true);
+            return RPB_1600_READ_OK;
+        }
+
+        recordTransaction(false);
+    }
+
+    return RPB_1600_READ_CORRUPT;
+}
+
+bool RPB_1600::checkResponse(uint8_t commandID, const uint8_t *rx, uint8_t length, bool block)
+{
+    // The count can't claim more bytes than we asked for
+    if (block && rx[0] >= length)
+    {
+        return false;
+    }
+
+    return !my_pec || checkPEC(commandID, rx, block ? 1 + rx[0] : length);
+}
+
+bool RPB_1600::checkPEC(uint8_t commandID, const uint8_t *data, uint8_t length)
+{
+    if (pmbus_read_pec(my_charger_address, commandID, data, length) == data[length])
+    {
+        return true;
+    }
+
+    RPB_1600_TRACE_EVENT(RPB_1600_TRACE_PEC_ERROR, commandID, RPB_1600_BUS_OK, data, length + 1);
+
+    my_pec_failures++;
+
+    for (uint8_t i = 0; i < my_num_pec_counters; i++)
+    {
+        if (my_pec_counters[i].command == commandID)
+        {
+            my_pec_counters[i].failures++;
+            return false;
+        }
+    }
+
+    if (my_num_pec_counters < RPB_1600_PEC_COUNTERS)
+    {
+        my_pec_counters[my_num_pec_counters].command = commandID;
+        my_pec_counters[my_num_pec_counters].failures = 1;
+        my_num_pec_counters++;
+    }
+
+    return false;
+}
+
+void RPB_1600::setClockLevel(uint8_t level)
+{
+    my_bus->changeClock(clock_levels[level]);
+    RPB_1600_TRACE_VALUE(RPB_1600_TRACE_CLOCK, 0, clock_levels[level]);
+}
+
+uint8_t RPB_1600::getClockLevel(void) const
+{
+    for (uint8_t level = 0; level < RPB_1600_CLOCK_LEVELS; level++)
+    {
+        if (clock_levels[level] == my_bus->getClock())
+        {
+            return level;
+        }
+    }
+
+    return 0;
+}
+
+void RPB_1600::recordTransaction(bool ok)
+{
+    my_clock_stats.transactions++;
+
+    if (!ok)
+    {
+        my_clock_stats.errors++;
+        my_window_errors++;
+    }
+
+    if (!my_auto_clock || ++my_window_transactions < RPB_1600_CLOCK_WINDOW)
+    {
+        return;
+    }
+
+    if (my_window_errors > RPB_1600_CLOCK_MAX_WINDOW_ERRORS)
+    {
+        my_clean_windows = 0;
+
+        uint8_t level = getClockLevel();
+
+        if (level > 0)
+        {
+            setClockLevel(level - 1);
+            my_clock_stats.step_downs++;
+        }
+    }
+    else if (my_window_errors > 0)
+    {
+        my_clean_windows = 0;
+    }
+    else if (getClockLevel() < my_max_clock_level && ++my_clean_windows >= RPB_1600_CLOCK_STEP_UP_WINDOWS)
+    {
+        my_clean_windows = 0;
+        setClockLevel(getClockLevel() + 1);
+        my_clock_stats.step_ups++;
+    }
+
+    my_window_transactions = 0;
+    my_window_errors = 0;
+}
+
+#ifdef RPB_1600_STATS
+void RPB_1600::recordStats(uint8_t commandID, uint8_t busStatus, uint8_t received, uint8_t expected, bool pecOk,
+                           uint8_t bytesWritten, uint32_t latency_us)
+{
+    // The bus reports how many bytes the charger had to send, we only ever take expected of them
+    uint8_t bytes_read = (received < expected) ? received : expected;
+
+    my_stats.record(commandID, RPB_1600_Stats::classify(busStatus, received, expected, pecOk),
+                    bytesWritten, bytes_read, latency_us);
+}
+#endif
+
+#if defined(RPB_1600_TRACE) || defined(RPB_1600_DEBUG)
+void RPB_1600::trace(uint8_t event, uint8_t commandID, uint8_t status, const uint8_t *data, uint8_t length)
+{
+#ifdef RPB_1600_TRACE
+    my_trace.record(my_bus->micros(), event, commandID, status, data, length);
+#else
+    // Debugging without tracing, print it now
+    rpb_1600_trace_record record;
+    char line[RPB_1600_TRACE_LINE_LENGTH];
+    RPB_1600_Trace::fill(&record, my_bus->micros(), event, commandID, status, data, length);
+    RPB_1600_Trace::format(&record, line, sizeof(line));
+    Serial.printf("<RPB-1600 DEBUG> %s\n", line);
+#endif
+}
+
+void RPB_1600::traceValue(uint8_t event, uint8_t commandID, uint32_t value)
+{
+    uint8_t data[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+    trace(event, commandID, 0, data, sizeof(data));
+}
+#endif
+
+bool RPB_1600::calibrationRound(uint8_t reference[][MAX_RECEIVE_BYTES], bool store)
+{
+    uint8_t data[MAX_RECEIVE_BYTES];
+
+    for (uint8_t i = 0; i < NUM_CALIBRATION_REGISTERS; i++)
+    {
+        const calibration_register *reg = &calibration_registers[i];
+
+        // Straight to the bus, one attempt: a cached or retried read would hide the errors we're looking for
+        if (!readRegister(reg->command, data, reg->length, 1, reg->block))
+        {
+            return false;
+        }
+
+        if (store)
+        {
+            memcpy(reference[i], data, reg->length);
+        }
+        else if (memcmp(reference[i], data, reg->length) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+uint8_t RPB_1600::readBurst(rpb_1600_read *items, const uint8_t *indices, uint8_t count)
+{
+    rpb_1600_bus_transfer transfers[RPB_1600_MAX_BURST_READS];
+    // With PEC on, responses land here first so the extra byte doesn't overrun the destination
+    uint8_t pec_rx[RPB_1600_MAX_BURST_READS][MAX_RECEIVE_BYTES + 1];
+    uint8_t num_ok = 0;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        rpb_1600_read *item = &items[indices[i]];
+        transfers[i].tx = &item->command;
+        transfers[i].tx_length = 1;
+        transfers[i].rx = my_pec ? pec_rx[i] : item->destination;
+        transfers[i].rx_length = item->length + (my_pec ? 1 : 0);
+    }
+
+#ifdef RPB_1600_STATS
+    uint32_t start = my_bus->micros();
+#endif
+
+    my_bus->writeReadMany(my_charger_address, transfers, count);
+
+#ifdef RPB_1600_STATS
+    // The burst is timed as a whole, so split it evenly
+    uint32_t latency = (my_bus->micros() - start) / count;
+#endif
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        rpb_1600_read *item = &items[indices[i]];
+        item->success = transfers[i].status == RPB_1600_BUS_OK && transfers[i].received == transfers[i].rx_length;
+        RPB_1600_TRACE_EVENT(RPB_1600_TRACE_BURST_READ, item->command, transfers[i].status, transfers[i].rx,
+                             (transfers[i].received < transfers[i].rx_length) ? transfers[i].received : transfers[i].rx_length);
+        bool pec_ok = !item->success || checkResponse(item->command, transfers[i].rx, item->length, item->block);
+
+#ifdef RPB_1600_STATS
+        recordStats(item->command, transfers[i].status, transfers[i].received, transfers[i].rx_length, pec_ok, 1, latency);
+#endif
+
+        if (!item->success)
+        {
+            recordTransaction(false);
+        }
+        else if (pec_ok)
+        {
+            recordTransaction(true);
+
+            if (my_pec)
+            {
+                memcpy(item->destination, pec_rx[i], item->length);
+            }
+        }
+        else
+        {
+            recordTransaction(false);
+
+            // Retry this one on its own, the burst already counted as the first attempt
+            item->success = readRegister(item->command, item->destination, item->length, my_retries, item->block);
+        }
+    }
+
+    uint32_t now = my_bus->micros();
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        rpb_1600_read *item = &items[indices[i]];
+
+        if (item->success)
+        {
+            num_ok++;
+
+            if (my_cache != nullptr)
+            {
+                my_cache->store(item->command, item->destination, item->length, now);
+            }
+        }
+    }
+
+    return num_ok;
+}
+
+void RPB_1600::completeCurrentRequest(uint8_t state)
+{
+    rpb_1600_request *request = my_current_request;
+
+    // Clear this first so the callback is free to submit more requests
+    my_current_request = nullptr;
+    request->state = state;
+
+    if (request->callback != nullptr)
+    {
+        request->callback(request);
+    }
+}
+
+bool RPB_1600::beginSnapshot(rpb_1600_snapshot *snapshot, rpb_1600_snapshot_callback callback, void *context)
+{
+    snapshot->owner = this;
+    snapshot->callback = callback;
+    snapshot->context = context;
+    snapshot->outstanding = snapshot->num_requests;
+    snapshot->state = RPB_1600_REQUEST_QUEUED;
+
+    for (uint8_t i = 0; i < snapshot->num_requests; i++)
+    {
+        rpb_1600_request *request = &snapshot->requests[i];
+        request->state = RPB_1600_REQUEST_IDLE;
+        submitRead(request, request->command, request->length, onSnapshotRequestComplete, snapshot);
+    }
+
+    return true;
+}
+
+void RPB_1600::onSnapshotRequestComplete(rpb_1600_request *request)
+{
+    rpb_1600_snapshot *snapshot = static_cast<rpb_1600_snapshot *>(request->context);
+
+    if (--snapshot->outstanding > 0)
+    {
+        return;
+    }
+
+    // That was the last read, make sure they all worked before touching the destination
+    for (uint8_t i = 0; i < snapshot->num_requests; i++)
+    {
+        if (snapshot->requests[i].state != RPB_1600_REQUEST_DONE)
+        {
+            snapshot->state = RPB_1600_REQUEST_FAILED;
+
+            if (snapshot->callback != nullptr)
+            {
+                snapshot->callback(snapshot);
+            }
+
+            return;
+        }
+    }
+
+    RPB_1600 *charger = snapshot->owner;
+    const uint8_t *raw[RPB_1600_MAX_SNAPSHOT_REQUESTS];
+
+    for (uint8_t i = 0; i < snapshot->num_requests; i++)
+    {
+        raw[i] = snapshot->requests[i].data;
+    }
+
+    if (snapshot->is_curve_params)
+    {
+        decodeCurveParams(raw, static_cast<curve_parameters *>(snapshot->destination));
+    }
+    else
+    {
+        readings *data = static_cast<readings *>(snapshot->destination);
+        decodeReadings(raw, data);
+
+        if (charger->my_readings_callback != nullptr)
+        {
+            charger->my_readings_callback(data, charger->my_bus->micros(), charger->my_readings_context);
+        }
+    }
+
+    snapshot->state = RPB_1600_REQUEST_DONE;
+
+    if (snapshot->callback != nullptr)
+    {
+        snapshot->callback(snapshot);
+    }
+}
+
+bool RPB_1600::writeLinearValue(uint8_t commandID, int8_t N, int32_t value, int32_t scale, uint32_t confirmTimeout_us)
+{
+    // The Y value is calculated using the following equation
+    // (reference PMBUS spec rev 1.1 section 7.1): Value = Y * 2 ^ N
+    // Y = Value / (2 ^ N), rounded to the nearest integer
+    if (N < LINEAR11_EXPONENT_MIN || N > LINEAR11_EXPONENT_MAX || !linear11_fits_narrow(value, scale, N))
+    {
+#ifdef RPB_1600_DEBUG
+        Serial.printf("<RPB-1600 DEBUG> Can't convert %ld / %ld to linear format with N = %d\n", (long)value,
+                      (long)scale, N);
+#endif
+        return false;
+    }
+
+    int16_t Y = linear11_mantissa(linear11_from_scaled_narrow(value, scale, N));
+
+    return writeLinearDataHelper(commandID, N, Y, confirmTimeout_us);
+}
+
+bool RPB_1600::writeLinearDataHelper(uint8_t commandID, int8_t N, int16_t Y, uint32_t confirmTimeout_us)
+{
+    // Make sure the N value fits in 5 bits
+    if (N < LINEAR11_EXPONENT_MIN || N > LINEAR11_EXPONENT_MAX)
+    {
+#ifdef RPB_1600_DEBUG
+        Serial.printf("<RPB-1600 DEBUG> N value too large! Can't convert to linear format. N = %d\n", N);
+#endif
+        return false;
+    }
+
+    // Make sure the Y (Mantissa) can fit in 11 bits
+    if (Y < LINEAR11_MANTISSA_MIN || Y > LINEAR11_MANTISSA_MAX)
+    {
+#ifdef RPB_1600_DEBUG
+        Serial.printf("<RPB-1600 DEBUG> Mantissa (Y) value too large! Can't convert to linear format. Y = %d\n", Y);
+#endif
+        return false;
+    }
+
+    // N goes in the highest 5 bits and Y in the lowest 11 bits of the outgoing data
+    // See Section 7.1 of the PMBus 1.1 specification for more info on the "Linear Data Format"
+    // Note that data[0] is the low byte (sent first) and data[1] is the high byte (sent second)
+    uint16_t word = linear11_pack(N, Y);
+    uint8_t data[2] = {(uint8_t)(word & 0x00FF), (uint8_t)(word >> 8)};
+
+    if (confirmTimeout_us > 0)
+    {
+        return writeTwoBytesConfirmed(commandID, data, confirmTimeout_us);
+    }
+
+    return writeTwoBytes(commandID, data);
+}
+
+void RPB_1600::decodeReadings(const uint8_t *const raw[], readings *data)
+{
+    data->v_in = parseLinearQuantity(raw[0]);
+    data->v_out = parseLinearVoltage(raw[1], CMD_N_VALUE_READ_VOUT);
+    data->i_out = parseLinearQuantity(raw[2]);
+    data->fan_speed_1 = parseLinearData(raw[3]);
+    data->fan_speed_2 = parseLinearData(raw[4]);
+}
+
+void RPB_1600::decodeCurveParams(const uint8_t *const raw[], curve_parameters *params)
+{
+    params->cc = parseLinearQuantity(raw[0]);
+    params->cv = parseLinearVoltage(raw[1], CMD_N_VALUE_CURVE_CV);
+    params->floating_voltage = parseLinearVoltage(raw[2], CMD_N_VALUE_CURVE_FV);
+    params->taper_current = parseLinearQuantity(raw[3]);
+    parseCurveConfig(raw[4], &params->config);
+    params->cc_timeout = parseLinearData(raw[5]);
+    params->cv_timeout = parseLinearData(raw[6]);
+    params->float_timeout = parseLinearData(raw[7]);
+    parseChargeStatus(raw[8], &params->status);
+}
+
+uint16_t RPB_1600::parseLinearData(const uint8_t *buffer)
+{
+    uint16_t rawData = linear_word(buffer);
+
+    // result = mantissa * 2 ^ N, rounded to the nearest whole unit
+    // The raw word is in the trace of the read it came from, tools/trace-decode shows N and Y
+    return static_cast<uint16_t>(linear_scale_narrow(linear11_mantissa(rawData), linear11_exponent(rawData), 1));
+}
+
+rpb_1600_quantity RPB_1600::parseLinearQuantity(const uint8_t *buffer)
+{
+#ifdef RPB_1600_FIXED_POINT
+    uint16_t rawData = linear_word(buffer);
+
+    // mantissa * 1000 * 2 ^ N, a few shifts and one multiply
+    return linear_scale_narrow(linear11_mantissa(rawData), linear11_exponent(rawData), RPB_1600_QUANTITY_SCALE);
+#else
+    return parseLinearData(buffer);
+#endif
+}
+
+rpb_1600_voltage RPB_1600::parseLinearVoltage(const uint8_t *buffer, int8_t N)
+{
+    // Voltages are in the Linear16 format: the whole word is an unsigned mantissa, and N is
+    // fixed by VOUT_MODE rather than sent with the data
+#ifdef RPB_1600_FIXED_POINT
+    return linear_scale_narrow(linear_word(buffer), N, RPB_1600_QUANTITY_SCALE);
+#else
+    return linear16_to_float(linear_word(buffer), N);
+#endif
+}
+
+void RPB_1600::parseCurveConfig(const uint8_t *buffer, curve_config *config)
+{
+    // Bits 0 & 1 of low byte
+    config->charge_curve_type = (buffer[0] & 0x03);
+    // Bits 2 & 3 of low byte
+    config->temp_compensation = (buffer[0] & 0x0C) >> 2;
+    // Bit 6 of low byte (0 = 3 stage, 1 = 2 stage)
+    config->num_charge_stages = (buffer[0] & 0x40) ? 2 : 3;
+    // Bit 0 of high byte
+    config->cc_timeout_indication_enabled = (buffer[1] & 0x01);
+    // Bit 1 of high byte
+    config->cv_timeout_indication_enabled = (buffer[1] & 0x02);
+    // Bit 2 of high byte
+    config->float_stage_timeout_indication_enabled = (buffer[1] & 0x04);
+}
+
+void RPB_1600::encodeCurveConfig(const curve_config *config, uint8_t *buffer)
+{
+    // Same bits parseCurveConfig() reads
+    buffer[0] = (buffer[0] & ~0x4F) |
+                (config->charge_curve_type & 0x03) |
+                ((config->temp_compensation & 0x03) << 2) |
+                ((config->num_charge_stages == 2) ? 0x40 : 0x00);
+    buffer[1] = (buffer[1] & ~0x07) |
+                (config->cc_timeout_indication_enabled ? 0x01 : 0x00) |
+                (config->cv_timeout_indication_enabled ? 0x02 : 0x00) |
+                (config->float_stage_timeout_indication_enabled ? 0x04 : 0x00);
+}
+
+bool RPB_1600::encodeCurveParams(const curve_parameters &params, const uint8_t current[][2], uint8_t target[][2])
+{
+    // Values, their scale and exponents, in curve_registers[] order (0 for CURVE_CONFIG). Integer
+    // arithmetic throughout, except for the volts of CV and FV without RPB_1600_FIXED_POINT.
+    const int32_t values[RPB_1600_CURVE_REGISTERS] = {
+        params.cc, 0, 0, params.taper_current, 0, params.cc_timeout, params.cv_timeout, params.float_timeout};
+    const int32_t scales[RPB_1600_CURVE_REGISTERS] = {
+        RPB_1600_QUANTITY_SCALE, 0, 0, RPB_1600_QUANTITY_SCALE, 0, 1, 1, 1};
+    const int8_t exponents[RPB_1600_CURVE_REGISTERS] = {
+        CMD_N_VALUE_CURVE_CC, 0, 0, CMD_N_VALUE_CURVE_TC, 0,
+        CMD_N_VALUE_CURVE_CC_TIMEOUT, CMD_N_VALUE_CURVE_CV_TIMEOUT, CMD_N_VALUE_CURVE_FLOAT_TIMEOUT};
+    const bool is_linear11[RPB_1600_CURVE_REGISTERS] = {true, false, false, true, false, true, true, true};
+
+    for (uint8_t i = 0; i < RPB_1600_CURVE_REGISTERS; i++)
+    {
+        uint16_t word;
+
+        if (is_linear11[i])
+        {
+            if (!linear11_fits_narrow(values[i], scales[i], exponents[i]))
+            {
+#ifdef RPB_1600_DEBUG
+                Serial.printf("<RPB-1600 DEBUG> %ld doesn't fit command 0x%x\n", (long)values[i], curve_registers[i]);
+#endif
+                return false;
+            }
+
+            word = linear11_from_scaled_narrow(values[i], scales[i], exponents[i]);
+        }
+        else if (curve_registers[i] == CMD_CODE_CURVE_CV || curve_registers[i] == CMD_CODE_CURVE_FV)
+        {
+            bool is_cv = curve_registers[i] == CMD_CODE_CURVE_CV;
+            rpb_1600_voltage voltage = is_cv ? params.cv : params.floating_voltage;
+
+            if (!encodeLinearVoltage(voltage, is_cv ? CMD_N_VALUE_CURVE_CV : CMD_N_VALUE_CURVE_FV, &word))
+            {
+#ifdef RPB_1600_DEBUG
+                Serial.printf("<RPB-1600 DEBUG> %.3f V doesn't fit command 0x%x\n",
+                              (double)voltage / RPB_1600_QUANTITY_SCALE, curve_registers[i]);
+#endif
+                return false;
+            }
+        }
+        else
+        {
+            target[i][0] = current[i][0];
+            target[i][1] = current[i][1];
+            encodeCurveConfig(&params.config, target[i]);
+            continue;
+        }
+
+        target[i][0] = word & 0xFF;
+        target[i][1] = word >> 8;
+    }
+
+    return true;
+}
+
+bool RPB_1600::encodeLinearVoltage(rpb_1600_voltage value, int8_t N, uint16_t *word)
+{
+#ifdef RPB_1600_FIXED_POINT
+    if (!linear16_fits_narrow(value, RPB_1600_QUANTITY_SCALE, N))
+    {
+        return false;
+    }
+
+    *word = linear16_from_scaled_narrow(value, RPB_1600_QUANTITY_SCALE, N);
+#else
+    if (!linear16_fits_float(value, N))
+    {
+        return false;
+    }
+
+    *word = linear16_from_float(value, N);
+#endif
+    return true;
+}
+
+void RPB_1600::parseBlockString(const uint8_t *buffer, char *string)
+{
+    // buffer[0] is the byte count, which checkResponse() made sure fits
+    uint8_t length = buffer[0];
+
+    // The charger pads its strings with spaces (and sometimes NULs)
+    while (length > 0 && (buffer[length] == ' ' || buffer[length] == '\0'))
+    {
+        length--;
+    }
+
+    memcpy(string, &buffer[1], length);
+    string[length] = '\0';
+}
+
+void RPB_1600::parseChargeStatus(const uint8_t *buffer, charge_status *status)
+{
+    // Low byte:
+    status->fully_charged = (buffer[0] & 0x01); // Bit 0
+    status->in_cc_mode = (buffer[0] & 0x02);    // Bit 1
+    status->in_cv_mode = (buffer[0] & 0x04);    // Bit 2
+    status->in_float_mode = (buffer[0] & 0x08); // Bit 3
+    // High byte:
+    status->EEPROM_error = (buffer[1] & 0x01);                    // Bit 0
+    status->temp_compensation_short_circuit = (buffer[1] & 0x04); // Bit 2
+    status->battery_detected = (buffer[1] & 0x08);                // Bit 3
+    status->timeout_flag_cc_mode = (buffer[1] & 0x20);            // Bit 5
+    status->timeout_flag_cv_mode = (buffer[1] & 0x40);            // Bit 6
+    status->timeout_flag_float_mode = (buffer[1] & 0x80);         // Bit 7
 }
\ No newline at end of file
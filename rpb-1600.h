@@ -4,6 +4,10 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include "rpb-1600-bus.h"
+#include "rpb-1600-stats.h"
+#include "rpb-1600-trace.h"
+#include "rpb-1600-traits.h"
 
 #ifndef RPB_1600_H
 #define RPB_1600_H
@@ -12,10 +16,44 @@
 // NOTE: You must call Serial.being(<baud rate>) in your setup() for this to work
 // #define RPB_1600_DEBUG
 
+// Uncomment the below #define to keep per command transaction counters and latency histograms,
+// see RPB_1600::getStats(). It has to be defined for every file that includes this one.
+// #define RPB_1600_STATS
+
+// Uncomment the below #define to record bus activity into a RAM ring instead of printing it as it
+// happens, see RPB_1600::getTrace(). Printing changes the bus timing, tracing barely does.
+// It has to be defined for every file that includes this one.
+// #define RPB_1600_TRACE
+
+// Uncomment the below #define to get readings and curve parameters as integers in thousandths of a
+// unit (millivolts, milliamps) instead of whole units and floats, see rpb_1600_quantity. Decoding and
+// encoding them then needs no floating point at all, which matters on boards without an FPU.
+// It has to be defined for every file that includes this one.
+// #define RPB_1600_FIXED_POINT
+
+// Trace events go to the ring with RPB_1600_TRACE, or are printed straight away with just RPB_1600_DEBUG
+#if defined(RPB_1600_TRACE) || defined(RPB_1600_DEBUG)
+#define RPB_1600_TRACE_EVENT(event, commandID, status, data, length) trace(event, commandID, status, data, length)
+#define RPB_1600_TRACE_VALUE(event, commandID, value) traceValue(event, commandID, value)
+#else
+#define RPB_1600_TRACE_EVENT(event, commandID, status, data, length)
+#define RPB_1600_TRACE_VALUE(event, commandID, value)
+#endif
+
 /**
  * @brief The maximum number of bytes we could possibly expect to receive from the charger
+ * @details The longest responses are the 12 byte manufacturer strings, which come as SMBus block
+ * reads with a byte count in front
+ */
+#define MAX_RECEIVE_BYTES 13
+
+/**
+ * @brief What a block read of up to length bytes takes on the bus, with its byte count
  */
-#define MAX_RECEIVE_BYTES 12
+#define RPB_1600_BLOCK_LENGTH(length) ((length) + 1)
+
+static_assert(rpb_1600_all_commands::max_length() <= MAX_RECEIVE_BYTES,
+              "A command in rpb-1600-traits.h is longer than MAX_RECEIVE_BYTES");
 
 #define N_EXPONENT_MASK 0xF800 // Bitmask for pulling out the first 5 bytes of the payload (the N exponent value)
 #define MANTISSA_MASK 0x07FF   // Bitmask for pulling out the last 11 bytes of the payload (the Mantissa)
@@ -23,23 +61,56 @@
 #define MANTISSA_LENGTH 11
 #define N_EXPONENT_SHIFT MANTISSA_LENGTH
 
+#ifdef RPB_1600_FIXED_POINT
+/**
+ * @brief A Linear11 reading or setting (input voltage, currents), in thousandths of its unit
+ */
+typedef int32_t rpb_1600_quantity;
+/**
+ * @brief A Linear16 output voltage, in millivolts
+ */
+typedef int32_t rpb_1600_voltage;
+#else
+/**
+ * @brief A Linear11 reading or setting (input voltage, currents), rounded to whole units
+ */
+typedef uint16_t rpb_1600_quantity;
+/**
+ * @brief A Linear16 output voltage, in volts
+ */
+typedef float rpb_1600_voltage;
+#endif
+
+/**
+ * @brief What the rpb_1600_quantity and rpb_1600_voltage fields count in, per unit (1 for whole units)
+ */
+#ifdef RPB_1600_FIXED_POINT
+#define RPB_1600_QUANTITY_SCALE RPB_1600_FIXED_SCALE
+#else
+#define RPB_1600_QUANTITY_SCALE 1
+#endif
+
 struct readings
 {
-    uint16_t v_in;
-    float v_out;
-    uint16_t i_out;
+    rpb_1600_quantity v_in;
+    rpb_1600_voltage v_out;
+    rpb_1600_quantity i_out;
     uint16_t fan_speed_1;
     uint16_t fan_speed_2;
 };
 
+/**
+ * @brief The manufacturer strings, see RPB_1600::getMfrData()
+ * @details NUL terminated, without the spaces the charger pads them with
+ */
 struct mfr_data
 {
-    char id[12];
-    char model[12];
-    char revision[6];
-    char location[3];
-    char date[6];
-    char serial[12];
+    char id[CMD_LENGTH_MFR_ID + 1];
+    char model[CMD_LENGTH_MFR_MODEL + 1];
+    char revision[CMD_LENGTH_MFR_REVISION + 1];
+    char location[CMD_LENGTH_MFR_LOCATION + 1];
+    char date[CMD_LENGTH_MFR_DATE + 1];
+    char serial[CMD_LENGTH_MFR_SERIAL + 1];
 };
 
 struct curve_config
@@ -91,10 +162,10 @@ struct charge_status
 
 struct curve_parameters
 {
-    uint16_t cc;
-    float cv;
-    float floating_voltage;
-    uint16_t taper_current;
+    rpb_1600_quantity cc;
+    rpb_1600_voltage cv;
+    rpb_1600_voltage floating_voltage;
+    rpb_1600_quantity taper_current;
     curve_config config;
     uint16_t cc_timeout;
     uint16_t cv_timeout;
@@ -102,11 +173,266 @@ struct curve_parameters
     charge_status status;
 };
 
+/**
+ * @brief One register to read with RPB_1600::readMany()
+ */
+struct rpb_1600_read
+{
+    uint8_t command;
+    uint8_t length;
+    // Where to put the response, must have room for length bytes
+    uint8_t *destination;
+    // Set by readMany(): true if exactly length bytes came back
+    bool success;
+    // An SMBus block read: the first byte of the response is a count of the bytes after it, and
+    // length includes it (see RPB_1600_BLOCK_LENGTH())
+    bool block;
+};
+
+/**
+ * @brief How a RPB_1600::readRaw() went
+ */
+enum rpb_1600_read_status : uint8_t
+{
+    RPB_1600_READ_OK = 0,
+    // The bus transaction failed, bus_status in rpb_1600_read_result says how
+    RPB_1600_READ_BUS_FAILED,
+    // Fewer bytes came back than were asked for
+    RPB_1600_READ_SHORT,
+    // The PEC didn't match, or a block read's count didn't fit, on every attempt
+    RPB_1600_READ_CORRUPT,
+    // length is more than MAX_RECEIVE_BYTES
+    RPB_1600_READ_TOO_LONG,
+};
+
+/**
+ * @brief What RPB_1600::readRaw() returns
+ */
+struct rpb_1600_read_result
+{
+    // A rpb_1600_read_status
+    uint8_t status;
+    // The rpb_1600_bus_status of the last attempt (RPB_1600_BUS_OK for a cache hit)
+    uint8_t bus_status;
+    // Bytes of response in the buffer, not counting the PEC. For a block read that's the count
+    // byte plus the bytes it counts. 0 if the read failed.
+    uint8_t length;
+};
+
+/**
+ * @brief How big a buffer RPB_1600::readRaw() needs for a length byte response, with room for the PEC
+ */
+#define RPB_1600_RAW_LENGTH(length) ((length) + 1)
+
+/**
+ * @brief The most reads readMany() sends to the bus in one burst, longer lists are split up
+ */
+#define RPB_1600_MAX_BURST_READS 12
+
+/**
+ * @brief The lifecycle of an asynchronous request (see RPB_1600::submitRead())
+ */
+enum rpb_1600_request_state : uint8_t
+{
+    RPB_1600_REQUEST_IDLE = 0,
+    // Waiting in the charger's queue
+    RPB_1600_REQUEST_QUEUED,
+    // On the bus right now
+    RPB_1600_REQUEST_IN_FLIGHT,
+    // Finished, data[] holds the response
+    RPB_1600_REQUEST_DONE,
+    // Finished, but the transaction failed or returned the wrong number of bytes
+    RPB_1600_REQUEST_FAILED,
+};
+
+struct rpb_1600_request;
+
+/**
+ * @brief Called from RPB_1600::service() when a request finishes
+ */
+typedef void (*rpb_1600_request_callback)(rpb_1600_request *request);
+
+/**
+ * @brief A single asynchronous read, owned by the caller
+ * @details Zero initialise it before first use (rpb_1600_request request{};). The request must
+ * stay alive until it reaches RPB_1600_REQUEST_DONE or RPB_1600_REQUEST_FAILED. It can then be
+ * submitted again.
+ */
+struct rpb_1600_request
+{
+    uint8_t command;
+    uint8_t length;
+    // One extra byte for the PEC, when it's enabled
+    uint8_t data[MAX_RECEIVE_BYTES + 1];
+    uint8_t received;
+    volatile uint8_t state;
+    // Retries used so far after PEC failures
+    uint8_t attempts;
+    rpb_1600_request_callback callback;
+    void *context;
+    // Used by RPB_1600 to chain queued requests together, don't touch
+    rpb_1600_request *next;
+};
+
+/**
+ * @brief The most reads an asynchronous snapshot is made of (getCurveParams() reads 9 registers)
+ */
+#define RPB_1600_MAX_SNAPSHOT_REQUESTS 9
+
+struct rpb_1600_snapshot;
+
+/**
+ * @brief Called from RPB_1600::service() when a snapshot finishes
+ */
+typedef void (*rpb_1600_snapshot_callback)(rpb_1600_snapshot *snapshot);
+
+/**
+ * @brief An asynchronous getReadings() or getCurveParams(), owned by the caller
+ * @details Zero initialise it before first use. state uses the same values as
+ * rpb_1600_request::state. The destination struct is only written once every read has
+ * finished, and only if they all succeeded.
+ */
+struct rpb_1600_snapshot
+{
+    rpb_1600_request requests[RPB_1600_MAX_SNAPSHOT_REQUESTS];
+    uint8_t num_requests;
+    uint8_t outstanding;
+    volatile uint8_t state;
+    bool is_curve_params;
+    void *destination;
+    class RPB_1600 *owner;
+    rpb_1600_snapshot_callback callback;
+    void *context;
+};
+
+/**
+ * @brief The number of commands RPB_1600 keeps a separate PEC failure count for
+ */
+#define RPB_1600_PEC_COUNTERS 16
+
+struct rpb_1600_pec_counter
+{
+    uint8_t command;
+    uint16_t failures;
+};
+
+/**
+ * @brief The bus clocks calibrateClock() tries, slowest first. The charger is specified for 100kHz.
+ */
+#define RPB_1600_CLOCK_LEVELS 3
+#define RPB_1600_CLOCK_LEVEL_FREQUENCIES {100000, 400000, 1000000}
+
+/**
+ * @brief How many times calibrateClock() reads every test register at each clock
+ */
+#define RPB_1600_CALIBRATION_ROUNDS 8
+
+/**
+ * @brief Automatic clock control looks at the error rate over windows of this many transactions...
+ */
+#define RPB_1600_CLOCK_WINDOW 64
+
+/**
+ * @brief ...steps the clock down after a window with more than this many errors...
+ */
+#define RPB_1600_CLOCK_MAX_WINDOW_ERRORS 2
+
+/**
+ * @brief ...and back up after this many windows in a row without any
+ */
+#define RPB_1600_CLOCK_STEP_UP_WINDOWS 32
+
+struct rpb_1600_clock_stats
+{
+    // The clock the bus is running at now
+    uint32_t clock;
+    // The fastest clock calibrateClock() found to be reliable
+    uint32_t max_clock;
+    // Every transaction, and the ones that failed (bus error, wrong length or PEC mismatch)
+    uint32_t transactions;
+    uint32_t errors;
+    // Automatic clock changes
+    uint16_t step_downs;
+    uint16_t step_ups;
+};
+
+/**
+ * @brief Called with every complete set of readings, see RPB_1600::onReadings()
+ * @param timestamp RPB_1600_Bus::micros() when the readings finished
+ */
+typedef void (*rpb_1600_readings_callback)(const readings *data, uint32_t timestamp, void *context);
+
+/**
+ * @brief CC, CV, FV, TC, CURVE_CONFIG and the three timeouts, the registers setCurveParams() programs
+ */
+#define RPB_1600_CURVE_REGISTERS 8
+
+/**
+ * @brief Confirmed writes give up if the register hasn't read back the new value after this long
+ */
+#define RPB_1600_CONFIRM_TIMEOUT_US 1000000
+
+/**
+ * @brief Confirmed writes poll the register with exponential backoff between these limits
+ */
+#define RPB_1600_CONFIRM_MIN_BACKOFF_US 100
+#define RPB_1600_CONFIRM_MAX_BACKOFF_US 50000
+
+class RPB_1600_Cache;
+class RPB_1600_SettleTracker;
+
 class RPB_1600
 {
 public:
+    /**
+     * @brief Construct a charger that talks over the default Wire bus
+     * @note On targets without the Arduino Wire library there is no default bus, use the constructor below
+     */
     RPB_1600();
-    bool Init(uint8_t chargerAddress);
+
+    /**
+     * @brief Construct a charger that talks over the given bus
+     * @details bus must outlive this object. Multiple chargers can share one bus.
+     */
+    RPB_1600(RPB_1600_Bus &bus);
+
+    /**
+     * @brief Set the address of the charger and bring up the bus at 100kHz
+     * @details Only the first charger on a bus brings it up. The others leave it running at whatever
+     * clock it's at, so initialising another charger doesn't undo calibrateClock().
+     * @param calibrate Run calibrateClock() straight away to find the fastest reliable clock
+     * @return true on success, false if there is no bus to talk over
+     */
+    bool Init(uint8_t chargerAddress, bool calibrate = false);
+
+    /**
+     * @brief Bring up bus at 100kHz, unless a charger on it already has
+     * @details Init() does this for its own bus. Call it to use the bus directly before any charger
+     * on it is initialised, e.g. to probe for chargers.
+     */
+    static void beginBus(RPB_1600_Bus &bus);
+
+    /**
+     * @brief Find the fastest clock the charger and wiring can handle, then keep an eye on it
+     * @details Reads MFR_ID and the CURVE_* registers at 100kHz, then reads them again
+     * RPB_1600_CALIBRATION_ROUNDS times at each faster clock. The fastest clock where every read
+     * came back identical is used, and automatic clock control is turned on (see setAutoClock()).
+     * Changes the clock for everything on the bus, so calibrate only one charger per bus.
+     * @return The chosen clock, or 0 if the registers couldn't even be read at 100kHz (the clock is left at 100kHz)
+     */
+    uint32_t calibrateClock(void);
+
+    /**
+     * @brief Watch the transaction error rate and step the clock down when it gets too high
+     * @details After a window of RPB_1600_CLOCK_WINDOW transactions with more than
+     * RPB_1600_CLOCK_MAX_WINDOW_ERRORS errors, the clock drops a level. After
+     * RPB_1600_CLOCK_STEP_UP_WINDOWS clean windows in a row it goes back up a level, but never past
+     * the clock calibrateClock() chose. Corrupted data can only be told apart from good data with
+     * PEC on (see setPEC()), without it only bus errors and short reads count as errors.
+     */
+    void setAutoClock(bool enabled);
+
+    rpb_1600_clock_stats getClockStats(void) const;
 
     /**
      * @brief Query charger for voltage & current readings, populate a "readings" struct
@@ -126,6 +452,79 @@ public:
      */
     bool getCurveParams(curve_parameters *params);
 
+    /**
+     * @brief Decode the raw responses behind a readings struct, without touching the bus
+     * @details raw[] points at the two bytes of each register, in the order getReadings() reads them:
+     * READ_VIN, READ_VOUT, READ_IOUT, READ_FAN_SPEED_1, READ_FAN_SPEED_2. Integer only with
+     * RPB_1600_FIXED_POINT.
+     */
+    static void decodeReadings(const uint8_t *const raw[], readings *data);
+
+    /**
+     * @brief Decode the raw responses behind a curve_parameters struct, without touching the bus
+     * @details raw[] is in the order getCurveParams() reads them: CURVE_CC, CURVE_CV, CURVE_FV,
+     * CURVE_TC, CURVE_CONFIG, the three timeouts and CHG_STATUS.
+     */
+    static void decodeCurveParams(const uint8_t *const raw[], curve_parameters *params);
+
+    /**
+     * @brief Parses the first two bytes of buffer[] in the "Linear Data" format outlined int the PMBus Specification
+     * @details see the PMBus V1.1 Section 7.1 "Linear Data Format" for more info. The result is rounded
+     * to the nearest whole unit, use the codec in rpb-1600-linear.h directly if you need the fraction.
+     */
+    static uint16_t parseLinearData(const uint8_t *buffer);
+
+    /**
+     * @brief Parse a Linear11 reading or setting into a rpb_1600_quantity
+     * @details Whole units like parseLinearData(), or thousandths with RPB_1600_FIXED_POINT
+     */
+    static rpb_1600_quantity parseLinearQuantity(const uint8_t *buffer);
+
+    /**
+     * @brief Parse a voltage reading in the Linear16 format, where N comes from VOUT_MODE
+     * @details See the PMBus 1.1 spec section 8.3.1 for more info. Volts, or millivolts with
+     * RPB_1600_FIXED_POINT.
+     */
+    static rpb_1600_voltage parseLinearVoltage(const uint8_t *buffer, int8_t N);
+
+    /**
+     * @brief Parses the first two bytes of buffer[] into a curve_config struct and returns it via argument.
+     * @details Meant to be called on the response to CMD_CODE_CURVE_CONFIG
+     */
+    static void parseCurveConfig(const uint8_t *buffer, curve_config *config);
+
+    /**
+     * @brief Copy a block read of a manufacturer string (byte count first) into string as a C string
+     * @details Drops the padding at the end. string needs room for the count plus a NUL.
+     */
+    static void parseBlockString(const uint8_t *buffer, char *string);
+
+    /**
+     * @brief Parses the first two bytes of buffer[] into a charge_status struct and returns it via argument.
+     * @details Meant to be called on the response to CMD_CODE_CHG_STATUS
+     */
+    static void parseChargeStatus(const uint8_t *buffer, charge_status *status);
+
+    /**
+     * @brief Read all six manufacturer strings (MFR_ID through MFR_SERIAL) in one burst of block reads
+     * @details They never change, so with a cache attached only the first call goes to the bus.
+     * Fields that couldn't be read are left alone.
+     * @return true if every string was read
+     */
+    bool getMfrData(mfr_data *data);
+
+    /**
+     * @brief Program a whole charge curve: CC, CV, FV, TC, CURVE_CONFIG and the three timeouts
+     * @details Reads the curve registers first (through the cache, if one is attached) and only writes
+     * the ones that differ, each confirmed like writeTwoBytesConfirmed(). If a write fails or doesn't
+     * read back within timeout_us, every register already written (and the one that failed) is put
+     * back the way it was. Bits of CURVE_CONFIG that curve_config doesn't cover are left alone, and
+     * params.status is ignored.
+     * @return true if the charger now holds params, false if nothing changed or everything was rolled
+     * back (or a value doesn't fit its register)
+     */
+    bool setCurveParams(const curve_parameters &params, uint32_t timeout_us = RPB_1600_CONFIRM_TIMEOUT_US);
+
     /**
      * @brief Write two arbitrary bytes with commandID
      * @return true on successful write, false otherwise
@@ -142,11 +541,241 @@ public:
     bool writeLinearDataCommand(uint8_t commandID, int8_t N, int16_t value);
 
     /**
-     * @brief Sends commandID to the charger, and reads the receiveLength byte(s) long response into my_rx_buffer[]
+     * @brief Like writeTwoBytes(), but only returns once the register reads back what was written
+     * @details The charger takes a while to apply a write, and reads in the meantime return the
+     * old value. This polls the register with exponential backoff (RPB_1600_CONFIRM_MIN_BACKOFF_US
+     * doubling up to RPB_1600_CONFIRM_MAX_BACKOFF_US) until it matches. With a settle tracker
+     * attached, the first poll comes just before the register's median settle time instead, and the
+     * settle time is measured between the last poll that missed and the first that matched. Only use
+     * it on registers that read back exactly what was written.
+     * @return true once the register matches, false if the write failed or timeout_us ran out
+     */
+    bool writeTwoBytesConfirmed(uint8_t commandID, uint8_t *data, uint32_t timeout_us = RPB_1600_CONFIRM_TIMEOUT_US);
+
+    /**
+     * @brief writeLinearDataCommand(), confirmed like writeTwoBytesConfirmed()
+     */
+    bool writeLinearDataCommandConfirmed(uint8_t commandID, int8_t N, int16_t value,
+                                         uint32_t timeout_us = RPB_1600_CONFIRM_TIMEOUT_US);
+
+    /**
+     * @brief writeLinearDataCommand() for a value in the same units as readings and curve_parameters
+     * @details With RPB_1600_FIXED_POINT value is in thousandths (millivolts, milliamps), like
+     * write<Cmd>(), otherwise in whole units. It's a separate name rather than an overload so a plain
+     * int literal can't quietly pick the wrong units.
+     * @return True on success, false on failure (including a value that doesn't fit with N)
+     */
+    bool writeLinearQuantity(uint8_t commandID, int8_t N, rpb_1600_quantity value);
+
+    /**
+     * @brief writeLinearQuantity(), confirmed like writeTwoBytesConfirmed()
+     */
+    bool writeLinearQuantityConfirmed(uint8_t commandID, int8_t N, rpb_1600_quantity value,
+                                      uint32_t timeout_us = RPB_1600_CONFIRM_TIMEOUT_US);
+
+    /**
+     * @brief Sends commandID to the charger and reads the receiveLength byte(s) long response, which
+     * is thrown away. Handy as a probe, use readRaw() to keep the bytes.
      * @return true if we received the number of bytes we were expecting, false otherwise.
      */
     bool readWithCommand(uint8_t commandID, uint8_t receiveLength);
 
+    /**
+     * @brief Read a register straight into buffer, through the cache
+     * @details The bus writes into buffer directly, the PEC (if it's on) included, so nothing is
+     * copied and nothing is kept in the object: reads into different buffers don't share any state,
+     * and the bytes can go to a log as they are. Parse them with the static parse*() helpers.
+     * @param buffer Room for RPB_1600_RAW_LENGTH(length) bytes. Only the first result.length mean
+     * anything afterwards.
+     * @param block An SMBus block read of up to length - 1 bytes, see rpb_1600_read
+     */
+    rpb_1600_read_result readRaw(uint8_t commandID, uint8_t *buffer, uint8_t length, bool block = false);
+
+    /**
+     * @brief Read a list of registers in one tightly packed burst
+     * @details Each read is its own write/repeated start/read transaction, but the bus isn't released
+     * between them. A failed read doesn't stop the ones after it, check each item's success field.
+     * Items longer than MAX_RECEIVE_BYTES fail without going to the bus.
+     * @return The number of reads that succeeded
+     */
+    uint8_t readMany(rpb_1600_read *items, uint8_t count);
+
+    /**
+     * @brief Read a register and decode it, with everything about the command known at compile time
+     * @details Cmd is one of the types in rpb_1600_cmd, for example
+     * read<rpb_1600_cmd::read_vout>(&volts). value is left alone if the read fails.
+     * @return true if the read succeeded
+     */
+    template <typename Cmd>
+    bool read(typename Cmd::value_type *value)
+    {
+        static_assert(Cmd::readable, "This command can't be read");
+        uint8_t data[Cmd::wire_length];
+
+        if (!readInto(Cmd::code, data, Cmd::wire_length, Cmd::block))
+        {
+            return false;
+        }
+
+        *value = Cmd::decode(data);
+        return true;
+    }
+
+    /**
+     * @brief Encode value for Cmd and write it
+     * @return false if value can't be represented in the command's format, or the write failed
+     */
+    template <typename Cmd>
+    bool write(const typename Cmd::value_type &value)
+    {
+        static_assert(Cmd::writable, "This command can't be written");
+        uint8_t data[Cmd::wire_length];
+
+        if (!Cmd::encode(value, data))
+        {
+            return false;
+        }
+
+        return writeBytes(Cmd::code, data, Cmd::wire_length);
+    }
+
+    /**
+     * @brief Read several commands in one readMany() burst and decode each into its own type
+     * @details readAll<rpb_1600_cmd::read_vin, rpb_1600_cmd::read_vout>(&vin, &vout). A value is only
+     * written if its read succeeded.
+     * @return true if every read succeeded
+     */
+    template <typename... Cmds>
+    bool readAll(typename Cmds::value_type *...values)
+    {
+        typedef rpb_1600_command_list<Cmds...> list;
+        static_assert(sizeof...(Cmds) > 0, "readAll() needs at least one command");
+        static_assert(list::readable(), "readAll() was given a command that can't be read");
+
+        uint8_t raw[sizeof...(Cmds)][list::max_length()];
+        rpb_1600_read items[sizeof...(Cmds)];
+        list::prepare(items, raw[0], list::max_length());
+
+        uint8_t num_read = readMany(items, sizeof...(Cmds));
+        list::decode(items, values...);
+        return num_read == sizeof...(Cmds);
+    }
+
+    /**
+     * @brief Queue a read of receiveLength bytes with commandID, and return immediately
+     * @details The read happens over subsequent calls to service(). Poll request->state, or pass a
+     * callback to be told when it finishes. Don't mix this with the blocking calls above while
+     * requests are outstanding on the same bus.
+     * @return true if the request was queued, false if it's already queued or receiveLength is too long
+     */
+    bool submitRead(rpb_1600_request *request, uint8_t commandID, uint8_t receiveLength,
+                    rpb_1600_request_callback callback = nullptr, void *context = nullptr);
+
+    /**
+     * @brief Non-blocking equivalent of getReadings()
+     * @details data is filled in once snapshot->state reaches RPB_1600_REQUEST_DONE
+     * @return true if the reads were queued, false if the snapshot is already in use
+     */
+    bool beginReadings(rpb_1600_snapshot *snapshot, readings *data,
+                       rpb_1600_snapshot_callback callback = nullptr, void *context = nullptr);
+
+    /**
+     * @brief Non-blocking equivalent of getCurveParams()
+     * @details params is filled in once snapshot->state reaches RPB_1600_REQUEST_DONE
+     * @return true if the reads were queued, false if the snapshot is already in use
+     */
+    bool beginCurveParams(rpb_1600_snapshot *snapshot, curve_parameters *params,
+                          rpb_1600_snapshot_callback callback = nullptr, void *context = nullptr);
+
+    /**
+     * @brief Advance the asynchronous state machine by at most one bus transaction
+     * @details Call this from loop(), or from your I2C complete interrupt if the bus backend
+     * supports one. Completion callbacks run from inside this call.
+     * @return true if there is still work outstanding
+     */
+    bool service(void);
+
+    /**
+     * @brief Whether any submitted requests haven't finished yet
+     */
+    bool isBusy(void) const;
+
+    /**
+     * @brief Answer reads from a register cache where its policies allow, pass nullptr to stop caching
+     * @details The cache is owned by the caller and must outlive this object (or be detached first).
+     * readWithCommand(), readMany() (and everything built on it) and submitRead() all check the cache,
+     * and writeTwoBytes()/writeLinearDataCommand() invalidate the register they write.
+     * Don't share one cache between chargers.
+     */
+    void attachCache(RPB_1600_Cache *cache);
+
+    RPB_1600_Cache *getCache(void) const;
+
+    /**
+     * @brief Record settle times of confirmed writes in tracker (see rpb-1600-settle.h), pass nullptr to stop
+     * @details The tracker is owned by the caller and must outlive this object (or be detached first)
+     */
+    void attachSettleTracker(RPB_1600_SettleTracker *tracker);
+
+    RPB_1600_SettleTracker *getSettleTracker(void) const;
+
+    /**
+     * @brief Have every successful getReadings() or beginReadings() passed on to callback
+     * @details Handy for feeding an RPB_1600_SampleRing (see rpb-1600-ring.h) straight from the
+     * polling code. Pass nullptr to stop.
+     */
+    void onReadings(rpb_1600_readings_callback callback, void *context = nullptr);
+
+    /**
+     * @brief Turn PMBus Packet Error Checking on or off (off by default)
+     * @details With PEC on, every read asks for one extra byte, the CRC-8 the charger calculates
+     * over the transaction, and a response that doesn't match it is thrown away and retried. Every
+     * write gets a PEC byte appended, which the charger checks and NACKs if it doesn't match, so
+     * NACKed writes are retried too. Reads that still fail after the retries fail as usual.
+     */
+    void setPEC(bool enabled);
+    bool getPEC(void) const;
+
+    /**
+     * @brief How many times to retry a transaction that failed its PEC check (defaults to 2)
+     */
+    void setRetries(uint8_t retries);
+
+    /**
+     * @brief Responses thrown away because of a PEC mismatch, over every command
+     */
+    uint32_t getPECFailures(void) const;
+
+    /**
+     * @brief Responses to commandID thrown away because of a PEC mismatch
+     * @details Counted separately for the first RPB_1600_PEC_COUNTERS commands that fail
+     */
+    uint16_t getPECFailures(uint8_t commandID) const;
+
+#ifdef RPB_1600_STATS
+    /**
+     * @brief Counters and latency histograms of every transaction this charger has put on the bus
+     * @details Cache hits aren't transactions and don't count. Each retry counts on its own.
+     */
+    const RPB_1600_Stats &getStats(void) const;
+
+    void resetStats(void);
+#endif
+
+#ifdef RPB_1600_TRACE
+    /**
+     * @brief What this charger has put on the bus lately, see rpb-1600-trace.h
+     */
+    RPB_1600_Trace &getTrace(void);
+#endif
+
+    /**
+     * @brief The bus this charger talks over (nullptr if there isn't one)
+     */
+    RPB_1600_Bus *getBus(void) const;
+
+    uint8_t getAddress(void) const;
+
 private:
     /**
      * @brief The address of the charger we're communicating with
@@ -158,53 +787,201 @@ private:
     uint8_t my_charger_address;
 
     /**
-     * @brief Buffer to hold bytes received over i2c
+     * @brief The bus the charger is connected to
      */
-    uint8_t my_rx_buffer[MAX_RECEIVE_BYTES];
+    RPB_1600_Bus *my_bus;
 
     /**
-     * @brief Helper for writing linear data with a specified commandID
-     * @details See the PMBus 1.1 Spec for more info on how the linear data format works
-     * @param N the exponent
-     * @param Y the mantissa
-     * @return True on success, false on failure
+     * @brief Queue of submitted requests waiting for the bus, oldest first
+     */
+    rpb_1600_request *my_queue_head = nullptr;
+    rpb_1600_request *my_queue_tail = nullptr;
+
+    /**
+     * @brief The request on the bus right now, if any
+     */
+    rpb_1600_request *my_current_request = nullptr;
+
+    /**
+     * @brief Optional register cache, see attachCache()
+     */
+    RPB_1600_Cache *my_cache = nullptr;
+
+    /**
+     * @brief Optional settle time history, see attachSettleTracker()
+     */
+    RPB_1600_SettleTracker *my_settle_tracker = nullptr;
+
+    /**
+     * @brief Optional listener for complete readings, see onReadings()
+     */
+    rpb_1600_readings_callback my_readings_callback = nullptr;
+    void *my_readings_context = nullptr;
+
+    /**
+     * @brief Packet error checking, see setPEC()
+     */
+    bool my_pec = false;
+    uint8_t my_retries = 2;
+    uint32_t my_pec_failures = 0;
+    rpb_1600_pec_counter my_pec_counters[RPB_1600_PEC_COUNTERS] = {};
+    uint8_t my_num_pec_counters = 0;
+
+    /**
+     * @brief Clock control, see calibrateClock() and setAutoClock()
+     */
+    bool my_auto_clock = false;
+    uint8_t my_max_clock_level = 0;
+    uint8_t my_window_transactions = 0;
+    uint8_t my_window_errors = 0;
+    uint8_t my_clean_windows = 0;
+    rpb_1600_clock_stats my_clock_stats = {};
+
+#ifdef RPB_1600_STATS
+    /**
+     * @brief Transaction statistics, see getStats()
+     */
+    RPB_1600_Stats my_stats;
+    // When the request on the bus right now was started
+    uint32_t my_request_start = 0;
+
+    /**
+     * @brief Count a finished transaction
+     * @param expected The number of bytes asked for, including a PEC. 0 for writes.
+     */
+    void recordStats(uint8_t commandID, uint8_t busStatus, uint8_t received, uint8_t expected, bool pecOk,
+                     uint8_t bytesWritten, uint32_t latency_us);
+#endif
+
+#ifdef RPB_1600_TRACE
+    /**
+     * @brief Recent bus activity, see getTrace()
+     */
+    RPB_1600_Trace my_trace;
+#endif
+
+#if defined(RPB_1600_TRACE) || defined(RPB_1600_DEBUG)
+    /**
+     * @brief Record a trace event (use RPB_1600_TRACE_EVENT(), which compiles away without tracing or debugging)
+     */
+    void trace(uint8_t event, uint8_t commandID, uint8_t status, const uint8_t *data, uint8_t length);
+    void traceValue(uint8_t event, uint8_t commandID, uint32_t value);
+#endif
+
+    /**
+     * @brief Run the bus at one of RPB_1600_CLOCK_LEVEL_FREQUENCIES
+     */
+    void setClockLevel(uint8_t level);
+
+    /**
+     * @brief The level of the clock the bus is running at now, shared by every charger on the bus
+     * @details 0 if the bus hasn't been set up, or is running at a clock that isn't one of the levels
+     */
+    uint8_t getClockLevel(void) const;
+
+    /**
+     * @brief Count a transaction towards the clock statistics, and adjust the clock if needed
+     */
+    void recordTransaction(bool ok);
+
+    /**
+     * @brief One round of calibration reads, compared against (or, the first time, stored in) reference
+     * @return true if every read succeeded and matched
+     */
+    bool calibrationRound(uint8_t reference[][MAX_RECEIVE_BYTES], bool store);
+
+    /**
+     * @brief Read a register straight from the bus (no cache), checking the PEC if it's enabled
+     * @param attempts How many times to try if the PEC doesn't match
+     * @param block An SMBus block read of up to length - 1 bytes, see rpb_1600_read
+     * @return true if exactly length bytes came back (and the PEC matched)
      */
-    bool writeLinearDataHelper(uint8_t commandID, int8_t N, int16_t Y);
+    bool readRegister(uint8_t commandID, uint8_t *destination, uint8_t length, uint8_t attempts, bool block = false);
 
     /**
-     * @brief Parses the first two bytes of my_rx_buffer[] in the "Linear Data" format outlined int the PMBus Specification
-     * @details see the PMBus V1.1 Section 7.1 "Linear Data Format" for more info
+     * @brief readRegister() into rx, which has room for the PEC after the length bytes
+     * @param busStatus Set to the bus status of the last attempt
+     * @return A rpb_1600_read_status
      */
-    uint16_t parseLinearData(void);
+    uint8_t readResponse(uint8_t commandID, uint8_t *rx, uint8_t length, uint8_t attempts, bool block,
+                         uint8_t *busStatus);
 
     /**
-     * @brief Parse a voltage reading in the linear format
-     * @details See the PMBus 1.1 spec section 8.3.1 for more info
+     * @brief Read length bytes with commandID into destination, through the cache
      */
-    float parseLinearVoltage(int8_t N);
+    bool readInto(uint8_t commandID, uint8_t *destination, uint8_t length, bool block = false);
 
     /**
-     * @brief Parses the first two bytes of my_rx_buffer[] into a curve_config struct and returns it via argument.
-     * @details Meant to be called after calling readWithCommand(CMD_CODE_CURVE_CONFIG, CMD_LENGTH_CURVE_CONFIG)
+     * @brief Whether a complete response is intact: a sensible byte count for a block read, and a
+     * matching PEC if it's enabled (which for a block read follows the bytes the count covers)
+     */
+    bool checkResponse(uint8_t commandID, const uint8_t *rx, uint8_t length, bool block);
+
+    /**
+     * @brief Write commandID followed by length bytes of data (and the PEC if it's enabled)
+     * @details Retries on a NACK when the PEC is on, and invalidates the register in the cache.
+     */
+    bool writeBytes(uint8_t commandID, const uint8_t *data, uint8_t length);
+
+    /**
+     * @brief Check the PEC byte that follows length bytes of response to commandID, and count it if it's wrong
+     */
+    bool checkPEC(uint8_t commandID, const uint8_t *data, uint8_t length);
+
+    /**
+     * @brief Run a burst of reads for the items at indices[] and record how each one went
+     * @return The number of reads that succeeded
+     */
+    uint8_t readBurst(rpb_1600_read *items, const uint8_t *indices, uint8_t count);
+
+    /**
+     * @brief Finish the request on the bus with the given state and run its callback
+     */
+    void completeCurrentRequest(uint8_t state);
+
+    /**
+     * @brief Queue every read in a snapshot, which must already have its commands filled in
+     */
+    bool beginSnapshot(rpb_1600_snapshot *snapshot, rpb_1600_snapshot_callback callback, void *context);
+
+    /**
+     * @brief Request callback for each read that makes up a snapshot
+     */
+    static void onSnapshotRequestComplete(rpb_1600_request *request);
+
+    /**
+     * @brief Convert value (in units of 1/scale) to the linear data format with exponent N and write it
+     * @param confirmTimeout_us 0 for a plain write, otherwise the timeout of a confirmed write
+     */
+    bool writeLinearValue(uint8_t commandID, int8_t N, int32_t value, int32_t scale, uint32_t confirmTimeout_us);
+
+    /**
+     * @brief Helper for writing linear data with a specified commandID
+     * @details See the PMBus 1.1 Spec for more info on how the linear data format works
+     * @param N the exponent
+     * @param Y the mantissa
+     * @param confirmTimeout_us 0 for a plain write, otherwise the timeout of a confirmed write
+     * @return True on success, false on failure
      */
-    void parseCurveConfig(curve_config *config);
+    bool writeLinearDataHelper(uint8_t commandID, int8_t N, int16_t Y, uint32_t confirmTimeout_us);
 
     /**
-     * @brief Parses the first two bytes of my_rx_buffer[] into a charge_status struct and returns it via argument.
-     * @details Meant to be called after calling readWithCommand(CMD_CODE_CHG_STATUS, CMD_LENGTH_CHG_STATUS)
+     * @brief The inverse of parseCurveConfig(), sets the bits config covers in buffer[] and leaves the rest
      */
-    void parseChargeStatus(charge_status *status);
+    static void encodeCurveConfig(const curve_config *config, uint8_t *buffer);
 
     /**
-     * @brief Takes in a twos complement number that's length bits and converts it to a 16 bit twos complement number
-     * @details Slightly modified version of this https://www.codeproject.com/Tips/1079637/Twos-Complement-for-Unusual-Integer-Sizes
+     * @brief Build the raw words setCurveParams() writes, in the order of curve_registers[]
+     * @param current What the registers hold now, for the CURVE_CONFIG bits params doesn't cover
+     * @return false if a value doesn't fit its register
      */
-    int16_t UpscaleTwosComplement(int16_t value, size_t length);
+    bool encodeCurveParams(const curve_parameters &params, const uint8_t current[][2], uint8_t target[][2]);
 
     /**
-     * @brief Zeros my_rx_buffer
+     * @brief The inverse of parseLinearVoltage()
+     * @return false if value doesn't fit with exponent N, word is left alone then
      */
-    void clearRXBuffer(void);
+    static bool encodeLinearVoltage(rpb_1600_voltage value, int8_t N, uint16_t *word);
 };
 
 #endif // RPB_1600_H
\ No newline at end of file
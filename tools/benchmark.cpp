@@ -0,0 +1,567 @@
+/**
+ * Benchmarks the library on the host against the simulated bus (see rpb-1600-sim.h) and prints the
+ * results as one JSON object, so runs can be stored and compared to catch regressions.
+ *
+ * Build on a Linux host from this directory (keep the optimization level the same between runs you compare):
+ *   g++ -std=gnu++14 -O2 -I.. benchmark.cpp ../rpb-1600*.cpp -lpthread -o benchmark
+ * Add -DRPB_1600_FIXED_POINT to measure the integer readings (the "fixed_point" field says which it was).
+ *
+ * Usage:
+ *   benchmark [--scale N] [--byte-latency-ns N] > results.json
+ *
+ * --scale multiplies the number of iterations (default 1). --byte-latency-ns adds a delay to every
+ * byte on the simulated bus, like a charger that stretches the clock.
+ *
+ * Every result has a name, a value and a unit:
+ *   linear11/16 decode and encode     conversions per second of host CPU
+ *   read_with_command/read_raw.overhead
+ *                                     host CPU per readWithCommand() or readRaw() beyond the bus call it makes:
+ *                                     the fastest of several interleaved runs of each, one minus the other.
+ *                                     Not clamped, so noise bigger than the overhead shows up as a negative
+ *                                     value rather than a misleading 0.
+ *   read_with_command/read_raw.overhead_spread
+ *                                     interquartile range of the overhead measured run by run, as a guide to
+ *                                     how much to trust it
+ *   get_readings/get_curve_params.*   snapshots per second of simulated bus time at 100k and 400k, and
+ *                                     host CPU per snapshot
+ *   decode_readings/decode_curve_params.*
+ *                                     host CPU and cycles (the x86 time stamp counter, left out elsewhere)
+ *                                     to decode one snapshot's raw bytes, no bus involved. The
+ *                                     decode-benchmark sketch measures the same thing on a board.
+ *   *.allocations, *.stack            heap allocations and bytes of stack per call
+ *
+ * Bus time is virtual, so the snapshot rates don't depend on the host. Host CPU numbers do, so only
+ * compare them between runs on the same machine.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <new>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include "rpb-1600.h"
+#include "rpb-1600-sim.h"
+#include "rpb-1600-linear.h"
+#include "rpb-1600-commands.h"
+
+#define BENCH_FORMAT_VERSION 2
+#define BENCH_CODEC_VALUES 1024
+#define BENCH_STACK_SIZE (64 * 1024)
+#define BENCH_STACK_PAINT 0xA5
+// Different raw snapshots the decode benchmarks cycle through
+#define BENCH_DECODE_SNAPSHOTS 64
+// Interleaved runs of a call and the bus transaction it makes, to measure the overhead between them
+#define BENCH_OVERHEAD_RUNS 9
+
+//----------------------------------------------------------------------
+// Allocation counting
+//----------------------------------------------------------------------
+
+static size_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    allocations++;
+    void *p = malloc(size ? size : 1);
+
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    free(p);
+}
+
+//----------------------------------------------------------------------
+// Stack measurement
+//----------------------------------------------------------------------
+
+typedef void (*bench_function)(void *context);
+
+static uint8_t stack_area[BENCH_STACK_SIZE];
+static ucontext_t caller_context;
+static ucontext_t measured_context;
+static bench_function stack_function;
+static void *stack_context;
+
+static void runOnPaintedStack(void)
+{
+    stack_function(stack_context);
+}
+
+/**
+ * @brief Run fn once on a stack painted with a known byte, and see how much of the paint it touched
+ * @details Includes the small frame of the trampoline that calls fn, which is the same for every function.
+ */
+static size_t measureStack(bench_function fn, void *context)
+{
+    memset(stack_area, BENCH_STACK_PAINT, sizeof(stack_area));
+    stack_function = fn;
+    stack_context = context;
+
+    getcontext(&measured_context);
+    measured_context.uc_stack.ss_sp = stack_area;
+    measured_context.uc_stack.ss_size = sizeof(stack_area);
+    measured_context.uc_link = &caller_context;
+    makecontext(&measured_context, runOnPaintedStack, 0);
+    swapcontext(&caller_context, &measured_context);
+
+    // The stack grows down, so the deepest point is the lowest byte that isn't paint any more
+    size_t untouched = 0;
+
+    while (untouched < sizeof(stack_area) && stack_area[untouched] == BENCH_STACK_PAINT)
+    {
+        untouched++;
+    }
+
+    return sizeof(stack_area) - untouched;
+}
+
+//----------------------------------------------------------------------
+// Results
+//----------------------------------------------------------------------
+
+static bool first_result = true;
+
+static void result(const char *name, double value, const char *unit)
+{
+    printf("%s\n    {\"name\": \"%s\", \"value\": %.6g, \"unit\": \"%s\"}", first_result ? "" : ",", name, value, unit);
+    first_result = false;
+}
+
+static double elapsedNanoseconds(std::chrono::steady_clock::time_point start)
+{
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief The x86 time stamp counter, or 0 where there isn't one we can read
+ */
+static uint64_t cycleCounter(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Time iterations calls of fn, and count the allocations they make
+ * @return Nanoseconds of host CPU per call
+ */
+static double timeCalls(bench_function fn, void *context, uint32_t iterations, double *allocationsPerCall)
+{
+    size_t allocations_before = allocations;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        fn(context);
+    }
+
+    double ns = elapsedNanoseconds(start);
+
+    if (allocationsPerCall != nullptr)
+    {
+        *allocationsPerCall = (double)(allocations - allocations_before) / iterations;
+    }
+
+    return ns / iterations;
+}
+
+//----------------------------------------------------------------------
+// Benchmarks
+//----------------------------------------------------------------------
+
+struct codec_context
+{
+    uint16_t words[BENCH_CODEC_VALUES];
+    float values[BENCH_CODEC_VALUES];
+    // Keeps the compiler from throwing the conversions away
+    volatile uint32_t sink;
+};
+
+static void linear11Decode(void *context)
+{
+    codec_context *c = static_cast<codec_context *>(context);
+    float sum = 0;
+
+    for (uint16_t i = 0; i < BENCH_CODEC_VALUES; i++)
+    {
+        sum += linear11_to_float(c->words[i]);
+    }
+
+    c->sink = (uint32_t)sum;
+}
+
+static void linear11Encode(void *context)
+{
+    codec_context *c = static_cast<codec_context *>(context);
+    uint16_t bits = 0;
+
+    for (uint16_t i = 0; i < BENCH_CODEC_VALUES; i++)
+    {
+        bits ^= linear11_from_float(c->values[i], -2);
+    }
+
+    c->sink = bits;
+}
+
+static void linear16Decode(void *context)
+{
+    codec_context *c = static_cast<codec_context *>(context);
+    float sum = 0;
+
+    for (uint16_t i = 0; i < BENCH_CODEC_VALUES; i++)
+    {
+        sum += linear16_to_float(c->words[i], CMD_N_VALUE_READ_VOUT);
+    }
+
+    c->sink = (uint32_t)sum;
+}
+
+static void linear16Encode(void *context)
+{
+    codec_context *c = static_cast<codec_context *>(context);
+    uint16_t bits = 0;
+
+    for (uint16_t i = 0; i < BENCH_CODEC_VALUES; i++)
+    {
+        bits ^= linear16_from_float(c->values[i], CMD_N_VALUE_READ_VOUT);
+    }
+
+    c->sink = bits;
+}
+
+struct charger_context
+{
+    RPB_1600_SimulatedBus bus;
+    RPB_1600_SimulatedCharger unit{0x47};
+    RPB_1600 charger{bus};
+    readings data;
+    curve_parameters params;
+};
+
+static void readWithCommand(void *context)
+{
+    charger_context *c = static_cast<charger_context *>(context);
+    c->charger.readWithCommand(CMD_CODE_READ_VOUT, CMD_LENGTH_READ_VOUT);
+}
+
+static void readRaw(void *context)
+{
+    charger_context *c = static_cast<charger_context *>(context);
+    uint8_t rx[RPB_1600_RAW_LENGTH(CMD_LENGTH_READ_VOUT)];
+    c->charger.readRaw(CMD_CODE_READ_VOUT, rx, CMD_LENGTH_READ_VOUT);
+}
+
+static void busWriteRead(void *context)
+{
+    // The transaction readWithCommand() makes, straight to the bus
+    charger_context *c = static_cast<charger_context *>(context);
+    uint8_t command = CMD_CODE_READ_VOUT;
+    uint8_t rx[CMD_LENGTH_READ_VOUT];
+    uint8_t received;
+    c->bus.writeRead(0x47, &command, 1, rx, sizeof(rx), &received);
+}
+
+static void getReadings(void *context)
+{
+    charger_context *c = static_cast<charger_context *>(context);
+    c->charger.getReadings(&c->data);
+}
+
+static void getCurveParams(void *context)
+{
+    charger_context *c = static_cast<charger_context *>(context);
+    c->charger.getCurveParams(&c->params);
+}
+
+struct decode_context
+{
+    // Raw responses in getReadings() and getCurveParams() order
+    uint8_t readings_raw[BENCH_DECODE_SNAPSHOTS][5][2];
+    uint8_t curve_raw[BENCH_DECODE_SNAPSHOTS][9][2];
+    readings data;
+    curve_parameters params;
+    volatile uint32_t sink;
+};
+
+static void putWord(uint16_t word, uint8_t *bytes)
+{
+    bytes[0] = word & 0xFF;
+    bytes[1] = word >> 8;
+}
+
+static void decodeReadings(void *context)
+{
+    decode_context *c = static_cast<decode_context *>(context);
+    uint32_t bits = 0;
+
+    for (uint16_t i = 0; i < BENCH_DECODE_SNAPSHOTS; i++)
+    {
+        const uint8_t *raw[5];
+
+        for (uint8_t r = 0; r < 5; r++)
+        {
+            raw[r] = c->readings_raw[i][r];
+        }
+
+        RPB_1600::decodeReadings(raw, &c->data);
+        bits ^= (uint32_t)c->data.v_out ^ (uint32_t)c->data.i_out;
+    }
+
+    c->sink = bits;
+}
+
+static void decodeCurveParams(void *context)
+{
+    decode_context *c = static_cast<decode_context *>(context);
+    uint32_t bits = 0;
+
+    for (uint16_t i = 0; i < BENCH_DECODE_SNAPSHOTS; i++)
+    {
+        const uint8_t *raw[9];
+
+        for (uint8_t r = 0; r < 9; r++)
+        {
+            raw[r] = c->curve_raw[i][r];
+        }
+
+        RPB_1600::decodeCurveParams(raw, &c->params);
+        bits ^= (uint32_t)c->params.cv ^ (uint32_t)c->params.cc;
+    }
+
+    c->sink = bits;
+}
+
+static void codecBenchmark(const char *name, bench_function fn, codec_context *context, uint32_t iterations)
+{
+    char full_name[64];
+    double ns = timeCalls(fn, context, iterations, nullptr);
+    snprintf(full_name, sizeof(full_name), "%s.throughput", name);
+    result(full_name, 1e9 * BENCH_CODEC_VALUES / ns, "conversions/s");
+}
+
+static void callBenchmark(const char *name, bench_function fn, charger_context *context, uint32_t iterations)
+{
+    char full_name[64];
+    double allocations_per_call;
+    double ns = timeCalls(fn, context, iterations, &allocations_per_call);
+
+    snprintf(full_name, sizeof(full_name), "%s.host_time", name);
+    result(full_name, ns, "ns/call");
+    snprintf(full_name, sizeof(full_name), "%s.allocations", name);
+    result(full_name, allocations_per_call, "allocations/call");
+    snprintf(full_name, sizeof(full_name), "%s.stack", name);
+    result(full_name, (double)measureStack(fn, context), "bytes");
+}
+
+/**
+ * @brief Measure what fn costs on top of the bus transaction it makes
+ * @details Alternates runs of the bus transaction and fn, so drift in the host (frequency scaling,
+ * other processes) hits both alike. The fastest run of each is the least disturbed, so the overhead
+ * is the difference between those. The spread is the interquartile range of the run by run differences.
+ */
+static void overheadBenchmark(const char *name, bench_function fn, charger_context *context, uint32_t iterations)
+{
+    char full_name[64];
+    double bus_ns[BENCH_OVERHEAD_RUNS];
+    double fn_ns[BENCH_OVERHEAD_RUNS];
+    double difference_ns[BENCH_OVERHEAD_RUNS];
+    uint32_t run_iterations = (iterations / BENCH_OVERHEAD_RUNS > 0) ? iterations / BENCH_OVERHEAD_RUNS : 1;
+
+    for (uint8_t i = 0; i < BENCH_OVERHEAD_RUNS; i++)
+    {
+        bus_ns[i] = timeCalls(busWriteRead, context, run_iterations, nullptr);
+        fn_ns[i] = timeCalls(fn, context, run_iterations, nullptr);
+        difference_ns[i] = fn_ns[i] - bus_ns[i];
+    }
+
+    std::sort(difference_ns, difference_ns + BENCH_OVERHEAD_RUNS);
+    double fastest_fn = *std::min_element(fn_ns, fn_ns + BENCH_OVERHEAD_RUNS);
+    double fastest_bus = *std::min_element(bus_ns, bus_ns + BENCH_OVERHEAD_RUNS);
+
+    snprintf(full_name, sizeof(full_name), "%s.overhead", name);
+    result(full_name, fastest_fn - fastest_bus, "ns/call");
+    snprintf(full_name, sizeof(full_name), "%s.overhead_spread", name);
+    result(full_name, difference_ns[(3 * BENCH_OVERHEAD_RUNS) / 4] - difference_ns[BENCH_OVERHEAD_RUNS / 4], "ns/call");
+}
+
+static void snapshotBenchmark(const char *name, bench_function fn, charger_context *context, uint32_t clock,
+                              uint32_t iterations)
+{
+    char full_name[64];
+    context->bus.setClock(clock);
+    context->bus.resetCounters();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        fn(context);
+    }
+
+    double host_ns = elapsedNanoseconds(start);
+    uint32_t bus_us = context->bus.getBusTimeMicros();
+
+    snprintf(full_name, sizeof(full_name), "%s.%luk.rate", name, (unsigned long)(clock / 1000));
+    result(full_name, (bus_us > 0) ? 1e6 * iterations / bus_us : 0, "snapshots/s");
+    snprintf(full_name, sizeof(full_name), "%s.%luk.bus_time", name, (unsigned long)(clock / 1000));
+    result(full_name, (double)bus_us / iterations, "us/snapshot");
+    snprintf(full_name, sizeof(full_name), "%s.%luk.host_time", name, (unsigned long)(clock / 1000));
+    result(full_name, host_ns / iterations, "ns/snapshot");
+}
+
+static void decodeBenchmark(const char *name, bench_function fn, decode_context *context, uint32_t iterations)
+{
+    char full_name[64];
+    uint64_t cycles_before = cycleCounter();
+    double ns = timeCalls(fn, context, iterations, nullptr);
+    uint64_t cycles = cycleCounter() - cycles_before;
+
+    snprintf(full_name, sizeof(full_name), "%s.host_time", name);
+    result(full_name, ns / BENCH_DECODE_SNAPSHOTS, "ns/snapshot");
+
+    if (cycles > 0)
+    {
+        snprintf(full_name, sizeof(full_name), "%s.cycles", name);
+        result(full_name, (double)cycles / iterations / BENCH_DECODE_SNAPSHOTS, "cycles/snapshot");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t scale = 1;
+    uint32_t byte_latency_ns = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc)
+        {
+            scale = (uint32_t)strtoul(argv[++i], nullptr, 0);
+        }
+        else if (strcmp(argv[i], "--byte-latency-ns") == 0 && i + 1 < argc)
+        {
+            byte_latency_ns = (uint32_t)strtoul(argv[++i], nullptr, 0);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--scale N] [--byte-latency-ns N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (scale == 0)
+    {
+        scale = 1;
+    }
+
+    // Values across the whole range the charger reports, and the words they encode to
+    static codec_context codec;
+
+    for (uint16_t i = 0; i < BENCH_CODEC_VALUES; i++)
+    {
+        codec.values[i] = (float)i * 0.37f;
+        codec.words[i] = linear11_from_float(codec.values[i], -2);
+    }
+
+    // Snapshots across the range the charger reports
+    static decode_context decode;
+
+    for (uint16_t i = 0; i < BENCH_DECODE_SNAPSHOTS; i++)
+    {
+        uint8_t(*r)[2] = decode.readings_raw[i];
+        putWord(linear11_from_float(200.0f + i, CMD_N_VALUE_READ_VIN), r[0]);
+        putWord(linear16_from_float(24.0f + i * 0.1f, CMD_N_VALUE_READ_VOUT), r[1]);
+        putWord(linear11_from_float(i * 0.75f, CMD_N_VALUE_READ_IOUT), r[2]);
+        putWord(linear11_from_float(3000.0f + i * 32, CMD_N_VALUE_READ_FAN_SPEED_1), r[3]);
+        putWord(linear11_from_float(3100.0f + i * 32, CMD_N_VALUE_READ_FAN_SPEED_2), r[4]);
+
+        uint8_t(*c)[2] = decode.curve_raw[i];
+        putWord(linear11_from_float(10.0f + i * 0.5f, CMD_N_VALUE_CURVE_CC), c[0]);
+        putWord(linear16_from_float(28.0f + i * 0.01f, CMD_N_VALUE_CURVE_CV), c[1]);
+        putWord(linear16_from_float(27.0f + i * 0.01f, CMD_N_VALUE_CURVE_FV), c[2]);
+        putWord(linear11_from_float(1.0f + i * 0.25f, CMD_N_VALUE_CURVE_TC), c[3]);
+        putWord(0x0004 | i, c[4]);
+        putWord(linear11_from_float(600 + i, CMD_N_VALUE_CURVE_CC_TIMEOUT), c[5]);
+        putWord(linear11_from_float(600 + i, CMD_N_VALUE_CURVE_CV_TIMEOUT), c[6]);
+        putWord(linear11_from_float(60 + i, CMD_N_VALUE_CURVE_FLOAT_TIMEOUT), c[7]);
+        putWord((uint16_t)(i * 0x0101), c[8]);
+    }
+
+    static charger_context charger;
+    charger.bus.attach(&charger.unit);
+    charger.bus.setByteLatency(byte_latency_ns);
+    charger.charger.Init(0x47);
+
+    printf("{\n  \"format\": %d,\n  \"compiler\": \"%s\",\n", BENCH_FORMAT_VERSION, __VERSION__);
+    printf("  \"scale\": %lu,\n  \"byte_latency_ns\": %lu,\n", (unsigned long)scale, (unsigned long)byte_latency_ns);
+#ifdef RPB_1600_FIXED_POINT
+    printf("  \"fixed_point\": true,\n");
+#else
+    printf("  \"fixed_point\": false,\n");
+#endif
+    printf("  \"results\": [");
+
+    codecBenchmark("linear11.decode", linear11Decode, &codec, 20000 * scale);
+    codecBenchmark("linear11.encode", linear11Encode, &codec, 20000 * scale);
+    codecBenchmark("linear16.decode", linear16Decode, &codec, 20000 * scale);
+    codecBenchmark("linear16.encode", linear16Encode, &codec, 20000 * scale);
+
+    decodeBenchmark("decode_readings", decodeReadings, &decode, 20000 * scale);
+    decodeBenchmark("decode_curve_params", decodeCurveParams, &decode, 20000 * scale);
+
+    // What readWithCommand() costs on top of the bus transaction (the simulator's share of it included)
+    uint32_t call_iterations = 200000 * scale;
+    callBenchmark("read_with_command", readWithCommand, &charger, call_iterations);
+    overheadBenchmark("read_with_command", readWithCommand, &charger, call_iterations);
+    callBenchmark("read_raw", readRaw, &charger, call_iterations);
+    overheadBenchmark("read_raw", readRaw, &charger, call_iterations);
+
+    callBenchmark("get_readings", getReadings, &charger, 50000 * scale);
+    callBenchmark("get_curve_params", getCurveParams, &charger, 50000 * scale);
+
+    const uint32_t clocks[] = {100000, 400000};
+
+    for (uint8_t i = 0; i < sizeof(clocks) / sizeof(clocks[0]); i++)
+    {
+        snapshotBenchmark("get_readings", getReadings, &charger, clocks[i], 1000 * scale);
+        snapshotBenchmark("get_curve_params", getCurveParams, &charger, clocks[i], 1000 * scale);
+    }
+
+    printf("\n  ]\n}\n");
+
+    return 0;
+}
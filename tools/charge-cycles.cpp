@@ -0,0 +1,209 @@
+/**
+ * Runs simulated chargers (see rpb-1600-sim.h) through complete charge cycles in virtual time, driving
+ * them through the library the way a charging supervisor would, and prints one CSV row per cycle.
+ *
+ * Build on the host from this directory:
+ *   g++ -std=gnu++14 -O2 -I.. charge-cycles.cpp ../rpb-1600*.cpp -lpthread -o charge-cycles
+ *
+ * Usage:
+ *   charge-cycles [cycles] [seed] > cycles.csv
+ *
+ * Each cycle gets a battery with a random capacity, internal resistance, starting charge and
+ * temperature, and a random temperature compensation setting. A cycle passes if the charger goes
+ * CC -> CV -> float and then finishes on the float timeout with no other flags raised, and the
+ * battery ends up at least 85% full. The exit status is the number of cycles that failed (capped at 255),
+ * so it can gate CI.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "rpb-1600.h"
+#include "rpb-1600-sim.h"
+
+// How often the supervisor polls, and how long a cycle gets before it's called stuck
+#define CYCLE_POLL_SECONDS 60
+#define CYCLE_LIMIT_MINUTES (48 * 60)
+#define CYCLE_FLOAT_TIMEOUT_MINUTES 60
+
+struct cycle_result
+{
+    rpb_1600_sim_battery battery;
+    uint8_t temp_compensation;
+    // Minutes into the cycle each stage was first seen, -1 if it never was
+    int32_t cv_minutes;
+    int32_t float_minutes;
+    int32_t done_minutes;
+    bool unexpected_flags;
+};
+
+static uint32_t random_state = 1;
+
+static float randomBetween(float minimum, float maximum)
+{
+    // xorshift32
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return minimum + (maximum - minimum) * (float)(random_state % 10001) / 10000.0f;
+}
+
+/**
+ * @brief Program the curve every cycle uses
+ */
+static bool programCurve(RPB_1600 &charger, uint8_t tempCompensation)
+{
+    curve_parameters params;
+
+    if (!charger.getCurveParams(&params))
+    {
+        return false;
+    }
+
+    params.cc = 40;
+    params.cv = 28.8f;
+    params.floating_voltage = 27.6f;
+    params.taper_current = 4;
+    params.cc_timeout = 900;
+    params.cv_timeout = 600;
+    params.float_timeout = CYCLE_FLOAT_TIMEOUT_MINUTES;
+    params.config.temp_compensation = tempCompensation;
+    params.config.num_charge_stages = 3;
+    params.config.cc_timeout_indication_enabled = true;
+    params.config.cv_timeout_indication_enabled = true;
+    params.config.float_stage_timeout_indication_enabled = true;
+
+    return charger.setCurveParams(params);
+}
+
+static bool passed(const cycle_result *result)
+{
+    return result->cv_minutes >= 0 && result->float_minutes > result->cv_minutes &&
+           result->done_minutes > result->float_minutes && !result->unexpected_flags &&
+           result->battery.state_of_charge > 0.85f;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t cycles = (argc > 1) ? (uint32_t)strtoul(argv[1], nullptr, 0) : 200;
+    random_state = (argc > 2) ? (uint32_t)strtoul(argv[2], nullptr, 0) : 1;
+    random_state = (random_state != 0) ? random_state : 1;
+
+    uint32_t failures = 0;
+
+    printf("cycle,address,capacity_ah,resistance,temperature,temp_compensation,start_soc,"
+           "cv_minutes,float_minutes,done_minutes,end_soc,result\n");
+
+    // A bus of chargers at a time
+    for (uint32_t first = 0; first < cycles; first += RPB_1600_SIM_MAX_UNITS)
+    {
+        uint8_t num_units = (cycles - first < RPB_1600_SIM_MAX_UNITS) ? cycles - first : RPB_1600_SIM_MAX_UNITS;
+        RPB_1600_SimulatedBus bus;
+        RPB_1600_SimulatedCharger *units[RPB_1600_SIM_MAX_UNITS];
+        RPB_1600 *chargers[RPB_1600_SIM_MAX_UNITS];
+        cycle_result results[RPB_1600_SIM_MAX_UNITS];
+
+        for (uint8_t i = 0; i < num_units; i++)
+        {
+            uint8_t address = 0x40 + i;
+            units[i] = new RPB_1600_SimulatedCharger(address);
+            chargers[i] = new RPB_1600(bus);
+            bus.attach(units[i]);
+
+            cycle_result *result = &results[i];
+            result->battery.capacity_ah = randomBetween(40, 200);
+            result->battery.internal_resistance = randomBetween(0.02f, 0.08f);
+            result->battery.empty_voltage = 23.0f;
+            result->battery.full_voltage = 29.0f;
+            result->battery.state_of_charge = randomBetween(0.05f, 0.6f);
+            result->battery.temperature = randomBetween(5, 40);
+            result->battery.temperature_coefficient = -0.004f;
+            result->battery.cells = 12;
+            result->battery.connected = true;
+            // -3, -4 or -5mV/C/cell, close enough to the battery to charge it fully at any temperature
+            result->temp_compensation = (uint8_t)randomBetween(1, 3.99f);
+            result->cv_minutes = -1;
+            result->float_minutes = -1;
+            result->done_minutes = -1;
+            result->unexpected_flags = false;
+
+            if (!chargers[i]->Init(address) || !programCurve(*chargers[i], result->temp_compensation))
+            {
+                fprintf(stderr, "Couldn't set up the charger at 0x%02x\n", address);
+                return 255;
+            }
+
+            // Connecting the battery starts the cycle
+            units[i]->setBattery(result->battery);
+        }
+
+        for (int32_t minute = 0; minute < CYCLE_LIMIT_MINUTES; minute++)
+        {
+            bus.advanceTime(CYCLE_POLL_SECONDS * 1000000UL);
+            uint8_t num_done = 0;
+
+            for (uint8_t i = 0; i < num_units; i++)
+            {
+                cycle_result *result = &results[i];
+                charge_status status;
+
+                if (result->done_minutes >= 0)
+                {
+                    num_done++;
+                    continue;
+                }
+
+                if (!chargers[i]->getChargeStatus(&status))
+                {
+                    continue;
+                }
+
+                if (status.in_cv_mode && result->cv_minutes < 0)
+                {
+                    result->cv_minutes = minute;
+                }
+
+                if (status.in_float_mode && result->float_minutes < 0)
+                {
+                    result->float_minutes = minute;
+                }
+
+                result->unexpected_flags |= status.EEPROM_error || status.temp_compensation_short_circuit ||
+                                            !status.battery_detected || status.timeout_flag_cc_mode ||
+                                            status.timeout_flag_cv_mode;
+
+                // Finished, or stopped on a fault
+                if (status.timeout_flag_float_mode || result->unexpected_flags)
+                {
+                    result->done_minutes = minute;
+                }
+            }
+
+            if (num_done == num_units)
+            {
+                break;
+            }
+        }
+
+        for (uint8_t i = 0; i < num_units; i++)
+        {
+            cycle_result *result = &results[i];
+            float start_soc = result->battery.state_of_charge;
+            result->battery = *units[i]->getBattery();
+            bool ok = passed(result);
+            failures += ok ? 0 : 1;
+
+            printf("%lu,0x%02x,%.1f,%.3f,%.1f,%u,%.3f,%ld,%ld,%ld,%.3f,%s\n", (unsigned long)(first + i),
+                   units[i]->getAddress(), result->battery.capacity_ah, result->battery.internal_resistance,
+                   result->battery.temperature, result->temp_compensation, start_soc, (long)result->cv_minutes,
+                   (long)result->float_minutes, (long)result->done_minutes, result->battery.state_of_charge,
+                   ok ? "pass" : "fail");
+
+            delete chargers[i];
+            delete units[i];
+        }
+    }
+
+    fprintf(stderr, "%lu cycles, %lu failed\n", (unsigned long)cycles, (unsigned long)failures);
+
+    return (failures < 255) ? failures : 255;
+}
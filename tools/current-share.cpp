@@ -0,0 +1,128 @@
+/**
+ * Runs the current sharing loop (see rpb-1600-share.h) against paralleled simulated chargers in
+ * virtual time, for every fleet size a bus can hold and two bus clocks, and prints one CSV row per run.
+ *
+ * Build on the host from this directory:
+ *   g++ -std=gnu++14 -O2 -I.. current-share.cpp ../rpb-1600*.cpp -lpthread -o current-share
+ *
+ * Usage:
+ *   current-share [seed] > share.csv
+ *
+ * Each charger gets a random setpoint error of up to +-60mV. A run passes if the loop brings the
+ * spread of output currents under SHARE_SETTLED_AMPS and keeps it there to the end, and no iteration
+ * takes longer than SHARE_BUDGET_US. The exit status is the number of runs that failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "rpb-1600.h"
+#include "rpb-1600-sim.h"
+#include "rpb-1600-fleet.h"
+#include "rpb-1600-share.h"
+#include "rpb-1600-commands.h"
+#include "rpb-1600-linear.h"
+
+#define SHARE_PERIOD_US 20000
+#define SHARE_BUDGET_US 10000
+#define SHARE_RUN_SECONDS 30
+#define SHARE_SETTLED_AMPS 0.5f
+// How finely loop() gets to run, in virtual time
+#define SHARE_TICK_US 50
+
+static uint32_t random_state = 1;
+
+static float randomBetween(float minimum, float maximum)
+{
+    // xorshift32
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return minimum + (maximum - minimum) * (float)(random_state % 10001) / 10000.0f;
+}
+
+int main(int argc, char **argv)
+{
+    random_state = (argc > 1) ? (uint32_t)strtoul(argv[1], nullptr, 0) : 1;
+    random_state = (random_state != 0) ? random_state : 1;
+
+    static const uint32_t clocks[] = {100000, 400000};
+    uint32_t failures = 0;
+
+    printf("units,clock,start_spread,settled_ms,end_spread,mean_duration_us,max_duration_us,"
+           "mean_jitter_us,max_jitter_us,writes_per_iteration,result\n");
+
+    for (uint8_t c = 0; c < sizeof(clocks) / sizeof(clocks[0]); c++)
+    {
+        for (uint8_t num_units = 2; num_units <= RPB_1600_UNITS_PER_BUS; num_units++)
+        {
+            RPB_1600_SimulatedBus bus;
+            RPB_1600_SimulatedBank bank;
+            RPB_1600_SimulatedCharger *units[RPB_1600_UNITS_PER_BUS];
+
+            for (uint8_t i = 0; i < num_units; i++)
+            {
+                units[i] = new RPB_1600_SimulatedCharger(RPB_1600_FIRST_ADDRESS + i);
+                units[i]->setWord(CMD_CODE_VOUT_COMMAND, linear16_from_float(26.6f, CMD_N_VALUE_VOUT_COMMAND));
+                bus.attach(units[i]);
+                bank.attach(units[i], randomBetween(-0.06f, 0.06f));
+            }
+
+            RPB_1600_Fleet fleet;
+            fleet.addBus(bus);
+            fleet.discover();
+            bus.setClock(clocks[c]);
+
+            RPB_1600_CurrentShare share(fleet);
+            share.setPeriod(SHARE_PERIOD_US);
+            share.setBudget(SHARE_BUDGET_US);
+            share.setGains(0.0f, 0.05f);
+            share.setDeadband(0.25f);
+            share.begin();
+
+            // The first iteration sees the chargers untrimmed
+            share.service();
+            float start_spread = share.getStats()->spread;
+            share.resetStats();
+
+            int32_t settled_ms = -1;
+
+            for (uint32_t t = 0; t < SHARE_RUN_SECONDS * 1000000UL; t += SHARE_TICK_US)
+            {
+                bus.advanceTime(SHARE_TICK_US);
+
+                if (!share.service())
+                {
+                    continue;
+                }
+
+                if (share.getStats()->spread > SHARE_SETTLED_AMPS)
+                {
+                    settled_ms = -1;
+                }
+                else if (settled_ms < 0)
+                {
+                    settled_ms = t / 1000;
+                }
+            }
+
+            const share_stats *stats = share.getStats();
+            bool ok = settled_ms >= 0 && stats->overruns == 0;
+            failures += ok ? 0 : 1;
+
+            printf("%u,%lu,%.2f,%ld,%.2f,%.0f,%lu,%.0f,%lu,%.3f,%s\n", num_units, (unsigned long)clocks[c],
+                   start_spread, (long)settled_ms, stats->spread,
+                   (double)stats->total_duration_us / stats->iterations, (unsigned long)stats->max_duration_us,
+                   (double)stats->total_jitter_us / stats->iterations, (unsigned long)stats->max_jitter_us,
+                   (double)stats->writes / stats->iterations, ok ? "pass" : "fail");
+
+            for (uint8_t i = 0; i < num_units; i++)
+            {
+                delete units[i];
+            }
+        }
+    }
+
+    fprintf(stderr, "%lu runs failed\n", (unsigned long)failures);
+
+    return (failures < 255) ? failures : 255;
+}
@@ -0,0 +1,74 @@
+/**
+ * Polls a charger from Linux userspace through i2c-dev (see rpb-1600-linux.h) and prints its
+ * readings as CSV, along with the system calls each snapshot took.
+ *
+ * Build on a Linux host from this directory:
+ *   g++ -std=gnu++14 -O2 -I.. i2c-dev-readings.cpp ../rpb-1600*.cpp -lpthread -o i2c-dev-readings
+ *
+ * Usage:
+ *   i2c-dev-readings [--simulate] [device] [address] [count] > readings.csv
+ *
+ * device defaults to /dev/i2c-1, address to 0x47 and count to 10 snapshots, one a second.
+ * --simulate answers the ioctls from a simulated charger instead (RPB_1600_SimulatedI2cDev), so it
+ * runs anywhere, in virtual time. The exit status is the number of snapshots that failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rpb-1600.h"
+#include "rpb-1600-linux.h"
+#include "rpb-1600-sim.h"
+
+#define SNAPSHOT_PERIOD_US 1000000
+
+int main(int argc, char **argv)
+{
+    bool simulate = argc > 1 && strcmp(argv[1], "--simulate") == 0;
+    int first_arg = simulate ? 2 : 1;
+    const char *device = (argc > first_arg) ? argv[first_arg] : "/dev/i2c-1";
+    uint8_t address = (argc > first_arg + 1) ? (uint8_t)strtoul(argv[first_arg + 1], nullptr, 0) : 0x47;
+    uint32_t count = (argc > first_arg + 2) ? (uint32_t)strtoul(argv[first_arg + 2], nullptr, 0) : 10;
+
+    RPB_1600_SimulatedBus sim_bus;
+    RPB_1600_SimulatedCharger sim_unit(address);
+    RPB_1600_SimulatedI2cDev sim_dev(sim_bus);
+    sim_bus.attach(&sim_unit);
+
+    RPB_1600_LinuxBus bus(device, simulate ? (RPB_1600_LinuxIo &)sim_dev : RPB_1600_DefaultLinuxIo);
+    RPB_1600 charger(bus);
+    charger.Init(address);
+
+    if (!bus.isOpen())
+    {
+        fprintf(stderr, "Couldn't open %s: %s\n", device, strerror(bus.getError()));
+        return 255;
+    }
+
+    uint32_t failures = 0;
+
+    printf("time_us,v_in,v_out,i_out,fan_speed_1,fan_speed_2,ioctls,result\n");
+
+    for (uint32_t n = 0; n < count; n++)
+    {
+        readings data;
+        memset(&data, 0, sizeof(data));
+
+        bus.resetCounters();
+        bool ok = charger.getReadings(&data);
+        failures += ok ? 0 : 1;
+
+        printf("%lu,%.3f,%.3f,%.3f,%u,%u,%lu,%s\n", (unsigned long)bus.micros(),
+               (double)data.v_in / RPB_1600_QUANTITY_SCALE, (double)data.v_out / RPB_1600_QUANTITY_SCALE,
+               (double)data.i_out / RPB_1600_QUANTITY_SCALE, data.fan_speed_1, data.fan_speed_2,
+               (unsigned long)bus.getIoctlCount(), ok ? "ok" : "fail");
+        fflush(stdout);
+
+        if (n + 1 < count)
+        {
+            bus.delayMicroseconds(SNAPSHOT_PERIOD_US);
+        }
+    }
+
+    return (failures < 255) ? failures : 255;
+}
@@ -0,0 +1,108 @@
+/**
+ * Replays a charge session log written by RPB_1600_LogWriter (see rpb-1600-log.h) as CSV.
+ *
+ * Build on the host from this directory:
+ *   g++ -std=c++11 -O2 -I.. log-replay.cpp ../rpb-1600-log.cpp -o log-replay
+ *
+ * Usage:
+ *   log-replay session.log [start_seconds] [speed] > session.csv
+ *
+ * start_seconds seeks straight to that point in the session. speed replays in scaled real time
+ * (1 = as recorded, 60 = a minute per second), the default of 0 replays as fast as possible.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "rpb-1600-log.h"
+
+static bool readBlock(uint32_t index, uint8_t *block, void *context)
+{
+    FILE *file = static_cast<FILE *>(context);
+
+    if (fseek(file, (long)index * RPB_1600_LOG_BLOCK_SIZE, SEEK_SET) != 0)
+    {
+        return false;
+    }
+
+    return fread(block, 1, RPB_1600_LOG_BLOCK_SIZE, file) == RPB_1600_LOG_BLOCK_SIZE;
+}
+
+static void sleepMicros(uint64_t us)
+{
+    struct timespec duration;
+    duration.tv_sec = us / 1000000;
+    duration.tv_nsec = (us % 1000000) * 1000;
+    nanosleep(&duration, nullptr);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s session.log [start_seconds] [speed]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(argv[1], "rb");
+
+    if (file == nullptr)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    double start = (argc > 2) ? atof(argv[2]) : 0;
+    double speed = (argc > 3) ? atof(argv[3]) : 0;
+
+    fseek(file, 0, SEEK_END);
+    uint32_t num_blocks = (uint32_t)(ftell(file) / RPB_1600_LOG_BLOCK_SIZE);
+
+    RPB_1600_LogReader reader(readBlock, file, num_blocks);
+
+    if (!reader.seekTime((uint64_t)(start * 1000000)))
+    {
+        fprintf(stderr, "Nothing to replay at %.3fs\n", start);
+        fclose(file);
+        return 1;
+    }
+
+    printf("timestamp_us,v_in,v_out,i_out,fan_speed_1,fan_speed_2,fully_charged,cc,cv,float,"
+           "eeprom_error,temp_comp_short,battery_detected,timeout_cc,timeout_cv,timeout_float\n");
+
+    log_record record;
+    uint32_t records = 0;
+    uint64_t previous = 0;
+
+    while (reader.next(&record))
+    {
+        if (speed > 0 && records > 0)
+        {
+            sleepMicros((uint64_t)((record.timestamp_us - previous) / speed));
+            fflush(stdout);
+        }
+
+        previous = record.timestamp_us;
+        records++;
+
+        const charge_status &s = record.status;
+        // Whole units or thousandths, depending on RPB_1600_FIXED_POINT
+        printf("%llu,%.3f,%.3f,%.3f,%u,%u,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n",
+               (unsigned long long)record.timestamp_us,
+               (double)record.data.v_in / RPB_1600_QUANTITY_SCALE,
+               (double)record.data.v_out / RPB_1600_QUANTITY_SCALE,
+               (double)record.data.i_out / RPB_1600_QUANTITY_SCALE,
+               record.data.fan_speed_1,
+               record.data.fan_speed_2,
+               s.fully_charged, s.in_cc_mode, s.in_cv_mode, s.in_float_mode,
+               s.EEPROM_error, s.temp_compensation_short_circuit, s.battery_detected,
+               s.timeout_flag_cc_mode, s.timeout_flag_cv_mode, s.timeout_flag_float_mode);
+    }
+
+    fclose(file);
+
+    fprintf(stderr, "%lu records from %lu blocks, %lu bad blocks skipped\n", (unsigned long)records,
+            (unsigned long)num_blocks, (unsigned long)reader.getBadBlocks());
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+/**
+ * Hammers RPB_1600_SampleRing (see rpb-1600-ring.h) from a producer thread and a consumer thread,
+ * and checks that every sample that gets through arrives once, in order and intact.
+ *
+ * Build on the host from this directory, with ThreadSanitizer to catch data races:
+ *   g++ -std=gnu++14 -O1 -g -fsanitize=thread -I.. ring-stress.cpp -lpthread -o ring-stress
+ *
+ * Usage:
+ *   ring-stress [samples] [capacity] [seed]
+ *
+ * samples defaults to 10000000 and capacity to 64. The consumer drains in random sized batches and
+ * now and then stalls, so the ring both runs dry and fills up. It also checks that delivered plus
+ * dropped samples add up to the number produced. The exit status is 0 if every check passed, and
+ * ThreadSanitizer makes it 66 if it saw a race.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include "rpb-1600-ring.h"
+
+// Largest batch the consumer drains in one go
+#define STRESS_MAX_BATCH 16
+// The producer pauses after roughly one in this many samples
+#define STRESS_BURST_ONE_IN 32
+
+static uint32_t random_state = 1;
+
+static uint32_t nextRandom(void)
+{
+    // xorshift32
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**
+ * @brief A sample whose every field can be checked against its sequence number
+ */
+static telemetry_sample makeSample(uint32_t sequence)
+{
+    telemetry_sample sample;
+    sample.timestamp_us = sequence;
+    sample.data.v_in = (rpb_1600_quantity)(sequence % 1000);
+    sample.data.v_out = (rpb_1600_voltage)(sequence % 777);
+    sample.data.i_out = (rpb_1600_quantity)(sequence % 100);
+    sample.data.fan_speed_1 = sequence & 0xFFFF;
+    sample.data.fan_speed_2 = sequence >> 16;
+    return sample;
+}
+
+static bool isIntact(const telemetry_sample &sample)
+{
+    telemetry_sample expected = makeSample(sample.timestamp_us);
+
+    return sample.data.v_in == expected.data.v_in && sample.data.v_out == expected.data.v_out &&
+           sample.data.i_out == expected.data.i_out && sample.data.fan_speed_1 == expected.data.fan_speed_1 &&
+           sample.data.fan_speed_2 == expected.data.fan_speed_2;
+}
+
+/**
+ * @brief Capacities that aren't a power of two are rounded down, 0 drops everything
+ */
+static bool checkCapacities(void)
+{
+    telemetry_sample storage[6];
+    bool ok = true;
+
+    RPB_1600_SampleRing empty(storage, 0);
+    ok &= empty.capacity() == 0 && !empty.push(makeSample(1)) && empty.getOverflows() == 1 && empty.size() == 0;
+
+    RPB_1600_SampleRing odd(storage, 6);
+    uint32_t accepted = 0;
+
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        accepted += odd.push(makeSample(i)) ? 1 : 0;
+    }
+
+    ok &= odd.capacity() == 4 && accepted == 4 && odd.getOverflows() == 6;
+
+    if (!ok)
+    {
+        fprintf(stderr, "Capacity check failed\n");
+    }
+
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t num_samples = (argc > 1) ? (uint32_t)strtoul(argv[1], nullptr, 0) : 10000000;
+    uint32_t capacity = (argc > 2) ? (uint32_t)strtoul(argv[2], nullptr, 0) : 64;
+    random_state = (argc > 3) ? (uint32_t)strtoul(argv[3], nullptr, 0) : 1;
+    random_state = (random_state != 0) ? random_state : 1;
+
+    bool ok = checkCapacities();
+
+    telemetry_sample *storage = new telemetry_sample[capacity];
+    RPB_1600_SampleRing ring(storage, capacity);
+    bool produced_all = false;
+    uint32_t accepted = 0;
+    // The producer gets its own random numbers, nextRandom() belongs to the consumer
+    uint32_t producer_state = random_state ^ 0x9E3779B9;
+
+    std::thread producer([&]() {
+        uint32_t state = producer_state;
+
+        for (uint32_t sequence = 0; sequence < num_samples; sequence++)
+        {
+            accepted += ring.push(makeSample(sequence)) ? 1 : 0;
+
+            // Pause between bursts, otherwise the producer just keeps the ring full
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+
+            if (state % STRESS_BURST_ONE_IN == 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        // The consumer only looks at this once the ring is empty, after the last push
+        __atomic_store_n(&produced_all, true, __ATOMIC_RELEASE);
+    });
+
+    uint32_t delivered = 0;
+    uint32_t out_of_order = 0;
+    uint32_t corrupted = 0;
+    uint32_t batches = 0;
+    int64_t last_sequence = -1;
+
+    while (true)
+    {
+        telemetry_sample batch[STRESS_MAX_BATCH];
+        bool finished = __atomic_load_n(&produced_all, __ATOMIC_ACQUIRE);
+        uint32_t count = ring.drain(batch, 1 + nextRandom() % STRESS_MAX_BATCH);
+        batches++;
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            out_of_order += ((int64_t)batch[i].timestamp_us <= last_sequence) ? 1 : 0;
+            corrupted += isIntact(batch[i]) ? 0 : 1;
+            last_sequence = batch[i].timestamp_us;
+        }
+
+        delivered += count;
+
+        // Nothing left and nothing more coming
+        if (count == 0 && finished)
+        {
+            break;
+        }
+
+        // Stall now and then so the ring fills up
+        if (nextRandom() % 64 == 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    producer.join();
+
+    uint32_t dropped = ring.getOverflows();
+    bool counts_ok = delivered == accepted && delivered + dropped == num_samples;
+    ok &= counts_ok && out_of_order == 0 && corrupted == 0;
+
+    printf("samples %lu, capacity %lu, delivered %lu, dropped %lu, batches %lu, out of order %lu, corrupted %lu, %s\n",
+           (unsigned long)num_samples, (unsigned long)ring.capacity(), (unsigned long)delivered,
+           (unsigned long)dropped, (unsigned long)batches, (unsigned long)out_of_order, (unsigned long)corrupted,
+           ok ? "pass" : "fail");
+
+    delete[] storage;
+
+    return ok ? 0 : 1;
+}
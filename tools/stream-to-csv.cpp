@@ -0,0 +1,71 @@
+/**
+ * Converts the binary telemetry stream from option 4 of the curve configurator (see rpb-1600-stream.h)
+ * to CSV, one row per frame.
+ *
+ * Build on the host from this directory:
+ *   g++ -std=c++11 -O2 -I.. stream-to-csv.cpp ../rpb-1600-stream.cpp -o stream-to-csv
+ *
+ * Usage:
+ *   stream-to-csv [capture.bin] > session.csv
+ *   stty -F /dev/ttyACM0 raw 115200 && stream-to-csv /dev/ttyACM0 > session.csv
+ *
+ * Reads stdin when no file is given. Checksum errors and dropped frames are reported on stderr at the end.
+ */
+
+#include <stdio.h>
+#include "rpb-1600-stream.h"
+#include "rpb-1600-linear.h"
+#include "rpb-1600-commands.h"
+
+int main(int argc, char **argv)
+{
+    FILE *input = stdin;
+
+    if (argc > 1)
+    {
+        input = fopen(argv[1], "rb");
+
+        if (input == nullptr)
+        {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    RPB_1600_StreamDecoder decoder;
+    stream_frame frame;
+    uint32_t frames = 0;
+    int byte;
+
+    printf("sequence,timestamp_us,v_in,v_out,i_out,fan_speed_1,fan_speed_2\n");
+
+    while ((byte = fgetc(input)) != EOF)
+    {
+        if (!decoder.feed((uint8_t)byte, &frame))
+        {
+            continue;
+        }
+
+        frames++;
+        printf("%u,%lu,%.0f,%.3f,%.2f,%.0f,%.0f\n",
+               frame.sequence,
+               (unsigned long)frame.timestamp_us,
+               linear11_to_float(frame.words[0]),
+               linear16_to_float(frame.words[1], CMD_N_VALUE_READ_VOUT),
+               linear11_to_float(frame.words[2]),
+               linear11_to_float(frame.words[3]),
+               linear11_to_float(frame.words[4]));
+    }
+
+    if (input != stdin)
+    {
+        fclose(input);
+    }
+
+    fprintf(stderr, "%lu frames, %lu checksum errors, %lu dropped\n",
+            (unsigned long)frames,
+            (unsigned long)decoder.getChecksumErrors(),
+            (unsigned long)decoder.getDroppedFrames());
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+/**
+ * Prints the trace dumps written by RPB_1600_Trace::dump() (see rpb-1600-trace.h) as text, one line
+ * per event, with two byte register values decoded.
+ *
+ * Build on the host from this directory:
+ *   g++ -std=c++11 -O2 -I.. trace-decode.cpp ../rpb-1600-trace.cpp -o trace-decode
+ *
+ * Usage:
+ *   trace-decode [capture.bin]
+ *   stty -F /dev/ttyACM0 raw 115200 && trace-decode /dev/ttyACM0
+ *
+ * Reads stdin when no file is given. Anything between dumps (like text from the sketch) is skipped.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "rpb-1600-trace.h"
+#include "rpb-1600-linear.h"
+#include "rpb-1600-commands.h"
+
+struct command_name
+{
+    uint8_t code;
+    const char *name;
+    // Linear16 with this N, or Linear11 when linear16 is false
+    bool linear16;
+    int8_t N;
+};
+
+// Registers whose two byte values mean something as a number
+static const command_name command_names[] = {
+    {CMD_CODE_VOUT_COMMAND, "VOUT_COMMAND", true, CMD_N_VALUE_VOUT_COMMAND},
+    {CMD_CODE_VOUT_TRIM, "VOUT_TRIM", true, CMD_N_VALUE_VOUT_TRIM},
+    {CMD_CODE_IOUT_OC_FAULT_LIMIT, "IOUT_OC_FAULT_LIMIT", false, 0},
+    {CMD_CODE_READ_VIN, "READ_VIN", false, 0},
+    {CMD_CODE_READ_VOUT, "READ_VOUT", true, CMD_N_VALUE_READ_VOUT},
+    {CMD_CODE_READ_IOUT, "READ_IOUT", false, 0},
+    {CMD_CODE_READ_FAN_SPEED_1, "READ_FAN_SPEED_1", false, 0},
+    {CMD_CODE_READ_FAN_SPEED_2, "READ_FAN_SPEED_2", false, 0},
+    {CMD_CODE_CURVE_CC, "CURVE_CC", false, 0},
+    {CMD_CODE_CURVE_CV, "CURVE_CV", true, CMD_N_VALUE_CURVE_CV},
+    {CMD_CODE_CURVE_FV, "CURVE_FV", true, CMD_N_VALUE_CURVE_FV},
+    {CMD_CODE_CURVE_TC, "CURVE_TC", false, 0},
+    {CMD_CODE_CURVE_CC_TIMEOUT, "CURVE_CC_TIMEOUT", false, 0},
+    {CMD_CODE_CURVE_CV_TIMEOUT, "CURVE_CV_TIMEOUT", false, 0},
+    {CMD_CODE_CURVE_FLOAT_TIMEOUT, "CURVE_FLOAT_TIMEOUT", false, 0},
+};
+
+static const command_name *findCommand(uint8_t code)
+{
+    for (size_t i = 0; i < sizeof(command_names) / sizeof(command_names[0]); i++)
+    {
+        if (command_names[i].code == code)
+        {
+            return &command_names[i];
+        }
+    }
+
+    return nullptr;
+}
+
+static void printRecord(uint8_t address, const rpb_1600_trace_record *record)
+{
+    char line[RPB_1600_TRACE_LINE_LENGTH];
+    RPB_1600_Trace::format(record, line, sizeof(line));
+    printf("0x%02x %s", address, line);
+
+    const command_name *command = findCommand(record->command);
+    bool has_word = record->event != RPB_1600_TRACE_CLOCK && record->event != RPB_1600_TRACE_SETTLED &&
+                    record->event != RPB_1600_TRACE_SETTLE_TIMEOUT && record->length >= 2;
+
+    if (command != nullptr && has_word)
+    {
+        uint16_t word = linear_word(record->data);
+
+        if (command->linear16)
+        {
+            printf("  %s = %.3f", command->name, linear16_to_float(word, command->N));
+        }
+        else
+        {
+            printf("  %s = %g (N %d, Y %d)", command->name, linear11_to_float(word), linear11_exponent(word),
+                   linear11_mantissa(word));
+        }
+    }
+
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    FILE *input = stdin;
+
+    if (argc > 1)
+    {
+        input = fopen(argv[1], "rb");
+
+        if (input == nullptr)
+        {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    uint8_t header[RPB_1600_TRACE_DUMP_HEADER_LENGTH];
+    uint8_t packed[RPB_1600_TRACE_PACKED_LENGTH];
+    uint8_t matched = 0;
+    uint32_t records = 0;
+    int byte;
+
+    while ((byte = fgetc(input)) != EOF)
+    {
+        // Hunt for the magic
+        if ((uint8_t)byte != (uint8_t)RPB_1600_TRACE_MAGIC[matched])
+        {
+            matched = ((uint8_t)byte == (uint8_t)RPB_1600_TRACE_MAGIC[0]) ? 1 : 0;
+            continue;
+        }
+
+        if (++matched < 4)
+        {
+            continue;
+        }
+
+        matched = 0;
+
+        if (fread(&header[4], 1, RPB_1600_TRACE_DUMP_HEADER_LENGTH - 4, input) != RPB_1600_TRACE_DUMP_HEADER_LENGTH - 4)
+        {
+            break;
+        }
+
+        if (header[5] != RPB_1600_TRACE_VERSION)
+        {
+            fprintf(stderr, "Skipping a version %d dump\n", header[5]);
+            continue;
+        }
+
+        uint16_t count = header[6] | (header[7] << 8);
+
+        for (uint16_t i = 0; i < count && fread(packed, 1, sizeof(packed), input) == sizeof(packed); i++)
+        {
+            rpb_1600_trace_record record;
+            RPB_1600_Trace::unpack(packed, &record);
+            printRecord(header[4], &record);
+            records++;
+        }
+    }
+
+    if (input != stdin)
+    {
+        fclose(input);
+    }
+
+    fprintf(stderr, "%lu events\n", (unsigned long)records);
+
+    return 0;
+}